@@ -0,0 +1,798 @@
+// File: bench.cpp
+// Headless benchmark for the N-Body engines: runs each engine for a fixed number of steps
+// over a sweep of body counts and reports ns/step, pairwise interactions/sec and GFLOP/s
+
+#include <algorithm>    // std::sort, std::min
+#include <chrono>       // std::chrono::steady_clock
+#include <cmath>        // std::sqrt, std::hypot
+#include <cstdlib>      // std::atoi, std::atof, std::strtoull
+#include <fstream>      // std::ofstream
+#include <functional>   // std::function
+#include <iostream>     // std::cout, std::cerr
+#include <sstream>      // std::stringstream
+#include <string>
+#include <thread>       // std::thread::hardware_concurrency
+#include <utility>      // std::move
+#include <vector>
+
+#include "Body.h"              // Body
+#include "InitialConditions.h" // generateBodies()
+#include "NBody.h"             // runCpuComputation(), StepFunction
+#include "GpuComputation.h"    // initGpuComputation(), runGpuComputation()
+#include "OpenCLDevice.h"      // printOpenCLDevices()
+#include "SimdComputation.h"   // initSimdComputation(), runSimdComputation()
+#include "ParallelComputation.h"  // initParallelComputation(), runParallelComputation()
+#include "BarnesHut.h"         // initBarnesHutComputation(), runBarnesHutComputation()
+#include "ParticleMesh.h"      // initParticleMeshComputation(), runParticleMeshComputation()
+#include "BlockTimestep.h"     // initBlockTimestepComputation(), runBlockTimestepComputation()
+#include "Integrators.h"       // initIntegratorComputation(), runIntegratorComputation()
+#include "Precision.h"         // initPrecisionComputation(), runPrecisionComputation()
+#include "Profiler.h"          // writeChromeTrace(), printProfileSummary()
+#include "Reorder.h"           // with_reordering()
+#include "TracerComputation.h" // initTracerComputation(), runTracerComputation()
+#include "HybridComputation.h" // initHybridComputation(), runHybridComputation()
+
+// Same physical constants and domain as the interactive front end
+constexpr float G = 1.f;
+constexpr float dt = 0.1f;
+constexpr float eps = 1e-1f;
+constexpr float center_mass = 1000.f;
+
+const int WIDTH = 1920;
+const int HEIGHT = 1080;
+
+// Floating point operations counted per pairwise interaction (2D, softened):
+// 2 sub (dx, dy), 3 mul/add (r^2), 1 rsqrt, 2 mul (inv^3), 2 mul (G*m*inv^3), 4 mul/add (ax, ay)
+// rounded up to the customary 20 so numbers stay comparable with published N-body figures
+constexpr double FLOPS_PER_INTERACTION = 20.0;
+
+// Computes accelerations only (into soa.ax / soa.ay), used to measure approximation error
+using ForceFunction = std::function<void(BodiesSOA&, float, float)>;
+
+// A benchmarkable engine: optional per-N setup/teardown around a step function.
+// Threaded engines are run once per entry of --threads, the others once per size.
+// Approximate engines provide 'forces' and are compared against the direct sum
+struct Engine {
+    std::string name;
+    std::function<bool(size_t n, size_t threads)> init;
+    StepFunction step;
+    std::function<void()> cleanup;
+    bool threaded = false;
+    ForceFunction forces;
+    double theta = 0.0;
+    std::function<void()> sync;    // waits for queued asynchronous work before the clock stops
+    BatchStepFunction batch;       // several steps per call with one readback, used for --substeps
+    std::function<std::string()> report;  // engine-specific counters, printed after the run
+    PermuteFunction permute;       // reorders state the engine keeps between calls, for --reorder
+    std::function<double(const std::vector<Body>&)> interactions;  // per step, default N (N - 1)
+    std::function<double(size_t n)> counted_interactions;  // interactions evaluated since init, for engines
+                                                           // whose work per step varies; replaces 'interactions'
+    bool pairwise = true;          // false: the work is not a sum over pairs, interactions/s and GFLOP/s print "-"
+};
+
+// Command line options for the benchmark
+struct BenchOptions {
+    std::vector<std::string> engines = { "cpu" };
+    std::vector<size_t> sizes = { 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000 };
+    std::vector<size_t> threads = { std::max(1u, std::thread::hardware_concurrency()) };
+    std::vector<double> thetas = { 0.5 };
+    size_t accuracy_samples = 1024;
+    int steps = 10;
+    int substeps = 1;
+    int warmup = 2;
+    int repeat = 3;
+    double max_step_seconds = 10.0;
+    std::string format = "json";
+    std::string output;
+    unsigned seed = 42;
+    ICPreset preset = ICPreset::Random;
+    std::string device;    // OpenCL device spec for the gpu engines
+    std::string trace;     // Chrome trace output, needs a build with NBODY_PROFILING
+    bool energy = false;   // measure the energy error of every run (an O(N^2) double pass at each end)
+    uint64_t reorder = 0;  // re-sort the bodies along the curve every this many steps, 0 = never
+    SpaceCurve curve = SpaceCurve::Morton;
+    float tracer_mass = 9.9f;  // bodies up to this mass are tracers in the tracer engines (about 99% of random bodies)
+};
+
+// One measured (engine, N) data point
+struct BenchResult {
+    std::string engine;
+    size_t n;
+    size_t threads;
+    int steps;
+    int substeps;         // steps per engine call (1 unless the engine batches and --substeps > 1)
+    int repeat;
+    double ns_per_step_median;
+    double ns_per_step_min;
+    double interactions_per_second;  // -1 for engines that are not pairwise
+    double gflops;
+    double speedup;       // versus the 1-thread run of the same engine and N (strong scaling), 0 if none
+    double efficiency;    // speedup / threads
+    double theta;         // opening angle of tree engines, 0 otherwise
+    double rms_error;     // relative acceleration error against the direct sum, -1 if not measured
+    double max_error;
+    double energy_error;  // (E_end - E_start) / |E_start| over warmup and timed steps, 0 if not measured
+    uint64_t reorder;     // steps between spatial reorders, 0 = bodies kept in creation order
+};
+
+// Engine with the mandatory parts filled in; optional members are set by the caller
+static Engine make_engine(const std::string& name,
+                          std::function<bool(size_t, size_t)> init,
+                          StepFunction step,
+                          std::function<void()> cleanup)
+{
+    Engine engine;
+    engine.name = name;
+    engine.init = std::move(init);
+    engine.step = std::move(step);
+    engine.cleanup = std::move(cleanup);
+    return engine;
+}
+
+// All engines the benchmark knows about
+static std::vector<Engine> available_engines(const BenchOptions& opt) {
+    std::vector<Engine> engines;
+
+    engines.push_back(make_engine("cpu",
+                                  [](size_t, size_t) { return true; },
+                                  runCpuComputation,
+                                  [] {}));
+
+    GpuOptions gpu;
+    gpu.device = opt.device;
+
+    TracerOptions tracers;
+    tracers.tracer_mass = opt.tracer_mass;
+    // only the sources pull, so a step is N x (sources + potentials) interactions
+    auto tracer_interactions = [tracers](const std::vector<Body>& bodies) {
+        ForceSources sources;
+        size_t moving = 0;
+        buildForceSources(bodies, tracers, eps, sources, moving);
+        return static_cast<double>(bodies.size()) * static_cast<double>(sources.size());
+    };
+
+    engines.push_back(make_engine("gpu",
+                                  [gpu](size_t n, size_t) { return initGpuComputation(n, gpu); },
+                                  runGpuComputation,
+                                  cleanupGpuComputation));
+
+    Engine resident = make_engine("gpu-resident",
+                                  [gpu](size_t n, size_t) { return initGpuComputation(n, gpu); },
+                                  runGpuResidentComputation,
+                                  cleanupGpuComputation);
+    resident.sync = finishGpuComputation;
+    resident.batch = runGpuResidentSubsteps;
+    resident.permute = permuteGpuState;
+    engines.push_back(resident);
+
+    // local-memory tiled kernels on resident state; work-group and tile size come from the autotuner
+    for (GpuKernel kernel : { GpuKernel::Tiled, GpuKernel::Fused }) {
+        Engine tiled = make_engine(std::string("gpu-") + gpuKernelName(kernel),
+                                   [gpu, kernel](size_t n, size_t) {
+                                       GpuOptions options = gpu;
+                                       options.kernel = kernel;
+                                       return initGpuComputation(n, options);
+                                   },
+                                   runGpuResidentComputation,
+                                   cleanupGpuComputation);
+        tiled.sync = finishGpuComputation;
+        tiled.batch = runGpuResidentSubsteps;
+        tiled.permute = permuteGpuState;
+        engines.push_back(tiled);
+    }
+
+    engines.push_back(make_engine("simd",
+                                  [](size_t n, size_t) { return initSimdComputation(n); },
+                                  runSimdComputation,
+                                  cleanupSimdComputation));
+
+    // pinned SIMD kernels, for comparing instruction sets on the same machine
+    for (SimdKernel kernel : { SimdKernel::Scalar, SimdKernel::AVX2, SimdKernel::AVX512 }) {
+        engines.push_back(make_engine(std::string("simd-") + simdKernelName(kernel),
+                                      [kernel](size_t n, size_t) { return initSimdComputation(n, kernel); },
+                                      runSimdComputation,
+                                      cleanupSimdComputation));
+    }
+
+    for (bool symmetric : { false, true }) {
+        Engine parallel = make_engine(symmetric ? "parallel-sym" : "parallel",
+                                      [symmetric](size_t n, size_t threads) {
+                                          ParallelOptions options;
+                                          options.threads = threads;
+                                          options.symmetric = symmetric;
+                                          return initParallelComputation(n, options);
+                                      },
+                                      runParallelComputation,
+                                      cleanupParallelComputation);
+        parallel.threaded = true;
+        engines.push_back(parallel);
+    }
+
+    // one Barnes-Hut entry per opening angle in --theta
+    for (double theta : opt.thetas) {
+        Engine tree = make_engine("barnes-hut",
+                                  [theta](size_t n, size_t threads) {
+                                      BarnesHutOptions options;
+                                      options.theta = static_cast<float>(theta);
+                                      options.threads = threads;
+                                      return initBarnesHutComputation(n, options);
+                                  },
+                                  runBarnesHutComputation,
+                                  cleanupBarnesHutComputation);
+        tree.threaded = true;
+        tree.forces = barnes_hut_compute_forces;
+        tree.theta = theta;
+        // leaf body-body terms plus accepted cells, as counted by the walk
+        tree.counted_interactions = [](size_t) {
+            return static_cast<double>(barnesHutStats().interactions);
+        };
+        engines.push_back(tree);
+    }
+
+    // periodic mesh solvers; forces include every periodic image, so they are not compared
+    // against the open-boundary direct sum. Their work is grid transforms, not pairs, so no
+    // interaction rate is reported
+    for (bool p3m : { false, true }) {
+        Engine mesh = make_engine(p3m ? "p3m" : "pm",
+                                  [p3m](size_t n, size_t threads) {
+                                      ParticleMeshOptions options;
+                                      options.p3m = p3m;
+                                      options.threads = threads;
+                                      return initParticleMeshComputation(n, options);
+                                  },
+                                  runParticleMeshComputation,
+                                  cleanupParticleMeshComputation);
+        mesh.threaded = true;
+        mesh.pairwise = false;
+        engines.push_back(mesh);
+    }
+
+    // individual power-of-two time steps; a macro step costs fewer than N force evaluations when
+    // most bodies sit on coarse levels, so the report shows evaluations per body and step
+    Engine block = make_engine("block",
+                               [](size_t n, size_t threads) {
+                                   BlockTimestepOptions options;
+                                   options.threads = threads;
+                                   return initBlockTimestepComputation(n, options);
+                               },
+                               runBlockTimestepComputation,
+                               cleanupBlockTimestepComputation);
+    block.threaded = true;
+    block.permute = permuteBlockTimestepState;
+    // every evaluation of an active body is a sum over the other N - 1
+    block.counted_interactions = [](size_t n) {
+        return static_cast<double>(blockTimestepStats().force_evaluations) * static_cast<double>(n - 1);
+    };
+    block.report = [] {
+        const BlockTimestepStats& stats = blockTimestepStats();
+        std::stringstream ss;
+        ss << "force evaluations per body-step "
+           << static_cast<double>(stats.force_evaluations) / (stats.steps * stats.bodies)
+           << ", force passes per step " << static_cast<double>(stats.sub_steps) / stats.steps
+           << ", deepest level " << stats.deepest_level;
+        return ss.str();
+    };
+    engines.push_back(block);
+
+    // the integrator schemes on one shared SIMD force backend; the report gives the energy and
+    // momentum drift over the timed steps, to compare how large a dt each scheme tolerates
+    for (IntegratorScheme scheme : { IntegratorScheme::Euler, IntegratorScheme::LeapfrogKDK,
+                                     IntegratorScheme::VelocityVerlet, IntegratorScheme::Yoshida4 }) {
+        Engine integrator = make_engine(integratorName(scheme),
+                                        [scheme](size_t n, size_t threads) {
+                                            IntegratorOptions options;
+                                            options.scheme = scheme;
+                                            options.threads = threads;
+                                            return initIntegratorComputation(n, options);
+                                        },
+                                        runIntegratorComputation,
+                                        cleanupIntegratorComputation);
+        integrator.threaded = true;
+        integrator.batch = runIntegratorSubsteps;
+        // schemes differ in force passes per step (Yoshida4 takes three)
+        integrator.counted_interactions = [](size_t n) {
+            return static_cast<double>(integratorStats().force_evaluations) * static_cast<double>(n) *
+                   static_cast<double>(n - 1);
+        };
+        integrator.report = [] {
+            measureIntegratorDrift();
+            const IntegratorStats& stats = integratorStats();
+            std::stringstream ss;
+            ss << "force passes per step " << static_cast<double>(stats.force_evaluations) / stats.steps
+               << ", energy drift per step " << stats.energyDriftPerStep()
+               << ", momentum error " << stats.momentum_error;
+            return ss.str();
+        };
+        engines.push_back(integrator);
+    }
+
+    // the direct sum in each precision mode; the report gives the force error against a double
+    // Kahan-summed reference, --energy the energy error of the run
+    for (PrecisionMode mode : { PrecisionMode::Float, PrecisionMode::Double, PrecisionMode::Mixed,
+                                PrecisionMode::Kahan }) {
+        Engine direct = make_engine(std::string("direct-") + precisionName(mode),
+                                    [mode](size_t n, size_t threads) {
+                                        PrecisionOptions options;
+                                        options.mode = mode;
+                                        options.threads = threads;
+                                        return initPrecisionComputation(n, options);
+                                    },
+                                    runPrecisionComputation,
+                                    cleanupPrecisionComputation);
+        direct.threaded = true;
+        direct.batch = runPrecisionSubsteps;
+        direct.report = [samples = opt.accuracy_samples] {
+            measurePrecisionError(samples);
+            const PrecisionStats& stats = precisionStats();
+            std::stringstream ss;
+            ss << "force rms error " << stats.force_rms_error << ", max " << stats.force_max_error;
+            return ss.str();
+        };
+        engines.push_back(direct);
+    }
+
+    // the fused kernel in the other precision variants (float is gpu-fused)
+    for (PrecisionMode mode : { PrecisionMode::Double, PrecisionMode::Mixed, PrecisionMode::Kahan }) {
+        Engine fused = make_engine(std::string("gpu-fused-") + precisionName(mode),
+                                   [gpu, mode](size_t n, size_t) {
+                                       GpuOptions options = gpu;
+                                       options.kernel = GpuKernel::Fused;
+                                       options.precision = mode;
+                                       return initGpuComputation(n, options);
+                                   },
+                                   runGpuResidentComputation,
+                                   cleanupGpuComputation);
+        fused.sync = finishGpuComputation;
+        fused.batch = runGpuResidentSubsteps;
+        fused.permute = permuteGpuState;
+        engines.push_back(fused);
+    }
+
+    // massive sources plus tracers: every body feels the sources, the central mass is a fixed
+    // potential. The report gives the split
+    Engine tracer = make_engine("tracer",
+                                [tracers](size_t n, size_t threads) {
+                                    TracerOptions options = tracers;
+                                    options.threads = threads;
+                                    return initTracerComputation(n, options);
+                                },
+                                runTracerComputation,
+                                cleanupTracerComputation);
+    tracer.threaded = true;
+    tracer.batch = runTracerSubsteps;
+    tracer.interactions = tracer_interactions;
+    tracer.report = [] {
+        const TracerStats& stats = tracerStats();
+        std::stringstream ss;
+        ss << "sources " << stats.sources << ", potentials " << stats.potentials << ", tracers " << stats.tracers;
+        return ss.str();
+    };
+    engines.push_back(tracer);
+
+    Engine gpu_tracer = make_engine("gpu-tracer",
+                                    [gpu, tracers](size_t n, size_t) {
+                                        GpuOptions options = gpu;
+                                        options.kernel = GpuKernel::Tracer;
+                                        options.tracers = tracers;
+                                        return initGpuComputation(n, options);
+                                    },
+                                    runGpuResidentComputation,
+                                    cleanupGpuComputation);
+    gpu_tracer.sync = finishGpuComputation;
+    gpu_tracer.batch = runGpuResidentSubsteps;
+    gpu_tracer.permute = permuteGpuState;
+    gpu_tracer.interactions = tracer_interactions;
+    engines.push_back(gpu_tracer);
+
+    // rows split between the OpenCL device and the CPU pool, rebalanced every step; the report
+    // gives the split the run settled on and the rates behind it
+    Engine hybrid = make_engine("hybrid",
+                                [device = opt.device](size_t n, size_t threads) {
+                                    HybridOptions options;
+                                    options.device = device;
+                                    options.threads = threads;
+                                    return initHybridComputation(n, options);
+                                },
+                                runHybridComputation,
+                                cleanupHybridComputation);
+    hybrid.threaded = true;
+    hybrid.batch = runHybridSubsteps;
+    hybrid.report = [] {
+        const HybridStats& stats = hybridStats();
+        std::stringstream ss;
+        ss << "device share " << stats.device_share << " (" << stats.device_rows << " rows), rows/s device "
+           << stats.device_rate << " cpu " << stats.cpu_rate << ", rebalances " << stats.rebalances
+           << ", exchanged per step " << static_cast<double>(stats.exchanged_bytes) / stats.steps / 1e6 << " MB";
+        return ss.str();
+    };
+    engines.push_back(hybrid);
+
+    return engines;
+}
+
+// Build the same initial conditions as main.cpp: n - 1 bodies from the preset plus the central mass
+static std::vector<Body> make_bodies(size_t n, const BenchOptions& opt) {
+    ICOptions ic;
+    ic.preset = opt.preset;
+    ic.seed = opt.seed;
+    ic.central_mass = center_mass;
+    ic.G = G;
+    return generateBodies(n, WIDTH, HEIGHT, ic);
+}
+
+// Split a comma separated list into its items
+static std::vector<std::string> split_list(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+// Parse sizes like "1000,10k,1M"
+static size_t parse_size(const std::string& s) {
+    double value = std::atof(s.c_str());
+    char suffix = s.empty() ? '\0' : s.back();
+    if (suffix == 'k' || suffix == 'K') value *= 1e3;
+    else if (suffix == 'm' || suffix == 'M') value *= 1e6;
+    return static_cast<size_t>(value);
+}
+
+// Parse thread counts like "1,2,8,all" or "pow2"
+static std::vector<size_t> parse_threads(const std::string& list) {
+    size_t all = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<size_t> threads;
+    for (const std::string& item : split_list(list)) {
+        if (item == "all") threads.push_back(all);
+        else if (item == "pow2") {
+            for (size_t t = 1; t < all; t *= 2) threads.push_back(t);
+            threads.push_back(all);
+        }
+        else threads.push_back(std::max(1, std::atoi(item.c_str())));
+    }
+    return threads;
+}
+
+static void print_usage() {
+    std::cout <<
+        "Usage: NBodyBench [options]\n"
+        "  --engines <a,b,...>   engines to run (cpu, gpu, gpu-resident, gpu-tiled, gpu-fused, simd,\n"
+        "                        simd-scalar, simd-avx2, simd-avx512, parallel, parallel-sym, barnes-hut,\n"
+        "                        pm, p3m, block, euler, kdk, verlet, yoshida4, direct-float,\n"
+        "                        direct-double, direct-mixed, direct-kahan, gpu-fused-double,\n"
+        "                        gpu-fused-mixed, gpu-fused-kahan, tracer, gpu-tracer,\n"
+        "                        hybrid),\n"
+        "                        default cpu\n"
+        "  --sizes <n,n,...>     body counts, accepts k/M suffixes, default 1k..1M\n"
+        "  --threads <t,t,...>   thread counts for threaded engines, 'all' = every core,\n"
+        "                        'pow2' = 1, 2, 4, ... up to every core, default all\n"
+        "  --theta <a,b,...>     Barnes-Hut opening angles, default 0.5\n"
+        "  --samples <int>       bodies checked against the direct sum for approximate engines, default 1024\n"
+        "  --steps <int>         timed steps per repeat, default 10\n"
+        "  --substeps <int>      steps per call for engines that batch them (gpu-resident, gpu-tiled,\n"
+        "                        gpu-fused): one readback per call instead of per step, default 1\n"
+        "  --warmup <int>        untimed steps before measuring, default 2\n"
+        "  --repeat <int>        timed repeats per size (median is reported), default 3\n"
+        "  --max-step <seconds>  skip larger sizes once a step exceeds this, default 10\n"
+        "  --format <json|csv>   output format, default json\n"
+        "  --output <path>       write results to a file instead of stdout\n"
+        "  --seed <int>          initial condition seed, default 42\n"
+        "  --preset <name>       initial conditions: random, uniform-disk, plummer, kepler-disk,\n"
+        "                        default random\n"
+        "  --device <spec>       OpenCL device for the gpu engines: gpu, cpu, <index>, <platform>:<device>\n"
+        "                        or part of the device name, default first GPU (CPU fallback)\n"
+        "  --energy              measure the relative energy error of every run (O(N^2) in double)\n"
+        "  --reorder <steps>     re-sort the bodies along a space-filling curve every <steps> steps\n"
+        "                        (and before the first), default 0 = keep the creation order\n"
+        "  --curve <name>        curve for --reorder: morton, hilbert, default morton\n"
+        "  --tracer-mass <m>     bodies up to this mass are massless tracers in tracer and gpu-tracer,\n"
+        "                        default 9.9 (random masses are 0.5..10, so about 1% are sources)\n"
+        "  --trace <path>        write a Chrome trace of every phase and print p50/p99 per phase\n"
+        "                        (builds with -DNBODY_PROFILING=ON only)\n"
+        "  --list-devices        print the OpenCL devices and exit\n";
+}
+
+// Parse command line arguments, returns false on error or --help
+static bool parse_args(int argc, char** argv, BenchOptions& opt) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--help" || arg == "-h") { print_usage(); return false; }
+        if (arg == "--list-devices") { printOpenCLDevices(std::cout); return false; }
+        if (arg == "--energy") { opt.energy = true; continue; }
+        if (!has_value) { std::cerr << "Missing value for " << arg << "\n"; return false; }
+
+        std::string value = argv[++i];
+        if (arg == "--engines") opt.engines = split_list(value);
+        else if (arg == "--sizes") {
+            opt.sizes.clear();
+            for (const std::string& s : split_list(value)) opt.sizes.push_back(parse_size(s));
+        }
+        else if (arg == "--threads") opt.threads = parse_threads(value);
+        else if (arg == "--theta") {
+            opt.thetas.clear();
+            for (const std::string& t : split_list(value)) opt.thetas.push_back(std::atof(t.c_str()));
+        }
+        else if (arg == "--samples") opt.accuracy_samples = std::max(1, std::atoi(value.c_str()));
+        else if (arg == "--steps") opt.steps = std::max(1, std::atoi(value.c_str()));
+        else if (arg == "--substeps") opt.substeps = std::max(1, std::atoi(value.c_str()));
+        else if (arg == "--warmup") opt.warmup = std::max(0, std::atoi(value.c_str()));
+        else if (arg == "--repeat") opt.repeat = std::max(1, std::atoi(value.c_str()));
+        else if (arg == "--max-step") opt.max_step_seconds = std::atof(value.c_str());
+        else if (arg == "--format") opt.format = value;
+        else if (arg == "--output") opt.output = value;
+        else if (arg == "--seed") opt.seed = static_cast<unsigned>(std::atoi(value.c_str()));
+        else if (arg == "--device") opt.device = value;
+        else if (arg == "--trace") opt.trace = value;
+        else if (arg == "--tracer-mass") opt.tracer_mass = static_cast<float>(std::atof(value.c_str()));
+        else if (arg == "--reorder") opt.reorder = std::strtoull(value.c_str(), nullptr, 10);
+        else if (arg == "--curve") {
+            if (!parseSpaceCurve(value, opt.curve)) {
+                std::cerr << "Unknown curve " << value << "\n";
+                return false;
+            }
+        }
+        else if (arg == "--preset") {
+            if (!parseICPreset(value, opt.preset)) {
+                std::cerr << "Unknown preset " << value << "\n";
+                return false;
+            }
+        }
+        else { std::cerr << "Unknown option " << arg << "\n"; print_usage(); return false; }
+    }
+    if (opt.format != "json" && opt.format != "csv") {
+        std::cerr << "Unknown format " << opt.format << "\n";
+        return false;
+    }
+    return true;
+}
+
+// Time 'steps' calls of the engine step and return the elapsed nanoseconds
+static double time_steps(const Engine& engine, std::vector<Body>& bodies, int steps, int substeps) {
+    auto start = std::chrono::steady_clock::now();
+    if (engine.batch && substeps > 1) {
+        for (int s = 0; s < steps; s += substeps) {
+            engine.batch(bodies, G, eps, dt, WIDTH, HEIGHT, std::min(substeps, steps - s));
+        }
+    }
+    else {
+        for (int s = 0; s < steps; ++s) {
+            engine.step(bodies, G, eps, dt, WIDTH, HEIGHT);
+        }
+    }
+    if (engine.sync) engine.sync();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+// Relative acceleration error of an approximate engine on the initial state, measured on the
+// first 'samples' bodies against the direct sum (randomBody output is unordered, so this is a random sample)
+static void measure_accuracy(const Engine& engine, const std::vector<Body>& bodies, size_t samples, BenchResult& result) {
+    BodiesSOA approx(0);
+    packBodies(bodies, approx);
+    engine.forces(approx, G, eps);
+
+    BodiesSOA exact(0);
+    packBodies(bodies, exact);
+    size_t k = std::min(samples, bodies.size());
+    simd_compute_forces_range(exact, 0, k, G, eps, detectSimdKernel());
+
+    double sum_sq = 0.0, max_err = 0.0;
+    for (size_t i = 0; i < k; ++i) {
+        double ref = std::hypot(exact.ax[i], exact.ay[i]);
+        double err = std::hypot(approx.ax[i] - exact.ax[i], approx.ay[i] - exact.ay[i]) / (ref > 0.0 ? ref : 1.0);
+        sum_sq += err * err;
+        max_err = std::max(max_err, err);
+    }
+    result.rms_error = std::sqrt(sum_sq / static_cast<double>(k));
+    result.max_error = max_err;
+}
+
+// Softened total energy of the bodies, evaluated in double
+static double total_energy(const std::vector<Body>& bodies) {
+    BodiesSOA soa(0);
+    packBodies(bodies, soa);
+    ThreadPool pool(0);
+    return measureConserved(soa, G, eps, pool).energy();
+}
+
+// The engine with every call going through the reordering stage; its step and batch share one
+// stage, so the step count (and with it the reorder schedule) runs on across warmup and repeats
+static Engine with_reorder(const Engine& engine, size_t threads, const BenchOptions& opt) {
+    ReorderOptions options;
+    options.every = opt.reorder;
+    options.curve = opt.curve;
+    options.threads = engine.threaded ? threads : 0;
+
+    Engine reordered = engine;
+    reordered.batch = with_reordering(engine.batch ? engine.batch : repeat_steps(engine.step), options,
+                                      engine.permute);
+    reordered.step = [batch = reordered.batch](std::vector<Body>& bodies, float G, float eps, float dt,
+                                               int width, int height) {
+        batch(bodies, G, eps, dt, width, height, 1);
+    };
+    return reordered;
+}
+
+// Run warmup and timed repeats for one engine at one body count
+static BenchResult run_one(const Engine& base, size_t n, size_t threads, const BenchOptions& opt) {
+    std::vector<Body> bodies = make_bodies(n, opt);
+    double interactions = base.interactions ? base.interactions(bodies)
+                                            : static_cast<double>(n) * static_cast<double>(n - 1);
+    const Engine engine = opt.reorder > 0 ? with_reorder(base, threads, opt) : base;
+
+    BenchResult result;
+    result.theta = engine.theta;
+    result.rms_error = -1.0;
+    result.max_error = -1.0;
+    if (engine.forces) measure_accuracy(engine, bodies, opt.accuracy_samples, result);
+    const double energy_start = opt.energy ? total_energy(bodies) : 0.0;
+
+    for (int w = 0; w < opt.warmup; ++w) {
+        engine.step(bodies, G, eps, dt, WIDTH, HEIGHT);
+    }
+
+    const double counted_start = engine.counted_interactions ? engine.counted_interactions(n) : 0.0;
+    std::vector<double> per_step;
+    for (int r = 0; r < opt.repeat; ++r) {
+        per_step.push_back(time_steps(engine, bodies, opt.steps, opt.substeps) / opt.steps);
+    }
+    std::sort(per_step.begin(), per_step.end());
+    if (engine.counted_interactions) {
+        interactions = (engine.counted_interactions(n) - counted_start) / (static_cast<double>(opt.repeat) * opt.steps);
+    }
+
+    // resident GPU engines hand back positions one call behind, so their last call is not included
+    result.energy_error = 0.0;
+    if (opt.energy && energy_start != 0.0)
+        result.energy_error = (total_energy(bodies) - energy_start) / std::abs(energy_start);
+
+    result.engine = engine.name;
+    result.n = n;
+    result.threads = threads;
+    result.steps = opt.steps;
+    result.substeps = base.batch ? opt.substeps : 1;
+    result.reorder = opt.reorder;
+    result.repeat = opt.repeat;
+    result.ns_per_step_median = per_step[per_step.size() / 2];
+    result.ns_per_step_min = per_step.front();
+
+    result.interactions_per_second = -1.0;
+    result.gflops = -1.0;
+    if (engine.pairwise) {
+        result.interactions_per_second = interactions / (result.ns_per_step_median * 1e-9);
+        result.gflops = result.interactions_per_second * FLOPS_PER_INTERACTION * 1e-9;
+    }
+    result.speedup = 0.0;
+    result.efficiency = 0.0;
+    return result;
+}
+
+// A rate, or 'none' where the engine has no pairwise interaction count
+static std::string rate(double value, const char* none) {
+    if (value < 0.0) return none;
+    std::stringstream ss;
+    ss << value;
+    return ss.str();
+}
+
+static void write_csv(std::ostream& out, const std::vector<BenchResult>& results) {
+    out << "engine,n,threads,steps,substeps,repeat,ns_per_step,ns_per_step_min,interactions_per_sec,gflops,speedup,efficiency,theta,rms_error,max_error,energy_error,reorder\n";
+    for (const BenchResult& r : results) {
+        out << r.engine << ',' << r.n << ',' << r.threads << ',' << r.steps << ',' << r.substeps << ',' << r.repeat << ','
+            << r.ns_per_step_median << ',' << r.ns_per_step_min << ','
+            << rate(r.interactions_per_second, "-") << ',' << rate(r.gflops, "-") << ','
+            << r.speedup << ',' << r.efficiency << ','
+            << r.theta << ',' << r.rms_error << ',' << r.max_error << ',' << r.energy_error << ',' << r.reorder << '\n';
+    }
+}
+
+static void write_json(std::ostream& out, const std::vector<BenchResult>& results) {
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        out << "  {\"engine\": \"" << r.engine << "\", \"n\": " << r.n
+            << ", \"threads\": " << r.threads
+            << ", \"steps\": " << r.steps << ", \"substeps\": " << r.substeps
+            << ", \"repeat\": " << r.repeat
+            << ", \"ns_per_step\": " << r.ns_per_step_median
+            << ", \"ns_per_step_min\": " << r.ns_per_step_min
+            << ", \"interactions_per_sec\": " << rate(r.interactions_per_second, "null")
+            << ", \"gflops\": " << rate(r.gflops, "null")
+            << ", \"speedup\": " << r.speedup
+            << ", \"efficiency\": " << r.efficiency
+            << ", \"theta\": " << r.theta
+            << ", \"rms_error\": " << r.rms_error
+            << ", \"max_error\": " << r.max_error
+            << ", \"energy_error\": " << r.energy_error
+            << ", \"reorder\": " << r.reorder << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "]\n";
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions opt;
+    if (!parse_args(argc, argv, opt)) return 1;
+    profileThreadName("bench");
+
+    std::vector<Engine> engines = available_engines(opt);
+    std::vector<BenchResult> results;
+
+    for (const std::string& name : opt.engines) {
+        bool found = false;
+        for (const Engine& engine : engines) {
+            if (engine.name != name) continue;
+            found = true;
+
+            std::vector<size_t> thread_counts = engine.threaded ? opt.threads : std::vector<size_t>{ 1 };
+            for (size_t threads : thread_counts) {
+                for (size_t n : opt.sizes) {
+                    if (n < 2) continue;
+                    if (!engine.init(n, threads)) {
+                        std::cerr << "Engine " << name << " failed to initialize for n = " << n << "\n";
+                        break;
+                    }
+                    BenchResult r;
+                    {
+                        // one span per run, so the trace groups each engine's phases
+                        NBODY_PROFILE_SCOPE(engine.name.c_str());
+                        r = run_one(engine, n, threads, opt);
+                    }
+                    const std::string report = engine.report ? engine.report() : std::string();
+                    engine.cleanup();
+
+                    std::cerr << name << " n=" << n << " threads=" << threads << " "
+                              << r.ns_per_step_median * 1e-6 << " ms/step, " << rate(r.gflops, "-") << " GFLOP/s";
+                    if (r.rms_error >= 0.0) std::cerr << ", theta=" << r.theta << " rms error " << r.rms_error;
+                    if (opt.energy) std::cerr << ", energy error " << r.energy_error;
+                    if (!report.empty()) std::cerr << ", " << report;
+                    std::cerr << "\n";
+                    results.push_back(r);
+
+                    // O(N^2) engines get slow fast: stop this sweep once a step is over budget
+                    if (r.ns_per_step_median * 1e-9 > opt.max_step_seconds) {
+                        std::cerr << name << ": step time over budget, skipping larger sizes\n";
+                        break;
+                    }
+                }
+            }
+        }
+        if (!found) {
+            std::cerr << "Unknown engine " << name << "\n";
+            return 1;
+        }
+    }
+
+    // strong scaling: compare every run against the single-thread run of the same engine and N
+    for (BenchResult& r : results) {
+        for (const BenchResult& base : results) {
+            if (base.engine == r.engine && base.n == r.n && base.theta == r.theta && base.threads == 1) {
+                r.speedup = base.ns_per_step_median / r.ns_per_step_median;
+                r.efficiency = r.speedup / static_cast<double>(r.threads);
+            }
+        }
+    }
+
+    std::ofstream file;
+    if (!opt.output.empty()) {
+        file.open(opt.output);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open " << opt.output << "\n";
+            return 1;
+        }
+    }
+    std::ostream& out = opt.output.empty() ? std::cout : file;
+
+    if (opt.format == "csv") write_csv(out, results);
+    else write_json(out, results);
+
+    if (!opt.trace.empty()) {
+        printProfileSummary(std::cerr);
+        if (!writeChromeTrace(opt.trace)) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,27 @@
+# Turn a text file into a header that holds it as a C++ raw string literal.
+# Usage: cmake -DINPUT=<file> -DOUTPUT=<header> -DNAME=<symbol> -P EmbedFile.cmake
+
+file(READ "${INPUT}" CONTENT)
+get_filename_component(FILE_NAME "${INPUT}" NAME)
+string(TOUPPER "${NAME}_H" GUARD)
+
+file(WRITE "${OUTPUT}.tmp"
+"// Generated from ${FILE_NAME} at build time, do not edit\n\
+\n\
+#ifndef ${GUARD}\n\
+#define ${GUARD}\n\
+\n\
+static const char ${NAME}[] = R\"NBODY_EMBED(${CONTENT})NBODY_EMBED\";\n\
+\n\
+#endif\n")
+
+# only touch the header when the content changed, so unrelated rebuilds stay incremental
+file(SHA256 "${OUTPUT}.tmp" NEW_HASH)
+if(EXISTS "${OUTPUT}")
+  file(SHA256 "${OUTPUT}" OLD_HASH)
+endif()
+if(NOT "${NEW_HASH}" STREQUAL "${OLD_HASH}")
+  file(RENAME "${OUTPUT}.tmp" "${OUTPUT}")
+else()
+  file(REMOVE "${OUTPUT}.tmp")
+endif()
@@ -0,0 +1,313 @@
+// File: distributed.cpp
+// Driver for the distributed engine. Without --rank it forks the ranks on this host for every
+// entry of --ranks and reports strong scaling (fixed total N) and/or weak scaling (fixed N per
+// rank); with --rank it is one rank of a ring started by hand, e.g. on several hosts over TCP
+
+#include <algorithm>    // std::max
+#include <chrono>       // std::chrono::steady_clock
+#include <cmath>        // std::fabs
+#include <cstdlib>      // std::atoi, std::atof
+#include <iomanip>      // std::setprecision
+#include <iostream>     // std::cout, std::cerr
+#include <sstream>      // std::stringstream
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>   // shm_unlink
+#include <sys/wait.h>   // waitpid
+#include <unistd.h>     // fork, pipe, getpid
+
+#include "Body.h"              // Body
+#include "Distributed.h"       // initDistributedComputation(), runDistributedSubsteps()
+#include "InitialConditions.h" // generateBodies()
+#include "NBody.h"             // runCpuComputation()
+#include "Transport.h"         // makeShmTransport(), makeTcpTransport()
+
+// Same physical constants and domain as the interactive front end and the benchmark
+constexpr float G = 1.f;
+constexpr float dt = 0.1f;
+constexpr float eps = 1e-1f;
+constexpr float center_mass = 1000.f;
+
+const int WIDTH = 1920;
+const int HEIGHT = 1080;
+
+// Command line options of the driver
+struct DistributedRunOptions {
+    std::vector<int> ranks = { 1, 2, 4 };
+    std::vector<size_t> sizes = { 4000 };   // total N for strong scaling, N per rank for weak scaling
+    std::string scaling = "both";
+    TransportKind transport = TransportKind::Shm;
+    std::vector<std::string> hosts;         // tcp: host:port per rank; empty = 127.0.0.1:<port + rank>
+    int port = 47000;
+    int rank = -1;                          // >= 0: run only this rank of a ring started by hand
+    std::string shm_name;                   // shm segment of a ring started by hand
+    int steps = 5;
+    int warmup = 1;
+    bool overlap = true;
+    bool check = false;
+};
+
+// What rank 0 measured, sent to the parent through a pipe
+struct RunResult {
+    double ms_per_step = 0.0;     // wall time between the barriers
+    double compute_ms = 0.0;      // slowest rank
+    double wait_ms = 0.0;         // slowest rank
+    double max_error = -1.0;      // largest position difference to runCpuComputation (--check)
+};
+
+static std::vector<std::string> split_list(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+// Parse sizes like "1000,10k,1M"
+static size_t parse_size(const std::string& s) {
+    double value = std::atof(s.c_str());
+    char suffix = s.empty() ? '\0' : s.back();
+    if (suffix == 'k' || suffix == 'K') value *= 1e3;
+    else if (suffix == 'm' || suffix == 'M') value *= 1e6;
+    return static_cast<size_t>(value);
+}
+
+static void print_usage() {
+    std::cout <<
+        "Usage: NBodyDistributed [options]\n"
+        "  --ranks <p,p,...>     processes per run, forked on this host, default 1,2,4\n"
+        "  --sizes <n,n,...>     total bodies (strong) or bodies per rank (weak), k/M suffixes, default 4k\n"
+        "  --scaling <mode>      strong, weak or both, default both\n"
+        "  --transport <name>    shm (this host) or tcp, default shm\n"
+        "  --hosts <h:p,...>     tcp ring, one host:port per rank, default 127.0.0.1:<port + rank>\n"
+        "  --port <int>          first port of the default tcp ring, default 47000\n"
+        "  --rank <r>            run only rank r of a ring started by hand (one process per --hosts\n"
+        "                        entry, or per rank of the single --ranks entry with --shm-name);\n"
+        "                        every rank needs the same options\n"
+        "  --shm-name <name>     shared memory segments of a ring started by hand, default /nbody-ring;\n"
+        "                        --sizes entry i uses <name>-i. A crashed run leaves them in /dev/shm,\n"
+        "                        remove them before the next\n"
+        "  --steps <int>         timed steps, default 5\n"
+        "  --warmup <int>        untimed steps before measuring, default 1\n"
+        "  --no-overlap          sum a block, then shift it, instead of shifting the next one meanwhile\n"
+        "  --check               compare the final positions with single-process runCpuComputation\n";
+}
+
+static bool parse_args(int argc, char** argv, DistributedRunOptions& opt) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--help" || arg == "-h") { print_usage(); return false; }
+        if (arg == "--check") { opt.check = true; continue; }
+        if (arg == "--no-overlap") { opt.overlap = false; continue; }
+        if (!has_value) { std::cerr << "Missing value for " << arg << "\n"; return false; }
+
+        std::string value = argv[++i];
+        if (arg == "--ranks") {
+            opt.ranks.clear();
+            for (const std::string& p : split_list(value)) opt.ranks.push_back(std::max(1, std::atoi(p.c_str())));
+        }
+        else if (arg == "--sizes") {
+            opt.sizes.clear();
+            for (const std::string& s : split_list(value)) opt.sizes.push_back(parse_size(s));
+        }
+        else if (arg == "--scaling") opt.scaling = value;
+        else if (arg == "--hosts") opt.hosts = split_list(value);
+        else if (arg == "--port") opt.port = std::atoi(value.c_str());
+        else if (arg == "--rank") opt.rank = std::atoi(value.c_str());
+        else if (arg == "--shm-name") opt.shm_name = value;
+        else if (arg == "--steps") opt.steps = std::max(1, std::atoi(value.c_str()));
+        else if (arg == "--warmup") opt.warmup = std::max(0, std::atoi(value.c_str()));
+        else if (arg == "--transport") {
+            if (!parseTransport(value, opt.transport)) {
+                std::cerr << "Unknown transport " << value << "\n";
+                return false;
+            }
+        }
+        else { std::cerr << "Unknown option " << arg << "\n"; print_usage(); return false; }
+    }
+    if (opt.scaling != "strong" && opt.scaling != "weak" && opt.scaling != "both") {
+        std::cerr << "Unknown scaling " << opt.scaling << "\n";
+        return false;
+    }
+    if (opt.ranks.empty() || opt.sizes.empty()) {
+        std::cerr << "--ranks and --sizes need at least one entry\n";
+        return false;
+    }
+    return true;
+}
+
+static std::vector<Body> make_bodies(size_t n) {
+    ICOptions ic;
+    ic.central_mass = center_mass;
+    ic.G = G;
+    ic.threads = 1;   // the ranks share the cores
+    return generateBodies(n, WIDTH, HEIGHT, ic);
+}
+
+// Run one rank to the end: every rank builds the same bodies and keeps its block. Only rank 0's
+// result is meaningful
+static bool run_rank(const DistributedRunOptions& opt, int ranks, int rank, size_t n,
+                     const std::string& shm_name, RunResult& result)
+{
+    std::unique_ptr<Transport> transport;
+    if (opt.transport == TransportKind::Shm) {
+        transport = makeShmTransport(shm_name, rank, ranks, distributedShiftBytes(n, ranks));
+    }
+    else {
+        std::vector<std::string> hosts = opt.hosts;
+        if (hosts.empty()) {
+            for (int r = 0; r < ranks; ++r) hosts.push_back("127.0.0.1:" + std::to_string(opt.port + r));
+        }
+        transport = makeTcpTransport(hosts, rank);
+    }
+    DistributedOptions options;
+    options.overlap = opt.overlap;
+    if (!initDistributedComputation(n, std::move(transport), options)) return false;
+
+    const std::vector<Body> initial = make_bodies(n);
+    std::vector<Body> local(initial.begin() + blockBegin(n, ranks, rank),
+                            initial.begin() + blockBegin(n, ranks, rank + 1));
+    Transport& ring = *distributedTransport();
+
+    runDistributedSubsteps(local, G, eps, dt, WIDTH, HEIGHT, opt.warmup);
+    const DistributedStats before = distributedStats();
+    ring.barrier();
+    auto start = std::chrono::steady_clock::now();
+    runDistributedSubsteps(local, G, eps, dt, WIDTH, HEIGHT, opt.steps);
+    ring.barrier();
+    auto end = std::chrono::steady_clock::now();
+    result.ms_per_step = std::chrono::duration<double, std::milli>(end - start).count() / opt.steps;
+
+    // slowest rank's compute and wait time
+    const DistributedStats& after = distributedStats();
+    double mine[2] = { (after.compute_seconds - before.compute_seconds) * 1e3 / opt.steps,
+                       (after.wait_seconds - before.wait_seconds) * 1e3 / opt.steps };
+    std::vector<double> all(2 * ranks);
+    ring.allGather(mine, sizeof(mine), all.data());
+    for (int r = 0; r < ranks; ++r) {
+        result.compute_ms = std::max(result.compute_ms, all[2 * r]);
+        result.wait_ms = std::max(result.wait_ms, all[2 * r + 1]);
+    }
+
+    if (opt.check) {
+        std::vector<Body> gathered;
+        gatherBodies(local, gathered);
+        if (rank == 0) {
+            std::vector<Body> reference = initial;
+            for (int s = 0; s < opt.warmup + opt.steps; ++s) runCpuComputation(reference, G, eps, dt, WIDTH, HEIGHT);
+            result.max_error = 0.0;
+            for (size_t i = 0; i < n; ++i) {
+                result.max_error = std::max<double>(result.max_error, std::fabs(gathered[i].x - reference[i].x));
+                result.max_error = std::max<double>(result.max_error, std::fabs(gathered[i].y - reference[i].y));
+            }
+        }
+    }
+    cleanupDistributedComputation();
+    return true;
+}
+
+// Fork 'ranks' processes for one run and collect rank 0's result; the parent never starts threads,
+// so forking is safe
+static bool run_local(const DistributedRunOptions& opt, int ranks, size_t n, int run, RunResult& result) {
+    const std::string shm_name = "/nbody-ring-" + std::to_string(getpid()) + "-" + std::to_string(run);
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+
+    std::vector<pid_t> children;
+    for (int rank = 0; rank < ranks; ++rank) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            RunResult mine;
+            bool ok = run_rank(opt, ranks, rank, n, shm_name, mine);
+            if (ok && rank == 0 && write(fds[1], &mine, sizeof(mine)) != static_cast<ssize_t>(sizeof(mine))) ok = false;
+            _exit(ok ? 0 : 1);
+        }
+        if (pid < 0) {
+            std::cerr << "fork failed\n";
+            break;
+        }
+        children.push_back(pid);
+    }
+    close(fds[1]);
+
+    bool ok = static_cast<int>(children.size()) == ranks
+              && read(fds[0], &result, sizeof(result)) == static_cast<ssize_t>(sizeof(result));
+    close(fds[0]);
+    for (pid_t pid : children) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    // gone already unless a rank failed before detaching
+    if (opt.transport == TransportKind::Shm) shm_unlink(shm_name.c_str());
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    DistributedRunOptions opt;
+    if (!parse_args(argc, argv, opt)) return 1;
+
+    if (opt.rank >= 0) {
+        const int ranks = opt.transport == TransportKind::Tcp && !opt.hosts.empty() ? static_cast<int>(opt.hosts.size())
+                                                                                  : opt.ranks.front();
+        const std::string shm_name = opt.shm_name.empty() ? "/nbody-ring" : opt.shm_name;
+        for (size_t run = 0; run < opt.sizes.size(); ++run) {
+            // one segment per size, as in run_local: a rank done with one size must not attach to
+            // the segment the slower ranks are still using
+            const size_t n = opt.sizes[run];
+            RunResult result;
+            if (!run_rank(opt, ranks, opt.rank, n, shm_name + "-" + std::to_string(run), result)) return 1;
+            if (opt.rank == 0) {
+                std::cout << "ranks " << ranks << ", n " << n << ": " << result.ms_per_step << " ms/step (compute "
+                          << result.compute_ms << ", wait " << result.wait_ms << ")";
+                if (opt.check) std::cout << ", max error " << result.max_error;
+                std::cout << "\n";
+            }
+        }
+        return 0;
+    }
+
+    std::vector<std::string> modes;
+    if (opt.scaling != "weak") modes.push_back("strong");
+    if (opt.scaling != "strong") modes.push_back("weak");
+
+    std::cout << "mode,ranks,n,transport,ms_per_step,compute_ms,wait_ms,speedup,efficiency";
+    if (opt.check) std::cout << ",max_error";
+    std::cout << "\n" << std::setprecision(4);
+
+    int run = 0;
+    for (const std::string& mode : modes) {
+        for (size_t size : opt.sizes) {
+            // speedup and efficiency are relative to the first entry of --ranks
+            double base_ms = 0.0;
+            const int base_ranks = opt.ranks.front();
+            for (int ranks : opt.ranks) {
+                const size_t n = mode == "weak" ? size * static_cast<size_t>(ranks) : size;
+                RunResult result;
+                if (!run_local(opt, ranks, n, run++, result)) {
+                    std::cerr << "Run with " << ranks << " ranks failed\n";
+                    return 1;
+                }
+                if (base_ms == 0.0) base_ms = result.ms_per_step;
+
+                // speedup = pairs per second relative to the base run. Weak scaling grows N with
+                // the ranks, so the pairs grow by scale^2 and the ideal step time by scale
+                const double scale = static_cast<double>(ranks) / base_ranks;
+                const double speedup = (mode == "weak" ? scale * scale : 1.0) * base_ms / result.ms_per_step;
+                const double efficiency = speedup / scale;
+                std::cout << mode << "," << ranks << "," << n << "," << transportName(opt.transport) << ","
+                          << result.ms_per_step << "," << result.compute_ms << "," << result.wait_ms << ","
+                          << speedup << "," << efficiency;
+                if (opt.check) std::cout << "," << result.max_error;
+                std::cout << std::endl;
+            }
+        }
+    }
+    return 0;
+}
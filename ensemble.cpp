@@ -0,0 +1,209 @@
+// File: ensemble.cpp
+// Driver for ensemble runs: M independent small systems (one seed each) stepped either one after
+// the other through a Simulation per system (the loop-* modes, what a sweep script does) or all
+// at once through an Ensemble (cpu, gpu). Reports simulations per hour for every mode
+
+#include <algorithm>    // std::max
+#include <chrono>       // std::chrono::steady_clock
+#include <cmath>        // std::fabs
+#include <cstdlib>      // std::atoi, std::strtoull
+#include <iomanip>      // std::setprecision
+#include <iostream>     // std::cout, std::cerr
+#include <sstream>      // std::stringstream
+#include <string>
+#include <vector>
+
+#include "Body.h"              // Body
+#include "Ensemble.h"          // Ensemble
+#include "InitialConditions.h" // generateBodies()
+#include "Simulation.h"        // Simulation
+
+// Same physical constants and domain as the interactive front end and the benchmark
+constexpr float G = 1.f;
+constexpr float dt = 0.1f;
+constexpr float eps = 1e-1f;
+constexpr float center_mass = 1000.f;
+
+const int WIDTH = 1920;
+const int HEIGHT = 1080;
+
+// Command line options of the driver
+struct EnsembleRunOptions {
+    size_t systems = 1000;
+    size_t bodies = 50;       // per system, plus the central mass
+    int steps = 100;
+    std::vector<std::string> modes = { "loop-cpu", "loop-simd", "cpu" };
+    size_t threads = 0;
+    std::string device;
+    uint64_t seed = 42;
+    bool check = false;
+};
+
+static std::vector<std::string> split_list(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+static void print_usage() {
+    std::cout <<
+        "Usage: NBodyEnsemble [options]\n"
+        "  --systems <int>       independent systems, default 1000\n"
+        "  --bodies <int>        bodies per system besides the central mass, default 50\n"
+        "  --steps <int>         steps of every system, default 100\n"
+        "  --modes <m,m,...>     loop-cpu, loop-simd, loop-parallel, loop-gpu (one Simulation per system,\n"
+        "                        in turn), cpu, gpu (one Ensemble); default loop-cpu,loop-simd,cpu\n"
+        "  --threads <int>       cpu, loop-parallel: pool workers, default all hardware threads\n"
+        "  --device <spec>       OpenCL device, see selectOpenCLDevice()\n"
+        "  --seed <int>          seed of system 0, system s uses seed + s, default 42\n"
+        "  --check               compare every system's final positions with the loop-simd run\n";
+}
+
+static bool parse_args(int argc, char** argv, EnsembleRunOptions& opt) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--help" || arg == "-h") { print_usage(); return false; }
+        if (arg == "--check") { opt.check = true; continue; }
+        if (!has_value) { std::cerr << "Missing value for " << arg << "\n"; return false; }
+
+        std::string value = argv[++i];
+        if (arg == "--systems") opt.systems = static_cast<size_t>(std::max(1, std::atoi(value.c_str())));
+        else if (arg == "--bodies") opt.bodies = static_cast<size_t>(std::max(0, std::atoi(value.c_str())));
+        else if (arg == "--steps") opt.steps = std::max(1, std::atoi(value.c_str()));
+        else if (arg == "--modes") opt.modes = split_list(value);
+        else if (arg == "--threads") opt.threads = static_cast<size_t>(std::max(0, std::atoi(value.c_str())));
+        else if (arg == "--device") opt.device = value;
+        else if (arg == "--seed") opt.seed = std::strtoull(value.c_str(), nullptr, 10);
+        else { std::cerr << "Unknown option " << arg << "\n"; print_usage(); return false; }
+    }
+    for (const std::string& mode : opt.modes) {
+        SimulationEngine engine = SimulationEngine::Cpu;
+        EnsembleBackend backend = EnsembleBackend::Cpu;
+        const bool loop = mode.compare(0, 5, "loop-") == 0;
+        if (loop ? !parseSimulationEngine(mode.substr(5), engine) : !parseEnsembleBackend(mode, backend)) {
+            std::cerr << "Unknown mode " << mode << "\n";
+            return false;
+        }
+    }
+    if (opt.modes.empty()) {
+        std::cerr << "--modes needs at least one entry\n";
+        return false;
+    }
+    return true;
+}
+
+static std::vector<std::vector<Body>> make_systems(const EnsembleRunOptions& opt) {
+    std::vector<std::vector<Body>> systems(opt.systems);
+    for (size_t s = 0; s < opt.systems; ++s) {
+        ICOptions ic;
+        ic.seed = opt.seed + s;
+        ic.central_mass = center_mass;
+        ic.G = G;
+        ic.threads = 1;   // small systems, a pool per system would cost more than generating them
+        systems[s] = generateBodies(opt.bodies + 1, WIDTH, HEIGHT, ic);
+    }
+    return systems;
+}
+
+// Step every system through its own Simulation, one after the other; 'result' gets the final states
+static bool run_loop(const EnsembleRunOptions& opt, SimulationEngine engine,
+                     const std::vector<std::vector<Body>>& systems, const SnapshotInfo& run,
+                     std::vector<std::vector<Body>>& result)
+{
+    SimulationOptions options;
+    options.engine = engine;
+    options.parallel.threads = opt.threads;
+    options.gpu.device = opt.device;
+    result.resize(systems.size());
+    for (size_t s = 0; s < systems.size(); ++s) {
+        std::unique_ptr<Simulation> sim = Simulation::create(systems[s], run, options);
+        if (!sim || !sim->step(opt.steps)) return false;
+        result[s] = sim->bodies();
+    }
+    return true;
+}
+
+// Step all systems together in one Ensemble
+static bool run_ensemble(const EnsembleRunOptions& opt, EnsembleBackend backend,
+                         const std::vector<std::vector<Body>>& systems, const SnapshotInfo& run,
+                         std::vector<std::vector<Body>>& result)
+{
+    EnsembleOptions options;
+    options.backend = backend;
+    options.threads = opt.threads;
+    options.device = opt.device;
+    std::unique_ptr<Ensemble> ensemble = Ensemble::create(systems, run, options);
+    if (!ensemble || !ensemble->step(opt.steps)) return false;
+    result.resize(systems.size());
+    for (size_t s = 0; s < systems.size(); ++s) ensemble->systemBodies(s, result[s]);
+    return true;
+}
+
+// Largest position difference between two sets of systems
+static double max_error(const std::vector<std::vector<Body>>& a, const std::vector<std::vector<Body>>& b) {
+    double error = 0.0;
+    for (size_t s = 0; s < a.size(); ++s) {
+        for (size_t i = 0; i < a[s].size(); ++i) {
+            error = std::max<double>(error, std::fabs(a[s][i].x - b[s][i].x));
+            error = std::max<double>(error, std::fabs(a[s][i].y - b[s][i].y));
+        }
+    }
+    return error;
+}
+
+int main(int argc, char** argv)
+{
+    EnsembleRunOptions opt;
+    if (!parse_args(argc, argv, opt)) return 1;
+
+    const std::vector<std::vector<Body>> systems = make_systems(opt);
+    SnapshotInfo run;
+    run.G = G;
+    run.eps = eps;
+    run.dt = dt;
+    run.width = WIDTH;
+    run.height = HEIGHT;
+
+    std::vector<std::vector<Body>> reference;
+    if (opt.check && !run_loop(opt, SimulationEngine::Simd, systems, run, reference)) return 1;
+
+    std::cout << "mode,systems,bodies,steps,seconds,sims_per_hour,speedup";
+    if (opt.check) std::cout << ",max_error";
+    std::cout << "\n" << std::setprecision(4);
+
+    // speedup is relative to the first entry of --modes
+    double base_seconds = 0.0;
+    for (const std::string& mode : opt.modes) {
+        std::vector<std::vector<Body>> result;
+        auto start = std::chrono::steady_clock::now();
+        bool ok;
+        if (mode.compare(0, 5, "loop-") == 0) {
+            SimulationEngine engine = SimulationEngine::Cpu;
+            parseSimulationEngine(mode.substr(5), engine);
+            ok = run_loop(opt, engine, systems, run, result);
+        }
+        else {
+            EnsembleBackend backend = EnsembleBackend::Cpu;
+            parseEnsembleBackend(mode, backend);
+            ok = run_ensemble(opt, backend, systems, run, result);
+        }
+        auto end = std::chrono::steady_clock::now();
+        if (!ok) {
+            std::cerr << "Mode " << mode << " failed\n";
+            continue;
+        }
+
+        const double seconds = std::chrono::duration<double>(end - start).count();
+        if (base_seconds == 0.0) base_seconds = seconds;
+        std::cout << mode << "," << opt.systems << "," << opt.bodies + 1 << "," << opt.steps << ","
+                  << seconds << "," << opt.systems * 3600.0 / seconds << "," << base_seconds / seconds;
+        if (opt.check) std::cout << "," << max_error(result, reference);
+        std::cout << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,53 @@
+// File: BarnesHut.h
+// Declares the Barnes-Hut quadtree CPU engine (O(N log N) approximate gravity)
+
+#ifndef BARNES_HUT_H
+#define BARNES_HUT_H
+
+#include <cstdint>
+#include <vector>
+#include "Body.h"
+
+// Tuning knobs for the Barnes-Hut engine
+struct BarnesHutOptions {
+    float theta = 0.5f;       // opening angle: a cell of side s at distance d is approximated if s / d < theta
+    size_t threads = 0;       // worker threads, 0 = all hardware threads
+    size_t leaf_size = 8;     // maximum number of bodies kept in a leaf cell
+};
+
+// Work counters since the last init
+struct BarnesHutStats {
+    uint64_t force_passes = 0;    // tree builds and walks
+    uint64_t interactions = 0;    // body-body terms in leaves plus accepted cell terms
+};
+
+// Create the thread pool and reserve the node arena for n_bodies
+bool initBarnesHutComputation(size_t n_bodies, const BarnesHutOptions& options);
+bool initBarnesHutComputation(size_t n_bodies);
+
+// Build the tree for the current positions and write approximate accelerations to soa.ax / soa.ay
+void barnes_hut_compute_forces(BodiesSOA& soa, const float G, const float eps);
+
+// One step on SoA data: tree build, traversal and integration
+void barnes_hut_step(BodiesSOA& soa,
+                     const float G,
+                     const float eps,
+                     const float dt,
+                     const int width,
+                     const int height);
+
+// Run one Barnes-Hut simulation step, updating the bodies vector
+void runBarnesHutComputation(std::vector<Body>& bodies,
+                             const float G,
+                             const float eps,
+                             const float dt,
+                             const int width,
+                             const int height);
+
+// Counters of the current run
+const BarnesHutStats& barnesHutStats();
+
+// Stop the worker threads and release the arena
+void cleanupBarnesHutComputation();
+
+#endif
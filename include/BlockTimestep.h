@@ -0,0 +1,53 @@
+// File: BlockTimestep.h
+// Declares the hierarchical block time-step engine: every body advances on its own power-of-two
+// fraction of dt and only bodies at the end of their step get new forces
+
+#ifndef BLOCK_TIMESTEP_H
+#define BLOCK_TIMESTEP_H
+
+#include <cstdint>
+#include <vector>
+#include "Body.h"
+#include "SimdComputation.h"
+
+// Tuning knobs for the block time-step engine
+struct BlockTimestepOptions {
+    int max_level = 12;          // finest step is dt / 2^max_level
+    float eta = 0.025f;          // accuracy parameter of the step criterion sqrt(2 eta eps / |a|)
+    size_t threads = 0;          // worker threads for the force pass, 0 = all hardware threads
+    SimdKernel kernel = detectSimdKernel();
+};
+
+// Work counters since init, for comparing against a single global step
+struct BlockTimestepStats {
+    size_t bodies = 0;
+    uint64_t steps = 0;              // macro steps of length dt
+    uint64_t force_evaluations = 0;  // bodies whose acceleration was recomputed (N per full force pass)
+    uint64_t sub_steps = 0;          // force passes (times at which at least one body was active)
+    int deepest_level = 0;           // finest level reached so far
+    std::vector<uint64_t> level_counts;  // bodies per level at the end of the last macro step
+};
+
+// Create the thread pool and scratch storage for n_bodies
+bool initBlockTimestepComputation(size_t n_bodies, const BlockTimestepOptions& options);
+bool initBlockTimestepComputation(size_t n_bodies);
+
+// Advance all bodies by dt (one macro step); inside it bodies on level l take 2^l kick-drift-kick
+// leapfrog steps of dt / 2^l, with levels chosen from |a| and eps after every step
+void runBlockTimestepComputation(std::vector<Body>& bodies,
+                                 const float G,
+                                 const float eps,
+                                 const float dt,
+                                 const int width,
+                                 const int height);
+
+// Follow a reordering of the caller's vector (new position k holds old body perm[k]; see
+// with_reordering): bodies keep their levels, only the indices the level slots point at change
+void permuteBlockTimestepState(const std::vector<uint32_t>& perm);
+
+const BlockTimestepStats& blockTimestepStats();
+
+// Release the engine's storage and threads
+void cleanupBlockTimestepComputation();
+
+#endif
@@ -7,6 +7,8 @@
 #include <random>
 #include <vector>
 #include <cstddef>
+#include <cstdint>
+#include <new>
 
 // Represents a single particle (body) in the simulation
 struct Body {
@@ -21,34 +23,101 @@ struct Body {
 
     float mass;
 
+    // Held in place: never kicked or drifted, but still attracts the others (e.g. the central mass)
+    bool pinned = false;
+
+    // Stable identity: the index the body was created with, kept when bodies are reordered
+    uint32_t id = 0;
+
     bool operator==(const Body &a) const
     {
         return (x == a.x && y == a.y);
     }
 };
 
+// Allocator handing out cache-line (64 byte) aligned storage so SIMD kernels can use aligned loads
+template <typename T, size_t Alignment = 64>
+struct AlignedAllocator
+{
+    using value_type = T;
+
+    template <typename U>
+    struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+    AlignedAllocator() noexcept = default;
+
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* p, size_t) noexcept
+    {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept { return true; }
+
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const noexcept { return false; }
+};
+
+using AlignedFloats = std::vector<float, AlignedAllocator<float>>;
+using AlignedBytes = std::vector<uint8_t, AlignedAllocator<uint8_t>>;
+using AlignedIds = std::vector<uint32_t, AlignedAllocator<uint32_t>>;
+
 // Structure-of-arrays layout for more efficient GPU or vectorized processing
 struct BodiesSOA
 {
-    std::vector<float> x;
-    std::vector<float> y;
+    AlignedFloats x;
+    AlignedFloats y;
+
+    AlignedFloats vx;
+    AlignedFloats vy;
+
+    AlignedFloats ax;
+    AlignedFloats ay;
 
-    std::vector<float> vx;
-    std::vector<float> vy;
+    AlignedFloats mass;
 
-    std::vector<float> ax;
-    std::vector<float> ay;
+    AlignedBytes pinned;   // 1 = Body::pinned
 
-    std::vector<float> mass;
+    AlignedIds id;         // Body::id
 
     size_t size;
 
     BodiesSOA(size_t n)
-        : x(n), y(n), vx(n), vy(n), ax(n), ay(n), mass(n), size(n) {}
+        : x(n), y(n), vx(n), vy(n), ax(n), ay(n), mass(n), pinned(n), id(n), size(n) {}
+
+    // Change the number of bodies, keeping existing values
+    void resize(size_t n)
+    {
+        x.resize(n); y.resize(n);
+        vx.resize(n); vy.resize(n);
+        ax.resize(n); ay.resize(n);
+        mass.resize(n);
+        pinned.resize(n);
+        id.resize(n);
+        size = n;
+    }
 };
 
+// Copy an array of bodies into structure-of-arrays form (resizes soa to match)
+void packBodies(const std::vector<Body>& bodies, BodiesSOA& soa);
+
+// Copy positions, velocities and accelerations back from structure-of-arrays form (mass, the
+// pinned flag and the id never change)
+void unpackBodies(const BodiesSOA& soa, std::vector<Body>& bodies);
+
 Body randomBody(std::mt19937 &rng, int width, int height);
 
     Body centralBody(float mass, int width, int height);
 
+// Computes the circular orbital speed for mass M at distance r
+float orbital_velocity_scalar(float M, float r);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,67 @@
+// File: BodyRenderer.h
+// Declares the batched SFML renderer: one vertex array (or one density texture) per frame
+
+#ifndef BODY_RENDERER_H
+#define BODY_RENDERER_H
+
+#include <cstdint>
+#include <vector>
+#include <SFML/Graphics.hpp>
+#include "Body.h"
+
+// How bodies are drawn
+enum class RenderMode {
+    Points,     // one vertex per body
+    Quads,      // small square per body, large ones for heavy bodies (like the old circles)
+    Heatmap     // bodies splatted into a density grid, shown as one texture; for millions of bodies
+};
+
+// Name shown in the HUD
+const char* renderModeName(RenderMode mode);
+
+// Quads up to 100k bodies, heatmap above
+RenderMode defaultRenderMode(size_t n_bodies);
+
+// Holds every buffer the draw path needs and reuses them across frames, so once sized for N
+// bodies update() and draw() do not allocate. Everything is submitted in a single draw call
+class BodyRenderer {
+public:
+    BodyRenderer(int width, int height, RenderMode mode);
+
+    // the sprite points at the member texture
+    BodyRenderer(const BodyRenderer&) = delete;
+    BodyRenderer& operator=(const BodyRenderer&) = delete;
+
+    RenderMode mode() const { return m_mode; }
+    void set_mode(RenderMode mode);
+    // Points -> Quads -> Heatmap -> Points
+    void cycle_mode();
+
+    // Rebuild vertices (or the density texture) from the current positions
+    void update(const std::vector<Body>& bodies);
+    void update(const float* x, const float* y, const float* mass, size_t n);
+
+    void draw(sf::RenderTarget& target) const;
+
+private:
+    template <typename Get>
+    void fill(size_t n, Get get);
+
+    int m_width;
+    int m_height;
+    RenderMode m_mode;
+
+    sf::VertexArray m_vertices;
+
+    // heatmap: density per cell of HEAT_CELL x HEAT_CELL pixels, mapped through a colour table
+    static constexpr int HEAT_CELL = 2;
+    int m_grid_w;
+    int m_grid_h;
+    std::vector<uint32_t> m_density;
+    std::vector<sf::Uint8> m_pixels;
+    std::vector<sf::Color> m_palette;
+    sf::Texture m_texture;
+    sf::Sprite m_sprite;
+};
+
+#endif
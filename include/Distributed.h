@@ -0,0 +1,70 @@
+// File: Distributed.h
+// Declares the domain-decomposed engine: the bodies are split into P contiguous blocks, one per
+// process (rank). Every step each rank passes (x, y, mass) blocks around a ring of Transports
+// (systolic direct sum): after P - 1 shifts it has summed the pull of every block on its own
+// bodies, and it only ever integrates those. The shift of the next block runs while the current
+// one is summed with accumulate_forces(), the kernel of runCpuComputation()
+
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Body.h"
+#include "Transport.h"
+
+// Ring settings
+struct DistributedOptions {
+    bool overlap = true;   // shift the next block while summing the current one; false = sum, then shift
+};
+
+// Time of this rank, summed over the steps so far
+struct DistributedStats {
+    uint64_t steps = 0;
+    double compute_seconds = 0.0;   // force sums and integration
+    double wait_seconds = 0.0;      // blocked on shifts the sums did not hide
+    uint64_t bytes_sent = 0;        // to the next rank
+};
+
+// First body of 'rank' when n bodies are split over 'ranks' (rank == ranks gives n); blocks differ
+// by at most one body
+size_t blockBegin(size_t n, int ranks, int rank);
+
+// Largest shift the engine makes for n bodies over 'ranks', the slot size a shared memory ring needs
+size_t distributedShiftBytes(size_t n, int ranks);
+
+// Take over the transport of this rank for n_total bodies in all; the local bodies passed to every
+// step are then the block [blockBegin(n_total, P, rank), blockBegin(n_total, P, rank + 1))
+bool initDistributedComputation(size_t n_total, std::unique_ptr<Transport> transport, const DistributedOptions& options);
+bool initDistributedComputation(size_t n_total, std::unique_ptr<Transport> transport);
+
+// One step of the local block (StepFunction signature); every rank must call it
+void runDistributedComputation(std::vector<Body>& local,
+                               const float G,
+                               const float eps,
+                               const float dt,
+                               const int width,
+                               const int height);
+
+// 'steps' steps (BatchStepFunction signature)
+void runDistributedSubsteps(std::vector<Body>& local,
+                            const float G,
+                            const float eps,
+                            const float dt,
+                            const int width,
+                            const int height,
+                            const int steps);
+
+// Every rank's bodies in global order, on every rank
+void gatherBodies(const std::vector<Body>& local, std::vector<Body>& all);
+
+// The ring of this process, e.g. for barriers around timings (null before init)
+Transport* distributedTransport();
+
+const DistributedStats& distributedStats();
+
+// Close the ring
+void cleanupDistributedComputation();
+
+#endif
@@ -0,0 +1,77 @@
+// File: Ensemble.h
+// Declares Ensemble, M independent systems stepped together: their bodies are packed back to back
+// into one SoA batch, system s owning bodies [offset(s), offset(s + 1)). On the CPU every system is
+// one task of the pool (all its steps run in one go, in cache); on OpenCL every system is one
+// work-group of a single launch per step (GpuKernel::Ensemble). Aimed at sweeps over thousands of
+// small systems, where one process or one launch per system costs more than the system itself
+
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Body.h"
+#include "GpuComputation.h"
+#include "SimdComputation.h"
+#include "Snapshot.h"     // SnapshotInfo
+#include "ThreadPool.h"
+
+// Where the systems are stepped
+enum class EnsembleBackend {
+    Cpu,      // one system per pool task, SIMD kernels
+    OpenCL    // one work-group per system
+};
+
+// Backend name as used on the command line ("cpu", "gpu")
+const char* ensembleBackendName(EnsembleBackend backend);
+
+// Parse a backend name, returns false if it is unknown
+bool parseEnsembleBackend(const std::string& name, EnsembleBackend& backend);
+
+struct EnsembleOptions {
+    EnsembleBackend backend = EnsembleBackend::Cpu;
+    size_t threads = 0;                       // Cpu: workers, 0 = all hardware threads
+    SimdKernel kernel = detectSimdKernel();   // Cpu
+    std::string device;                       // OpenCL: see selectOpenCLDevice()
+    bool binary_cache = true;                 // OpenCL: reuse compiled programs from the on-disk cache
+    size_t local_size = 0;                    // OpenCL: work-group size, 0 = largest system rounded to 32 (up to 256)
+};
+
+class Ensemble {
+public:
+    // Pack the systems (any sizes, at least one body each) under shared run parameters; prints the
+    // cause and returns null if the backend cannot be set up
+    static std::unique_ptr<Ensemble> create(const std::vector<std::vector<Body>>& systems, const SnapshotInfo& run,
+                                            const EnsembleOptions& options);
+
+    Ensemble(const Ensemble&) = delete;
+    Ensemble& operator=(const Ensemble&) = delete;
+
+    // Advance every system by 'steps' steps; false if the OpenCL backend rejected a launch
+    bool step(int steps = 1);
+
+    size_t systems() const { return m_offsets.size() - 1; }
+    size_t offset(size_t system) const { return m_offsets[system]; }
+
+    // Current state of one system
+    void systemBodies(size_t system, std::vector<Body>& bodies);
+
+    // Shared run parameters, with the step count and simulated time of the current state
+    const SnapshotInfo& run() const { return m_run; }
+
+private:
+    Ensemble(const SnapshotInfo& run, const EnsembleOptions& options);
+
+    SnapshotInfo m_run;
+    EnsembleOptions m_options;
+    std::vector<uint32_t> m_offsets;      // M + 1 entries, the last one is the number of bodies
+    BodiesSOA m_soa;                      // Cpu: the batch
+    std::unique_ptr<ThreadPool> m_pool;   // Cpu
+    std::vector<Body> m_batch;            // OpenCL: host copy of the batch
+    std::unique_ptr<GpuEngine> m_gpu;     // OpenCL
+    bool m_stale = false;                 // m_batch is behind the device
+};
+
+#endif
@@ -1,23 +1,148 @@
 // File: GpuComputation.h
-// Provides initialization, per-frame execution, and cleanup for GPU-based N-body computation
+// Provides initialization, per-frame execution, and cleanup for GPU-based N-body computation.
+// All device state lives in a GpuEngine, so one process can run many simulations; the free
+// functions act on a default engine owned by this module
 
 #ifndef GPU_COMPUTATION_H
 #define GPU_COMPUTATION_H
 
 #include "Body.h"
+#include "Precision.h"   // PrecisionMode
+#include "TracerComputation.h"   // TracerOptions
+#include <cstdint>
+#include <memory>
+#include <string>
 #include <vector>
 
-// Prepare GPU resources and compile kernels for n_bodies elements
-void initGpuComputation(size_t n_bodies);
+// Force kernel used for every step
+enum class GpuKernel {
+    Basic,   // original compute_forces + integrate_bodies, one global read per pair
+    Tiled,   // float4 bodies staged in __local tiles, separate integration launch
+    Fused,   // tiled forces and integration in a single launch
+    Tracer,  // only the sources of GpuOptions::tracers pull (N x N_sources), forces and integration fused
+    Ensemble // independent systems (GpuOptions::systems), one work-group each, forces and integration fused
+};
 
-// Execute one simulation step on the GPU, updating the bodies vector
-void runGpuComputation(std::vector<Body>& bodies, 
+// Device, kernel selection and launch geometry
+struct GpuOptions {
+    std::string device;         // see selectOpenCLDevice(); empty = $NBODY_OPENCL_DEVICE, else first GPU, then CPU
+    bool binary_cache = true;   // reuse compiled programs from the on-disk cache
+    GpuKernel kernel = GpuKernel::Basic;
+    size_t local_size = 0;      // work-group size; 0 = cached / autotuned value
+    size_t tile_size = 0;       // bodies per __local tile (multiple of 4); 0 = cached / autotuned value
+    bool autotune = true;       // time candidate sizes when the on-disk cache has no entry for the device
+    // force sums: float, mixed (double sums), kahan (compensated float sums) or double (pair terms
+    // and sums in double). Device buffers stay float in every mode; mixed and double need cl_khr_fp64
+    PrecisionMode precision = PrecisionMode::Float;
+    // sources and fixed potentials of the tracer kernel (threads and kernel are not used); its
+    // sums are always float
+    TracerOptions tracers;
+    // system offsets of the ensemble kernel: system s owns bodies [systems[s], systems[s + 1]) and
+    // only feels those; the last entry is the number of bodies
+    std::vector<uint32_t> systems;
+};
+
+// Device, queue, kernels and buffers of one simulation (defined in GpuComputation.cpp)
+struct GpuState;
+
+// One simulation on its own OpenCL context. Any number can coexist in a process, each used by one
+// thread at a time; the methods do what the free functions below do for the default engine
+class GpuEngine {
+public:
+    // Prepare a device for n_bodies elements; prints the cause and returns null if no device
+    // matches or any OpenCL call fails
+    static std::unique_ptr<GpuEngine> create(size_t n_bodies, const GpuOptions& options);
+    ~GpuEngine();
+
+    GpuEngine(const GpuEngine&) = delete;
+    GpuEngine& operator=(const GpuEngine&) = delete;
+
+    bool step(std::vector<Body>& bodies, const float G, const float eps, const float dt,
+              const int width, const int height);                           // runGpuComputation
+    bool upload(const std::vector<Body>& bodies);                           // uploadGpuState
+    bool download(std::vector<Body>& bodies);                               // downloadGpuState
+    void invalidate();                                                      // invalidateGpuState
+    bool permute(const std::vector<uint32_t>& perm);                        // permuteGpuState
+    bool stepResident(const float G, const float eps, const float dt,
+                      const int width, const int height, int steps);        // stepGpuResident
+    bool readback(std::vector<Body>& bodies, bool latest);                  // readbackGpuPositions
+    void finish();                                                          // finishGpuComputation
+    bool runResident(std::vector<Body>& bodies, const float G, const float eps, const float dt,
+                     const int width, const int height, const int steps);   // runGpuResidentSubsteps
+
+private:
+    explicit GpuEngine(GpuState* state) : m_state(state) {}
+    GpuState* m_state;
+};
+
+// Prepare GPU resources and compile kernels for n_bodies elements; prints the cause and returns
+// false if no device matches or any OpenCL call fails
+bool initGpuComputation(size_t n_bodies, const GpuOptions& options);
+bool initGpuComputation(size_t n_bodies);
+
+// Short name of a kernel variant ("basic", "tiled", "fused", "tracer", "ensemble")
+const char* gpuKernelName(GpuKernel kernel);
+
+// Every call that queues device work prints the cause and returns false if OpenCL rejects a
+// transfer, a kernel argument or a launch (e.g. a work-group or __local size the kernel cannot
+// take). A rejected resident step leaves the device state unusable: later resident steps, permutes
+// and downloads return false until uploadGpuState replaces it
+
+// Execute one simulation step on the GPU, updating the bodies vector (untouched on failure)
+bool runGpuComputation(std::vector<Body>& bodies, 
                        const float G, 
                        const float eps, 
                        const float dt, 
                        const int width, 
                        const int height);
 
+// Device-resident mode: state lives on the device across steps and only positions come back
+
+// Copy the full state to the device (mass is uploaded only here)
+bool uploadGpuState(const std::vector<Body>& bodies);
+
+// Blocking download of positions, velocities and accelerations (e.g. for a snapshot); false
+// (bodies untouched) if nothing was uploaded yet
+bool downloadGpuState(std::vector<Body>& bodies);
+
+// Force the next resident step to re-upload bodies, e.g. after the host changed them
+void invalidateGpuState();
+
+// Reorder the resident state on the device to match bodies reordered on the host
+// (new position k holds old body perm[k]; see with_reordering)
+bool permuteGpuState(const std::vector<uint32_t>& perm);
+
+// Enqueue one step on the resident state plus an asynchronous position readback, without waiting
+bool stepGpuResident(const float G, const float eps, const float dt, const int width, const int height);
+
+// Same for 'steps' steps queued back-to-back, with a single readback after the last one
+bool stepGpuResident(const float G, const float eps, const float dt, const int width, const int height, int steps);
+
+// Copy positions from the pinned staging buffer into bodies; 'latest' waits for the most recent
+// step, otherwise the previous (normally already finished) readback is used. False if none yet
+bool readbackGpuPositions(std::vector<Body>& bodies, bool latest);
+
+// Block until all queued device work has finished
+void finishGpuComputation();
+
+// Resident step with the render_bodies signature; bodies receive positions one step behind
+bool runGpuResidentComputation(std::vector<Body>& bodies,
+                               const float G,
+                               const float eps,
+                               const float dt,
+                               const int width,
+                               const int height);
+
+// Resident variant for multi-substep frames: 'steps' steps per call, one position readback
+// (again one call behind)
+bool runGpuResidentSubsteps(std::vector<Body>& bodies,
+                            const float G,
+                            const float eps,
+                            const float dt,
+                            const int width,
+                            const int height,
+                            const int steps);
+
 // Release all GPU resources allocated by initGpuComputation
 void cleanupGpuComputation();
 
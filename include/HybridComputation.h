@@ -0,0 +1,74 @@
+// File: HybridComputation.h
+// Declares the heterogeneous engine: the target rows of the all-pairs step are split between an
+// OpenCL device (rows [0, k)) and the CPU thread pool (rows [k, N)). Both sides run at the same
+// time, each integrates its own rows, and only position slices cross between them every step.
+// The split k follows the measured throughput of the two sides. Any OpenCL device works,
+// including a CPU implementation standing in for an accelerator
+
+#ifndef HYBRID_COMPUTATION_H
+#define HYBRID_COMPUTATION_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Body.h"
+#include "SimdComputation.h"
+
+// Device, split and CPU settings
+struct HybridOptions {
+    std::string device;          // see selectOpenCLDevice(); empty = $NBODY_OPENCL_DEVICE, else first GPU, then CPU
+    bool binary_cache = true;    // reuse compiled programs from the on-disk cache
+    size_t threads = 0;          // CPU workers, 0 = all hardware threads
+    SimdKernel kernel = detectSimdKernel();
+    float device_share = 0.5f;   // fraction of the rows on the device for the first step
+    bool rebalance = true;       // move the split after every step from the measured rates
+    float smoothing = 0.5f;      // weight of the newest measurement in the averaged rates
+    size_t min_rows = 64;        // rows either side keeps, so both stay measured (N < 2 * min_rows: CPU only)
+};
+
+// Split and rates as of the last step
+struct HybridStats {
+    uint64_t steps = 0;
+    size_t device_rows = 0;
+    double device_share = 0.0;      // device_rows / N
+    double device_rate = 0.0;       // averaged target rows per second, transfers included
+    double cpu_rate = 0.0;
+    uint64_t rebalances = 0;        // steps after which the split moved
+    uint64_t exchanged_bytes = 0;   // host <-> device traffic of the steps (slices and migrations)
+};
+
+// Device rows for n bodies that give both sides the same time at the given rates: rounded to
+// 'granularity' and clamped to [min_rows, n - min_rows]
+size_t hybridSplit(size_t n, double device_rate, double cpu_rate, size_t min_rows, size_t granularity);
+
+// Select the device, build the kernels and create the pool for n_bodies; prints the cause and
+// returns false on failure
+bool initHybridComputation(size_t n_bodies, const HybridOptions& options);
+bool initHybridComputation(size_t n_bodies);
+
+// A rejected OpenCL command prints its cause and makes the run functions return false with the
+// bodies untouched; every call uploads the full state again, so the next call starts clean
+
+// One step (StepFunction signature)
+bool runHybridComputation(std::vector<Body>& bodies,
+                          const float G,
+                          const float eps,
+                          const float dt,
+                          const int width,
+                          const int height);
+
+// 'steps' steps with one full upload and download per call (BatchStepFunction signature)
+bool runHybridSubsteps(std::vector<Body>& bodies,
+                       const float G,
+                       const float eps,
+                       const float dt,
+                       const int width,
+                       const int height,
+                       const int steps);
+
+const HybridStats& hybridStats();
+
+// Release the device resources and threads
+void cleanupHybridComputation();
+
+#endif
@@ -0,0 +1,48 @@
+// File: InitialConditions.h
+// Declares the parallel, counter-based initial condition generator and its preset distributions
+
+#ifndef INITIAL_CONDITIONS_H
+#define INITIAL_CONDITIONS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Body.h"
+
+// Distributions the generator can draw from
+enum class ICPreset {
+    Random,        // same distributions as randomBody(): uniform radius in the annulus, velocities in [-1, 1]
+    UniformDisk,   // uniform surface density in the annulus, at rest (cold collapse)
+    Plummer,       // Plummer sphere projected onto the plane, with its isotropic velocity distribution
+    KeplerDisk     // uniform annulus on circular orbits around the central mass
+};
+
+// Generator settings. Body i depends only on (seed, i), so the output is the same for any
+// thread count
+struct ICOptions {
+    ICPreset preset = ICPreset::Random;
+    uint64_t seed = 42;
+    float central_mass = 1000.f;   // pinned body at the origin stored last, as main.cpp does; 0 = none
+    float min_mass = 0.5f;         // body masses are uniform in [min_mass, max_mass)
+    float max_mass = 10.f;
+    float inner_radius = 50.f;     // annulus of the disk presets
+    float outer_radius = 0.f;      // 0 = min(width, height) / 2 - 20, like randomBody(); at least 1,
+                                   // inner_radius is lowered to half of it if not below
+    float plummer_radius = 0.f;    // Plummer scale radius, 0 = outer_radius / 4
+    float G = 1.f;                 // for the velocities of Plummer and KeplerDisk
+    size_t threads = 0;            // worker threads, 0 = all hardware threads
+};
+
+// Preset name as used on the command line ("random", "uniform-disk", "plummer", "kepler-disk")
+const char* icPresetName(ICPreset preset);
+
+// Parse a preset name, returns false if it is unknown
+bool parseICPreset(const std::string& name, ICPreset& preset);
+
+// Fill soa (resized to n) with n bodies for a width x height box, in parallel
+void generateBodies(BodiesSOA& soa, size_t n, int width, int height, const ICOptions& options);
+
+// Same, as an array of bodies
+std::vector<Body> generateBodies(size_t n, int width, int height, const ICOptions& options);
+
+#endif
@@ -0,0 +1,289 @@
+// File: Integrators.h
+// Declares the compile-time integrator schemes (semi-implicit Euler, leapfrog KDK, velocity Verlet,
+// 4th-order Yoshida), the kick/drift building blocks they share over any force backend, and the
+// SoA engine that runs them with energy and momentum drift measurement
+
+#ifndef INTEGRATORS_H
+#define INTEGRATORS_H
+
+#include <algorithm>  // for std::max
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Body.h"
+#include "Profiler.h"
+#include "SimdComputation.h"
+#include "ThreadPool.h"
+
+// Schemes the engine can run, chosen once per call; the per-body loops are all compile-time
+enum class IntegratorScheme {
+    Euler,           // semi-implicit Euler, what integrate_bodies does: 1st order, 1 force pass per step
+    LeapfrogKDK,     // kick-drift-kick leapfrog: 2nd order, 1 force pass per step
+    VelocityVerlet,  // position-form velocity Verlet: 2nd order, 1 force pass per step
+    Yoshida4         // Yoshida's symplectic triple-jump of leapfrog: 4th order, 3 force passes per step
+};
+
+// Scheme name as used on the command line ("euler", "kdk", "verlet", "yoshida4")
+const char* integratorName(IntegratorScheme scheme);
+
+// Parse a scheme name, returns false if it is unknown
+bool parseIntegrator(const std::string& name, IntegratorScheme& scheme);
+
+// Force backend shared by every scheme: all-pairs SIMD kernels split over a thread pool.
+// Any type with operator()(BodiesSOA&) that fills ax / ay can stand in for it
+struct SimdForces {
+    ThreadPool* pool;
+    float G;
+    float eps;
+    SimdKernel kernel;
+
+    void operator()(BodiesSOA& soa) const {
+        NBODY_PROFILE_SCOPE("forces");
+        const size_t grain = std::max<size_t>(64, soa.size / (4 * pool->size()));
+        pool->parallel_for(soa.size, grain, [&](size_t begin, size_t end, size_t) {
+            simd_compute_forces_range(soa, begin, end, G, eps, kernel);
+        });
+    }
+};
+
+// Kick and drift passes over a SoA state for the schemes below. Pinned bodies are neither kicked
+// nor drifted; drifts wrap positions around the box edges as integrate_bodies does
+template <typename Forces>
+class IntegratorOps {
+public:
+    IntegratorOps(BodiesSOA& soa, Forces& forces, ThreadPool& pool, AlignedFloats& saved_ax,
+                  AlignedFloats& saved_ay, int width, int height)
+        : m_soa(soa), m_forces(forces), m_pool(pool), m_saved_ax(saved_ax), m_saved_ay(saved_ay),
+          m_width(width), m_height(height) {}
+
+    // New accelerations for every body
+    void forces() {
+        m_forces(m_soa);
+        ++m_force_passes;
+    }
+
+    // v += a h
+    void kick(float h) {
+        NBODY_PROFILE_SCOPE("kick");
+        for_bodies([&](size_t i) {
+            m_soa.vx[i] += m_soa.ax[i] * h;
+            m_soa.vy[i] += m_soa.ay[i] * h;
+        });
+    }
+
+    // x += v h
+    void drift(float h) {
+        NBODY_PROFILE_SCOPE("drift");
+        for_bodies([&](size_t i) {
+            store_position(i, m_soa.x[i] + m_soa.vx[i] * h, m_soa.y[i] + m_soa.vy[i] * h);
+        });
+    }
+
+    // x += v h + a h^2 / 2, keeping a for average_kick
+    void drift_quadratic(float h) {
+        NBODY_PROFILE_SCOPE("drift");
+        const float hh = 0.5f * h * h;
+        for_bodies([&](size_t i) {
+            m_saved_ax[i] = m_soa.ax[i];
+            m_saved_ay[i] = m_soa.ay[i];
+            store_position(i, m_soa.x[i] + m_soa.vx[i] * h + m_soa.ax[i] * hh,
+                              m_soa.y[i] + m_soa.vy[i] * h + m_soa.ay[i] * hh);
+        });
+    }
+
+    // v += (a_saved + a) h / 2
+    void average_kick(float h) {
+        NBODY_PROFILE_SCOPE("kick");
+        const float half = 0.5f * h;
+        for_bodies([&](size_t i) {
+            m_soa.vx[i] += (m_saved_ax[i] + m_soa.ax[i]) * half;
+            m_soa.vy[i] += (m_saved_ay[i] + m_soa.ay[i]) * half;
+        });
+    }
+
+    uint64_t force_passes() const { return m_force_passes; }
+
+private:
+    // Below this many bodies a pass runs on the calling thread; waking workers would cost more
+    static constexpr size_t SERIAL_BODIES = 16384;
+
+    template <typename F>
+    void for_bodies(F&& f) {
+        const uint8_t* pinned = m_soa.pinned.data();
+        auto range = [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; ++i)
+                if (!pinned[i]) f(i);
+        };
+        if (m_soa.size <= SERIAL_BODIES) range(0, m_soa.size, 0);
+        else m_pool.parallel_for(m_soa.size, std::max(SERIAL_BODIES, m_soa.size / (4 * m_pool.size())), range);
+    }
+
+    void store_position(size_t i, float x, float y) {
+        if (x < -m_width / 2) x += m_width;
+        else if (x > m_width / 2) x -= m_width;
+        if (y < -m_height / 2) y += m_height;
+        else if (y > m_height / 2) y -= m_height;
+        m_soa.x[i] = x;
+        m_soa.y[i] = y;
+    }
+
+    BodiesSOA& m_soa;
+    Forces& m_forces;
+    ThreadPool& m_pool;
+    AlignedFloats& m_saved_ax;
+    AlignedFloats& m_saved_ay;
+    int m_width;
+    int m_height;
+    uint64_t m_force_passes = 0;
+};
+
+// Scheme policies: step(ops, dt) advances the state by dt. Schemes with start_forces = true use
+// the accelerations of the current positions on entry (left by their previous step) and leave
+// the ones of the new positions behind
+namespace integrator {
+
+// Semi-implicit Euler: forces, kick, drift
+struct Euler {
+    static constexpr bool start_forces = false;
+
+    template <typename Ops>
+    static void step(Ops& ops, float dt) {
+        ops.forces();
+        ops.kick(dt);
+        ops.drift(dt);
+    }
+};
+
+// Leapfrog kick-drift-kick; the closing forces are the opening ones of the next step
+struct LeapfrogKDK {
+    static constexpr bool start_forces = true;
+
+    template <typename Ops>
+    static void step(Ops& ops, float dt) {
+        ops.kick(0.5f * dt);
+        ops.drift(dt);
+        ops.forces();
+        ops.kick(0.5f * dt);
+    }
+};
+
+// Velocity Verlet in position form: the same trajectory as KDK in exact arithmetic, with the
+// velocity updated once per step from the average of the old and new accelerations
+struct VelocityVerlet {
+    static constexpr bool start_forces = true;
+
+    template <typename Ops>
+    static void step(Ops& ops, float dt) {
+        ops.drift_quadratic(dt);
+        ops.forces();
+        ops.average_kick(dt);
+    }
+};
+
+// Yoshida (1990) fourth order: leapfrog steps of w1 dt, w0 dt, w1 dt with w1 = 1 / (2 - 2^(1/3))
+// and w0 = 1 - 2 w1 (negative), the half kicks between them merged
+struct Yoshida4 {
+    static constexpr bool start_forces = true;
+    static constexpr double W1 = 1.3512071919596576;
+    static constexpr double W0 = -1.7024143839193153;
+
+    template <typename Ops>
+    static void step(Ops& ops, float dt) {
+        const float w1 = static_cast<float>(W1) * dt;
+        const float w0 = static_cast<float>(W0) * dt;
+        const float k1 = static_cast<float>(0.5 * W1) * dt;
+        const float k2 = static_cast<float>(0.5 * (W0 + W1)) * dt;
+
+        ops.kick(k1);
+        ops.drift(w1);
+        ops.forces();
+        ops.kick(k2);
+        ops.drift(w0);
+        ops.forces();
+        ops.kick(k2);
+        ops.drift(w1);
+        ops.forces();
+        ops.kick(k1);
+    }
+};
+
+} // namespace integrator
+
+// Run 'steps' steps of a scheme; 'primed' says whether ax / ay already hold the forces of the
+// current positions (only read by schemes that need them)
+template <typename Scheme, typename Forces>
+void integrate_steps(IntegratorOps<Forces>& ops, float dt, int steps, bool primed) {
+    if (Scheme::start_forces && !primed) ops.forces();
+    for (int s = 0; s < steps; ++s) Scheme::step(ops, dt);
+}
+
+// Totals the integrators should conserve. Energy uses the softened potential that matches the
+// force kernels, -G m_i m_j / sqrt(r^2 + eps^2). Momentum is only conserved without pinned
+// bodies (they absorb it); the angular momentum about the origin is also conserved with a pinned
+// body there. Wrapping at the box edges moves bodies without a force and breaks all three
+struct ConservedQuantities {
+    double kinetic = 0.0;
+    double potential = 0.0;
+    double px = 0.0;
+    double py = 0.0;
+    double lz = 0.0;               // angular momentum about the origin
+    double momentum_scale = 0.0;   // sum of m |v|, to make momentum errors relative
+
+    double energy() const { return kinetic + potential; }
+};
+
+// Measure the conserved quantities of a state; the potential is an O(N^2) double-precision pass
+ConservedQuantities measureConserved(const BodiesSOA& soa, float G, float eps, ThreadPool& pool);
+
+// Engine settings
+struct IntegratorOptions {
+    IntegratorScheme scheme = IntegratorScheme::LeapfrogKDK;
+    size_t threads = 0;            // worker threads, 0 = all hardware threads
+    SimdKernel kernel = detectSimdKernel();
+    uint64_t monitor_every = 0;    // measure the drift every this many steps, 0 = only on request
+};
+
+// Work and drift since init
+struct IntegratorStats {
+    uint64_t steps = 0;
+    uint64_t force_evaluations = 0;   // full force passes (N bodies each)
+    ConservedQuantities initial;      // before the first step
+    ConservedQuantities current;      // at the last measurement
+    uint64_t measured_step = 0;       // step of the last measurement
+    double energy_error = 0.0;        // (E - E0) / |E0| at the last measurement
+    double max_energy_error = 0.0;    // largest |energy_error| measured
+    double momentum_error = 0.0;      // |P - P0| / sum(m |v|) at the last measurement
+    double angular_momentum_error = 0.0;  // (Lz - Lz0) / |Lz0| at the last measurement
+
+    double energyDriftPerStep() const { return measured_step ? energy_error / measured_step : 0.0; }
+};
+
+// Create the thread pool and pick the scheme; returns false if the CPU cannot run the kernel
+bool initIntegratorComputation(size_t n_bodies, const IntegratorOptions& options);
+
+// One step with the configured scheme (StepFunction signature)
+void runIntegratorComputation(std::vector<Body>& bodies,
+                              const float G,
+                              const float eps,
+                              const float dt,
+                              const int width,
+                              const int height);
+
+// 'steps' steps with one pack / unpack (BatchStepFunction signature)
+void runIntegratorSubsteps(std::vector<Body>& bodies,
+                           const float G,
+                           const float eps,
+                           const float dt,
+                           const int width,
+                           const int height,
+                           const int steps);
+
+// Measure the current state against the initial one and update the drift fields of the stats
+void measureIntegratorDrift();
+
+const IntegratorStats& integratorStats();
+
+// Release the engine's storage and threads
+void cleanupIntegratorComputation();
+
+#endif
@@ -0,0 +1,52 @@
+// File: MortonOrder.h
+// Declares Morton (Z-order) and Hilbert key generation and a parallel radix sort for spatial ordering of bodies
+
+#ifndef MORTON_ORDER_H
+#define MORTON_ORDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+// Bits per axis in a 2D Morton key (two axes fill a 32-bit key)
+constexpr int MORTON_BITS = 16;
+
+// Interleave two 16-bit grid coordinates into a 32-bit Morton key (x in the even bits)
+uint32_t morton_encode(uint32_t gx, uint32_t gy);
+
+// Position of grid cell (gx, gy) along a 2D Hilbert curve over the same 16-bit grid. Unlike the
+// Z-order curve it never jumps: consecutive keys are always adjacent cells
+uint32_t hilbert_encode(uint32_t gx, uint32_t gy);
+
+// Square bounding box of a set of points: lower corner and side length
+struct MortonBounds {
+    float min_x;
+    float min_y;
+    float size;
+};
+
+// Reusable buffers for the Morton helpers, so repeated calls do not allocate
+struct MortonScratch {
+    std::vector<uint32_t> keys;
+    std::vector<uint32_t> values;
+    std::vector<size_t> histograms;
+    std::vector<float> bounds;
+};
+
+// Smallest square containing every point (computed in parallel)
+MortonBounds morton_bounds(const float* x, const float* y, size_t n, MortonScratch& scratch, ThreadPool& pool);
+
+// Morton key of every point inside 'bounds', written to keys[i]
+void morton_keys(const float* x, const float* y, size_t n, const MortonBounds& bounds,
+                 uint32_t* keys, ThreadPool& pool);
+
+// Hilbert key of every point inside 'bounds', written to keys[i]
+void hilbert_keys(const float* x, const float* y, size_t n, const MortonBounds& bounds,
+                  uint32_t* keys, ThreadPool& pool);
+
+// Stable parallel LSD radix sort (8-bit digits) of keys with their values carried along
+void radix_sort_pairs(uint32_t* keys, uint32_t* values, size_t n, MortonScratch& scratch, ThreadPool& pool);
+
+#endif
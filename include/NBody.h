@@ -4,13 +4,28 @@
 #ifndef NBODY_H
 #define NBODY_H
 
+#include <functional>
 #include <vector>
-#include <SFML/Graphics.hpp>  // for sf::Color
 #include "Body.h"
 
+// One simulation step: (bodies, G, eps, dt, width, height)
+using StepFunction = std::function<void(std::vector<Body>&, float, float, float, int, int)>;
+
+// 'steps' simulation steps in one call; bodies only need to be current after the last one,
+// so engines can batch the work (e.g. queue every step on the GPU with a single readback)
+using BatchStepFunction = std::function<void(std::vector<Body>&, float, float, float, int, int, int steps)>;
+
+// Wrap a single-step function so it can be driven several steps at a time
+BatchStepFunction repeat_steps(StepFunction step);
+
 // Compute pairwise gravitational accelerations
 void compute_forces(std::vector<Body>& bodies, const float G, const float eps);
 
+// Add the pull of 'count' sources, given as interleaved (x, y, mass) triples, to the accelerations
+// of bodies without clearing them first. As in compute_forces, a source at exactly a body's position
+// is skipped, so a block can be passed as its own sources (the distributed engine's per-rank kernel)
+void accumulate_forces(std::vector<Body>& bodies, const float* sources, size_t count, const float G, const float eps);
+
 // Integrate positions and velocities over timestep dt and wrap around edges
 void integrate_bodies(std::vector<Body>& bodies, const float dt, const int width, const int height);
 
@@ -0,0 +1,68 @@
+// File: OpenCLDevice.h
+// OpenCL platform/device selection and program builds backed by an on-disk binary cache
+
+#ifndef OPENCL_DEVICE_H
+#define OPENCL_DEVICE_H
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+#define CL_TARGET_OPENCL_VERSION 120
+#include <gegl-0.4/opencl/cl.h>
+
+// One device as enumerated over all platforms
+struct OpenCLDeviceInfo {
+    cl_platform_id platform = nullptr;
+    cl_device_id device = nullptr;
+    cl_device_type type = 0;
+    size_t platform_index = 0;
+    size_t device_index = 0;      // index within its platform
+    std::string name;
+    std::string platform_name;
+    bool fp64 = false;            // cl_khr_fp64: double arithmetic in kernels
+};
+
+// Every device of every platform, in platform order
+std::vector<OpenCLDeviceInfo> listOpenCLDevices();
+
+// Pick a device by spec:
+//   ""                     first GPU, falling back to the first CPU device, then to anything
+//   gpu | cpu | accelerator | all   first device of that type
+//   <k>                    k-th device in listOpenCLDevices() order
+//   <p>:<d>                device d of platform p
+//   anything else          first device whose device or platform name contains it (case-insensitive)
+// Prints the reason and returns false if nothing matches
+bool selectOpenCLDevice(const std::string& spec, OpenCLDeviceInfo& selected);
+
+// Select the device of an engine (spec as for selectOpenCLDevice; empty = $NBODY_OPENCL_DEVICE,
+// then the default), create a context on it and one in-order queue with 'queue_properties'.
+// Prints the cause and returns false on failure; whatever was created is left in context / queue
+// for the caller to release
+bool createOpenCLQueue(const std::string& spec, cl_command_queue_properties queue_properties,
+                       OpenCLDeviceInfo& selected, cl_context& context, cl_command_queue& queue);
+
+// n rounded up to a multiple of 'multiple' (NDRange global sizes are whole work-groups)
+size_t roundUpToMultiple(size_t n, size_t multiple);
+
+// Print listOpenCLDevices() with the indices accepted by selectOpenCLDevice
+void printOpenCLDevices(std::ostream& out);
+
+// Root of the on-disk caches: $NBODY_CACHE_DIR, else $XDG_CACHE_HOME/nbody, else ~/.cache/nbody
+std::string openclCacheDirectory();
+
+// Build source for one device. With use_cache, a binary keyed by platform, device, driver, build
+// options and a hash of the source is loaded from <cache>/kernels instead of compiling, and stored
+// after a successful compile. Returns nullptr (and prints the build log) on failure
+cl_program buildOpenCLProgram(cl_context context,
+                              cl_device_id device,
+                              const std::string& source,
+                              const std::string& options,
+                              bool use_cache);
+
+// Print "OpenCL error <code> in <what>" and return false if err is not CL_SUCCESS
+bool checkOpenCL(cl_int err, const char* what);
+
+// clSetKernelArg that keeps the first error in err, so a whole argument list is checked once
+void setOpenCLArg(cl_int& err, cl_kernel kernel, cl_uint index, size_t size, const void* value);
+
+#endif
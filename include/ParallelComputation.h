@@ -0,0 +1,75 @@
+// File: ParallelComputation.h
+// Declares the multithreaded, tiled CPU engine built on ThreadPool and the SIMD kernels. All state,
+// thread pool included, lives in a ParallelEngine, so one process can run many simulations; the
+// free functions act on a default engine owned by this module
+
+#ifndef PARALLEL_COMPUTATION_H
+#define PARALLEL_COMPUTATION_H
+
+#include <memory>
+#include <vector>
+#include "Body.h"
+#include "SimdComputation.h"
+
+// Tuning knobs for the parallel engine
+struct ParallelOptions {
+    size_t threads = 0;          // worker threads, 0 = all hardware threads
+    bool symmetric = false;      // use Newton's third law: each pair once, per-thread accumulators
+    size_t tile_rows = 0;        // targets per tile, 0 = derived from N and the thread count
+    size_t tile_cols = 4096;     // sources per tile: x, y, mass of 4096 bodies is 48 KB and stays in L2
+    SimdKernel kernel = detectSimdKernel();
+};
+
+// Pool, options and scratch buffers of one engine (defined in ParallelComputation.cpp)
+struct ParallelState;
+
+// One multithreaded engine with its own pool. Any number can coexist in a process, each used by
+// one thread at a time; the methods do what the free functions below do for the default engine
+class ParallelEngine {
+public:
+    // Create the thread pool and scratch buffers for n_bodies, returns null if the kernel is unsupported
+    static std::unique_ptr<ParallelEngine> create(size_t n_bodies, const ParallelOptions& options);
+    ~ParallelEngine();
+
+    ParallelEngine(const ParallelEngine&) = delete;
+    ParallelEngine& operator=(const ParallelEngine&) = delete;
+
+    void step(std::vector<Body>& bodies, const float G, const float eps, const float dt,
+              const int width, const int height);                           // runParallelComputation
+    void stepSoA(BodiesSOA& soa, const float G, const float eps, const float dt,
+                 const int width, const int height);                        // parallel_step
+    size_t threads() const;                                                 // parallelThreadCount
+
+private:
+    explicit ParallelEngine(ParallelState* state) : m_state(state) {}
+    ParallelState* m_state;
+};
+
+// Create the thread pool and scratch buffers for n_bodies, returns false if the kernel is unsupported
+bool initParallelComputation(size_t n_bodies, const ParallelOptions& options);
+bool initParallelComputation(size_t n_bodies);
+
+// Number of threads used by the engine (valid after init)
+size_t parallelThreadCount();
+
+// One step on SoA data: forces and integration in a single parallel pass (re-initializes with the
+// same options when soa holds a different number of bodies than the last init)
+void parallel_step(BodiesSOA& soa,
+                   const float G,
+                   const float eps,
+                   const float dt,
+                   const int width,
+                   const int height);
+
+// Run one parallel simulation step, updating the bodies vector
+void runParallelComputation(std::vector<Body>& bodies,
+                            const float G,
+                            const float eps,
+                            const float dt,
+                            const int width,
+                            const int height);
+
+// Stop the worker threads and release scratch buffers
+void cleanupParallelComputation();
+
+#endif
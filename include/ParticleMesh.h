@@ -0,0 +1,47 @@
+// File: ParticleMesh.h
+// Declares the periodic particle-mesh (FFT) CPU engine, with an optional P3M short-range correction
+
+#ifndef PARTICLE_MESH_H
+#define PARTICLE_MESH_H
+
+#include <vector>
+#include "Body.h"
+
+// Tuning knobs for the particle-mesh engine
+struct ParticleMeshOptions {
+    size_t grid = 0;          // mesh cells along the longer box side (power of two), 0 = derived from N
+    bool p3m = false;         // add the short-range pair sum, so close encounters get the exact force
+    float split = 1.25f;      // P3M force-split radius r_s in mesh cells
+    float cutoff = 4.5f;      // P3M short-range cutoff in units of r_s
+    size_t threads = 0;       // worker threads, 0 = all hardware threads
+};
+
+// Create the thread pool and per-body scratch for n_bodies. The mesh itself is sized on the
+// first step, once the box (width x height) is known
+bool initParticleMeshComputation(size_t n_bodies, const ParticleMeshOptions& options);
+bool initParticleMeshComputation(size_t n_bodies);
+
+// Accelerations in the periodic width x height box (every body feels all periodic images),
+// written to soa.ax / soa.ay
+void particle_mesh_compute_forces(BodiesSOA& soa, const float G, const float eps, const int width, const int height);
+
+// One step on SoA data: mesh forces, optional short-range correction and integration
+void particle_mesh_step(BodiesSOA& soa,
+                        const float G,
+                        const float eps,
+                        const float dt,
+                        const int width,
+                        const int height);
+
+// Run one particle-mesh simulation step, updating the bodies vector
+void runParticleMeshComputation(std::vector<Body>& bodies,
+                                const float G,
+                                const float eps,
+                                const float dt,
+                                const int width,
+                                const int height);
+
+// Stop the worker threads and release the mesh
+void cleanupParticleMeshComputation();
+
+#endif
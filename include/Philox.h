@@ -0,0 +1,63 @@
+// File: Philox.h
+// Philox4x32-10 counter-based random number generator (Salmon et al., "Parallel random numbers:
+// as easy as 1, 2, 3", SC'11)
+
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <array>
+#include <cstdint>
+
+using PhiloxCounter = std::array<uint32_t, 4>;
+using PhiloxKey = std::array<uint32_t, 2>;
+
+// Ten rounds of Philox: a keyed bijection of the 128-bit counter. Every (key, counter) pair gives
+// four independent 32-bit values, with no state carried from one call to the next
+inline PhiloxCounter philox4x32(PhiloxCounter ctr, PhiloxKey key)
+{
+    const uint32_t M0 = 0xD2511F53u, M1 = 0xCD9E8D57u;
+    const uint32_t W0 = 0x9E3779B9u, W1 = 0xBB67AE85u;
+
+    for (int round = 0; round < 10; ++round) {
+        const uint64_t p0 = static_cast<uint64_t>(M0) * ctr[0];
+        const uint64_t p1 = static_cast<uint64_t>(M1) * ctr[2];
+        ctr = { static_cast<uint32_t>(p1 >> 32) ^ ctr[1] ^ key[0], static_cast<uint32_t>(p1),
+                static_cast<uint32_t>(p0 >> 32) ^ ctr[3] ^ key[1], static_cast<uint32_t>(p0) };
+        key[0] += W0;
+        key[1] += W1;
+    }
+    return ctr;
+}
+
+// Random stream for one item (e.g. one body): the counter is (index, block), the key is the seed.
+// Draws depend only on (seed, index, draw number), never on which thread runs or in what order
+class PhiloxStream {
+public:
+    PhiloxStream(uint64_t seed, uint64_t index)
+        : m_key{ static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32) },
+          m_ctr{ static_cast<uint32_t>(index), static_cast<uint32_t>(index >> 32), 0, 0 } {}
+
+    uint32_t next()
+    {
+        if (m_used == 4) {
+            m_block = philox4x32(m_ctr, m_key);
+            ++m_ctr[2];
+            m_used = 0;
+        }
+        return m_block[m_used++];
+    }
+
+    // Uniform in [0, 1)
+    double uniform() { return next() * (1.0 / 4294967296.0); }
+
+    // Uniform in [lo, hi)
+    double uniform(double lo, double hi) { return lo + (hi - lo) * uniform(); }
+
+private:
+    PhiloxKey m_key;
+    PhiloxCounter m_ctr;
+    PhiloxCounter m_block{};
+    int m_used = 4;
+};
+
+#endif
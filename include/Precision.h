@@ -0,0 +1,136 @@
+// File: Precision.h
+// Declares the precision modes of the direct-sum engines and the CPU engine templated on them:
+// the storage type of the state and the type forces are summed in are chosen independently. The
+// float modes run the SIMD tile kernel instantiated on their accumulator, so they differ from the
+// simd engine only in how rows are summed; double runs the double tile kernel
+
+#ifndef PRECISION_H
+#define PRECISION_H
+
+#include <cmath>      // for std::sqrt
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Body.h"
+#include "SimdComputation.h"   // simd_accumulate_forces_tile, KahanSum
+
+// Storage / accumulation pairs
+enum class PrecisionMode {
+    Float,    // float state, float sums: what every other engine does
+    Double,   // double state, double sums
+    Mixed,    // float state, pair terms in float, summed in double
+    Kahan     // float state, float sums with a compensation term (Kahan 1965)
+};
+
+// Mode name as used on the command line ("float", "double", "mixed", "kahan")
+const char* precisionName(PrecisionMode mode);
+
+// Parse a mode name, returns false if it is unknown
+bool parsePrecision(const std::string& name, PrecisionMode& mode);
+
+template <typename Real>
+using AlignedVector = std::vector<Real, AlignedAllocator<Real>>;
+
+// SoA state in the storage type of a mode
+template <typename Real>
+struct PrecisionState {
+    size_t size = 0;
+    AlignedVector<Real> x, y, vx, vy, ax, ay, mass;
+    AlignedBytes pinned;
+
+    void resize(size_t n) {
+        size = n;
+        for (AlignedVector<Real>* a : { &x, &y, &vx, &vy, &ax, &ay, &mass }) a->resize(n);
+        pinned.resize(n);
+    }
+};
+
+// Accelerations of bodies [begin, end) from all bodies: pair terms in Real, summed in Accum.
+// Plain 1 / sqrt, cubed by multiplication, so float storage never goes through double. Scalar:
+// only the reference of measurePrecisionError() (double, Kahan-summed) runs it
+template <typename Real, typename Accum>
+void precision_forces_range(PrecisionState<Real>& s, size_t begin, size_t end, Real G, Real eps) {
+    const Real eps2 = eps * eps;
+    for (size_t i = begin; i < end; ++i) {
+        const Real xi = s.x[i], yi = s.y[i];
+        Accum sum_x = Accum(), sum_y = Accum();
+        for (size_t j = 0; j < s.size; ++j) {
+            if (j == i) continue;
+            const Real dx = s.x[j] - xi;
+            const Real dy = s.y[j] - yi;
+            const Real inv = Real(1) / std::sqrt(dx * dx + dy * dy + eps2);
+            const Real f = s.mass[j] * inv * inv * inv;
+            sum_x += dx * f;
+            sum_y += dy * f;
+        }
+        s.ax[i] = G * static_cast<Real>(sum_x);
+        s.ay[i] = G * static_cast<Real>(sum_y);
+    }
+}
+
+// Semi-implicit Euler over bodies [begin, end), as integrate_bodies: pinned bodies stay, wrap at edges
+template <typename Real>
+void precision_integrate_range(PrecisionState<Real>& s, size_t begin, size_t end, Real dt, int width, int height) {
+    const Real half_w = static_cast<Real>(width / 2);
+    const Real half_h = static_cast<Real>(height / 2);
+    for (size_t i = begin; i < end; ++i) {
+        if (s.pinned[i]) continue;
+        s.vx[i] += s.ax[i] * dt;
+        s.vy[i] += s.ay[i] * dt;
+        Real x = s.x[i] + s.vx[i] * dt;
+        Real y = s.y[i] + s.vy[i] * dt;
+        if (x < -half_w) x += width;
+        else if (x > half_w) x -= width;
+        if (y < -half_h) y += height;
+        else if (y > half_h) y -= height;
+        s.x[i] = x;
+        s.y[i] = y;
+    }
+}
+
+// Engine settings
+struct PrecisionOptions {
+    PrecisionMode mode = PrecisionMode::Float;
+    size_t threads = 0;    // worker threads, 0 = all hardware threads
+    SimdKernel kernel = detectSimdKernel();
+};
+
+// Accuracy of the run since init
+struct PrecisionStats {
+    uint64_t steps = 0;
+    double initial_energy = 0.0;   // softened total energy before the first step (in double)
+    double energy_error = 0.0;     // (E - E0) / |E0| at the last measurement
+    double force_rms_error = 0.0;  // relative acceleration error against a double / Kahan reference
+    double force_max_error = 0.0;
+};
+
+// Create the thread pool and state for n_bodies in the given mode
+bool initPrecisionComputation(size_t n_bodies, const PrecisionOptions& options);
+
+// One step (StepFunction signature). The state stays in the mode's storage type between calls;
+// it is only reloaded from bodies when they no longer match what the last call wrote back
+void runPrecisionComputation(std::vector<Body>& bodies,
+                             const float G,
+                             const float eps,
+                             const float dt,
+                             const int width,
+                             const int height);
+
+// 'steps' steps with one load / store (BatchStepFunction signature)
+void runPrecisionSubsteps(std::vector<Body>& bodies,
+                          const float G,
+                          const float eps,
+                          const float dt,
+                          const int width,
+                          const int height,
+                          const int steps);
+
+// Measure the energy error of the current state and the force error of up to 'samples' bodies
+void measurePrecisionError(size_t samples);
+
+const PrecisionStats& precisionStats();
+
+// Release the engine's storage and threads
+void cleanupPrecisionComputation();
+
+#endif
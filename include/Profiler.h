@@ -0,0 +1,82 @@
+// File: Profiler.h
+// Declares the phase profiler: scoped CPU timers and OpenCL event timestamps, kept as rolling
+// p50/p99 statistics and as a trace that can be exported for chrome://tracing or Perfetto.
+// Everything is recorded only in builds with NBODY_PROFILING (CMake option of the same name);
+// without it the macros expand to nothing and the functions below are empty stubs
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+typedef struct _cl_event* cl_event;
+
+// Rolling statistics of one phase over its most recent PROFILE_WINDOW samples
+struct ProfileSummary {
+    std::string name;
+    uint64_t count = 0;        // samples since the profiler started
+    double p50_ms = 0.0;
+    double p99_ms = 0.0;
+    double mean_ms = 0.0;
+    double total_ms = 0.0;     // over all samples
+};
+
+constexpr size_t PROFILE_WINDOW = 1024;
+
+// Nanoseconds on the profiler's clock (steady_clock)
+inline uint64_t profileNow() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Record one completed phase on the calling thread; 'name' must outlive the profiler (a literal)
+void profileRecord(const char* name, uint64_t begin_ns, uint64_t end_ns);
+
+// Hand over an OpenCL event (retained until its timestamps are read). The queue must have been
+// created with CL_QUEUE_PROFILING_ENABLE; times are mapped onto the host clock through the moment
+// of this call, which is taken as the moment the command was queued
+void profileGpuEvent(const char* name, cl_event event);
+
+// Label the calling thread's track in the trace
+void profileThreadName(const char* name);
+
+// Read the timestamps of every finished OpenCL event handed over so far
+void profileCollectGpu();
+
+// Per-phase statistics, sorted by total time
+std::vector<ProfileSummary> profileSummary();
+void printProfileSummary(std::ostream& out);
+
+// Write everything recorded so far as Chrome trace event JSON; false without NBODY_PROFILING
+bool writeChromeTrace(const std::string& path);
+
+// Times a scope
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name) : m_name(name), m_begin(profileNow()) {}
+    ~ProfileScope() { profileRecord(m_name, m_begin, profileNow()); }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    const char* m_name;
+    uint64_t m_begin;
+};
+
+#define NBODY_PROFILE_CONCAT_(a, b) a##b
+#define NBODY_PROFILE_CONCAT(a, b) NBODY_PROFILE_CONCAT_(a, b)
+
+#ifdef NBODY_PROFILING
+#define NBODY_PROFILE_SCOPE(name) ProfileScope NBODY_PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define NBODY_PROFILE_GPU_EVENT(name, event) profileGpuEvent(name, event)
+#else
+#define NBODY_PROFILE_SCOPE(name) ((void)0)
+#define NBODY_PROFILE_GPU_EVENT(name, event) ((void)0)
+#endif
+
+#endif
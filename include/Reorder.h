@@ -0,0 +1,66 @@
+// File: Reorder.h
+// Declares the spatial reordering stage: every K steps the bodies are re-sorted along a
+// space-filling curve, so that bodies close in space are also close in memory. The sort is a
+// stable radix sort over the body index, and Body::id travels with every body, so a body can
+// still be followed across reorders and in snapshots
+
+#ifndef REORDER_H
+#define REORDER_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "Body.h"
+#include "MortonOrder.h"   // MortonScratch
+#include "NBody.h"         // BatchStepFunction
+
+class ThreadPool;
+
+// Curve the bodies are sorted along
+enum class SpaceCurve {
+    Morton,    // Z-order: cheapest keys, but jumps between quadrants
+    Hilbert    // consecutive keys are always neighbouring cells, slightly better locality
+};
+
+// Curve name as used on the command line ("morton", "hilbert")
+const char* spaceCurveName(SpaceCurve curve);
+
+// Parse a curve name, returns false if it is unknown
+bool parseSpaceCurve(const std::string& name, SpaceCurve& curve);
+
+// Stage settings
+struct ReorderOptions {
+    uint64_t every = 64;                    // steps between reorders, counted from the first call
+    SpaceCurve curve = SpaceCurve::Morton;
+    size_t threads = 0;                     // workers for keys, sort and gather, 0 = all hardware threads
+};
+
+// Reusable buffers, so a reorder does not allocate once sized
+struct ReorderScratch {
+    MortonScratch morton;
+    std::vector<uint32_t> keys;
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<Body> bodies;
+};
+
+// Stable order of the bodies along the curve: perm[k] is the index of the body that belongs at
+// position k; bodies with equal keys keep their relative order
+void spatialOrder(const std::vector<Body>& bodies, SpaceCurve curve, std::vector<uint32_t>& perm,
+                  ReorderScratch& scratch, ThreadPool& pool);
+
+// Move every body to its new position: bodies[k] = old bodies[perm[k]]
+void permuteBodies(std::vector<Body>& bodies, const std::vector<uint32_t>& perm,
+                   ReorderScratch& scratch, ThreadPool& pool);
+
+// Called with the permutation right after the bodies were reordered, for engines that keep their
+// own copy of the state between calls (permuteGpuState, permuteBlockTimestepState)
+using PermuteFunction = std::function<void(const std::vector<uint32_t>& perm)>;
+
+// Wrap an engine so that the bodies are re-sorted before every step that is a multiple of 'every'
+// (including the first). Batches are cut at those steps, as with_checkpoints does
+BatchStepFunction with_reordering(BatchStepFunction compute, const ReorderOptions& options,
+                                  PermuteFunction permute_state = nullptr);
+
+#endif
@@ -7,11 +7,20 @@
 #include <functional>
 #include <vector>
 #include "Body.h"
+#include "NBody.h"   // StepFunction, BatchStepFunction
 #include <SFML/Graphics.hpp>  // for sf::Color, sf::Time, etc.
 
+// How many simulation steps are advanced per presented frame
+struct SubstepOptions {
+    int substeps = 1;              // fixed steps per frame (starting value in adaptive mode)
+    bool adaptive = false;         // adjust the count every frame to fill the physics budget
+    int max_substeps = 256;        // upper bound in adaptive mode
+    float budget_fraction = 0.75f; // share of the frame time given to physics in adaptive mode
+};
+
 // Draws all bodies in a window, calling 'computations' each frame to update positions
 void render_bodies(
-    std::function<void(std::vector<Body>&, float, float, float, int, int)> computations,
+    StepFunction computations,
     std::vector<Body>& bodies,
     const float G,
     const float eps,
@@ -19,10 +28,31 @@ void render_bodies(
     const int width,
     const int height);
 
+// Same, advancing the simulation by several steps per frame as configured in 'substeps'
+void render_bodies(
+    BatchStepFunction computations,
+    std::vector<Body>& bodies,
+    const float G,
+    const float eps,
+    const float dt,
+    const int width,
+    const int height,
+    const SubstepOptions& substeps);
+
+// Runs the engine on its own thread (see SimulationThread) and draws the newest published snapshot
+// each frame; 'substeps' sets the steps between snapshots, adaptive mode sizes them to about one
+// frame. On return bodies hold what SimulationThread::stop() leaves in them
+void render_bodies_threaded(
+    BatchStepFunction computations,
+    std::vector<Body>& bodies,
+    const float G,
+    const float eps,
+    const float dt,
+    const int width,
+    const int height,
+    const SubstepOptions& substeps);
+
 // Maps a body's mass to an SFML color for visualization
 sf::Color mass_to_color(float mass);
 
-// Computes the circular orbital speed for mass M at distance r
-float orbital_velocity_scalar(float M, float r);
-
 #endif // SFML_H
\ No newline at end of file
@@ -0,0 +1,114 @@
+// File: SimdComputation.h
+// Declares the vectorized structure-of-arrays CPU engine (scalar, AVX2 and AVX-512 kernels)
+
+#ifndef SIMD_COMPUTATION_H
+#define SIMD_COMPUTATION_H
+
+#include <cstdint>
+#include <vector>
+#include "Body.h"
+
+// Force kernels available to the SIMD engine, selected at runtime
+enum class SimdKernel {
+    Scalar,
+    AVX2,
+    AVX512
+};
+
+// Best kernel supported by the running CPU (checked through CPUID)
+SimdKernel detectSimdKernel();
+
+// True if the running CPU can execute the given kernel
+bool simdKernelSupported(SimdKernel kernel);
+
+// Human readable kernel name ("scalar", "avx2", "avx512")
+const char* simdKernelName(SimdKernel kernel);
+
+// Compensated sum: c carries the low-order bits lost by the last addition and feeds them back
+// into the next one, so the error stays O(eps) instead of O(n eps). Needs strict IEEE evaluation
+// (no -ffast-math), otherwise the compiler may simplify the compensation away
+template <typename T>
+struct KahanSum {
+    T sum = T(0);
+    T c = T(0);
+
+    KahanSum& operator+=(T value) {
+        const T y = value - c;
+        const T t = sum + y;
+        c = (t - sum) - y;
+        sum = t;
+        return *this;
+    }
+    operator T() const { return sum; }
+};
+
+// Add the acceleration due to sources [j_begin, j_end) to targets [begin, end) (one tile of the N x N matrix)
+void simd_accumulate_forces_tile(BodiesSOA& soa, size_t begin, size_t end, size_t j_begin, size_t j_end,
+                                 const float G, const float eps, SimdKernel kernel);
+
+// The same tile on plain float arrays, with every target row summed in Accum: float (what the call
+// above runs), double or KahanSum<float>. Pair terms stay float. Instantiated for those three
+template <typename Accum>
+void simd_accumulate_forces_tile(const float* x, const float* y, const float* m, float* ax, float* ay,
+                                 size_t begin, size_t end, size_t j_begin, size_t j_end,
+                                 const float G, const float eps, SimdKernel kernel);
+
+// The same tile on double arrays: pair terms and sums in double, exact 1 / sqrt
+void simd_accumulate_forces_tile(const double* x, const double* y, const double* m, double* ax, double* ay,
+                                 size_t begin, size_t end, size_t j_begin, size_t j_end,
+                                 const double G, const double eps, SimdKernel kernel);
+
+// Separate list of bodies that pull, for targets that are not all sources themselves (tracers).
+// Every source has its own squared softening, and the index of the body it is in the target
+// arrays (-1 for a fixed potential, which is never a target) so the self term can be skipped
+struct ForceSources {
+    AlignedFloats x;
+    AlignedFloats y;
+    AlignedFloats mass;
+    AlignedFloats eps2;
+    std::vector<int32_t, AlignedAllocator<int32_t>> id;
+
+    size_t size() const { return x.size(); }
+    void clear();
+    void add(float sx, float sy, float smass, float seps2, int32_t sid);
+};
+
+// Add the pull of every source to the accelerations of targets [begin, end): N_targets x N_sources
+// interactions, vectorized over the targets
+void simd_accumulate_source_forces(BodiesSOA& soa, size_t begin, size_t end, const ForceSources& sources,
+                                   const float G, SimdKernel kernel);
+
+// Compute accelerations of bodies [begin, end) due to all bodies, writing soa.ax / soa.ay
+void simd_compute_forces_range(BodiesSOA& soa, size_t begin, size_t end, const float G, const float eps, SimdKernel kernel);
+
+// Compute accelerations of every body
+void simd_compute_forces(BodiesSOA& soa, const float G, const float eps, SimdKernel kernel);
+
+// Integrate bodies [begin, end) over timestep dt and wrap around edges, skipping pinned bodies
+void simd_integrate_range(BodiesSOA& soa, size_t begin, size_t end, const float dt, const int width, const int height);
+
+// Same as simd_integrate_range but writes the new positions to x_out / y_out, so other threads
+// can keep reading the old positions from soa while the step is still in progress
+void simd_integrate_range_into(BodiesSOA& soa, float* x_out, float* y_out, size_t begin, size_t end,
+                               const float dt, const int width, const int height);
+
+// Integrate every body
+void simd_integrate_bodies(BodiesSOA& soa, const float dt, const int width, const int height);
+
+// Prepare SoA storage for n_bodies and pick the kernel (detectSimdKernel() by default),
+// returns false if the CPU cannot run the requested kernel
+bool initSimdComputation(size_t n_bodies, SimdKernel kernel);
+bool initSimdComputation(size_t n_bodies);
+
+// Run one SIMD simulation step (forces + integration), updating the bodies vector
+void runSimdComputation(std::vector<Body>& bodies,
+                        const float G,
+                        const float eps,
+                        const float dt,
+                        const int width,
+                        const int height);
+
+// Release the SoA storage allocated by initSimdComputation
+void cleanupSimdComputation();
+
+#endif
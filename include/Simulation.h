@@ -0,0 +1,78 @@
+// File: Simulation.h
+// Declares Simulation, one self-contained N-body system: bodies, run parameters and engine state
+// live in the object and nowhere else, so a process can hold any number of them (parameter
+// sweeps, tests, the baseline of the ensemble driver). Engines: the reference CPU step, the SIMD
+// kernels on one thread, the multithreaded SIMD engine on the simulation's own ParallelEngine
+// (pool included), and OpenCL through its own GpuEngine.
+//
+// The other engines (Barnes-Hut, particle-mesh, block time steps, integrators, precision, tracer,
+// hybrid, distributed) still keep their state in file-level statics, so Simulation does not offer them
+
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "Body.h"
+#include "GpuComputation.h"
+#include "ParallelComputation.h"
+#include "SimdComputation.h"
+#include "Snapshot.h"   // SnapshotInfo
+
+// Step implementation of a Simulation
+enum class SimulationEngine {
+    Cpu,    // runCpuComputation on the bodies
+    Simd,       // SIMD force and integration kernels on a private SoA copy, single-threaded
+    Parallel,   // the same SoA copy stepped by a private ParallelEngine and its thread pool
+    Gpu         // device-resident OpenCL steps on a private GpuEngine
+};
+
+// Engine name as used on the command line ("cpu", "simd", "parallel", "gpu")
+const char* simulationEngineName(SimulationEngine engine);
+
+// Parse an engine name, returns false if it is unknown
+bool parseSimulationEngine(const std::string& name, SimulationEngine& engine);
+
+struct SimulationOptions {
+    SimulationEngine engine = SimulationEngine::Cpu;
+    SimdKernel kernel = detectSimdKernel();   // Simd
+    ParallelOptions parallel;                 // Parallel: threads, symmetric mode, tiles, kernel
+    GpuOptions gpu;                           // Gpu: device, kernel variant, launch geometry
+};
+
+class Simulation {
+public:
+    // Take over the bodies and run parameters (G, eps, dt, box, step count and time); prints the
+    // cause and returns null if the engine cannot be set up
+    static std::unique_ptr<Simulation> create(std::vector<Body> bodies, const SnapshotInfo& run,
+                                              const SimulationOptions& options);
+
+    Simulation(const Simulation&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
+
+    // Advance by 'steps' steps of run().dt; false if the OpenCL engine rejected a launch (the
+    // state then stays where it was before this call)
+    bool step(int steps = 1);
+
+    // Current state; the SIMD, parallel and OpenCL engines copy it back on the first call after a step
+    const std::vector<Body>& bodies();
+
+    // Run parameters, with the step count and simulated time of the current state
+    const SnapshotInfo& run() const { return m_run; }
+
+    SimulationEngine engine() const { return m_options.engine; }
+
+private:
+    Simulation(std::vector<Body> bodies, const SnapshotInfo& run, const SimulationOptions& options);
+
+    std::vector<Body> m_bodies;
+    SnapshotInfo m_run;
+    SimulationOptions m_options;
+    BodiesSOA m_soa;                              // Simd, Parallel
+    std::unique_ptr<ParallelEngine> m_parallel;   // Parallel
+    std::unique_ptr<GpuEngine> m_gpu;             // Gpu
+    bool m_stale = false;                         // m_bodies is behind the engine's copy
+};
+
+#endif
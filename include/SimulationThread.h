@@ -0,0 +1,88 @@
+// File: SimulationThread.h
+// Runs an engine on its own thread and publishes body snapshots through a lock-free triple buffer
+
+#ifndef SIMULATION_THREAD_H
+#define SIMULATION_THREAD_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include "Body.h"
+#include "NBody.h"          // BatchStepFunction
+#include "TripleBuffer.h"
+
+// What the renderer needs from one simulation state
+struct BodySnapshot {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> mass;
+    uint64_t step = 0;      // simulation steps completed when the snapshot was taken
+};
+
+// Step count for the next batch: as many steps as fit into 'budget' seconds at the smoothed
+// per-step cost, growing at most 2x per batch. 'seconds' is what the last batch of 'steps' took;
+// step_cost carries the smoothed cost between calls (start it at 0)
+int adaptSubsteps(int steps, float seconds, float budget, int max_steps, float& step_cost);
+
+// Steps the engine as fast as it can on a dedicated thread. After every batch of
+// 'steps_per_snapshot' steps the positions are copied into the triple buffer, so the consumer
+// (the render loop) never blocks the simulation and the simulation never blocks the consumer.
+// The bodies vector belongs to the thread between start() and stop()
+class SimulationThread {
+public:
+    SimulationThread(BatchStepFunction compute,
+                     std::vector<Body>& bodies,
+                     float G,
+                     float eps,
+                     float dt,
+                     int width,
+                     int height,
+                     int steps_per_snapshot = 1);
+    ~SimulationThread();
+
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+
+    // Instead of a fixed batch, size every batch to take about 'batch_seconds' (at most max_steps
+    // steps), starting from steps_per_snapshot. Call before start()
+    void adapt(float batch_seconds, int max_steps);
+
+    void start();
+    // Join the thread. bodies then hold what the engine left in them after its last completed
+    // batch: the full state for host engines, but only positions for the resident OpenCL engine,
+    // one batch behind, with the velocities of the last upload (downloadGpuState has the rest)
+    void stop();
+
+    // Consumer side: switch to the newest snapshot, false if nothing new was published
+    bool acquire() { return m_buffer.update(); }
+    const BodySnapshot& snapshot() const { return m_buffer.read_buffer(); }
+
+    // Counters, safe to read from any thread
+    uint64_t steps() const { return m_steps.load(std::memory_order_relaxed); }
+    uint64_t published() const { return m_published.load(std::memory_order_relaxed); }
+    uint64_t skipped() const { return m_skipped.load(std::memory_order_relaxed); }   // overwritten before being read
+    int batch() const { return m_batch.load(std::memory_order_relaxed); }             // steps in the current batch
+
+private:
+    void run();
+    void publish();
+
+    BatchStepFunction m_compute;
+    std::vector<Body>& m_bodies;
+    float m_G, m_eps, m_dt;
+    int m_width, m_height;
+    int m_steps_per_snapshot;
+    float m_batch_seconds = 0.f;   // > 0: adaptive batches
+    int m_max_steps = 1;
+
+    TripleBuffer<BodySnapshot> m_buffer;
+    std::thread m_thread;
+    std::atomic<bool> m_stop{ false };
+    std::atomic<uint64_t> m_steps{ 0 };
+    std::atomic<uint64_t> m_published{ 0 };
+    std::atomic<uint64_t> m_skipped{ 0 };
+    std::atomic<int> m_batch{ 1 };
+};
+
+#endif
@@ -0,0 +1,176 @@
+// File: Snapshot.h
+// Declares the binary snapshot format, its memory-mapped reader and the background checkpoint writer
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Body.h"
+#include "NBody.h"   // BatchStepFunction
+
+// File layout (little-endian): a 128-byte SnapshotHeader followed by the arrays x, y, vx, vy, mass
+// of n floats each, (since version 2) n pinned bytes and (since version 3) n uint32 body ids,
+// every array starting on a 64-byte boundary. Uncompressed files can therefore be mapped and used
+// in place. Compressed files hold one zlib stream of the same padded block
+constexpr char SNAPSHOT_MAGIC[8] = { 'N', 'B', 'O', 'D', 'Y', 'S', 'N', 'P' };
+constexpr uint32_t SNAPSHOT_VERSION = 3;
+constexpr uint32_t SNAPSHOT_COMPRESSED = 1u << 0;
+constexpr int SNAPSHOT_ARRAYS = 7;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;            // SNAPSHOT_COMPRESSED
+    uint64_t n;                // bodies
+    uint64_t step;             // steps taken since the initial conditions
+    double time;               // simulated time
+    float G;
+    float eps;
+    float dt;
+    int32_t width;             // box the positions wrap in
+    int32_t height;
+    uint32_t reserved0;
+    uint64_t payload_bytes;    // bytes after the header (compressed size for compressed files)
+    uint8_t reserved[56];
+};
+static_assert(sizeof(SnapshotHeader) == 128, "snapshot header must stay 128 bytes");
+
+// Run parameters stored with a snapshot
+struct SnapshotInfo {
+    uint64_t step = 0;
+    double time = 0.0;
+    float G = 1.f;
+    float eps = 0.1f;
+    float dt = 0.1f;
+    int width = 0;
+    int height = 0;
+};
+
+// Byte offset of array 'index' (0 = x ... 4 = mass, 5 = pinned, 6 = id) from the end of the header, and
+// the size of the whole padded block in a file of the given version
+size_t snapshotArrayOffset(size_t n, int index);
+size_t snapshotPayloadBytes(size_t n, uint32_t version = SNAPSHOT_VERSION);
+
+// Write a snapshot to 'path' through a temporary file and a rename, so a reader (or a restart
+// after the process was killed) never sees a half-written file. Compression needs zlib
+bool writeSnapshot(const std::string& path, const BodiesSOA& soa, const SnapshotInfo& info, bool compress);
+
+// Read-only view of a snapshot file. Uncompressed files are mapped and the array pointers point
+// into the mapping (zero copy); compressed files are inflated into memory owned by the view
+class MappedSnapshot {
+public:
+    MappedSnapshot() = default;
+    ~MappedSnapshot();
+
+    MappedSnapshot(const MappedSnapshot&) = delete;
+    MappedSnapshot& operator=(const MappedSnapshot&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    size_t size() const { return m_n; }
+    const SnapshotInfo& info() const { return m_info; }
+    bool compressed() const { return m_compressed; }
+
+    const float* x() const { return array(0); }
+    const float* y() const { return array(1); }
+    const float* vx() const { return array(2); }
+    const float* vy() const { return array(3); }
+    const float* mass() const { return array(4); }
+
+    // Pinned flags, nullptr for version 1 files, which predate them
+    const uint8_t* pinned() const { return m_version >= 2 ? bytes(5) : nullptr; }
+
+    // Body ids, nullptr for files before version 3 (bodies were never reordered then)
+    const uint32_t* ids() const { return m_version >= 3 ? reinterpret_cast<const uint32_t*>(bytes(6)) : nullptr; }
+
+private:
+    const unsigned char* bytes(int index) const;
+    const float* array(int index) const { return reinterpret_cast<const float*>(bytes(index)); }
+
+    void* m_map = nullptr;
+    size_t m_map_bytes = 0;
+    const unsigned char* m_payload = nullptr;
+    AlignedFloats m_inflated;
+    size_t m_n = 0;
+    uint32_t m_version = 0;
+    SnapshotInfo m_info;
+    bool m_compressed = false;
+};
+
+// Load a snapshot into bodies (accelerations zeroed); 'path' may also be a directory, in which
+// case the newest snapshot in it is used. Bodies of version 1 files are pinned if their mass is
+// at least 1000, the rule the engines used before the flag existed; files without ids number the
+// bodies in file order
+bool loadSnapshot(const std::string& path, std::vector<Body>& bodies, SnapshotInfo& info);
+
+// Newest snapshot (highest step) in a directory written by SnapshotWriter, "" if there is none
+std::string findLatestSnapshot(const std::string& directory);
+
+// Writes snapshots on a background thread. submit() copies the state into one of two buffers
+// and returns; the thread writes the other one meanwhile. If a submitted snapshot has not been
+// started when the next one arrives, it is replaced (the newer state wins), so the stepping
+// thread never waits for the disk. Files are named snapshot_<step>.nbs; only the newest 'keep'
+// are kept
+class SnapshotWriter {
+public:
+    SnapshotWriter(const std::string& directory, bool compress, int keep = 2);
+    ~SnapshotWriter();
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    // Queue a copy of the state for writing
+    void submit(const std::vector<Body>& bodies, const SnapshotInfo& info);
+    void submit(const BodiesSOA& soa, const SnapshotInfo& info);
+
+    // Block until every submitted snapshot is on disk
+    void flush();
+
+    uint64_t written() const;
+    uint64_t replaced() const;
+
+private:
+    struct Slot {
+        BodiesSOA soa{ 0 };
+        SnapshotInfo info;
+    };
+
+    template <typename Fill>
+    void submit_with(Fill fill);
+    void writer_loop();
+    void remove_old();
+
+    std::string m_directory;
+    bool m_compress;
+    int m_keep;
+
+    Slot m_slots[2];
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+    int m_pending = -1;     // slot waiting to be written
+    int m_writing = -1;     // slot the thread is writing
+    uint64_t m_written = 0;
+    uint64_t m_replaced = 0;
+    bool m_stop = false;
+    std::thread m_thread;
+};
+
+// Brings the full state of an engine that keeps it elsewhere (velocities and current positions of the
+// resident OpenCL engine) back into the bodies; false if that failed
+using SyncFunction = std::function<bool(std::vector<Body>& bodies)>;
+
+// Wrap an engine so that every 'every' steps the state is handed to 'writer'. 'info' carries the
+// run parameters and the step count so far; its step and time advance with the wrapped engine.
+// 'sync', if set, runs before every snapshot; a checkpoint whose sync fails is skipped
+BatchStepFunction with_checkpoints(BatchStepFunction compute, SnapshotWriter& writer, SnapshotInfo info, uint64_t every,
+                                   SyncFunction sync = nullptr);
+
+#endif
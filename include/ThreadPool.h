@@ -0,0 +1,87 @@
+// File: ThreadPool.h
+// Declares a persistent work-stealing thread pool used by the multithreaded CPU engines
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of worker threads that execute batches of indexed tasks.
+// Each batch is split into per-worker deques; a worker drains its own deque from the front
+// and, once empty, steals from the back of the others so uneven tasks still balance.
+// The calling thread takes part as worker 0, so a pool of size 1 has no extra threads.
+class ThreadPool {
+public:
+    // threads == 0 uses std::thread::hardware_concurrency()
+    explicit ThreadPool(size_t threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of workers, including the calling thread
+    size_t size() const { return m_workers; }
+
+    // Run task(t, worker) for every t in [0, n_tasks) and block until all have finished.
+    // The callable is only referenced, never copied, so dispatching a batch does not allocate
+    template <typename F>
+    void run(size_t n_tasks, F&& task)
+    {
+        using Callable = typename std::remove_reference<F>::type;
+        run_tasks(n_tasks,
+                  [](void* ctx, size_t t, size_t worker) { (*static_cast<Callable*>(ctx))(t, worker); },
+                  const_cast<void*>(static_cast<const void*>(&task)));
+    }
+
+    // Split [0, n) into chunks of at most 'grain' items and run body(begin, end, worker) on each
+    template <typename F>
+    void parallel_for(size_t n, size_t grain, F&& body)
+    {
+        grain = grain == 0 ? 1 : grain;
+        size_t chunks = (n + grain - 1) / grain;
+        run(chunks, [&](size_t c, size_t worker) {
+            size_t begin = c * grain;
+            size_t end = begin + grain < n ? begin + grain : n;
+            body(begin, end, worker);
+        });
+    }
+
+private:
+    using TaskFunction = void (*)(void* ctx, size_t task, size_t worker);
+
+    void run_tasks(size_t n_tasks, TaskFunction function, void* ctx);
+
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    void worker_loop(size_t worker);
+    void drain(size_t worker);
+    bool pop_local(size_t worker, size_t& task);
+    bool steal(size_t worker, size_t& task);
+
+    size_t m_workers;
+    std::vector<std::thread> m_threads;
+    std::vector<std::unique_ptr<WorkQueue>> m_queues;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    TaskFunction m_function = nullptr;
+    void* m_context = nullptr;
+    std::atomic<size_t> m_remaining{0};
+    size_t m_generation = 0;
+    size_t m_busy = 0;
+    bool m_stop = false;
+};
+
+#endif
@@ -0,0 +1,74 @@
+// File: TracerComputation.h
+// Declares the tracer engine: bodies are split into a few massive sources and massless (or
+// negligible-mass) tracers. Every body feels the sources, but only the sources pull, so a step
+// costs N_total x N_sources interactions instead of N^2. Pinned sources can be treated as fixed
+// analytic potentials, and further potentials can be added that have no body at all
+
+#ifndef TRACER_COMPUTATION_H
+#define TRACER_COMPUTATION_H
+
+#include <cstdint>
+#include <vector>
+#include "Body.h"
+#include "SimdComputation.h"   // ForceSources, SimdKernel
+
+// Fixed softened point-mass (Plummer) potential -G mass / sqrt(r^2 + softening^2)
+struct FixedPotential {
+    float x = 0.f;
+    float y = 0.f;
+    float mass = 0.f;
+    float softening = 0.f;     // core radius, 0 = the step's eps
+};
+
+// Engine settings
+struct TracerOptions {
+    float tracer_mass = 0.f;      // bodies with mass <= this are tracers: pulled, but pulling nothing
+    bool analytic_pinned = true;  // pinned sources become fixed potentials (never re-read from the bodies)
+    float pinned_softening = 0.f; // core radius of those potentials, 0 = the step's eps
+    std::vector<FixedPotential> potentials;   // extra potentials with no body, e.g. a halo
+    size_t threads = 0;           // worker threads, 0 = all hardware threads
+    SimdKernel kernel = detectSimdKernel();
+};
+
+// Shape of the last step
+struct TracerStats {
+    uint64_t steps = 0;
+    size_t sources = 0;        // massive bodies that pull, re-read every step
+    size_t potentials = 0;     // fixed potentials (analytic pinned bodies and TracerOptions::potentials)
+    size_t tracers = 0;
+};
+
+// Source list for the bodies: moving sources first (their positions are refreshed every step,
+// the count is returned in 'moving'), then pinned sources and the extra potentials. Sources that
+// are bodies carry the body's index, so they skip themselves as targets. With eps = 0 sources
+// without a softening of their own get eps2 = 0, which the OpenCL kernel reads as the step's eps
+void buildForceSources(const std::vector<Body>& bodies, const TracerOptions& options, float eps,
+                       ForceSources& sources, size_t& moving);
+
+// Create the thread pool and storage for n_bodies; false if the SIMD kernel is unsupported
+bool initTracerComputation(size_t n_bodies, const TracerOptions& options);
+bool initTracerComputation(size_t n_bodies);
+
+// One step (StepFunction signature)
+void runTracerComputation(std::vector<Body>& bodies,
+                          const float G,
+                          const float eps,
+                          const float dt,
+                          const int width,
+                          const int height);
+
+// 'steps' steps with one pack / unpack and one source list (BatchStepFunction signature)
+void runTracerSubsteps(std::vector<Body>& bodies,
+                       const float G,
+                       const float eps,
+                       const float dt,
+                       const int width,
+                       const int height,
+                       const int steps);
+
+const TracerStats& tracerStats();
+
+// Release the engine's storage and threads
+void cleanupTracerComputation();
+
+#endif
@@ -0,0 +1,91 @@
+// File: Transport.h
+// Declares the ring transports of the distributed engine: every rank sends to rank + 1 and
+// receives from rank - 1 (mod P). Implementations only provide a blocking exchange; overlapping
+// it with computation, barriers and gathers are built on top of that once, here
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Kind of link between the ranks
+enum class TransportKind {
+    Shm,   // POSIX shared memory mailboxes, ranks on one host
+    Tcp    // one TCP connection per ring edge, ranks on any hosts
+};
+
+// Transport name as used on the command line ("shm", "tcp")
+const char* transportName(TransportKind kind);
+
+// Parse a transport name, returns false if it is unknown
+bool parseTransport(const std::string& name, TransportKind& kind);
+
+class Transport {
+public:
+    Transport(int rank, int size) : m_rank(rank), m_size(size) {}
+    virtual ~Transport();
+
+    Transport(const Transport&) = delete;
+    Transport& operator=(const Transport&) = delete;
+
+    int rank() const { return m_rank; }
+    int size() const { return m_size; }
+
+    // Send send_bytes to the next rank and receive recv_bytes from the previous one, in the
+    // background on the transport's helper thread (started by the first call, kept until the
+    // transport is destroyed); neither buffer may be touched until finishShift() returns
+    void startShift(const void* send, size_t send_bytes, void* recv, size_t recv_bytes);
+    void finishShift();
+
+    // Blocking shift
+    void shift(const void* send, size_t send_bytes, void* recv, size_t recv_bytes);
+
+    // Every rank's 'bytes' bytes, in rank order, on every rank (P - 1 shifts around the ring)
+    void allGather(const void* mine, size_t bytes, void* all);
+
+    // Return once every rank has called it
+    void barrier();
+
+protected:
+    // The actual exchange, blocking; must not wait for the receive before the send has started,
+    // since every rank sends at the same time
+    virtual void exchange(const void* send, size_t send_bytes, void* recv, size_t recv_bytes) = 0;
+
+private:
+    // Helper thread body: runs every shift startShift() hands over until m_stop
+    void run_shifts();
+
+    int m_rank;
+    int m_size;
+
+    // the shift in flight; m_busy is set by startShift and cleared by the helper once it is done
+    const void* m_send = nullptr;
+    size_t m_send_bytes = 0;
+    void* m_recv = nullptr;
+    size_t m_recv_bytes = 0;
+    bool m_busy = false;
+    bool m_stop = false;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;   // startShift -> helper
+    std::condition_variable m_done;   // helper -> finishShift
+    std::thread m_helper;
+};
+
+// Shared memory ring for 'size' ranks on this host: a segment called 'name' (e.g. "/nbody-ring")
+// with two mailbox slots of 'max_bytes' per rank. Every rank opens the same name; the last rank to
+// detach removes it. Prints the cause and returns nullptr on failure
+std::unique_ptr<Transport> makeShmTransport(const std::string& name, int rank, int size, size_t max_bytes);
+
+// TCP ring over 'hosts' ("host:port" per rank, this rank listens on its own entry and connects to
+// the next); waits up to 'timeout_seconds' for the neighbours. Prints the cause and returns nullptr
+// on failure
+std::unique_ptr<Transport> makeTcpTransport(const std::vector<std::string>& hosts, int rank,
+                                            double timeout_seconds = 30.0);
+
+#endif
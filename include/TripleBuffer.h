@@ -0,0 +1,55 @@
+// File: TripleBuffer.h
+// Lock-free single-producer / single-consumer triple buffer for handing snapshots between threads
+
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+// Three slots: the producer owns 'back', the consumer owns 'front', and 'middle' is exchanged
+// atomically between them together with a flag telling whether it holds an unread snapshot.
+// Neither side ever waits: the producer always has a free slot to write into, and the consumer
+// always has the newest complete snapshot (older unread ones are dropped).
+template <typename T>
+class TripleBuffer {
+public:
+    // Slot the producer fills next
+    T& write_buffer() { return m_slots[m_back]; }
+
+    // Hand the filled slot to the consumer and take the middle one back for writing.
+    // Returns false if the snapshot it replaces was never picked up (i.e. it was skipped)
+    bool publish()
+    {
+        uint8_t previous = m_middle.exchange(static_cast<uint8_t>(m_back | FRESH), std::memory_order_acq_rel);
+        m_back = previous & INDEX;
+        return (previous & FRESH) == 0;
+    }
+
+    // Switch to the newest published snapshot; false (front unchanged) if nothing new arrived
+    bool update()
+    {
+        if ((m_middle.load(std::memory_order_relaxed) & FRESH) == 0) return false;
+        uint8_t previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+        m_front = previous & INDEX;
+        return true;
+    }
+
+    // Snapshot the consumer currently reads
+    const T& read_buffer() const { return m_slots[m_front]; }
+
+    // Direct slot access for setup before both threads start (e.g. to pre-size every slot)
+    T& slot(int i) { return m_slots[i]; }
+
+private:
+    static constexpr uint8_t INDEX = 0x3;
+    static constexpr uint8_t FRESH = 0x4;
+
+    // producer, consumer and shared index on separate cache lines
+    T m_slots[3];
+    alignas(64) uint8_t m_back = 0;
+    alignas(64) uint8_t m_front = 1;
+    alignas(64) std::atomic<uint8_t> m_middle{ 2 };
+};
+
+#endif
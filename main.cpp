@@ -1,13 +1,24 @@
 // File: main.cpp
 // Entry point for N-Body simulation: sets up bodies, chooses CPU/GPU path, and starts rendering
 
+#include <algorithm>    // std::max
+#include <cstdlib>      // std::exit
 #include <iostream>     // std::cout, std::cin
+#include <memory>       // std::unique_ptr
+#include <string>       // std::string, std::stoull, std::stof
 #include <vector>       // std::vector
-#include <random>       // std::mt19937
-#include "Body.h"       // randomBody(), centralBody(), Body
+#include "Body.h"       // Body
+#include "InitialConditions.h"  // generateBodies()
 #include "NBody.h"      // compute_forces(), integrate_bodies(), G, eps, dt (if you’ve exposed them here)
 #include "SFML.h"       // render_bodies()
 #include "GpuComputation.h"
+#include "Integrators.h"  // initIntegratorComputation(), runIntegratorSubsteps()
+#include "Precision.h"    // initPrecisionComputation(), runPrecisionSubsteps()
+#include "Profiler.h"   // writeChromeTrace(), printProfileSummary()
+#include "Reorder.h"    // with_reordering()
+#include "Snapshot.h"   // loadSnapshot(), SnapshotWriter
+#include "TracerComputation.h"  // initTracerComputation(), runTracerSubsteps()
+#include "HybridComputation.h"  // initHybridComputation(), runHybridSubsteps()
 
 // Constants
 constexpr float G = 1.f;
@@ -19,38 +30,194 @@ constexpr float center_mass = 1000.f;
 const int WIDTH = 1920;
 const int HEIGHT = 1080;
 
-int main()
+int main(int argc, char** argv)
 {
-    // initialize random generator and create a set of bodies
+    // optional: start from a snapshot (or the newest one in a directory) and write checkpoints
+    std::string load_path, checkpoint_dir, trace_path;
+    uint64_t checkpoint_every = 1000;
+    bool compress = false;
+    ICPreset preset = ICPreset::Random;
+    uint64_t seed = 42;
+    bool use_integrator = false;
+    IntegratorScheme scheme = IntegratorScheme::LeapfrogKDK;
+    bool use_precision = false;
+    PrecisionMode precision = PrecisionMode::Float;
+    ReorderOptions reorder;
+    reorder.every = 0;
+    bool use_tracers = false;
+    TracerOptions tracers;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--load" && i + 1 < argc) load_path = argv[++i];
+        else if (arg == "--checkpoint" && i + 1 < argc) checkpoint_dir = argv[++i];
+        else if (arg == "--checkpoint-every" && i + 1 < argc) checkpoint_every = std::stoull(argv[++i]);
+        else if (arg == "--compress") compress = true;
+        else if (arg == "--trace" && i + 1 < argc) trace_path = argv[++i];
+        else if (arg == "--preset" && i + 1 < argc && parseICPreset(argv[i + 1], preset)) ++i;
+        else if (arg == "--seed" && i + 1 < argc) seed = std::stoull(argv[++i]);
+        else if (arg == "--integrator" && i + 1 < argc && parseIntegrator(argv[i + 1], scheme)) {
+            use_integrator = true;
+            ++i;
+        }
+        else if (arg == "--precision" && i + 1 < argc && parsePrecision(argv[i + 1], precision)) {
+            use_precision = true;
+            ++i;
+        }
+        else if (arg == "--reorder" && i + 1 < argc) reorder.every = std::stoull(argv[++i]);
+        else if (arg == "--curve" && i + 1 < argc && parseSpaceCurve(argv[i + 1], reorder.curve)) ++i;
+        else if (arg == "--tracers" && i + 1 < argc) {
+            tracers.tracer_mass = std::stof(argv[++i]);
+            use_tracers = true;
+        }
+        else {
+            std::cerr << "Usage: NBody [--preset random|uniform-disk|plummer|kepler-disk] [--seed <int>]\n"
+                         "             [--integrator euler|kdk|verlet|yoshida4] [--precision float|double|mixed|kahan]\n"
+                         "             [--reorder <steps>] [--curve morton|hilbert] [--tracers <max tracer mass>]\n"
+                         "             [--trace <file.json>] [--load <snapshot|directory>] [--checkpoint <directory>]\n"
+                         "             [--checkpoint-every <steps>] [--compress]\n";
+            return 1;
+        }
+    }
+
     std::vector<Body> bodies;
-    static std::mt19937 rng(42);
+    SnapshotInfo run;
+    run.G = G;
+    run.eps = eps;
+    run.dt = dt;
+    run.width = WIDTH;
+    run.height = HEIGHT;
 
-    for (int i = 0; i < n_bodies; ++i) {
-        bodies.push_back(randomBody(rng, WIDTH, HEIGHT));
+    if (!load_path.empty()) {
+        // a restart continues with the parameters the snapshot was written with
+        if (!loadSnapshot(load_path, bodies, run)) return 1;
+    }
+    else {
+        // n_bodies bodies plus the fixed central mass, generated in parallel
+        ICOptions ic;
+        ic.preset = preset;
+        ic.seed = seed;
+        ic.central_mass = center_mass;
+        ic.G = G;
+        bodies = generateBodies(n_bodies + 1, WIDTH, HEIGHT, ic);
     }
 
-    // create a central massive body at the simulation center
-    Body centerBody = centralBody(center_mass ,WIDTH, HEIGHT);
-    bodies.push_back(centerBody);
+    // checkpoints are written by a background thread every 'checkpoint_every' steps; with
+    // --reorder the bodies are also re-sorted along a space-filling curve every 'reorder.every'
+    // steps ('permute' follows the reorder in state an engine keeps on its own, 'sync' brings that
+    // state back before a checkpoint)
+    std::unique_ptr<SnapshotWriter> writer;
+    if (!checkpoint_dir.empty()) writer = std::make_unique<SnapshotWriter>(checkpoint_dir, compress);
+    auto staged = [&](BatchStepFunction compute, PermuteFunction permute, SyncFunction sync = nullptr) {
+        if (reorder.every > 0) compute = with_reordering(compute, reorder, permute);
+        return writer ? with_checkpoints(compute, *writer, run, checkpoint_every, sync) : compute;
+    };
 
-    // ask user whether to use GPU (OpenCL) acceleration
-    std::cout << "Do you want to render with OpenCL? (1/0)" << std::endl;
+    // ask user whether to use GPU (OpenCL) acceleration, or split every step between both
+    std::cout << "Do you want to render with OpenCL? (1/0, 2 = split between OpenCL and the CPU)" << std::endl;
     int open_cl_render;
     std::cin >> open_cl_render;
 
-    if (open_cl_render) {
+    // ask how many simulation steps to advance per rendered frame
+    std::cout << "Simulation steps per frame? (0 = adapt to the frame budget)" << std::endl;
+    int steps_per_frame = 1;
+    std::cin >> steps_per_frame;
+    SubstepOptions substeps;
+    substeps.adaptive = steps_per_frame <= 0;
+    substeps.substeps = std::max(1, steps_per_frame);
+
+    // ask whether physics should run on its own thread, decoupled from drawing
+    std::cout << "Run the simulation on a separate thread? (1/0)" << std::endl;
+    int threaded = 0;
+    std::cin >> threaded;
+
+    if (open_cl_render == 2) {
+        // device and CPU pool share the rows of every step; the split follows their measured speed
+        if (!initHybridComputation(bodies.size())) return 1;
+        // a rejected OpenCL command (cause already printed) leaves the bodies where they were, so
+        // the run ends instead of drawing a frozen frame
+        BatchStepFunction hybrid = [](std::vector<Body>& b, float G, float eps, float dt, int w, int h, int steps) {
+            if (!runHybridSubsteps(b, G, eps, dt, w, h, steps)) std::exit(1);
+        };
+        if (threaded)
+            render_bodies_threaded(staged(hybrid, nullptr), bodies, run.G, run.eps, run.dt,
+                                   run.width, run.height, substeps);
+        else
+            render_bodies(staged(hybrid, nullptr), bodies, run.G, run.eps, run.dt,
+                          run.width, run.height, substeps);
+        const HybridStats& stats = hybridStats();
+        std::cout << "hybrid: " << stats.steps << " steps, device share " << stats.device_share << "\n";
+        cleanupHybridComputation();
+    }
+    else if (open_cl_render) {
         // initialize GPU resources and run simulation on GPU
-        initGpuComputation(bodies.size());
+        GpuOptions gpu_options;
+        gpu_options.kernel = use_tracers ? GpuKernel::Tracer : GpuKernel::Fused;
+        gpu_options.precision = precision;
+        gpu_options.tracers = tracers;
+        if (!initGpuComputation(bodies.size(), gpu_options)) return 1;
 
-        // render loop: use GPU-accelerated computation to update and draw bodies
-        render_bodies(runGpuComputation, bodies, G, eps, dt, WIDTH, HEIGHT);
+        // render loop: state stays on the GPU, all substeps of a frame are queued at once and
+        // only the final positions come back for drawing. A rejected launch leaves the device
+        // state frozen (the cause is already printed), so the run ends instead of drawing it forever
+        BatchStepFunction gpu = [](std::vector<Body>& b, float G, float eps, float dt, int w, int h, int steps) {
+            if (!runGpuResidentSubsteps(b, G, eps, dt, w, h, steps)) std::exit(1);
+        };
+        // the host copy holds positions one batch behind and the velocities of the upload, so every
+        // checkpoint downloads the full device state first
+        if (threaded)
+            render_bodies_threaded(staged(gpu, permuteGpuState, downloadGpuState), bodies, run.G, run.eps, run.dt,
+                                   run.width, run.height, substeps);
+        else
+            render_bodies(staged(gpu, permuteGpuState, downloadGpuState), bodies, run.G, run.eps, run.dt,
+                          run.width, run.height, substeps);
         // clean up GPU resources after rendering
         cleanupGpuComputation();
     }
     else {
-        // run simulation on CPU and render
-        render_bodies(runCpuComputation, bodies, G, eps, dt, WIDTH, HEIGHT);
+        // run simulation on CPU and render: the reference step, the tracer engine, the direct sum
+        // in the chosen precision, or the SoA integrator engine
+        BatchStepFunction cpu = repeat_steps(runCpuComputation);
+        const bool tracer_engine = use_tracers && !use_precision && !use_integrator;
+        if (tracer_engine) {
+            initTracerComputation(bodies.size(), tracers);
+            cpu = runTracerSubsteps;
+        }
+        if (use_precision && !use_integrator) {
+            PrecisionOptions precision_options;
+            precision_options.mode = precision;
+            initPrecisionComputation(bodies.size(), precision_options);
+            cpu = runPrecisionSubsteps;
+        }
+        if (use_integrator) {
+            IntegratorOptions integrator_options;
+            integrator_options.scheme = scheme;
+            initIntegratorComputation(bodies.size(), integrator_options);
+            cpu = runIntegratorSubsteps;
+        }
+
+        if (threaded)
+            render_bodies_threaded(staged(cpu, nullptr), bodies, run.G, run.eps, run.dt,
+                                   run.width, run.height, substeps);
+        else
+            render_bodies(staged(cpu, nullptr), bodies, run.G, run.eps, run.dt,
+                          run.width, run.height, substeps);
+
+        if (use_integrator) {
+            measureIntegratorDrift();
+            const IntegratorStats& stats = integratorStats();
+            std::cout << integratorName(scheme) << ": " << stats.steps << " steps, relative energy error "
+                      << stats.energy_error << " (" << stats.energyDriftPerStep() << " per step), momentum error "
+                      << stats.momentum_error << "\n";
+            cleanupIntegratorComputation();
+        }
+        if (use_precision && !use_integrator) cleanupPrecisionComputation();
+        if (tracer_engine) cleanupTracerComputation();
     }
 
+    // per-phase p50 / p99 and a trace for chrome://tracing (profiling builds only)
+    if (!trace_path.empty()) {
+        printProfileSummary(std::cout);
+        writeChromeTrace(trace_path);
+    }
     return 0;
 }
\ No newline at end of file
@@ -1,9 +1,49 @@
 /* File: NBody.cl
  * OpenCL kernels for N-Body simulation:
  * - compute_forces: calculates gravitational accelerations for each body
- * - integrate_bodies: updates velocities and positions, skipping central mass, with wrap-around
+ * - integrate_bodies: updates velocities and positions, skipping pinned bodies, with wrap-around
+ * - pack_bodies / compute_forces_tiled / integrate_tiled: float4 bodies staged in local memory
+ * - step_tiled: fused tiled force + integration
+ * - gather_sources / tracer_step: massless tracers pulled by a short list of sources
+ * - ensemble_step: many independent small systems, one work-group each
  */
 
+/* Precision variants, selected by the host with -D (GpuOptions::precision). Buffers are float in
+ * every variant; only the arithmetic of the force sums changes:
+ *   (none)        float pair terms, float sums
+ *   ACCUM_DOUBLE  float pair terms summed in double                    (needs cl_khr_fp64)
+ *   ACCUM_KAHAN   float pair terms, Kahan-compensated float sums
+ *   PAIR_DOUBLE   pair terms and sums in double, from the float state  (needs cl_khr_fp64)
+ * ACC_ZERO declares an accumulator (plus its compensation term), ACC_ADD adds a real2 to it and
+ * ACC_VALUE reads it back as float2. Builds must not use -cl-fast-relaxed-math, which would let
+ * the compiler drop the compensation.
+ */
+#if defined(ACCUM_DOUBLE) || defined(PAIR_DOUBLE)
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#define ACC_ZERO(a) double2 a = (double2)(0.0)
+#define ACC_ADD(a, v) (a += convert_double2(v))
+#define ACC_VALUE(a) convert_float2(a)
+#elif defined(ACCUM_KAHAN)
+#define ACC_ZERO(a) float2 a = (float2)(0.0f), a##_c = (float2)(0.0f)
+#define ACC_ADD(a, v) do { float2 y_ = (v) - a##_c; float2 t_ = a + y_; a##_c = (t_ - a) - y_; a = t_; } while (0)
+#define ACC_VALUE(a) (a)
+#else
+#define ACC_ZERO(a) float2 a = (float2)(0.0f)
+#define ACC_ADD(a, v) (a += (v))
+#define ACC_VALUE(a) (a)
+#endif
+
+// Type of the pair arithmetic
+#ifdef PAIR_DOUBLE
+typedef double  real;
+typedef double2 real2;
+#define TO_REAL2(v) convert_double2(v)
+#else
+typedef float   real;
+typedef float2  real2;
+#define TO_REAL2(v) (v)
+#endif
+
 // Kernel to compute pairwise gravitational accelerations
 __kernel void compute_forces(
     __global float* x,
@@ -18,29 +58,30 @@ __kernel void compute_forces(
     int i = get_global_id(0);
     if (i >= n) return;
 
-    float axi = 0.0f;
-    float ayi = 0.0f;
+    real2 pi = TO_REAL2((float2)(x[i], y[i]));
+    real eps2 = (real)eps * eps;
+    ACC_ZERO(acc);
 
     // loop over all other bodies to accumulate force
     for (int j = 0; j < n; j++) {
         if (j == i) continue; // skip self
 
         // compute relative vector components
-        float dx = x[j] - x[i];
-        float dy = y[j] - y[i];
+        real2 d = TO_REAL2((float2)(x[j], y[j])) - pi;
         // compute softened inverse distance cubed
-        float inv_distance_cubed = pow(1/sqrt(pow(dx,2) + pow(dy,2) + pow(eps,2)), 3);
+        real inv_distance = 1 / sqrt(d.x * d.x + d.y * d.y + eps2);
+        real inv_distance_cubed = inv_distance * inv_distance * inv_distance;
 
         // gravitational force magnitude from body j
-        float f = G * mass[j] * inv_distance_cubed;
-        
+        real f = G * mass[j] * inv_distance_cubed;
+
         // accumulate acceleration contributions
-        axi += dx * f;
-        ayi += dy * f;
+        ACC_ADD(acc, d * f);
     }
 
-    ax[i] = axi;
-    ay[i] = ayi;
+    float2 a = ACC_VALUE(acc);
+    ax[i] = a.x;
+    ay[i] = a.y;
 }
 
 // Kernel to integrate body motion and apply toroidal wrapping
@@ -51,7 +92,7 @@ __kernel void integrate_bodies(
     __global float* vy,
     __global float* ax,
     __global float* ay,
-    __global float* mass,
+    __global const uchar* pinned,
     int n,
     float dt,
     int width,
@@ -60,8 +101,8 @@ __kernel void integrate_bodies(
     int i = get_global_id(0);
     if (i >= n) return;
 
-    // do not move the central massive body
-    if (mass[i] >= 1000.0f) return;
+    // pinned bodies (the central mass) stay fixed
+    if (pinned[i]) return;
 
     // update velocity by acceleration
     vx[i] += ax[i] * dt;
@@ -78,3 +119,342 @@ __kernel void integrate_bodies(
     if (y[i] < -height/2) y[i] += height;
     else if (y[i] > height/2) y[i] -= height;
 }
+
+/* Tiled kernels: bodies are packed as float4 (x, y, pinned, mass) and each work-group stages
+ * TILE_SIZE of them at a time in __local memory, so a body is read from global memory once per
+ * work-group instead of once per work-item. TILE_SIZE is set by the host with -D and must be a
+ * multiple of 4 (the inner loop is unrolled by four). Padding work-items (i >= n) still take part
+ * in the cooperative loads and barriers.
+ */
+#ifndef TILE_SIZE
+#define TILE_SIZE 64
+#endif
+
+// Pack the SoA positions, pinned flags and masses into the float4 layout used by the tiled kernels
+__kernel void pack_bodies(
+    __global const float* x,
+    __global const float* y,
+    __global const float* mass,
+    __global const uchar* pinned,
+    __global float4* body,
+    int n
+) {
+    int i = get_global_id(0);
+    if (i >= n) return;
+    body[i] = (float4)(x[i], y[i], pinned[i] ? 1.0f : 0.0f, mass[i]);
+}
+
+// Reordering of the resident state: out[k] = in[perm[k]], one launch per SoA array
+__kernel void gather_floats(
+    __global const float* in,
+    __global float* out,
+    __global const uint* perm,
+    int n
+) {
+    int k = get_global_id(0);
+    if (k >= n) return;
+    out[k] = in[perm[k]];
+}
+
+__kernel void gather_bytes(
+    __global const uchar* in,
+    __global uchar* out,
+    __global const uint* perm,
+    int n
+) {
+    int k = get_global_id(0);
+    if (k >= n) return;
+    out[k] = in[perm[k]];
+}
+
+// Softened pull of body bj on position pi, without G. Self (and zero-mass padding) contributes
+// nothing because dx = dy = 0 or mass = 0; r2 == 0 (eps = 0) is masked to avoid 0 * inf
+real2 body_pull(real2 pi, float4 bj, real eps2)
+{
+    real2 d = TO_REAL2(bj.xy) - pi;
+    real r2 = d.x * d.x + d.y * d.y + eps2;
+    real inv = rsqrt(r2);
+    real s = bj.w * inv * inv * inv;
+    s = (r2 > 0) ? s : 0;
+    return d * s;
+}
+
+// Sum of the pulls of all n bodies on body i, TILE_SIZE bodies per pass through local memory.
+// Must be reached by every work-item of the group because of the barriers
+float2 tiled_acceleration(__global const float4* body, int n, float eps,
+                          __local float4* tile, int i)
+{
+    int lid = get_local_id(0);
+    int lsize = get_local_size(0);
+    real2 pi = TO_REAL2((i < n) ? body[i].xy : (float2)(0.0f));
+    real eps2 = (real)eps * eps;
+    ACC_ZERO(acc);
+
+    for (int base = 0; base < n; base += TILE_SIZE) {
+        // cooperative load; slots past n get zero mass so the unrolled loop can overrun safely
+        for (int k = lid; k < TILE_SIZE; k += lsize) {
+            int j = base + k;
+            tile[k] = (j < n) ? body[j] : (float4)(0.0f);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        int count = min(TILE_SIZE, n - base);
+        for (int k = 0; k < count; k += 4) {
+            ACC_ADD(acc, body_pull(pi, tile[k],     eps2));
+            ACC_ADD(acc, body_pull(pi, tile[k + 1], eps2));
+            ACC_ADD(acc, body_pull(pi, tile[k + 2], eps2));
+            ACC_ADD(acc, body_pull(pi, tile[k + 3], eps2));
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    return ACC_VALUE(acc);
+}
+
+// Velocity and position update with toroidal wrapping; pinned bodies (b.z != 0) stay put
+float4 advance_body(float4 b, float2* v, float2 a, float dt, int width, int height)
+{
+    if (b.z != 0.0f) return b;
+
+    *v += a * dt;
+    b.xy += *v * dt;
+
+    if (b.x < -width/2) b.x += width;
+    else if (b.x > width/2) b.x -= width;
+
+    if (b.y < -height/2) b.y += height;
+    else if (b.y > height/2) b.y -= height;
+    return b;
+}
+
+// Tiled force kernel: writes G * acceleration to ax / ay
+__kernel void compute_forces_tiled(
+    __global const float4* body,
+    __global float* ax,
+    __global float* ay,
+    int n,
+    float G,
+    float eps,
+    __local float4* tile
+) {
+    int i = get_global_id(0);
+    float2 acc = tiled_acceleration(body, n, eps, tile, i);
+    if (i >= n) return;
+
+    ax[i] = G * acc.x;
+    ay[i] = G * acc.y;
+}
+
+// Integration for the tiled path: reads body_in, writes body_out and keeps the SoA x / y current
+// for readback
+__kernel void integrate_tiled(
+    __global const float4* body_in,
+    __global float4* body_out,
+    __global float* x,
+    __global float* y,
+    __global float* vx,
+    __global float* vy,
+    __global const float* ax,
+    __global const float* ay,
+    int n,
+    float dt,
+    int width,
+    int height
+) {
+    int i = get_global_id(0);
+    if (i >= n) return;
+
+    float2 v = (float2)(vx[i], vy[i]);
+    float4 b = advance_body(body_in[i], &v, (float2)(ax[i], ay[i]), dt, width, height);
+
+    body_out[i] = b;
+    x[i] = b.x;
+    y[i] = b.y;
+    vx[i] = v.x;
+    vy[i] = v.y;
+}
+
+// Fused force + integration in one launch. Other work-groups may still be reading body_in, so the
+// new state goes to body_out (the host swaps the two buffers every step)
+__kernel void step_tiled(
+    __global const float4* body_in,
+    __global float4* body_out,
+    __global float* x,
+    __global float* y,
+    __global float* vx,
+    __global float* vy,
+    __global float* ax,
+    __global float* ay,
+    int n,
+    float G,
+    float eps,
+    float dt,
+    int width,
+    int height,
+    __local float4* tile
+) {
+    int i = get_global_id(0);
+    float2 acc = G * tiled_acceleration(body_in, n, eps, tile, i);
+    if (i >= n) return;
+
+    float2 v = (float2)(vx[i], vy[i]);
+    float4 b = advance_body(body_in[i], &v, acc, dt, width, height);
+
+    body_out[i] = b;
+    x[i] = b.x;
+    y[i] = b.y;
+    vx[i] = v.x;
+    vy[i] = v.y;
+    ax[i] = acc.x;
+    ay[i] = acc.y;
+}
+
+/* Tracer kernels (GpuKernel::Tracer): only the sources pull. Sources are float4 (x, y, mass,
+ * eps2, where 0 stands for the step's eps^2) with the index of their body in source_id (-1 for
+ * fixed potentials); the moving ones come first and are refreshed from the SoA positions before
+ * every step. Targets read only their own position, so the step integrates in place.
+ */
+
+// Copy the current positions of the first n_moving sources out of the SoA
+__kernel void gather_sources(
+    __global const float* x,
+    __global const float* y,
+    __global float4* source,
+    __global const int* source_id,
+    int n_moving
+) {
+    int k = get_global_id(0);
+    if (k >= n_moving) return;
+    int i = source_id[k];
+    source[k].xy = (float2)(x[i], y[i]);
+}
+
+// Pull of every source on every body (TILE_SIZE sources staged in __local memory at a time),
+// then the same update as integrate_bodies
+__kernel void tracer_step(
+    __global const float4* source,
+    __global const int* source_id,
+    int n_sources,
+    __global float* x,
+    __global float* y,
+    __global float* vx,
+    __global float* vy,
+    __global float* ax,
+    __global float* ay,
+    __global const uchar* pinned,
+    int n,
+    float G,
+    float eps,
+    float dt,
+    int width,
+    int height,
+    __local float4* tile,
+    __local int* tile_id
+) {
+    int i = get_global_id(0);
+    int lid = get_local_id(0);
+    int lsize = get_local_size(0);
+    float eps2 = eps * eps;
+    float2 pi = i < n ? (float2)(x[i], y[i]) : (float2)(0.0f);
+    float2 acc = (float2)(0.0f);
+
+    for (int base = 0; base < n_sources; base += TILE_SIZE) {
+        int count = min(TILE_SIZE, n_sources - base);
+        for (int k = lid; k < count; k += lsize) {
+            tile[k] = source[base + k];
+            tile_id[k] = source_id[base + k];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int j = 0; j < count; ++j) {
+            float4 s = tile[j];
+            float2 d = s.xy - pi;
+            float r2 = d.x * d.x + d.y * d.y + (s.w > 0.0f ? s.w : eps2);
+            float inv = r2 > 0.0f ? rsqrt(r2) : 0.0f;
+            float f = tile_id[j] == i ? 0.0f : s.z * inv * inv * inv;
+            acc += d * f;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (i >= n) return;
+
+    acc *= G;
+    ax[i] = acc.x;
+    ay[i] = acc.y;
+    if (pinned[i]) return;
+
+    float2 v = (float2)(vx[i], vy[i]) + acc * dt;
+    float2 p = pi + v * dt;
+
+    if (p.x < -width/2) p.x += width;
+    else if (p.x > width/2) p.x -= width;
+
+    if (p.y < -height/2) p.y += height;
+    else if (p.y > height/2) p.y -= height;
+
+    vx[i] = v.x;
+    vy[i] = v.y;
+    x[i] = p.x;
+    y[i] = p.y;
+}
+
+/* Ensemble kernel (GpuKernel::Ensemble): independent systems packed into one batch. Work-group s
+ * steps system s alone, bodies [offset[s], offset[s + 1]), so a launch is one work-group per
+ * system and no system feels another. The float4 bodies are double-buffered as in step_tiled.
+ */
+__kernel void ensemble_step(
+    __global const float4* body_in,
+    __global float4* body_out,
+    __global float* x,
+    __global float* y,
+    __global float* vx,
+    __global float* vy,
+    __global float* ax,
+    __global float* ay,
+    __global const uint* offset,
+    float G,
+    float eps,
+    float dt,
+    int width,
+    int height,
+    __local float4* tile
+) {
+    int s = get_group_id(0);
+    int lid = get_local_id(0);
+    int lsize = get_local_size(0);
+    int begin = offset[s];
+    int end = offset[s + 1];
+    real eps2 = (real)eps * eps;
+
+    // work-item lid takes bodies begin + lid, begin + lid + lsize, ...; the whole group runs every
+    // pass because of the barriers
+    for (int first = begin; first < end; first += lsize) {
+        int i = first + lid;
+        real2 pi = TO_REAL2((i < end) ? body_in[i].xy : (float2)(0.0f));
+        ACC_ZERO(acc);
+
+        for (int base = begin; base < end; base += TILE_SIZE) {
+            for (int k = lid; k < TILE_SIZE; k += lsize) {
+                int j = base + k;
+                tile[k] = (j < end) ? body_in[j] : (float4)(0.0f);
+            }
+            barrier(CLK_LOCAL_MEM_FENCE);
+
+            int count = min(TILE_SIZE, end - base);
+            for (int k = 0; k < count; ++k) ACC_ADD(acc, body_pull(pi, tile[k], eps2));
+            barrier(CLK_LOCAL_MEM_FENCE);
+        }
+        if (i >= end) continue;
+
+        float2 a = G * ACC_VALUE(acc);
+        float2 v = (float2)(vx[i], vy[i]);
+        float4 b = advance_body(body_in[i], &v, a, dt, width, height);
+
+        body_out[i] = b;
+        x[i] = b.x;
+        y[i] = b.y;
+        vx[i] = v.x;
+        vy[i] = v.y;
+        ax[i] = a.x;
+        ay[i] = a.y;
+    }
+}
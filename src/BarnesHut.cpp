@@ -0,0 +1,370 @@
+// File: BarnesHut.cpp
+// Implements the Barnes-Hut quadtree engine
+//  - bodies are sorted by 16+16 bit Morton key, so every tree cell owns a contiguous range of them
+//  - the top levels of the tree are built serially, the subtrees below in parallel into per-task
+//    arenas which are then stitched into the main arena; all arenas keep their capacity between
+//    steps, so steady-state stepping does not allocate nodes
+//  - traversal runs in parallel over the Morton-sorted bodies (neighbouring bodies walk similar paths)
+
+#include <algorithm>  // for std::lower_bound, std::min, std::max, std::fill
+#include <cmath>      // for std::sqrt
+#include <cstdint>    // for uint32_t
+#include <memory>     // for std::unique_ptr
+
+#include "BarnesHut.h"
+#include "MortonOrder.h"
+#include "Profiler.h"
+#include "SimdComputation.h"
+#include "ThreadPool.h"
+
+// One quadtree cell. Children of a cell are stored next to each other in the arena
+struct QuadNode {
+    float com_x;            // center of mass
+    float com_y;
+    float mass;             // total mass
+    float x0;               // lower corner and side of the cell
+    float y0;
+    float size;
+    uint32_t first_child;   // arena index of the first child
+    uint32_t child_count;   // 0 for a leaf
+    uint32_t begin;         // range of Morton-sorted bodies inside the cell
+    uint32_t end;
+};
+
+// A cell whose subtree is built by a parallel task
+struct DeferredCell {
+    uint32_t index;
+    int level;
+};
+
+// Barnes-Hut runtime state
+static std::unique_ptr<ThreadPool>          s_pool;
+static BarnesHutOptions                     s_options;
+static BodiesSOA                            s_soa(0);
+static MortonScratch                        s_scratch;
+static std::vector<uint32_t>                s_keys;
+static std::vector<uint32_t>                s_order;    // sorted position -> original body index
+static AlignedFloats                        s_sx, s_sy, s_sm;
+static AlignedFloats                        s_sax, s_say;
+static std::vector<QuadNode>                s_nodes;    // main arena
+static std::vector<std::vector<QuadNode>>   s_local;    // per-task arenas
+static std::vector<DeferredCell>            s_deferred;
+static std::vector<size_t>                  s_offsets;
+static int                                  s_defer_level = MORTON_BITS + 1;
+static std::vector<uint64_t>                s_walk_terms;  // per-worker interaction counts of the last walk
+static BarnesHutStats                       s_stats;
+
+// Center of mass of a range of sorted bodies
+static void leaf_mass(QuadNode& node) {
+    float m = 0.f, mx = 0.f, my = 0.f;
+    for (uint32_t b = node.begin; b < node.end; ++b) {
+        m += s_sm[b];
+        mx += s_sm[b] * s_sx[b];
+        my += s_sm[b] * s_sy[b];
+    }
+    node.mass = m;
+    node.com_x = m > 0.f ? mx / m : node.x0 + node.size * 0.5f;
+    node.com_y = m > 0.f ? my / m : node.y0 + node.size * 0.5f;
+}
+
+// Center of mass of a cell from its (already finished) children
+static void children_mass(QuadNode& node, const std::vector<QuadNode>& nodes) {
+    float m = 0.f, mx = 0.f, my = 0.f;
+    for (uint32_t c = node.first_child; c < node.first_child + node.child_count; ++c) {
+        m += nodes[c].mass;
+        mx += nodes[c].mass * nodes[c].com_x;
+        my += nodes[c].mass * nodes[c].com_y;
+    }
+    node.mass = m;
+    node.com_x = m > 0.f ? mx / m : node.x0 + node.size * 0.5f;
+    node.com_y = m > 0.f ? my / m : node.y0 + node.size * 0.5f;
+}
+
+// Split nodes[index] into its non-empty quadrants and recurse. The caller has set begin, end,
+// x0, y0 and size. Cells at 'defer_level' are recorded in s_deferred instead of being expanded
+static void build_node(std::vector<QuadNode>& nodes, uint32_t index, int level, int defer_level) {
+    QuadNode node = nodes[index];
+    node.first_child = 0;
+    node.child_count = 0;
+
+    if (node.end - node.begin <= s_options.leaf_size || level >= MORTON_BITS) {
+        leaf_mass(node);
+        nodes[index] = node;
+        return;
+    }
+    if (level == defer_level) {
+        nodes[index] = node;
+        s_deferred.push_back({ index, level });
+        return;
+    }
+
+    // the two key bits below the cell's prefix select the quadrant (bit 0: x, bit 1: y)
+    const int shift = 2 * (MORTON_BITS - 1 - level);
+    const uint32_t prefix = s_keys[node.begin] & ~static_cast<uint32_t>((uint64_t(4) << shift) - 1);
+    uint32_t bounds[5];
+    bounds[0] = node.begin;
+    bounds[4] = node.end;
+    for (uint32_t d = 1; d < 4; ++d) {
+        const uint32_t* split = std::lower_bound(s_keys.data() + node.begin, s_keys.data() + node.end,
+                                                 prefix | (d << shift));
+        bounds[d] = static_cast<uint32_t>(split - s_keys.data());
+    }
+
+    const float half = node.size * 0.5f;
+    node.first_child = static_cast<uint32_t>(nodes.size());
+    for (uint32_t d = 0; d < 4; ++d) {
+        if (bounds[d] == bounds[d + 1]) continue;
+        QuadNode child;
+        child.x0 = node.x0 + (d & 1) * half;
+        child.y0 = node.y0 + (d >> 1) * half;
+        child.size = half;
+        child.begin = bounds[d];
+        child.end = bounds[d + 1];
+        nodes.push_back(child);
+        ++node.child_count;
+    }
+    nodes[index] = node;
+
+    for (uint32_t c = 0; c < node.child_count; ++c) {
+        build_node(nodes, node.first_child + c, level + 1, defer_level);
+    }
+
+    // with deferral some descendants are unfinished; finish_top_levels fills in the mass later
+    if (defer_level > MORTON_BITS) children_mass(nodes[index], nodes);
+}
+
+// Recompute the mass of the serially built top cells once their deferred subtrees are in place
+static void finish_top_levels(uint32_t index, int level) {
+    QuadNode& node = s_nodes[index];
+    if (node.child_count == 0 || level >= s_defer_level) return;
+    for (uint32_t c = node.first_child; c < node.first_child + node.child_count; ++c) {
+        finish_top_levels(c, level + 1);
+    }
+    children_mass(s_nodes[index], s_nodes);
+}
+
+// Morton sort, gather into sorted order, build the tree
+static void build_tree(const BodiesSOA& soa) {
+    const size_t n = soa.size;
+
+    MortonBounds bounds = morton_bounds(soa.x.data(), soa.y.data(), n, s_scratch, *s_pool);
+    morton_keys(soa.x.data(), soa.y.data(), n, bounds, s_keys.data(), *s_pool);
+    for (size_t i = 0; i < n; ++i) s_order[i] = static_cast<uint32_t>(i);
+    radix_sort_pairs(s_keys.data(), s_order.data(), n, s_scratch, *s_pool);
+
+    s_pool->parallel_for(n, 4096, [&](size_t begin, size_t end, size_t) {
+        for (size_t s = begin; s < end; ++s) {
+            s_sx[s] = soa.x[s_order[s]];
+            s_sy[s] = soa.y[s_order[s]];
+            s_sm[s] = soa.mass[s_order[s]];
+        }
+    });
+
+    // serial top levels
+    s_nodes.clear();
+    s_deferred.clear();
+    QuadNode root;
+    root.x0 = bounds.min_x;
+    root.y0 = bounds.min_y;
+    root.size = bounds.size;
+    root.begin = 0;
+    root.end = static_cast<uint32_t>(n);
+    s_nodes.push_back(root);
+    build_node(s_nodes, 0, 0, s_defer_level);
+
+    if (s_defer_level > MORTON_BITS) return;
+
+    // parallel subtrees, each into its own arena with the deferred cell as local node 0
+    if (s_local.size() < s_deferred.size()) s_local.resize(s_deferred.size());
+    s_pool->run(s_deferred.size(), [&](size_t t, size_t) {
+        std::vector<QuadNode>& local = s_local[t];
+        local.clear();
+        local.push_back(s_nodes[s_deferred[t].index]);
+        build_node(local, 0, s_deferred[t].level, MORTON_BITS + 1);
+    });
+
+    // stitch: local node k > 0 goes to offset + k - 1 in the main arena
+    s_offsets.resize(s_deferred.size());
+    size_t total = s_nodes.size();
+    for (size_t t = 0; t < s_deferred.size(); ++t) {
+        s_offsets[t] = total;
+        total += s_local[t].size() - 1;
+    }
+    s_nodes.resize(total);
+
+    s_pool->run(s_deferred.size(), [&](size_t t, size_t) {
+        const std::vector<QuadNode>& local = s_local[t];
+        const uint32_t shift = static_cast<uint32_t>(s_offsets[t]) - 1;
+        for (size_t k = 0; k < local.size(); ++k) {
+            QuadNode node = local[k];
+            if (node.child_count > 0) node.first_child += shift;
+            size_t target = k == 0 ? s_deferred[t].index : s_offsets[t] + k - 1;
+            s_nodes[target] = node;
+        }
+    });
+
+    finish_top_levels(0, 0);
+}
+
+// Walk the tree for one sorted body and return its (unscaled) acceleration; 'terms' counts the
+// body-body and cell terms summed
+static void walk(uint32_t s, float theta2, float eps2, float& out_ax, float& out_ay, uint64_t& terms) {
+    const float xi = s_sx[s];
+    const float yi = s_sy[s];
+    float ax = 0.f, ay = 0.f;
+
+    uint32_t stack[4 * (MORTON_BITS + 2)];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const QuadNode& node = s_nodes[stack[--top]];
+
+        if (node.child_count == 0) {
+            // leaf: direct sum, self skipped by index
+            terms += node.end - node.begin - (s >= node.begin && s < node.end ? 1 : 0);
+            for (uint32_t b = node.begin; b < node.end; ++b) {
+                if (b == s) continue;
+                float dx = s_sx[b] - xi;
+                float dy = s_sy[b] - yi;
+                float inv = 1.f / std::sqrt(dx * dx + dy * dy + eps2);
+                float f = s_sm[b] * inv * inv * inv;
+                ax += dx * f;
+                ay += dy * f;
+            }
+            continue;
+        }
+
+        float dx = node.com_x - xi;
+        float dy = node.com_y - yi;
+        float d2 = dx * dx + dy * dy;
+        bool inside = xi >= node.x0 && xi < node.x0 + node.size &&
+                      yi >= node.y0 && yi < node.y0 + node.size;
+
+        if (!inside && node.size * node.size < theta2 * d2) {
+            // far enough: the whole cell acts as a point mass at its center of mass
+            float inv = 1.f / std::sqrt(d2 + eps2);
+            float f = node.mass * inv * inv * inv;
+            ax += dx * f;
+            ay += dy * f;
+            ++terms;
+        }
+        else {
+            for (uint32_t c = 0; c < node.child_count; ++c) stack[top++] = node.first_child + c;
+        }
+    }
+
+    out_ax = ax;
+    out_ay = ay;
+}
+
+// Initialize the pool and size every buffer for n_bodies
+bool initBarnesHutComputation(size_t n_bodies, const BarnesHutOptions& options) {
+    s_options = options;
+    s_options.leaf_size = std::max<size_t>(1, s_options.leaf_size);
+    s_pool = std::make_unique<ThreadPool>(options.threads);
+
+    // defer at the first level with enough cells to keep every worker busy (single thread: never)
+    s_defer_level = MORTON_BITS + 1;
+    if (s_pool->size() > 1) {
+        s_defer_level = 1;
+        while ((size_t(1) << (2 * s_defer_level)) < s_pool->size() * 8 && s_defer_level < 6) ++s_defer_level;
+    }
+
+    s_soa.resize(n_bodies);
+    s_keys.assign(n_bodies, 0);
+    s_order.assign(n_bodies, 0);
+    s_sx.assign(n_bodies, 0.f);
+    s_sy.assign(n_bodies, 0.f);
+    s_sm.assign(n_bodies, 0.f);
+    s_sax.assign(n_bodies, 0.f);
+    s_say.assign(n_bodies, 0.f);
+    s_scratch.keys.resize(n_bodies);
+    s_scratch.values.resize(n_bodies);
+    s_nodes.reserve(2 * n_bodies + 1);
+    s_walk_terms.assign(s_pool->size(), 0);
+    s_stats = BarnesHutStats();
+    return true;
+}
+
+bool initBarnesHutComputation(size_t n_bodies) {
+    return initBarnesHutComputation(n_bodies, BarnesHutOptions());
+}
+
+void barnes_hut_compute_forces(BodiesSOA& soa, const float G, const float eps)
+{
+    const size_t n = soa.size;
+    if (n == 0) return;
+
+    {
+        NBODY_PROFILE_SCOPE("tree build");
+        build_tree(soa);
+    }
+
+    NBODY_PROFILE_SCOPE("tree walk");
+    const float theta2 = s_options.theta * s_options.theta;
+    const float eps2 = eps * eps;
+    std::fill(s_walk_terms.begin(), s_walk_terms.end(), 0);
+    s_pool->parallel_for(n, 256, [&](size_t begin, size_t end, size_t worker) {
+        uint64_t terms = 0;
+        for (size_t s = begin; s < end; ++s) {
+            walk(static_cast<uint32_t>(s), theta2, eps2, s_sax[s], s_say[s], terms);
+        }
+        s_walk_terms[worker] += terms;
+    });
+    ++s_stats.force_passes;
+    for (uint64_t terms : s_walk_terms) s_stats.interactions += terms;
+
+    // back to the caller's order
+    s_pool->parallel_for(n, 4096, [&](size_t begin, size_t end, size_t) {
+        for (size_t s = begin; s < end; ++s) {
+            soa.ax[s_order[s]] = G * s_sax[s];
+            soa.ay[s_order[s]] = G * s_say[s];
+        }
+    });
+}
+
+void barnes_hut_step(BodiesSOA& soa,
+                     const float G,
+                     const float eps,
+                     const float dt,
+                     const int width,
+                     const int height)
+{
+    barnes_hut_compute_forces(soa, G, eps);
+    NBODY_PROFILE_SCOPE("integrate");
+    s_pool->parallel_for(soa.size, 4096, [&](size_t begin, size_t end, size_t) {
+        simd_integrate_range(soa, begin, end, dt, width, height);
+    });
+}
+
+// Perform one Barnes-Hut step: pack into SoA, step, unpack
+void runBarnesHutComputation(std::vector<Body>& bodies,
+                             const float G,
+                             const float eps,
+                             const float dt,
+                             const int width,
+                             const int height)
+{
+    packBodies(bodies, s_soa);
+    barnes_hut_step(s_soa, G, eps, dt, width, height);
+    unpackBodies(s_soa, bodies);
+}
+
+const BarnesHutStats& barnesHutStats() {
+    return s_stats;
+}
+
+void cleanupBarnesHutComputation() {
+    s_pool.reset();
+    s_soa = BodiesSOA(0);
+    s_keys = std::vector<uint32_t>();
+    s_order = std::vector<uint32_t>();
+    s_sx = AlignedFloats(); s_sy = AlignedFloats(); s_sm = AlignedFloats();
+    s_sax = AlignedFloats(); s_say = AlignedFloats();
+    s_nodes = std::vector<QuadNode>();
+    s_walk_terms.clear();
+    s_local.clear();
+    s_deferred.clear();
+    s_scratch = MortonScratch();
+}
@@ -0,0 +1,259 @@
+// File: BlockTimestep.cpp
+// Implements the hierarchical block time-step engine
+//  - a body on level l steps with dt / 2^l using kick-drift-kick leapfrog; its level is chosen
+//    after every step from sqrt(2 eta eps / |a|), and it may only move to a level whose steps
+//    start at the current time, so all levels stay synchronized at the end of every macro step
+//  - bodies are kept sorted by level, deepest first, so the bodies ending a step at any time
+//    (those on level >= some l) are always a prefix: forces are computed for that prefix only,
+//    against all bodies, with the SIMD kernels on the thread pool
+//  - every body is drifted to the current time between force passes, kicks only touch the prefix
+
+#include <algorithm>  // for std::max, std::min, std::partition_point
+#include <cmath>      // for std::sqrt
+#include <memory>     // for std::unique_ptr
+
+#include "BlockTimestep.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+// Block time-step runtime state; all per-body arrays are in level order
+static std::unique_ptr<ThreadPool>   s_pool;
+static BlockTimestepOptions          s_options;
+static BlockTimestepStats            s_stats;
+static BodiesSOA                     s_soa(0);
+static BodiesSOA                     s_sorted(0);   // counting sort target
+static std::vector<uint32_t>         s_id;          // slot -> index in the caller's vector
+static std::vector<uint32_t>         s_id_sorted;
+static std::vector<uint8_t>          s_level;
+static std::vector<uint8_t>          s_level_sorted;
+static std::vector<size_t>           s_offsets;     // counting sort bins
+static bool                          s_primed = false;  // accelerations and levels are current
+
+// Coarsest level whose steps start (and end) at fine tick t; every level at t = 0 and t = 2^L
+static int lowest_level_at(uint64_t t) {
+    const int L = s_options.max_level;
+    if (t % (uint64_t(1) << L) == 0) return 0;
+    int zeros = 0;
+    while ((t >> zeros & 1) == 0) ++zeros;
+    return L - zeros;
+}
+
+// Level with the largest step dt / 2^level not above the criterion, no coarser than 'lowest'
+static int choose_level(float ax, float ay, float eps, float dt, int lowest) {
+    const float a = std::sqrt(ax * ax + ay * ay);
+    int level = 0;
+    if (a > 0.f) {
+        const float step = std::sqrt(2.f * s_options.eta * eps / a);
+        while (level < s_options.max_level && dt / static_cast<float>(1 << level) > step) ++level;
+    }
+    return std::max(level, lowest);
+}
+
+// Number of leading slots on level >= lowest
+static size_t active_count(int lowest) {
+    return static_cast<size_t>(std::partition_point(s_level.begin(), s_level.end(),
+                                                    [lowest](uint8_t l) { return l >= lowest; }) - s_level.begin());
+}
+
+// Accelerations of slots [0, count) from all bodies
+static void compute_active_forces(size_t count, const float G, const float eps) {
+    NBODY_PROFILE_SCOPE("forces");
+    const size_t grain = std::max<size_t>(64, count / (4 * s_pool->size()));
+    s_pool->parallel_for(count, grain, [&](size_t begin, size_t end, size_t) {
+        simd_compute_forces_range(s_soa, begin, end, G, eps, s_options.kernel);
+    });
+    s_stats.force_evaluations += count;
+    ++s_stats.sub_steps;
+}
+
+// Half kick of slots [0, count), each with its own step
+static void half_kick(size_t count, const float dt) {
+    for (size_t i = 0; i < count; ++i) {
+        if (s_soa.pinned[i]) continue;
+        const float h = 0.5f * dt / static_cast<float>(1 << s_level[i]);
+        s_soa.vx[i] += s_soa.ax[i] * h;
+        s_soa.vy[i] += s_soa.ay[i] * h;
+    }
+}
+
+// Move every body by 'span' of time and wrap around edges as integrate_bodies does
+static void drift_all(const float span, const int width, const int height) {
+    NBODY_PROFILE_SCOPE("drift");
+    const size_t n = s_soa.size;
+    s_pool->parallel_for(n, std::max<size_t>(16384, n / (4 * s_pool->size())), [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            if (s_soa.pinned[i]) continue;
+            float x = s_soa.x[i] + s_soa.vx[i] * span;
+            float y = s_soa.y[i] + s_soa.vy[i] * span;
+            if (x < -width / 2) x += width;
+            else if (x > width / 2) x -= width;
+            if (y < -height / 2) y += height;
+            else if (y > height / 2) y -= height;
+            s_soa.x[i] = x;
+            s_soa.y[i] = y;
+        }
+    });
+}
+
+// Stable counting sort of slots [0, count) by level, deepest first
+static void sort_by_level(size_t count) {
+    const int L = s_options.max_level;
+    std::fill(s_offsets.begin(), s_offsets.end(), 0);
+    for (size_t i = 0; i < count; ++i) ++s_offsets[L - s_level[i] + 1];
+    for (int b = 0; b <= L; ++b) s_offsets[b + 1] += s_offsets[b];
+
+    for (size_t i = 0; i < count; ++i) {
+        const size_t k = s_offsets[L - s_level[i]]++;
+        s_sorted.x[k] = s_soa.x[i];
+        s_sorted.y[k] = s_soa.y[i];
+        s_sorted.vx[k] = s_soa.vx[i];
+        s_sorted.vy[k] = s_soa.vy[i];
+        s_sorted.ax[k] = s_soa.ax[i];
+        s_sorted.ay[k] = s_soa.ay[i];
+        s_sorted.mass[k] = s_soa.mass[i];
+        s_sorted.pinned[k] = s_soa.pinned[i];
+        s_id_sorted[k] = s_id[i];
+        s_level_sorted[k] = s_level[i];
+    }
+    std::copy(s_sorted.x.begin(), s_sorted.x.begin() + count, s_soa.x.begin());
+    std::copy(s_sorted.y.begin(), s_sorted.y.begin() + count, s_soa.y.begin());
+    std::copy(s_sorted.vx.begin(), s_sorted.vx.begin() + count, s_soa.vx.begin());
+    std::copy(s_sorted.vy.begin(), s_sorted.vy.begin() + count, s_soa.vy.begin());
+    std::copy(s_sorted.ax.begin(), s_sorted.ax.begin() + count, s_soa.ax.begin());
+    std::copy(s_sorted.ay.begin(), s_sorted.ay.begin() + count, s_soa.ay.begin());
+    std::copy(s_sorted.mass.begin(), s_sorted.mass.begin() + count, s_soa.mass.begin());
+    std::copy(s_sorted.pinned.begin(), s_sorted.pinned.begin() + count, s_soa.pinned.begin());
+    std::copy(s_id_sorted.begin(), s_id_sorted.begin() + count, s_id.begin());
+    std::copy(s_level_sorted.begin(), s_level_sorted.begin() + count, s_level.begin());
+}
+
+// New levels for slots [0, count) after their forces were updated at tick t
+static void assign_levels(size_t count, uint64_t t, const float eps, const float dt) {
+    const int lowest = lowest_level_at(t);
+    for (size_t i = 0; i < count; ++i) {
+        s_level[i] = static_cast<uint8_t>(s_soa.pinned[i]
+            ? lowest
+            : choose_level(s_soa.ax[i], s_soa.ay[i], eps, dt, lowest));
+        s_stats.deepest_level = std::max<int>(s_stats.deepest_level, s_level[i]);
+    }
+    sort_by_level(count);
+}
+
+// One macro step of length dt, in fine ticks of dt / 2^max_level
+static void macro_step(const float G, const float eps, const float dt, const int width, const int height) {
+    const int L = s_options.max_level;
+    const uint64_t T = uint64_t(1) << L;
+    const float tick = dt / static_cast<float>(T);
+    const size_t n = s_soa.size;
+
+    if (!s_primed) {
+        compute_active_forces(n, G, eps);
+        assign_levels(n, 0, eps, dt);
+        s_primed = true;
+    }
+
+    uint64_t t = 0;
+    size_t opening = n;   // every body starts a step at t = 0
+    while (t < T) {
+        half_kick(opening, dt);
+
+        // drift to the next time a body ends its step: the end of the deepest level's step
+        const uint64_t span = T >> s_level[0];
+        drift_all(static_cast<float>(span) * tick, width, height);
+        t += span;
+
+        // bodies ending their step: new forces, closing kick, new level, and they open the next step
+        const size_t active = active_count(lowest_level_at(t));
+        compute_active_forces(active, G, eps);
+        half_kick(active, dt);
+        assign_levels(active, t, eps, dt);
+        opening = active;
+    }
+
+    ++s_stats.steps;
+    s_stats.level_counts.assign(L + 1, 0);
+    for (size_t i = 0; i < n; ++i) ++s_stats.level_counts[s_level[i]];
+}
+
+bool initBlockTimestepComputation(size_t n_bodies, const BlockTimestepOptions& options) {
+    if (!simdKernelSupported(options.kernel)) return false;
+
+    s_options = options;
+    s_options.max_level = std::min(std::max(options.max_level, 0), 30);
+    s_pool = std::make_unique<ThreadPool>(options.threads);
+    s_options.threads = s_pool->size();
+
+    s_soa.resize(n_bodies);
+    s_sorted.resize(n_bodies);
+    s_id.resize(n_bodies);
+    s_id_sorted.resize(n_bodies);
+    s_level.assign(n_bodies, 0);
+    s_level_sorted.resize(n_bodies);
+    s_offsets.assign(s_options.max_level + 2, 0);
+    for (size_t i = 0; i < n_bodies; ++i) s_id[i] = static_cast<uint32_t>(i);
+    s_stats = BlockTimestepStats();
+    s_stats.bodies = n_bodies;
+    s_primed = false;
+    return true;
+}
+
+bool initBlockTimestepComputation(size_t n_bodies) {
+    return initBlockTimestepComputation(n_bodies, BlockTimestepOptions());
+}
+
+// Gather into level order, step, scatter back
+void runBlockTimestepComputation(std::vector<Body>& bodies,
+                                 const float G,
+                                 const float eps,
+                                 const float dt,
+                                 const int width,
+                                 const int height)
+{
+    if (bodies.size() != s_soa.size) initBlockTimestepComputation(bodies.size(), s_options);
+
+    for (size_t k = 0; k < s_soa.size; ++k) {
+        const Body& b = bodies[s_id[k]];
+        s_soa.x[k] = b.x;
+        s_soa.y[k] = b.y;
+        s_soa.vx[k] = b.velocity_x;
+        s_soa.vy[k] = b.velocity_y;
+        s_soa.ax[k] = b.acceleration_x;
+        s_soa.ay[k] = b.acceleration_y;
+        s_soa.mass[k] = b.mass;
+        s_soa.pinned[k] = b.pinned;
+    }
+
+    macro_step(G, eps, dt, width, height);
+
+    for (size_t k = 0; k < s_soa.size; ++k) {
+        Body& b = bodies[s_id[k]];
+        b.x = s_soa.x[k];
+        b.y = s_soa.y[k];
+        b.velocity_x = s_soa.vx[k];
+        b.velocity_y = s_soa.vy[k];
+        b.acceleration_x = s_soa.ax[k];
+        b.acceleration_y = s_soa.ay[k];
+    }
+}
+
+void permuteBlockTimestepState(const std::vector<uint32_t>& perm) {
+    if (perm.size() != s_id.size()) return;
+    std::vector<uint32_t> moved_to(perm.size());
+    for (size_t k = 0; k < perm.size(); ++k) moved_to[perm[k]] = static_cast<uint32_t>(k);
+    for (uint32_t& id : s_id) id = moved_to[id];
+}
+
+const BlockTimestepStats& blockTimestepStats() {
+    return s_stats;
+}
+
+void cleanupBlockTimestepComputation() {
+    s_pool.reset();
+    s_soa = BodiesSOA(0);
+    s_sorted = BodiesSOA(0);
+    s_id.clear();
+    s_id_sorted.clear();
+    s_level.clear();
+    s_level_sorted.clear();
+    s_primed = false;
+}
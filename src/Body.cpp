@@ -2,6 +2,8 @@
 // Implements helper functions to create simulation bodies
 
 #include "Body.h"
+#include "Profiler.h"
+#include <cmath>
 #include <random>
 
 // Generates a random body positioned randomly within the window
@@ -36,7 +38,7 @@ Body randomBody(std::mt19937& rng, int width, int height) {
     return body;
 }
 
-// Creates a central, stationary body with given mass at the origin
+// Creates a central, pinned body with given mass at the origin
 Body centralBody(float mass, int width, int height) {
     // central body at center with no movement
     Body body;
@@ -47,6 +49,42 @@ Body centralBody(float mass, int width, int height) {
     body.velocity_y = 0.f;
     body.acceleration_x = 0.f;
     body.acceleration_y = 0.f;
+    body.pinned = true;
 
     return body;
-}
\ No newline at end of file
+}
+
+// Compute circular orbital speed for mass M at distance r (assumes G=1)
+float orbital_velocity_scalar(float M, float r) {
+    return std::sqrt(1.0f * M / r);
+}
+
+// Copy an array of bodies into structure-of-arrays form
+void packBodies(const std::vector<Body>& bodies, BodiesSOA& soa) {
+    NBODY_PROFILE_SCOPE("pack");
+    soa.resize(bodies.size());
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        soa.x[i]    = bodies[i].x;
+        soa.y[i]    = bodies[i].y;
+        soa.vx[i]   = bodies[i].velocity_x;
+        soa.vy[i]   = bodies[i].velocity_y;
+        soa.ax[i]   = bodies[i].acceleration_x;
+        soa.ay[i]   = bodies[i].acceleration_y;
+        soa.mass[i] = bodies[i].mass;
+        soa.pinned[i] = bodies[i].pinned;
+        soa.id[i]   = bodies[i].id;
+    }
+}
+
+// Copy the evolving state back into the array of bodies (mass never changes)
+void unpackBodies(const BodiesSOA& soa, std::vector<Body>& bodies) {
+    NBODY_PROFILE_SCOPE("unpack");
+    for (size_t i = 0; i < soa.size; ++i) {
+        bodies[i].x              = soa.x[i];
+        bodies[i].y              = soa.y[i];
+        bodies[i].velocity_x     = soa.vx[i];
+        bodies[i].velocity_y     = soa.vy[i];
+        bodies[i].acceleration_x = soa.ax[i];
+        bodies[i].acceleration_y = soa.ay[i];
+    }
+}
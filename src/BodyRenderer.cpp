@@ -0,0 +1,149 @@
+// File: BodyRenderer.cpp
+// Implements the batched vertex-array and heatmap renderers
+
+#include <algorithm>  // for std::fill, std::max, std::min
+#include <cmath>      // for std::log1p
+
+#include "BodyRenderer.h"
+#include "SFML.h"     // mass_to_color()
+
+const char* renderModeName(RenderMode mode) {
+    switch (mode) {
+    case RenderMode::Points:  return "points";
+    case RenderMode::Quads:   return "quads";
+    default:                  return "heatmap";
+    }
+}
+
+RenderMode defaultRenderMode(size_t n_bodies) {
+    return n_bodies <= 100000 ? RenderMode::Quads : RenderMode::Heatmap;
+}
+
+// Heatmap colour table: black -> purple -> orange -> yellow -> white
+static std::vector<sf::Color> make_palette() {
+    const float stops[][3] = { { 0, 0, 0 }, { 80, 18, 123 }, { 230, 80, 40 }, { 252, 230, 90 }, { 255, 255, 255 } };
+    const int segments = 4;
+    std::vector<sf::Color> palette(256);
+    for (int i = 0; i < 256; ++i) {
+        float t = i / 255.f * segments;
+        int s = std::min(segments - 1, static_cast<int>(t));
+        float f = t - s;
+        palette[i] = sf::Color(static_cast<sf::Uint8>(stops[s][0] + f * (stops[s + 1][0] - stops[s][0])),
+                               static_cast<sf::Uint8>(stops[s][1] + f * (stops[s + 1][1] - stops[s][1])),
+                               static_cast<sf::Uint8>(stops[s][2] + f * (stops[s + 1][2] - stops[s][2])));
+    }
+    return palette;
+}
+
+// All heatmap buffers are sized here once; vertices are sized on the first update
+BodyRenderer::BodyRenderer(int width, int height, RenderMode mode)
+    : m_width(width), m_height(height), m_mode(mode),
+      m_grid_w((width + HEAT_CELL - 1) / HEAT_CELL), m_grid_h((height + HEAT_CELL - 1) / HEAT_CELL)
+{
+    m_density.resize(static_cast<size_t>(m_grid_w) * m_grid_h);
+    m_pixels.resize(m_density.size() * 4);
+    m_palette = make_palette();
+    m_texture.create(m_grid_w, m_grid_h);
+    m_texture.setSmooth(true);
+    m_sprite.setTexture(m_texture, true);
+    m_sprite.setScale(static_cast<float>(HEAT_CELL), static_cast<float>(HEAT_CELL));
+    set_mode(mode);
+}
+
+void BodyRenderer::set_mode(RenderMode mode) {
+    m_mode = mode;
+    m_vertices.setPrimitiveType(mode == RenderMode::Quads ? sf::Quads : sf::Points);
+}
+
+void BodyRenderer::cycle_mode() {
+    switch (m_mode) {
+    case RenderMode::Points: set_mode(RenderMode::Quads);   break;
+    case RenderMode::Quads:  set_mode(RenderMode::Heatmap); break;
+    default:                 set_mode(RenderMode::Points);  break;
+    }
+}
+
+void BodyRenderer::update(const std::vector<Body>& bodies) {
+    fill(bodies.size(), [&](size_t i, float& x, float& y, float& mass) {
+        x = bodies[i].x;
+        y = bodies[i].y;
+        mass = bodies[i].mass;
+    });
+}
+
+void BodyRenderer::update(const float* x, const float* y, const float* mass, size_t n) {
+    fill(n, [&](size_t i, float& xi, float& yi, float& mi) {
+        xi = x[i];
+        yi = y[i];
+        mi = mass[i];
+    });
+}
+
+// Shared by both update() overloads; get(i, x, y, mass) reads body i. The simulation origin is
+// the window centre
+template <typename Get>
+void BodyRenderer::fill(size_t n, Get get) {
+    const float cx = m_width / 2.f;
+    const float cy = m_height / 2.f;
+    float x, y, mass;
+
+    if (m_mode == RenderMode::Heatmap) {
+        // splat body counts (not mass, so the central body does not wash out the map)
+        std::fill(m_density.begin(), m_density.end(), 0u);
+        uint32_t peak = 0;
+        for (size_t i = 0; i < n; ++i) {
+            get(i, x, y, mass);
+            int gx = static_cast<int>((cx + x) / HEAT_CELL);
+            int gy = static_cast<int>((cy + y) / HEAT_CELL);
+            if (gx < 0 || gy < 0 || gx >= m_grid_w || gy >= m_grid_h) continue;
+            peak = std::max(peak, ++m_density[static_cast<size_t>(gy) * m_grid_w + gx]);
+        }
+
+        // logarithmic scale keeps both the dense core and the sparse halo visible
+        const float scale = peak > 0 ? 255.f / std::log1p(static_cast<float>(peak)) : 0.f;
+        for (size_t c = 0; c < m_density.size(); ++c) {
+            const sf::Color& color = m_density[c]
+                ? m_palette[std::min(255, static_cast<int>(std::log1p(static_cast<float>(m_density[c])) * scale))]
+                : m_palette[0];
+            m_pixels[4 * c + 0] = color.r;
+            m_pixels[4 * c + 1] = color.g;
+            m_pixels[4 * c + 2] = color.b;
+            m_pixels[4 * c + 3] = 255;
+        }
+        m_texture.update(m_pixels.data());
+        return;
+    }
+
+    const size_t per_body = m_mode == RenderMode::Quads ? 4 : 1;
+    if (m_vertices.getVertexCount() != n * per_body) m_vertices.resize(n * per_body);
+
+    for (size_t i = 0; i < n; ++i) {
+        get(i, x, y, mass);
+        const sf::Color color = mass_to_color(mass);
+        const float px = cx + x;
+        const float py = cy + y;
+
+        if (per_body == 1) {
+            m_vertices[i].position = sf::Vector2f(px, py);
+            m_vertices[i].color = color;
+            continue;
+        }
+
+        // same sizes as the old circles: radius 6 for heavy bodies, 2 otherwise
+        const float r = mass > 50.0f ? 6.f : 2.f;
+        sf::Vertex* quad = &m_vertices[4 * i];
+        quad[0].position = sf::Vector2f(px - r, py - r);
+        quad[1].position = sf::Vector2f(px + r, py - r);
+        quad[2].position = sf::Vector2f(px + r, py + r);
+        quad[3].position = sf::Vector2f(px - r, py + r);
+        quad[0].color = quad[1].color = quad[2].color = quad[3].color = color;
+    }
+}
+
+// One draw call for the whole frame
+void BodyRenderer::draw(sf::RenderTarget& target) const {
+    if (m_mode == RenderMode::Heatmap)
+        target.draw(m_sprite);
+    else
+        target.draw(m_vertices);
+}
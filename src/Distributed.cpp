@@ -0,0 +1,159 @@
+// File: Distributed.cpp
+// Implements the ring-pass direct sum of the distributed engine
+//  - pass p sums the block that started on rank - p; the block for pass p + 1 is shifted in the
+//    background meanwhile, into a second buffer, so a rank holds at most two foreign blocks
+//  - block sizes follow from blockBegin(), so shifts carry no headers
+//  - the self pass uses the rank's own bodies as sources: accumulate_forces() skips a source at a
+//    body's own position exactly as compute_forces() does
+
+#include <algorithm>  // for std::copy, std::max
+#include <chrono>     // for std::chrono::steady_clock
+#include <utility>    // for std::swap
+
+#include "Distributed.h"
+#include "NBody.h"
+#include "Profiler.h"
+
+// Distributed runtime state, one rank per process
+static std::unique_ptr<Transport> s_transport;
+static DistributedOptions         s_options;
+static DistributedStats           s_stats;
+static size_t                     s_total = 0;
+static std::vector<float>         s_current;   // block being summed, interleaved (x, y, mass)
+static std::vector<float>         s_next;      // block being received
+
+size_t blockBegin(size_t n, int ranks, int rank) {
+    return n * static_cast<size_t>(rank) / static_cast<size_t>(ranks);
+}
+
+// Bodies in the largest block
+static size_t max_block(size_t n, int ranks) {
+    return (n + static_cast<size_t>(ranks) - 1) / static_cast<size_t>(ranks);
+}
+
+size_t distributedShiftBytes(size_t n, int ranks) {
+    // gatherBodies() moves whole bodies, the steps only (x, y, mass)
+    return max_block(n, ranks) * std::max(sizeof(Body), 3 * sizeof(float));
+}
+
+bool initDistributedComputation(size_t n_total, std::unique_ptr<Transport> transport, const DistributedOptions& options) {
+    if (!transport) return false;
+    s_transport = std::move(transport);
+    s_options = options;
+    s_stats = DistributedStats();
+    s_total = n_total;
+    s_current.assign(3 * max_block(n_total, s_transport->size()), 0.f);
+    s_next.assign(s_current.size(), 0.f);
+    return true;
+}
+
+bool initDistributedComputation(size_t n_total, std::unique_ptr<Transport> transport) {
+    return initDistributedComputation(n_total, std::move(transport), DistributedOptions());
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static size_t block_size(int rank) {
+    const int ranks = s_transport->size();
+    return blockBegin(s_total, ranks, rank + 1) - blockBegin(s_total, ranks, rank);
+}
+
+static void distributed_step(std::vector<Body>& local, float G, float eps, float dt, int width, int height) {
+    const int ranks = s_transport->size();
+    const int rank = s_transport->rank();
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < local.size(); ++i) {
+        Body& b = local[i];
+        b.acceleration_x = 0.f;
+        b.acceleration_y = 0.f;
+        s_current[3 * i + 0] = b.x;
+        s_current[3 * i + 1] = b.y;
+        s_current[3 * i + 2] = b.mass;
+    }
+    s_stats.compute_seconds += seconds_since(start);
+
+    for (int p = 0; p < ranks; ++p) {
+        const int origin = (rank - p + ranks) % ranks;
+        const int incoming = (origin - 1 + ranks) % ranks;
+        const bool shift = p + 1 < ranks;
+        const size_t send_bytes = block_size(origin) * 3 * sizeof(float);
+        const size_t recv_bytes = block_size(incoming) * 3 * sizeof(float);
+
+        if (shift && s_options.overlap) s_transport->startShift(s_current.data(), send_bytes, s_next.data(), recv_bytes);
+
+        start = std::chrono::steady_clock::now();
+        accumulate_forces(local, s_current.data(), block_size(origin), G, eps);
+        s_stats.compute_seconds += seconds_since(start);
+
+        if (!shift) break;
+        start = std::chrono::steady_clock::now();
+        {
+            NBODY_PROFILE_SCOPE("shift");
+            if (s_options.overlap) s_transport->finishShift();
+            else s_transport->shift(s_current.data(), send_bytes, s_next.data(), recv_bytes);
+        }
+        s_stats.wait_seconds += seconds_since(start);
+        s_stats.bytes_sent += send_bytes;
+        std::swap(s_current, s_next);
+    }
+
+    start = std::chrono::steady_clock::now();
+    integrate_bodies(local, dt, width, height);
+    s_stats.compute_seconds += seconds_since(start);
+    ++s_stats.steps;
+}
+
+void runDistributedSubsteps(std::vector<Body>& local,
+                            const float G,
+                            const float eps,
+                            const float dt,
+                            const int width,
+                            const int height,
+                            const int steps)
+{
+    for (int step = 0; step < steps; ++step) distributed_step(local, G, eps, dt, width, height);
+}
+
+void runDistributedComputation(std::vector<Body>& local,
+                               const float G,
+                               const float eps,
+                               const float dt,
+                               const int width,
+                               const int height)
+{
+    distributed_step(local, G, eps, dt, width, height);
+}
+
+void gatherBodies(const std::vector<Body>& local, std::vector<Body>& all) {
+    // the ring moves equal blocks, so every block is padded to the largest one
+    const int ranks = s_transport->size();
+    const size_t slot = max_block(s_total, ranks);
+    std::vector<Body> mine(slot);
+    std::copy(local.begin(), local.end(), mine.begin());
+    std::vector<Body> padded(slot * static_cast<size_t>(ranks));
+    s_transport->allGather(mine.data(), slot * sizeof(Body), padded.data());
+
+    all.resize(s_total);
+    for (int r = 0; r < ranks; ++r) {
+        std::copy(padded.begin() + slot * r, padded.begin() + slot * r + block_size(r),
+                  all.begin() + blockBegin(s_total, ranks, r));
+    }
+}
+
+Transport* distributedTransport() {
+    return s_transport.get();
+}
+
+const DistributedStats& distributedStats() {
+    return s_stats;
+}
+
+void cleanupDistributedComputation() {
+    s_transport.reset();
+    s_current = std::vector<float>();
+    s_next = std::vector<float>();
+    s_total = 0;
+}
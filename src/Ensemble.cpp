@@ -0,0 +1,120 @@
+// File: Ensemble.cpp
+// Implements Ensemble
+//  - Cpu: one pool task per system runs all requested steps of it, so a small system stays in L1
+//    from the first step to the last; systems only differ in their index range of the shared SoA
+//  - OpenCL: the batch is uploaded once and stepped resident; a system is copied back only when
+//    asked for, from one full download of the batch
+
+#include <algorithm>  // for std::fill, std::copy
+#include <iostream>   // for std::cerr
+
+#include "Ensemble.h"
+#include "Profiler.h"
+
+const char* ensembleBackendName(EnsembleBackend backend) {
+    return backend == EnsembleBackend::OpenCL ? "gpu" : "cpu";
+}
+
+bool parseEnsembleBackend(const std::string& name, EnsembleBackend& backend) {
+    for (EnsembleBackend b : { EnsembleBackend::Cpu, EnsembleBackend::OpenCL }) {
+        if (name == ensembleBackendName(b)) {
+            backend = b;
+            return true;
+        }
+    }
+    return false;
+}
+
+Ensemble::Ensemble(const SnapshotInfo& run, const EnsembleOptions& options)
+    : m_run(run), m_options(options), m_soa(0) {}
+
+std::unique_ptr<Ensemble> Ensemble::create(const std::vector<std::vector<Body>>& systems, const SnapshotInfo& run,
+                                           const EnsembleOptions& options)
+{
+    if (systems.empty()) {
+        std::cerr << "An ensemble needs at least one system\n";
+        return nullptr;
+    }
+    std::unique_ptr<Ensemble> ensemble(new Ensemble(run, options));
+    std::vector<Body>& batch = ensemble->m_batch;
+    std::vector<uint32_t>& offsets = ensemble->m_offsets;
+    offsets.push_back(0);
+    for (const std::vector<Body>& system : systems) {
+        if (system.empty()) {
+            std::cerr << "Ensemble system " << offsets.size() - 1 << " has no bodies\n";
+            return nullptr;
+        }
+        batch.insert(batch.end(), system.begin(), system.end());
+        offsets.push_back(static_cast<uint32_t>(batch.size()));
+    }
+
+    if (options.backend == EnsembleBackend::OpenCL) {
+        GpuOptions gpu;
+        gpu.device = options.device;
+        gpu.binary_cache = options.binary_cache;
+        gpu.kernel = GpuKernel::Ensemble;
+        gpu.local_size = options.local_size;
+        gpu.systems = offsets;
+        ensemble->m_gpu = GpuEngine::create(batch.size(), gpu);
+        if (!ensemble->m_gpu || !ensemble->m_gpu->upload(batch)) return nullptr;
+        return ensemble;
+    }
+
+    if (!simdKernelSupported(options.kernel)) {
+        std::cerr << "This CPU cannot run the " << simdKernelName(options.kernel) << " kernel\n";
+        return nullptr;
+    }
+    ensemble->m_pool = std::make_unique<ThreadPool>(options.threads);
+    packBodies(batch, ensemble->m_soa);
+    batch = std::vector<Body>();
+    return ensemble;
+}
+
+bool Ensemble::step(int steps) {
+    const SnapshotInfo& r = m_run;
+    if (m_gpu) {
+        if (!m_gpu->stepResident(r.G, r.eps, r.dt, r.width, r.height, steps)) return false;
+        m_stale = true;
+    }
+    else {
+        NBODY_PROFILE_SCOPE("ensemble");
+        m_pool->run(systems(), [&](size_t s, size_t) {
+            const size_t begin = m_offsets[s];
+            const size_t end = m_offsets[s + 1];
+            for (int step = 0; step < steps; ++step) {
+                std::fill(m_soa.ax.begin() + begin, m_soa.ax.begin() + end, 0.f);
+                std::fill(m_soa.ay.begin() + begin, m_soa.ay.begin() + end, 0.f);
+                simd_accumulate_forces_tile(m_soa, begin, end, begin, end, r.G, r.eps, m_options.kernel);
+                simd_integrate_range(m_soa, begin, end, r.dt, r.width, r.height);
+            }
+        });
+    }
+    m_run.step += steps;
+    m_run.time += static_cast<double>(steps) * r.dt;
+    return true;
+}
+
+void Ensemble::systemBodies(size_t system, std::vector<Body>& bodies) {
+    const size_t begin = m_offsets[system];
+    const size_t end = m_offsets[system + 1];
+    if (m_gpu) {
+        if (m_stale && m_gpu->download(m_batch)) m_stale = false;
+        bodies.assign(m_batch.begin() + begin, m_batch.begin() + end);
+        return;
+    }
+
+    // unpack just this system's range
+    bodies.resize(end - begin);
+    for (size_t i = begin; i < end; ++i) {
+        Body& b = bodies[i - begin];
+        b.x = m_soa.x[i];
+        b.y = m_soa.y[i];
+        b.velocity_x = m_soa.vx[i];
+        b.velocity_y = m_soa.vy[i];
+        b.acceleration_x = m_soa.ax[i];
+        b.acceleration_y = m_soa.ay[i];
+        b.mass = m_soa.mass[i];
+        b.pinned = m_soa.pinned[i] != 0;
+        b.id = m_soa.id[i];
+    }
+}
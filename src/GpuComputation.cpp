@@ -2,77 +2,969 @@
 // Handles GPU acceleration for N-body simulation using OpenCL
 
 #include "GpuComputation.h"
+#include "OpenCLDevice.h"
+#include "NBodyKernelSource.h"   // NBODY_KERNEL_SOURCE, generated from opencl/NBody.cl by CMake
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
 #include <iostream>
 #include <fstream>
+#include <limits>
 #include <sstream>
-#define CL_TARGET_OPENCL_VERSION 120
-#include <gegl-0.4/opencl/cl.h>
-
-
-// GPU runtime state: holds OpenCL context, queue, program, kernels, buffers, and number of bodies
-static cl_context        s_context        = nullptr;
-static cl_command_queue  s_queue          = nullptr;
-static cl_program        s_program        = nullptr;
-static cl_kernel         s_k_forces       = nullptr;
-static cl_kernel         s_k_integrate    = nullptr;
-static cl_mem            s_buf_x          = nullptr;
-static cl_mem            s_buf_y          = nullptr;
-static cl_mem            s_buf_vx         = nullptr;
-static cl_mem            s_buf_vy         = nullptr;
-static cl_mem            s_buf_ax         = nullptr;
-static cl_mem            s_buf_ay         = nullptr;
-static cl_mem            s_buf_mass       = nullptr;
-static size_t            s_n              = 0;
-
-// Initialize GPU: create context, compile kernels, and allocate device buffers
-void initGpuComputation(size_t n_bodies) {
-    cl_int err;
-    s_n = n_bodies;
+#include <string>
+#include <utility>
+
+
+// GPU runtime state of one engine: OpenCL context, queue, program, kernels, buffers, and number
+// of bodies. Engines share nothing, so any number of simulations can run in one process
+struct GpuState {
+    cl_context        context          = nullptr;
+    cl_command_queue  queue            = nullptr;
+    cl_device_id      device           = nullptr;
+    cl_program        program          = nullptr;
+    cl_kernel         k_forces         = nullptr;
+    cl_kernel         k_integrate      = nullptr;
+    cl_mem            buf_x            = nullptr;
+    cl_mem            buf_y            = nullptr;
+    cl_mem            buf_vx           = nullptr;
+    cl_mem            buf_vy           = nullptr;
+    cl_mem            buf_ax           = nullptr;
+    cl_mem            buf_ay           = nullptr;
+    cl_mem            buf_mass         = nullptr;
+    cl_mem            buf_pinned       = nullptr;    // one byte per body, Body::pinned
+    size_t            n                = 0;
+    bool              binary_cache     = true;       // load/store compiled programs on disk
+
+    // Tiled kernels: float4 (x, y, pinned, mass) bodies, double-buffered because the fused kernel still
+    // reads the old positions in other work-groups while writing the new ones
+    GpuKernel         kernel           = GpuKernel::Basic;
+    cl_kernel         k_pack           = nullptr;
+    cl_kernel         k_forces_tiled   = nullptr;
+    cl_kernel         k_integrate_tiled = nullptr;
+    cl_kernel         k_step_tiled     = nullptr;
+    cl_mem            buf_body[2]      = { nullptr, nullptr };
+    int               body             = 0;          // body buffer holding the current state
+    size_t            local_size       = 64;         // work-group size of every launch
+    size_t            global_size      = 0;          // n rounded up to a multiple of local_size
+    size_t            tile_size        = 64;         // bodies per __local tile (TILE_SIZE)
+    PrecisionMode     precision        = PrecisionMode::Float;   // selects the -D precision variant
+
+    // Device-resident mode: state stays on the device between steps, positions come back through
+    // a pinned (host-allocated, persistently mapped) staging buffer with two slots, so the host
+    // reads slot k - 1 while the device fills slot k
+    cl_mem            buf_staging      = nullptr;
+    float*            staging_host     = nullptr;
+    bool              resident         = false;      // device buffers hold the current state
+    bool              failed           = false;      // a launch was rejected, the device state is unusable
+    int               slot             = 0;          // staging slot of the most recent readback
+    cl_event          readback[2][2]   = { { nullptr, nullptr }, { nullptr, nullptr } };
+
+    // Reordering of the resident state: each array is gathered into a scratch buffer of the same
+    // type, which is then swapped in (kernel arguments are set at every launch, so handles may move)
+    cl_kernel         k_gather_floats  = nullptr;
+    cl_kernel         k_gather_bytes   = nullptr;
+    cl_mem            buf_perm         = nullptr;
+    cl_mem            buf_scratch      = nullptr;    // n floats
+    cl_mem            buf_scratch_bytes = nullptr;   // n bytes
+
+    // Tracer kernel: float4 (x, y, mass, eps2) sources, moving ones first, built on the host from the
+    // bodies and refreshed on the device; the host keeps the list to remap its ids on a reorder
+    TracerOptions     tracers;
+    cl_kernel         k_gather_sources = nullptr;
+    cl_kernel         k_tracer_step    = nullptr;
+    cl_mem            buf_source       = nullptr;
+    cl_mem            buf_source_id    = nullptr;
+    size_t            source_capacity  = 0;
+    ForceSources      sources;
+    size_t            moving           = 0;
+
+    // Ensemble kernel: one work-group per system, system s owns bodies [offset[s], offset[s + 1])
+    cl_kernel         k_ensemble_step  = nullptr;
+    cl_mem            buf_offset       = nullptr;
+    size_t            systems          = 0;
+};
+
+// Engine behind the free functions (the front end and the benchmark)
+static std::unique_ptr<GpuEngine> s_default;
+
+#ifdef NBODY_PROFILING
+// Event argument for one profiled transfer or launch: the temporary hands its event to the
+// profiler and releases it at the end of the enqueue statement
+class ProfiledEvent {
+public:
+    explicit ProfiledEvent(const char* name) : m_name(name) {}
+    ~ProfiledEvent() {
+        if (!m_event) return;
+        profileGpuEvent(m_name, m_event);
+        clReleaseEvent(m_event);
+    }
+    operator cl_event*() { return &m_event; }
+
+private:
+    const char* m_name;
+    cl_event m_event = nullptr;
+};
+#define PROFILED(name) ProfiledEvent(name)
+#else
+#define PROFILED(name) NULL
+#endif
+
+const char* gpuKernelName(GpuKernel kernel) {
+    switch (kernel) {
+    case GpuKernel::Tiled: return "tiled";
+    case GpuKernel::Fused: return "fused";
+    case GpuKernel::Tracer: return "tracer";
+    case GpuKernel::Ensemble: return "ensemble";
+    default:               return "basic";
+    }
+}
+
+// The tiled variants keep a float4 copy of the bodies (and are the ones worth autotuning)
+static bool tiled_kernel(const GpuState& g) {
+    return g.kernel == GpuKernel::Tiled || g.kernel == GpuKernel::Fused;
+}
+
+// The ensemble kernel reads the same float4 bodies
+static bool float4_bodies(const GpuState& g) {
+    return tiled_kernel(g) || g.kernel == GpuKernel::Ensemble;
+}
+
+// Compile the kernel source for g.device with the given TILE_SIZE and precision variant (or load
+// it from the binary cache, which is keyed on the options)
+static cl_program build_program(GpuState& g, const std::string& src, size_t tile_size) {
+    std::string options = "-D TILE_SIZE=" + std::to_string(tile_size);
+    switch (g.precision) {
+    case PrecisionMode::Mixed:  options += " -D ACCUM_DOUBLE"; break;
+    case PrecisionMode::Kahan:  options += " -D ACCUM_KAHAN";  break;
+    case PrecisionMode::Double: options += " -D PAIR_DOUBLE";  break;
+    default: break;
+    }
+    return buildOpenCLProgram(g.context, g.device, src, options, g.binary_cache);
+}
+
+// Arguments of the pack kernel: SoA x / y / mass / pinned into body; returns the first error
+static cl_int set_pack_args(GpuState& g, cl_kernel k, cl_mem body, int n) {
+    cl_int err = CL_SUCCESS;
+    setOpenCLArg(err, k, 0, sizeof(cl_mem), &g.buf_x);
+    setOpenCLArg(err, k, 1, sizeof(cl_mem), &g.buf_y);
+    setOpenCLArg(err, k, 2, sizeof(cl_mem), &g.buf_mass);
+    setOpenCLArg(err, k, 3, sizeof(cl_mem), &g.buf_pinned);
+    setOpenCLArg(err, k, 4, sizeof(cl_mem), &body);
+    setOpenCLArg(err, k, 5, sizeof(int),    &n);
+    return err;
+}
+
+// Arguments of compute_forces_tiled, including the __local tile; returns the first error
+static cl_int set_forces_tiled_args(GpuState& g, cl_kernel k, cl_mem body, int n, float G, float eps, size_t tile_size) {
+    cl_int err = CL_SUCCESS;
+    setOpenCLArg(err, k, 0, sizeof(cl_mem), &body);
+    setOpenCLArg(err, k, 1, sizeof(cl_mem), &g.buf_ax);
+    setOpenCLArg(err, k, 2, sizeof(cl_mem), &g.buf_ay);
+    setOpenCLArg(err, k, 3, sizeof(int),    &n);
+    setOpenCLArg(err, k, 4, sizeof(float),  &G);
+    setOpenCLArg(err, k, 5, sizeof(float),  &eps);
+    setOpenCLArg(err, k, 6, sizeof(cl_float4) * tile_size, NULL);
+    return err;
+}
+
+// Arguments of the fused step_tiled kernel, including the __local tile; returns the first error
+static cl_int set_step_tiled_args(GpuState& g, cl_kernel k, cl_mem body_in, cl_mem body_out, int n,
+                                  float G, float eps, float dt, int width, int height, size_t tile_size)
+{
+    cl_int err = CL_SUCCESS;
+    setOpenCLArg(err, k,  0, sizeof(cl_mem), &body_in);
+    setOpenCLArg(err, k,  1, sizeof(cl_mem), &body_out);
+    setOpenCLArg(err, k,  2, sizeof(cl_mem), &g.buf_x);
+    setOpenCLArg(err, k,  3, sizeof(cl_mem), &g.buf_y);
+    setOpenCLArg(err, k,  4, sizeof(cl_mem), &g.buf_vx);
+    setOpenCLArg(err, k,  5, sizeof(cl_mem), &g.buf_vy);
+    setOpenCLArg(err, k,  6, sizeof(cl_mem), &g.buf_ax);
+    setOpenCLArg(err, k,  7, sizeof(cl_mem), &g.buf_ay);
+    setOpenCLArg(err, k,  8, sizeof(int),    &n);
+    setOpenCLArg(err, k,  9, sizeof(float),  &G);
+    setOpenCLArg(err, k, 10, sizeof(float),  &eps);
+    setOpenCLArg(err, k, 11, sizeof(float),  &dt);
+    setOpenCLArg(err, k, 12, sizeof(int),    &width);
+    setOpenCLArg(err, k, 13, sizeof(int),    &height);
+    setOpenCLArg(err, k, 14, sizeof(cl_float4) * tile_size, NULL);
+    return err;
+}
+
+// Bodies the autotuner times on: the system itself, capped at 8192
+static size_t tuning_bodies(size_t n) {
+    return std::min<size_t>(n, 8192);
+}
+
+// Tuning results depend on the device, its driver, the kernel variant, its precision and the
+// power-of-two bucket of the bodies they were timed on (a 51-body result says little about 8192)
+static std::string tuning_key(const GpuState& g, GpuKernel kernel) {
+    char name[256] = { 0 };
+    char driver[256] = { 0 };
+    clGetDeviceInfo(g.device, CL_DEVICE_NAME,    sizeof(name) - 1,   name,   NULL);
+    clGetDeviceInfo(g.device, CL_DRIVER_VERSION, sizeof(driver) - 1, driver, NULL);
+    std::string key = std::string(name) + " | " + driver + " | " + gpuKernelName(kernel);
+    if (g.precision != PrecisionMode::Float) key += std::string(" | ") + precisionName(g.precision);
+    size_t bucket = 1;
+    while (bucket < tuning_bodies(g.n)) bucket *= 2;
+    return key + " | n<=" + std::to_string(bucket);
+}
+
+// One autotune.txt entry per line: "<local size> <tile size> <key>"
+static bool parse_tuning(const std::string& line, size_t& local_size, size_t& tile_size, std::string& key) {
+    std::istringstream fields(line);
+    if (!(fields >> local_size >> tile_size)) return false;
+    return static_cast<bool>(std::getline(fields >> std::ws, key));
+}
+
+static bool load_tuning(const std::string& key, size_t& local_size, size_t& tile_size) {
+    std::ifstream in(std::filesystem::path(openclCacheDirectory()) / "autotune.txt");
+    std::string line, entry;
+    size_t local, tile;
+    while (std::getline(in, line)) {
+        if (parse_tuning(line, local, tile, entry) && entry == key) {
+            local_size = local;
+            tile_size = tile;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Replace or append the entry for key; failing to write only means tuning again next time
+static void store_tuning(const std::string& key, size_t local_size, size_t tile_size) {
+    std::filesystem::path dir = openclCacheDirectory();
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+
+    std::vector<std::string> lines;
+    {
+        std::ifstream in(dir / "autotune.txt");
+        std::string line, entry;
+        size_t local, tile;
+        while (std::getline(in, line)) {
+            if (parse_tuning(line, local, tile, entry) && entry == key) continue;
+            lines.push_back(line);
+        }
+    }
+
+    std::ofstream out(dir / "autotune.txt", std::ios::trunc);
+    for (const std::string& line : lines) out << line << "\n";
+    out << local_size << " " << tile_size << " " << key << "\n";
+    if (!out) std::cerr << "Could not write tuning cache in " << dir << "\n";
+}
+
+// Time every (work-group size, tile size) candidate of the kernel the variant launches per step,
+// on a synthetic lattice of tuning_bodies() bodies, and return the fastest. Needs the buffers
+// allocated. A candidate whose launches are rejected is skipped, so no failed timing can win
+static bool autotune(GpuState& g, const std::string& src, GpuKernel kernel, size_t& best_local, size_t& best_tile) {
+    size_t max_group = 0;
+    cl_ulong local_mem = 0;
+    clGetDeviceInfo(g.device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(max_group), &max_group, NULL);
+    clGetDeviceInfo(g.device, CL_DEVICE_LOCAL_MEM_SIZE,      sizeof(local_mem), &local_mem, NULL);
+
+    // a regular lattice keeps the timings free of NaN / denormal slow paths
+    const int n = static_cast<int>(tuning_bodies(g.n));
+    const int side = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(n))));
+    std::vector<float> x(n), y(n), mass(n, 1.f), zero(n, 0.f);
+    std::vector<cl_uchar> pinned(n, 0);
+    for (int i = 0; i < n; ++i) {
+        x[i] = (i % side - side / 2) * 4.f;
+        y[i] = (i / side - side / 2) * 4.f;
+    }
+    size_t bytes = sizeof(float) * n;
+    cl_int uploaded = CL_SUCCESS;
+    for (cl_int write : {
+             clEnqueueWriteBuffer(g.queue, g.buf_x,    CL_FALSE, 0, bytes, x.data(),    0, NULL, NULL),
+             clEnqueueWriteBuffer(g.queue, g.buf_y,    CL_FALSE, 0, bytes, y.data(),    0, NULL, NULL),
+             clEnqueueWriteBuffer(g.queue, g.buf_vx,   CL_FALSE, 0, bytes, zero.data(), 0, NULL, NULL),
+             clEnqueueWriteBuffer(g.queue, g.buf_vy,   CL_FALSE, 0, bytes, zero.data(), 0, NULL, NULL),
+             clEnqueueWriteBuffer(g.queue, g.buf_pinned, CL_FALSE, 0, n, pinned.data(), 0, NULL, NULL),
+             clEnqueueWriteBuffer(g.queue, g.buf_mass, CL_TRUE,  0, bytes, mass.data(), 0, NULL, NULL) })
+        if (uploaded == CL_SUCCESS) uploaded = write;
+    if (!checkOpenCL(uploaded, "clEnqueueWriteBuffer (autotune)")) {
+        clFinish(g.queue);
+        return false;
+    }
+
+    const size_t local_sizes[] = { 32, 64, 128, 256, 512 };
+    const size_t tile_sizes[]  = { 32, 64, 128, 256, 512, 1024, 2048 };
+    const float G = 1.f, eps = 0.1f, dt = 0.1f;
+    const int width = 1920, height = 1080;
+    double best_time = std::numeric_limits<double>::max();
+    bool packed = false;
+
+    for (size_t tile : tile_sizes) {
+        // keep half of the local memory free for the implementation
+        if (sizeof(cl_float4) * tile > local_mem / 2) break;
+        cl_program program = build_program(g, src, tile);
+        if (!program) continue;
+
+        cl_int err;
+        const char* name = kernel == GpuKernel::Fused ? "step_tiled" : "compute_forces_tiled";
+        cl_kernel k = clCreateKernel(program, name, &err);
+        if (err != CL_SUCCESS) {
+            clReleaseProgram(program);
+            continue;
+        }
+        size_t kernel_group = 0;
+        clGetKernelWorkGroupInfo(k, g.device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(kernel_group), &kernel_group, NULL);
+
+        if (!packed) {
+            cl_kernel pack = clCreateKernel(program, "pack_bodies", &err);
+            size_t global = n;
+            packed = err == CL_SUCCESS && set_pack_args(g, pack, g.buf_body[0], n) == CL_SUCCESS
+                     && clEnqueueNDRangeKernel(g.queue, pack, 1, NULL, &global, NULL, 0, NULL, NULL) == CL_SUCCESS;
+            clFinish(g.queue);
+            if (pack) clReleaseKernel(pack);
+        }
+        // a tile size whose __local buffer the kernel cannot take is skipped like one that fails to build
+        if (packed) {
+            err = kernel == GpuKernel::Fused
+                ? set_step_tiled_args(g, k, g.buf_body[0], g.buf_body[1], n, G, eps, dt, width, height, tile)
+                : set_forces_tiled_args(g, k, g.buf_body[0], n, G, eps, tile);
+        }
+        if (!packed || err != CL_SUCCESS) {
+            clReleaseKernel(k);
+            clReleaseProgram(program);
+            continue;
+        }
+
+        for (size_t local : local_sizes) {
+            // a tile spans one to four work-groups worth of cooperative loads
+            if (local > tile || tile > 4 * local || local > max_group || local > kernel_group) continue;
+            size_t global = roundUpToMultiple(n, local);
+
+            // one warm-up launch, then the mean of three
+            if (clEnqueueNDRangeKernel(g.queue, k, 1, NULL, &global, &local, 0, NULL, NULL) != CL_SUCCESS) continue;
+            if (clFinish(g.queue) != CL_SUCCESS) continue;
+            auto start = std::chrono::steady_clock::now();
+            cl_int launched = CL_SUCCESS;
+            for (int r = 0; r < 3 && launched == CL_SUCCESS; ++r)
+                launched = clEnqueueNDRangeKernel(g.queue, k, 1, NULL, &global, &local, 0, NULL, NULL);
+            cl_int finished = clFinish(g.queue);
+            if (launched != CL_SUCCESS || finished != CL_SUCCESS) continue;
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / 3;
 
-    // load kernel source
-    std::ifstream cl_file("../opencl/NBody.cl");
+            if (seconds < best_time) {
+                best_time = seconds;
+                best_local = local;
+                best_tile = tile;
+            }
+        }
+        clReleaseKernel(k);
+        clReleaseProgram(program);
+    }
+
+    if (best_time == std::numeric_limits<double>::max()) {
+        std::cerr << "OpenCL autotune found no working configuration\n";
+        return false;
+    }
+    std::cerr << "OpenCL autotune (" << gpuKernelName(kernel) << "): work-group " << best_local
+              << ", tile " << best_tile << "\n";
+    return true;
+}
+
+// Kernel source: compiled into the executable, or read from $NBODY_KERNEL_FILE while editing kernels
+static bool kernel_source(std::string& src) {
+    const char* path = std::getenv("NBODY_KERNEL_FILE");
+    if (!path) {
+        src = NBODY_KERNEL_SOURCE;
+        return true;
+    }
+    std::ifstream cl_file(path);
     if (!cl_file.is_open()) {
-        std::cerr << "Failed to open OpenCL kernel file\n";
-        return;
-    }
-    std::string src{ std::istreambuf_iterator<char>(cl_file),
-                     std::istreambuf_iterator<char>() };
-    const char* source_str = src.c_str();
-    size_t source_size = src.size();
-
-    // platform & device
-    cl_platform_id platform;
-    cl_uint num_platforms;
-    err = clGetPlatformIDs(1, &platform, &num_platforms);
-    cl_device_id device;
-    cl_uint num_devices;
-    err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, &num_devices);
-
-    // context & queue
-    s_context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
-    s_queue   = clCreateCommandQueue(s_context, device, 0, &err);
+        std::cerr << "Failed to open OpenCL kernel file " << path << "\n";
+        return false;
+    }
+    src.assign(std::istreambuf_iterator<char>(cl_file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// Every step of initialization; on false the caller releases whatever was created
+static bool init_device(GpuState& g, const GpuOptions& options) {
+    cl_int err;
+
+    std::string src;
+    if (!kernel_source(src)) return false;
+
+    // platform & device: explicit option, else $NBODY_OPENCL_DEVICE, else first GPU with CPU fallback
+#ifdef NBODY_PROFILING
+    const cl_command_queue_properties queue_properties = CL_QUEUE_PROFILING_ENABLE;
+#else
+    const cl_command_queue_properties queue_properties = 0;
+#endif
+    OpenCLDeviceInfo selected;
+    if (!createOpenCLQueue(options.device, queue_properties, selected, g.context, g.queue)) return false;
+    g.device = selected.device;
+    if ((g.precision == PrecisionMode::Mixed || g.precision == PrecisionMode::Double) && !selected.fp64) {
+        std::cerr << selected.name << " has no cl_khr_fp64; precision '" << precisionName(g.precision)
+                  << "' is not available on it\n";
+        return false;
+    }
+
+    // buffers (no host copy here)
+    size_t bytes = sizeof(float) * g.n;
+    for (cl_mem* buf : { &g.buf_x, &g.buf_y, &g.buf_vx, &g.buf_vy, &g.buf_ax, &g.buf_ay }) {
+        *buf = clCreateBuffer(g.context, CL_MEM_READ_WRITE, bytes, NULL, &err);
+        if (!checkOpenCL(err, "clCreateBuffer")) return false;
+    }
+    // mass and pinned flags are only read by the step kernels, but a reorder gathers into them
+    for (cl_mem* buf : { &g.buf_mass, &g.buf_scratch }) {
+        *buf = clCreateBuffer(g.context, CL_MEM_READ_WRITE, bytes, NULL, &err);
+        if (!checkOpenCL(err, "clCreateBuffer")) return false;
+    }
+    for (cl_mem* buf : { &g.buf_pinned, &g.buf_scratch_bytes }) {
+        *buf = clCreateBuffer(g.context, CL_MEM_READ_WRITE, g.n, NULL, &err);
+        if (!checkOpenCL(err, "clCreateBuffer")) return false;
+    }
+    g.buf_perm = clCreateBuffer(g.context, CL_MEM_READ_ONLY, sizeof(cl_uint) * g.n, NULL, &err);
+    if (!checkOpenCL(err, "clCreateBuffer")) return false;
+    if (float4_bodies(g)) {
+        for (cl_mem& buf : g.buf_body) {
+            buf = clCreateBuffer(g.context, CL_MEM_READ_WRITE, sizeof(cl_float4) * g.n, NULL, &err);
+            if (!checkOpenCL(err, "clCreateBuffer")) return false;
+        }
+    }
+
+    // pinned staging for the resident mode: [slot][x | y], mapped once for the lifetime of the buffer
+    g.buf_staging = clCreateBuffer(g.context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, 4 * bytes, NULL, &err);
+    if (!checkOpenCL(err, "clCreateBuffer (pinned staging)")) return false;
+    g.staging_host = static_cast<float*>(clEnqueueMapBuffer(g.queue, g.buf_staging, CL_TRUE,
+                                                            CL_MAP_READ | CL_MAP_WRITE, 0, 4 * bytes,
+                                                            0, NULL, NULL, &err));
+    if (!checkOpenCL(err, "clEnqueueMapBuffer (pinned staging)") || !g.staging_host) return false;
+
+    // ensemble system offsets, read by the step kernel only
+    if (g.kernel == GpuKernel::Ensemble) {
+        g.systems = options.systems.size() - 1;
+        g.buf_offset = clCreateBuffer(g.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                      sizeof(cl_uint) * options.systems.size(),
+                                      const_cast<uint32_t*>(options.systems.data()), &err);
+        if (!checkOpenCL(err, "clCreateBuffer (system offsets)")) return false;
+    }
+
+    // launch geometry: explicit options, else the on-disk cache, else the autotuner, else defaults.
+    // An ensemble work-group covers one system, so its default is the largest system (32 to 256)
+    size_t local = options.local_size;
+    size_t tile = options.tile_size;
+    if (local == 0 && g.kernel == GpuKernel::Ensemble) {
+        size_t largest = 0;
+        for (size_t s = 0; s < g.systems; ++s)
+            largest = std::max<size_t>(largest, options.systems[s + 1] - options.systems[s]);
+        local = std::min<size_t>(std::max<size_t>(roundUpToMultiple(largest, 32), 32), 256);
+    }
+    if (local == 0 && tile == 0 && tiled_kernel(g)) {
+        std::string key = tuning_key(g, g.kernel);
+        if (!load_tuning(key, local, tile) && options.autotune && autotune(g, src, g.kernel, local, tile))
+            store_tuning(key, local, tile);
+    }
+    if (local == 0) local = tile ? std::min<size_t>(tile, 64) : 64;
+    if (tile == 0) tile = std::max<size_t>(local, 64);
+    tile = roundUpToMultiple(tile, 4);
 
     // program build
-    s_program = clCreateProgramWithSource(s_context, 1, &source_str, &source_size, &err);
-    err = clBuildProgram(s_program, 1, &device, NULL, NULL, NULL);
+    g.program = build_program(g, src, tile);
+    if (!g.program) return false;
 
     // kernels
-    s_k_forces    = clCreateKernel(s_program, "compute_forces",    &err);
-    s_k_integrate = clCreateKernel(s_program, "integrate_bodies", &err);
+    const bool tiled = tiled_kernel(g);
+    const bool tracer = g.kernel == GpuKernel::Tracer;
+    const bool ensemble = g.kernel == GpuKernel::Ensemble;
+    struct { cl_kernel* kernel; const char* name; bool used; } kernels[] = {
+        { &g.k_forces,          "compute_forces",       true   },
+        { &g.k_integrate,       "integrate_bodies",     true   },
+        { &g.k_gather_floats,   "gather_floats",        true   },
+        { &g.k_gather_bytes,    "gather_bytes",         true   },
+        { &g.k_pack,            "pack_bodies",          tiled || ensemble },
+        { &g.k_forces_tiled,    "compute_forces_tiled", tiled  },
+        { &g.k_integrate_tiled, "integrate_tiled",      tiled  },
+        { &g.k_step_tiled,      "step_tiled",           tiled  },
+        { &g.k_gather_sources,  "gather_sources",       tracer },
+        { &g.k_tracer_step,     "tracer_step",          tracer },
+        { &g.k_ensemble_step,   "ensemble_step",        ensemble },
+    };
+    for (auto& k : kernels) {
+        if (!k.used) continue;
+        *k.kernel = clCreateKernel(g.program, k.name, &err);
+        if (!checkOpenCL(err, k.name)) return false;
 
-    // buffers (no host copy here)
-    size_t bytes = sizeof(float) * s_n;
-    s_buf_x    = clCreateBuffer(s_context, CL_MEM_READ_WRITE, bytes, NULL, &err);
-    s_buf_y    = clCreateBuffer(s_context, CL_MEM_READ_WRITE, bytes, NULL, &err);
-    s_buf_vx   = clCreateBuffer(s_context, CL_MEM_READ_WRITE, bytes, NULL, &err);
-    s_buf_vy   = clCreateBuffer(s_context, CL_MEM_READ_WRITE, bytes, NULL, &err);
-    s_buf_ax   = clCreateBuffer(s_context, CL_MEM_READ_WRITE, bytes, NULL, &err);
-    s_buf_ay   = clCreateBuffer(s_context, CL_MEM_READ_WRITE, bytes, NULL, &err);
-    s_buf_mass = clCreateBuffer(s_context, CL_MEM_READ_ONLY,  bytes, NULL, &err);
-}
-
-// Execute one simulation step on GPU: upload data, run kernels, download results
-void runGpuComputation(std::vector<Body> &bodies,
+        // the work-group size must be accepted by every kernel that may be launched with it
+        size_t kernel_group = 0;
+        if (clGetKernelWorkGroupInfo(*k.kernel, g.device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(kernel_group),
+                                     &kernel_group, NULL) == CL_SUCCESS && kernel_group > 0)
+            local = std::min(local, kernel_group);
+    }
+
+    // an explicit or cached tile whose __local buffers do not fit would fail every launch
+    cl_ulong local_mem = 0;
+    clGetDeviceInfo(g.device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(local_mem), &local_mem, NULL);
+    const size_t tile_bytes = float4_bodies(g) ? sizeof(cl_float4) * tile
+                            : tracer ? (sizeof(cl_float4) + sizeof(cl_int)) * tile : 0;
+    if (local_mem > 0 && tile_bytes > local_mem) {
+        std::cerr << "OpenCL tile of " << tile << " bodies needs " << tile_bytes << " bytes of local memory, the device has "
+                  << local_mem << "\n";
+        return false;
+    }
+    g.local_size = local;
+    g.tile_size = tile;
+    g.global_size = ensemble ? g.systems * g.local_size : roundUpToMultiple(g.n, g.local_size);
+    return true;
+}
+
+// Initialize an engine: select a device, compile (or load cached) kernels, and allocate device
+// buffers. Any failure releases what was created and returns null
+std::unique_ptr<GpuEngine> GpuEngine::create(size_t n_bodies, const GpuOptions& options) {
+    std::unique_ptr<GpuEngine> engine(new GpuEngine(new GpuState()));
+    GpuState& g = *engine->m_state;
+    g.n = n_bodies;
+    g.kernel = options.kernel;
+    g.precision = options.precision;
+    g.tracers = options.tracers;
+    g.binary_cache = options.binary_cache;
+
+    if (g.kernel == GpuKernel::Ensemble && (options.systems.size() < 2 || options.systems.back() != n_bodies)) {
+        std::cerr << "The ensemble kernel needs system offsets ending at " << n_bodies << "\n";
+        return nullptr;
+    }
+    if (!init_device(g, options)) return nullptr;
+    return engine;
+}
+
+bool initGpuComputation(size_t n_bodies) {
+    return initGpuComputation(n_bodies, GpuOptions());
+}
+
+bool initGpuComputation(size_t n_bodies, const GpuOptions& options) {
+    s_default = GpuEngine::create(n_bodies, options);
+    return s_default != nullptr;
+}
+
+// Rebuild the float4 bodies from the SoA buffers after the host wrote new state (tiled variants)
+static bool enqueue_pack(GpuState& g) {
+    if (!float4_bodies(g)) return true;
+    // one work-item per body (global_size of the ensemble kernel counts work-groups per system)
+    size_t global = roundUpToMultiple(g.n, g.local_size);
+    if (!checkOpenCL(set_pack_args(g, g.k_pack, g.buf_body[g.body], static_cast<int>(g.n)), "clSetKernelArg (pack_bodies)"))
+        return false;
+    return checkOpenCL(clEnqueueNDRangeKernel(g.queue, g.k_pack, 1, NULL, &global, &g.local_size, 0, NULL,
+                                              PROFILED("pack_bodies")),
+                       "clEnqueueNDRangeKernel (pack_bodies)");
+}
+
+// Upload the source list of the tracer kernel (g.sources, ids already in the current body order),
+// growing the device buffers if it got longer
+static bool write_sources(GpuState& g) {
+    const size_t count = g.sources.size();
+    std::vector<cl_float4> source(count);
+    for (size_t k = 0; k < count; ++k)
+        source[k] = cl_float4{ { g.sources.x[k], g.sources.y[k], g.sources.mass[k], g.sources.eps2[k] } };
+
+    if (count > g.source_capacity || !g.buf_source) {
+        if (g.buf_source)    clReleaseMemObject(g.buf_source);
+        if (g.buf_source_id) clReleaseMemObject(g.buf_source_id);
+        g.buf_source_id = nullptr;
+        g.source_capacity = std::max<size_t>(count, 1);
+        cl_int err;
+        g.buf_source = clCreateBuffer(g.context, CL_MEM_READ_WRITE, sizeof(cl_float4) * g.source_capacity, NULL, &err);
+        if (!checkOpenCL(err, "clCreateBuffer (sources)")) return false;
+        g.buf_source_id = clCreateBuffer(g.context, CL_MEM_READ_ONLY, sizeof(cl_int) * g.source_capacity, NULL, &err);
+        if (!checkOpenCL(err, "clCreateBuffer (source ids)")) return false;
+    }
+    if (count == 0) return true;
+    cl_int err = clEnqueueWriteBuffer(g.queue, g.buf_source, CL_FALSE, 0, sizeof(cl_float4) * count, source.data(),
+                                      0, NULL, PROFILED("write sources"));
+    if (!checkOpenCL(err, "clEnqueueWriteBuffer (sources)")) return false;
+    err = clEnqueueWriteBuffer(g.queue, g.buf_source_id, CL_TRUE, 0, sizeof(cl_int) * count, g.sources.id.data(),
+                               0, NULL, PROFILED("write source ids"));
+    return checkOpenCL(err, "clEnqueueWriteBuffer (source ids)");
+}
+
+// Rebuild the tracer kernel's sources from bodies. eps is left to the kernel (eps2 = 0 means the
+// step's eps), so the list stays valid when eps changes
+static bool upload_sources(GpuState& g, const std::vector<Body>& bodies) {
+    if (g.kernel != GpuKernel::Tracer) return true;
+    buildForceSources(bodies, g.tracers, 0.f, g.sources, g.moving);
+    return write_sources(g);
+}
+
+// Enqueue one step of the selected kernel variant, chained by events (no host synchronization).
+// Waits for 'wait' if given and returns the event of the last launch in 'done'. Prints the cause and
+// returns false if an argument or a launch is rejected (then nothing is returned in 'done')
+static bool enqueue_step(GpuState& g, const float G, const float eps, const float dt, const int width, const int height,
+                         cl_event wait, cl_event* done)
+{
+    int ni = static_cast<int>(g.n);
+    cl_int err = CL_SUCCESS;
+    cl_uint n_wait = wait ? 1 : 0;
+    const cl_event* wait_list = wait ? &wait : NULL;
+
+    if (g.kernel == GpuKernel::Tracer) {
+        int n_sources = static_cast<int>(g.sources.size());
+        int n_moving = static_cast<int>(g.moving);
+        cl_event gathered = nullptr;
+        if (n_moving > 0) {
+            size_t global = roundUpToMultiple(g.moving, g.local_size);
+            setOpenCLArg(err, g.k_gather_sources, 0, sizeof(cl_mem), &g.buf_x);
+            setOpenCLArg(err, g.k_gather_sources, 1, sizeof(cl_mem), &g.buf_y);
+            setOpenCLArg(err, g.k_gather_sources, 2, sizeof(cl_mem), &g.buf_source);
+            setOpenCLArg(err, g.k_gather_sources, 3, sizeof(cl_mem), &g.buf_source_id);
+            setOpenCLArg(err, g.k_gather_sources, 4, sizeof(int),    &n_moving);
+            if (!checkOpenCL(err, "clSetKernelArg (gather_sources)")) return false;
+            err = clEnqueueNDRangeKernel(g.queue, g.k_gather_sources, 1, NULL, &global, &g.local_size,
+                                         n_wait, wait_list, &gathered);
+            if (!checkOpenCL(err, "clEnqueueNDRangeKernel (gather_sources)")) return false;
+            NBODY_PROFILE_GPU_EVENT("gather_sources", gathered);
+            n_wait = 1;
+            wait_list = &gathered;
+        }
+
+        setOpenCLArg(err, g.k_tracer_step,  0, sizeof(cl_mem), &g.buf_source);
+        setOpenCLArg(err, g.k_tracer_step,  1, sizeof(cl_mem), &g.buf_source_id);
+        setOpenCLArg(err, g.k_tracer_step,  2, sizeof(int),    &n_sources);
+        setOpenCLArg(err, g.k_tracer_step,  3, sizeof(cl_mem), &g.buf_x);
+        setOpenCLArg(err, g.k_tracer_step,  4, sizeof(cl_mem), &g.buf_y);
+        setOpenCLArg(err, g.k_tracer_step,  5, sizeof(cl_mem), &g.buf_vx);
+        setOpenCLArg(err, g.k_tracer_step,  6, sizeof(cl_mem), &g.buf_vy);
+        setOpenCLArg(err, g.k_tracer_step,  7, sizeof(cl_mem), &g.buf_ax);
+        setOpenCLArg(err, g.k_tracer_step,  8, sizeof(cl_mem), &g.buf_ay);
+        setOpenCLArg(err, g.k_tracer_step,  9, sizeof(cl_mem), &g.buf_pinned);
+        setOpenCLArg(err, g.k_tracer_step, 10, sizeof(int),    &ni);
+        setOpenCLArg(err, g.k_tracer_step, 11, sizeof(float),  &G);
+        setOpenCLArg(err, g.k_tracer_step, 12, sizeof(float),  &eps);
+        setOpenCLArg(err, g.k_tracer_step, 13, sizeof(float),  &dt);
+        setOpenCLArg(err, g.k_tracer_step, 14, sizeof(int),    &width);
+        setOpenCLArg(err, g.k_tracer_step, 15, sizeof(int),    &height);
+        setOpenCLArg(err, g.k_tracer_step, 16, sizeof(cl_float4) * g.tile_size, NULL);
+        setOpenCLArg(err, g.k_tracer_step, 17, sizeof(cl_int) * g.tile_size, NULL);
+        cl_event step_done = nullptr;
+        if (checkOpenCL(err, "clSetKernelArg (tracer_step)")) {
+            err = clEnqueueNDRangeKernel(g.queue, g.k_tracer_step, 1, NULL, &g.global_size, &g.local_size,
+                                         n_wait, wait_list, &step_done);
+            checkOpenCL(err, "clEnqueueNDRangeKernel (tracer_step)");
+        }
+        if (gathered) clReleaseEvent(gathered);
+        if (err != CL_SUCCESS) return false;
+        NBODY_PROFILE_GPU_EVENT("tracer_step", step_done);
+        if (done) *done = step_done;
+        else if (step_done) clReleaseEvent(step_done);
+        return true;
+    }
+
+    if (g.kernel == GpuKernel::Ensemble) {
+        setOpenCLArg(err, g.k_ensemble_step,  0, sizeof(cl_mem), &g.buf_body[g.body]);
+        setOpenCLArg(err, g.k_ensemble_step,  1, sizeof(cl_mem), &g.buf_body[g.body ^ 1]);
+        setOpenCLArg(err, g.k_ensemble_step,  2, sizeof(cl_mem), &g.buf_x);
+        setOpenCLArg(err, g.k_ensemble_step,  3, sizeof(cl_mem), &g.buf_y);
+        setOpenCLArg(err, g.k_ensemble_step,  4, sizeof(cl_mem), &g.buf_vx);
+        setOpenCLArg(err, g.k_ensemble_step,  5, sizeof(cl_mem), &g.buf_vy);
+        setOpenCLArg(err, g.k_ensemble_step,  6, sizeof(cl_mem), &g.buf_ax);
+        setOpenCLArg(err, g.k_ensemble_step,  7, sizeof(cl_mem), &g.buf_ay);
+        setOpenCLArg(err, g.k_ensemble_step,  8, sizeof(cl_mem), &g.buf_offset);
+        setOpenCLArg(err, g.k_ensemble_step,  9, sizeof(float),  &G);
+        setOpenCLArg(err, g.k_ensemble_step, 10, sizeof(float),  &eps);
+        setOpenCLArg(err, g.k_ensemble_step, 11, sizeof(float),  &dt);
+        setOpenCLArg(err, g.k_ensemble_step, 12, sizeof(int),    &width);
+        setOpenCLArg(err, g.k_ensemble_step, 13, sizeof(int),    &height);
+        setOpenCLArg(err, g.k_ensemble_step, 14, sizeof(cl_float4) * g.tile_size, NULL);
+        if (!checkOpenCL(err, "clSetKernelArg (ensemble_step)")) return false;
+        cl_event step_done = nullptr;
+        err = clEnqueueNDRangeKernel(g.queue, g.k_ensemble_step, 1, NULL, &g.global_size, &g.local_size,
+                                     n_wait, wait_list, &step_done);
+        if (!checkOpenCL(err, "clEnqueueNDRangeKernel (ensemble_step)")) return false;
+        NBODY_PROFILE_GPU_EVENT("ensemble_step", step_done);
+        if (done) *done = step_done;
+        else if (step_done) clReleaseEvent(step_done);
+        g.body ^= 1;
+        return true;
+    }
+
+    if (g.kernel == GpuKernel::Fused) {
+        err = set_step_tiled_args(g, g.k_step_tiled, g.buf_body[g.body], g.buf_body[g.body ^ 1], ni,
+                                  G, eps, dt, width, height, g.tile_size);
+        if (!checkOpenCL(err, "clSetKernelArg (step_tiled)")) return false;
+        cl_event step_done = nullptr;
+        err = clEnqueueNDRangeKernel(g.queue, g.k_step_tiled, 1, NULL, &g.global_size, &g.local_size,
+                                     n_wait, wait_list, &step_done);
+        if (!checkOpenCL(err, "clEnqueueNDRangeKernel (step_tiled)")) return false;
+        NBODY_PROFILE_GPU_EVENT("step_tiled", step_done);
+        if (done) *done = step_done;
+        else if (step_done) clReleaseEvent(step_done);
+        g.body ^= 1;
+        return true;
+    }
+
+    cl_kernel forces = g.k_forces;
+    cl_kernel integrate = g.k_integrate;
+    if (g.kernel == GpuKernel::Tiled) {
+        forces = g.k_forces_tiled;
+        integrate = g.k_integrate_tiled;
+        err = set_forces_tiled_args(g, g.k_forces_tiled, g.buf_body[g.body], ni, G, eps, g.tile_size);
+
+        setOpenCLArg(err, g.k_integrate_tiled,  0, sizeof(cl_mem), &g.buf_body[g.body]);
+        setOpenCLArg(err, g.k_integrate_tiled,  1, sizeof(cl_mem), &g.buf_body[g.body ^ 1]);
+        setOpenCLArg(err, g.k_integrate_tiled,  2, sizeof(cl_mem), &g.buf_x);
+        setOpenCLArg(err, g.k_integrate_tiled,  3, sizeof(cl_mem), &g.buf_y);
+        setOpenCLArg(err, g.k_integrate_tiled,  4, sizeof(cl_mem), &g.buf_vx);
+        setOpenCLArg(err, g.k_integrate_tiled,  5, sizeof(cl_mem), &g.buf_vy);
+        setOpenCLArg(err, g.k_integrate_tiled,  6, sizeof(cl_mem), &g.buf_ax);
+        setOpenCLArg(err, g.k_integrate_tiled,  7, sizeof(cl_mem), &g.buf_ay);
+        setOpenCLArg(err, g.k_integrate_tiled,  8, sizeof(int),    &ni);
+        setOpenCLArg(err, g.k_integrate_tiled,  9, sizeof(float),  &dt);
+        setOpenCLArg(err, g.k_integrate_tiled, 10, sizeof(int),    &width);
+        setOpenCLArg(err, g.k_integrate_tiled, 11, sizeof(int),    &height);
+    } else {
+        setOpenCLArg(err, g.k_forces,    0, sizeof(cl_mem), &g.buf_x);
+        setOpenCLArg(err, g.k_forces,    1, sizeof(cl_mem), &g.buf_y);
+        setOpenCLArg(err, g.k_forces,    2, sizeof(cl_mem), &g.buf_ax);
+        setOpenCLArg(err, g.k_forces,    3, sizeof(cl_mem), &g.buf_ay);
+        setOpenCLArg(err, g.k_forces,    4, sizeof(cl_mem), &g.buf_mass);
+        setOpenCLArg(err, g.k_forces,    5, sizeof(int),    &ni);
+        setOpenCLArg(err, g.k_forces,    6, sizeof(float),  &G);
+        setOpenCLArg(err, g.k_forces,    7, sizeof(float),  &eps);
+
+        setOpenCLArg(err, g.k_integrate, 0, sizeof(cl_mem), &g.buf_x);
+        setOpenCLArg(err, g.k_integrate, 1, sizeof(cl_mem), &g.buf_y);
+        setOpenCLArg(err, g.k_integrate, 2, sizeof(cl_mem), &g.buf_vx);
+        setOpenCLArg(err, g.k_integrate, 3, sizeof(cl_mem), &g.buf_vy);
+        setOpenCLArg(err, g.k_integrate, 4, sizeof(cl_mem), &g.buf_ax);
+        setOpenCLArg(err, g.k_integrate, 5, sizeof(cl_mem), &g.buf_ay);
+        setOpenCLArg(err, g.k_integrate, 6, sizeof(cl_mem), &g.buf_pinned);
+        setOpenCLArg(err, g.k_integrate, 7, sizeof(int),    &ni);
+        setOpenCLArg(err, g.k_integrate, 8, sizeof(float),  &dt);
+        setOpenCLArg(err, g.k_integrate, 9, sizeof(int),    &width);
+        setOpenCLArg(err, g.k_integrate,10, sizeof(int),    &height);
+    }
+
+    const bool tiled = g.kernel == GpuKernel::Tiled;
+    if (!checkOpenCL(err, tiled ? "clSetKernelArg (tiled step)" : "clSetKernelArg (step)")) return false;
+    cl_event forces_done = nullptr, integrate_done = nullptr;
+    err = clEnqueueNDRangeKernel(g.queue, forces, 1, NULL, &g.global_size, &g.local_size,
+                                 n_wait, wait_list, &forces_done);
+    if (!checkOpenCL(err, tiled ? "clEnqueueNDRangeKernel (compute_forces_tiled)" : "clEnqueueNDRangeKernel (compute_forces)"))
+        return false;
+    err = clEnqueueNDRangeKernel(g.queue, integrate, 1, NULL, &g.global_size, &g.local_size, 1, &forces_done,
+                                 &integrate_done);
+    NBODY_PROFILE_GPU_EVENT(tiled ? "compute_forces_tiled" : "compute_forces", forces_done);
+    clReleaseEvent(forces_done);
+    if (!checkOpenCL(err, tiled ? "clEnqueueNDRangeKernel (integrate_tiled)" : "clEnqueueNDRangeKernel (integrate_bodies)"))
+        return false;
+    NBODY_PROFILE_GPU_EVENT(tiled ? "integrate_tiled" : "integrate_bodies", integrate_done);
+    // the tiled pair wrote the other float4 buffer
+    if (tiled) g.body ^= 1;
+    if (done) *done = integrate_done;
+    else if (integrate_done) clReleaseEvent(integrate_done);
+    return true;
+}
+
+// Release the events of a staging slot
+static void release_readback(GpuState& g, int slot) {
+    for (cl_event& e : g.readback[slot]) {
+        if (e) clReleaseEvent(e);
+        e = nullptr;
+    }
+}
+
+// Copy all state to the device once; mass and pinned flags are never uploaded again. A successful
+// upload also clears an earlier launch failure, since it replaces the whole state
+static bool uploadGpuState(GpuState& g, const std::vector<Body>& bodies) {
+    BodiesSOA soa(0);
+    packBodies(bodies, soa);
+
+    size_t bytes = sizeof(float) * g.n;
+    cl_int err = CL_SUCCESS;
+    for (cl_int write : {
+             clEnqueueWriteBuffer(g.queue, g.buf_x,    CL_FALSE, 0, bytes, soa.x.data(),    0, NULL, PROFILED("write x")),
+             clEnqueueWriteBuffer(g.queue, g.buf_y,    CL_FALSE, 0, bytes, soa.y.data(),    0, NULL, PROFILED("write y")),
+             clEnqueueWriteBuffer(g.queue, g.buf_vx,   CL_FALSE, 0, bytes, soa.vx.data(),   0, NULL, PROFILED("write vx")),
+             clEnqueueWriteBuffer(g.queue, g.buf_vy,   CL_FALSE, 0, bytes, soa.vy.data(),   0, NULL, PROFILED("write vy")),
+             clEnqueueWriteBuffer(g.queue, g.buf_mass, CL_FALSE, 0, bytes, soa.mass.data(), 0, NULL, PROFILED("write mass")),
+             clEnqueueWriteBuffer(g.queue, g.buf_pinned, CL_FALSE, 0, g.n, soa.pinned.data(), 0, NULL, PROFILED("write pinned")) })
+        if (err == CL_SUCCESS) err = write;
+    const bool ok = checkOpenCL(err, "clEnqueueWriteBuffer (upload)") && enqueue_pack(g) && upload_sources(g, bodies);
+    // the host copy goes out of scope, so wait for the (non-blocking) writes once here
+    clFinish(g.queue);
+
+    release_readback(g, 0);
+    release_readback(g, 1);
+    g.resident = ok;
+    g.failed = !ok;
+    return ok;
+}
+
+// Blocking download of positions and velocities, for snapshots or handing state back to the CPU.
+// Leaves bodies untouched and returns false if the state is not on the device or a read fails
+static bool downloadGpuState(GpuState& g, std::vector<Body>& bodies) {
+    if (!g.resident || g.failed) return false;
+    BodiesSOA soa(g.n);
+    size_t bytes = sizeof(float) * g.n;
+    cl_int err = CL_SUCCESS;
+    for (cl_int read : {
+             clEnqueueReadBuffer(g.queue, g.buf_x,  CL_FALSE, 0, bytes, soa.x.data(),  0, NULL, PROFILED("read x")),
+             clEnqueueReadBuffer(g.queue, g.buf_y,  CL_FALSE, 0, bytes, soa.y.data(),  0, NULL, PROFILED("read y")),
+             clEnqueueReadBuffer(g.queue, g.buf_vx, CL_FALSE, 0, bytes, soa.vx.data(), 0, NULL, PROFILED("read vx")),
+             clEnqueueReadBuffer(g.queue, g.buf_vy, CL_FALSE, 0, bytes, soa.vy.data(), 0, NULL, PROFILED("read vy")),
+             clEnqueueReadBuffer(g.queue, g.buf_ax, CL_FALSE, 0, bytes, soa.ax.data(), 0, NULL, PROFILED("read ax")),
+             clEnqueueReadBuffer(g.queue, g.buf_ay, CL_TRUE,  0, bytes, soa.ay.data(), 0, NULL, PROFILED("read ay")) })
+        if (err == CL_SUCCESS) err = read;
+    if (!checkOpenCL(err, "clEnqueueReadBuffer (download)")) {
+        clFinish(g.queue);   // the other reads may still target soa
+        return false;
+    }
+    for (size_t i = 0; i < g.n; ++i) soa.mass[i] = bodies[i].mass;
+    unpackBodies(soa, bodies);
+    return true;
+}
+
+// Mark the device copy stale, e.g. after the host edited bodies; the next resident step re-uploads
+static void invalidateGpuState(GpuState& g) {
+    g.resident = false;
+}
+
+// Gather every SoA array through the permutation on the device and rebuild the float4 bodies.
+// Readbacks queued before it hold positions in the old order, so they are dropped; the next
+// readbackGpuPositions then waits for the first one in the new order. A rejected gather leaves the
+// arrays in mixed orders, so it marks the state failed like a rejected step
+static bool permuteGpuState(GpuState& g, const std::vector<uint32_t>& perm) {
+    // not resident yet: the next step uploads the (already reordered) host bodies anyway. Ensemble
+    // systems are fixed index ranges, which a reorder of the whole batch would mix
+    if (!g.resident || perm.size() != g.n || g.kernel == GpuKernel::Ensemble) return true;
+    if (g.failed) return false;
+    NBODY_PROFILE_SCOPE("permute");
+
+    int ni = static_cast<int>(g.n);
+    cl_int err = clEnqueueWriteBuffer(g.queue, g.buf_perm, CL_TRUE, 0, sizeof(cl_uint) * g.n, perm.data(), 0, NULL,
+                                      PROFILED("write perm"));
+    g.failed = !checkOpenCL(err, "clEnqueueWriteBuffer (perm)");
+    for (cl_mem* buf : { &g.buf_x, &g.buf_y, &g.buf_vx, &g.buf_vy, &g.buf_ax, &g.buf_ay, &g.buf_mass }) {
+        if (g.failed) return false;
+        setOpenCLArg(err, g.k_gather_floats, 0, sizeof(cl_mem), buf);
+        setOpenCLArg(err, g.k_gather_floats, 1, sizeof(cl_mem), &g.buf_scratch);
+        setOpenCLArg(err, g.k_gather_floats, 2, sizeof(cl_mem), &g.buf_perm);
+        setOpenCLArg(err, g.k_gather_floats, 3, sizeof(int),    &ni);
+        if (err == CL_SUCCESS)
+            err = clEnqueueNDRangeKernel(g.queue, g.k_gather_floats, 1, NULL, &g.global_size, &g.local_size, 0, NULL,
+                                         PROFILED("gather_floats"));
+        g.failed = !checkOpenCL(err, "gather_floats");
+        std::swap(*buf, g.buf_scratch);
+    }
+    if (g.failed) return false;
+    setOpenCLArg(err, g.k_gather_bytes, 0, sizeof(cl_mem), &g.buf_pinned);
+    setOpenCLArg(err, g.k_gather_bytes, 1, sizeof(cl_mem), &g.buf_scratch_bytes);
+    setOpenCLArg(err, g.k_gather_bytes, 2, sizeof(cl_mem), &g.buf_perm);
+    setOpenCLArg(err, g.k_gather_bytes, 3, sizeof(int),    &ni);
+    if (err == CL_SUCCESS)
+        err = clEnqueueNDRangeKernel(g.queue, g.k_gather_bytes, 1, NULL, &g.global_size, &g.local_size, 0, NULL,
+                                     PROFILED("gather_bytes"));
+    g.failed = !checkOpenCL(err, "gather_bytes");
+    std::swap(g.buf_pinned, g.buf_scratch_bytes);
+    g.failed = g.failed || !enqueue_pack(g);
+
+    // sources that are bodies follow them to their new index
+    if (!g.failed && g.kernel == GpuKernel::Tracer && g.sources.size() > 0) {
+        std::vector<int32_t> position(g.n);
+        for (size_t k = 0; k < g.n; ++k) position[perm[k]] = static_cast<int32_t>(k);
+        for (int32_t& id : g.sources.id)
+            if (id >= 0) id = position[id];
+        g.failed = !write_sources(g);
+    }
+
+    release_readback(g, 0);
+    release_readback(g, 1);
+    return !g.failed;
+}
+
+// Advance the device-resident state by 'steps' steps, queued back-to-back with no host round trip,
+// and queue one asynchronous position readback after the last of them. A rejected launch leaves
+// the state part-way through a step: it is marked failed, and this and every later step (until
+// the next upload) returns false without queuing anything
+static bool stepGpuResident(GpuState& g, const float G, const float eps, const float dt, const int width, const int height, int steps) {
+    if (g.failed) return false;
+    cl_event step_done = nullptr;
+    for (int s = 0; s < steps && !g.failed; ++s) {
+        cl_event previous = step_done;
+        step_done = nullptr;
+        g.failed = !enqueue_step(g, G, eps, dt, width, height, previous, &step_done);
+        if (previous) clReleaseEvent(previous);
+    }
+    if (g.failed) {
+        if (step_done) clReleaseEvent(step_done);
+        std::cerr << "OpenCL step failed; the device state stays unusable until the next upload\n";
+        return false;
+    }
+    if (!step_done) return true;
+
+    // readback into the slot the host is not looking at
+    g.slot ^= 1;
+    release_readback(g, g.slot);
+    size_t bytes = sizeof(float) * g.n;
+    float* slot = g.staging_host + 2 * g.n * g.slot;
+    cl_int err = clEnqueueReadBuffer(g.queue, g.buf_x, CL_FALSE, 0, bytes, slot, 1, &step_done,
+                                     &g.readback[g.slot][0]);
+    if (err == CL_SUCCESS)
+        err = clEnqueueReadBuffer(g.queue, g.buf_y, CL_FALSE, 0, bytes, slot + g.n, 1, &step_done,
+                                  &g.readback[g.slot][1]);
+    clReleaseEvent(step_done);
+    if (!checkOpenCL(err, "clEnqueueReadBuffer (readback)")) {
+        // the steps are queued, only this readback is lost; readbackGpuPositions skips the slot
+        release_readback(g, g.slot);
+        g.slot ^= 1;
+        return false;
+    }
+    NBODY_PROFILE_GPU_EVENT("readback x", g.readback[g.slot][0]);
+    NBODY_PROFILE_GPU_EVENT("readback y", g.readback[g.slot][1]);
+    clFlush(g.queue);
+    return true;
+}
+
+// Copy the newest positions that have finished arriving into bodies. With 'latest' the readback of
+// the most recent step is waited for; otherwise the previous one is used, so the host never waits
+// on work that was just queued. Returns false if no readback has completed yet
+static bool readbackGpuPositions(GpuState& g, std::vector<Body>& bodies, bool latest) {
+    int slot = latest ? g.slot : (g.slot ^ 1);
+    if (!g.readback[slot][0]) {
+        slot ^= 1;
+        if (!g.readback[slot][0]) return false;
+    }
+    if (!checkOpenCL(clWaitForEvents(2, g.readback[slot]), "clWaitForEvents (readback)")) return false;
+
+    const float* x = g.staging_host + 2 * g.n * slot;
+    const float* y = x + g.n;
+    for (size_t i = 0; i < g.n; ++i) {
+        bodies[i].x = x[i];
+        bodies[i].y = y[i];
+    }
+    return true;
+}
+
+// Wait until every queued command has finished
+static void finishGpuComputation(GpuState& g) {
+    clFinish(g.queue);
+}
+
+// Resident steps with the render_bodies signature: uploads on first use, then all substeps are
+// queued at once and only positions come back, one call behind, so drawing frame k overlaps with
+// the device computing the next one. False if the upload or a launch failed
+static bool runGpuResidentSubsteps(GpuState& g, std::vector<Body>& bodies,
+                            const float G,
+                            const float eps,
+                            const float dt,
+                            const int width,
+                            const int height,
+                            const int steps)
+{
+    NBODY_PROFILE_SCOPE("gpu substeps");
+    if (!g.resident && !uploadGpuState(g, bodies)) return false;
+    if (!stepGpuResident(g, G, eps, dt, width, height, steps)) return false;
+    readbackGpuPositions(g, bodies, false);
+    return true;
+}
+
+// Execute one simulation step on GPU: upload data, run kernels, download results. Leaves bodies
+// untouched and returns false if a transfer or launch is rejected
+static bool runGpuComputation(GpuState& g, std::vector<Body> &bodies,
                        const float G,
                        const float eps,
                        const float dt,
@@ -80,62 +972,56 @@ void runGpuComputation(std::vector<Body> &bodies,
                        const int height)
 {
     // pack data into structure-of-arrays for GPU
-    BodiesSOA soa(s_n);
-    for (size_t i = 0; i < s_n; ++i) {
-        soa.x[i]    = bodies[i].x;
-        soa.y[i]    = bodies[i].y;
-        soa.vx[i]   = bodies[i].velocity_x;
-        soa.vy[i]   = bodies[i].velocity_y;
-        soa.ax[i]   = 0.f;
-        soa.ay[i]   = 0.f;
-        soa.mass[i] = bodies[i].mass;
-    }
-
-    size_t bytes = sizeof(float) * s_n;
+    BodiesSOA soa(g.n);
+    {
+        NBODY_PROFILE_SCOPE("pack");
+        for (size_t i = 0; i < g.n; ++i) {
+            soa.x[i]    = bodies[i].x;
+            soa.y[i]    = bodies[i].y;
+            soa.vx[i]   = bodies[i].velocity_x;
+            soa.vy[i]   = bodies[i].velocity_y;
+            soa.ax[i]   = 0.f;
+            soa.ay[i]   = 0.f;
+            soa.mass[i] = bodies[i].mass;
+            soa.pinned[i] = bodies[i].pinned;
+        }
+    }
+
+    size_t bytes = sizeof(float) * g.n;
     // copy input arrays to GPU buffers
-    clEnqueueWriteBuffer(s_queue, s_buf_x,    CL_FALSE, 0, bytes, soa.x.data(),    0, NULL, NULL);
-    clEnqueueWriteBuffer(s_queue, s_buf_y,    CL_FALSE, 0, bytes, soa.y.data(),    0, NULL, NULL);
-    clEnqueueWriteBuffer(s_queue, s_buf_vx,   CL_FALSE, 0, bytes, soa.vx.data(),   0, NULL, NULL);
-    clEnqueueWriteBuffer(s_queue, s_buf_vy,   CL_FALSE, 0, bytes, soa.vy.data(),   0, NULL, NULL);
-    clEnqueueWriteBuffer(s_queue, s_buf_mass, CL_FALSE, 0, bytes, soa.mass.data(), 0, NULL, NULL);
-    clFinish(s_queue);
-
-    int ni = static_cast<int>(s_n);
-    // set kernel arguments and run force computation
-    clSetKernelArg(s_k_forces,    0, sizeof(cl_mem), &s_buf_x);
-    clSetKernelArg(s_k_forces,    1, sizeof(cl_mem), &s_buf_y);
-    clSetKernelArg(s_k_forces,    2, sizeof(cl_mem), &s_buf_ax);
-    clSetKernelArg(s_k_forces,    3, sizeof(cl_mem), &s_buf_ay);
-    clSetKernelArg(s_k_forces,    4, sizeof(cl_mem), &s_buf_mass);
-    clSetKernelArg(s_k_forces,    5, sizeof(int),    &ni);
-    clSetKernelArg(s_k_forces,    6, sizeof(float),  &G);
-    clSetKernelArg(s_k_forces,    7, sizeof(float),  &eps);
-    clEnqueueNDRangeKernel(s_queue, s_k_forces, 1, NULL, &s_n, NULL, 0, NULL, NULL);
-    clFinish(s_queue);
-
-    // set kernel arguments and run integration step
-    clSetKernelArg(s_k_integrate, 0, sizeof(cl_mem), &s_buf_x);
-    clSetKernelArg(s_k_integrate, 1, sizeof(cl_mem), &s_buf_y);
-    clSetKernelArg(s_k_integrate, 2, sizeof(cl_mem), &s_buf_vx);
-    clSetKernelArg(s_k_integrate, 3, sizeof(cl_mem), &s_buf_vy);
-    clSetKernelArg(s_k_integrate, 4, sizeof(cl_mem), &s_buf_ax);
-    clSetKernelArg(s_k_integrate, 5, sizeof(cl_mem), &s_buf_ay);
-    clSetKernelArg(s_k_integrate, 6, sizeof(cl_mem), &s_buf_mass); 
-    clSetKernelArg(s_k_integrate, 7, sizeof(int),    &ni);
-    clSetKernelArg(s_k_integrate, 8, sizeof(float),  &dt);
-    clSetKernelArg(s_k_integrate, 9, sizeof(int),    &width);
-    clSetKernelArg(s_k_integrate,10, sizeof(int),    &height);
-    clEnqueueNDRangeKernel(s_queue, s_k_integrate, 1, NULL, &s_n, NULL, 0, NULL, NULL);
-    clFinish(s_queue);
+    cl_int err = CL_SUCCESS;
+    for (cl_int write : {
+             clEnqueueWriteBuffer(g.queue, g.buf_x,    CL_FALSE, 0, bytes, soa.x.data(),    0, NULL, PROFILED("write x")),
+             clEnqueueWriteBuffer(g.queue, g.buf_y,    CL_FALSE, 0, bytes, soa.y.data(),    0, NULL, PROFILED("write y")),
+             clEnqueueWriteBuffer(g.queue, g.buf_vx,   CL_FALSE, 0, bytes, soa.vx.data(),   0, NULL, PROFILED("write vx")),
+             clEnqueueWriteBuffer(g.queue, g.buf_vy,   CL_FALSE, 0, bytes, soa.vy.data(),   0, NULL, PROFILED("write vy")),
+             clEnqueueWriteBuffer(g.queue, g.buf_mass, CL_FALSE, 0, bytes, soa.mass.data(), 0, NULL, PROFILED("write mass")),
+             clEnqueueWriteBuffer(g.queue, g.buf_pinned, CL_FALSE, 0, g.n, soa.pinned.data(), 0, NULL, PROFILED("write pinned")) })
+        if (err == CL_SUCCESS) err = write;
+
+    // run the force and integration kernels; the in-order queue keeps the writes ahead of them
+    bool ok = checkOpenCL(err, "clEnqueueWriteBuffer (step)") && enqueue_pack(g) && upload_sources(g, bodies)
+              && enqueue_step(g, G, eps, dt, width, height, nullptr, nullptr);
 
     // read updated positions and velocities back to host
-    clEnqueueReadBuffer (s_queue, s_buf_x,  CL_TRUE, 0, bytes, soa.x.data(),  0, NULL, NULL);
-    clEnqueueReadBuffer (s_queue, s_buf_y,  CL_TRUE, 0, bytes, soa.y.data(),  0, NULL, NULL);
-    clEnqueueReadBuffer (s_queue, s_buf_vx, CL_TRUE, 0, bytes, soa.vx.data(), 0, NULL, NULL);
-    clEnqueueReadBuffer (s_queue, s_buf_vy, CL_TRUE, 0, bytes, soa.vy.data(), 0, NULL, NULL);
+    if (ok) {
+        for (cl_int read : {
+                 clEnqueueReadBuffer(g.queue, g.buf_x,  CL_TRUE, 0, bytes, soa.x.data(),  0, NULL, PROFILED("read x")),
+                 clEnqueueReadBuffer(g.queue, g.buf_y,  CL_TRUE, 0, bytes, soa.y.data(),  0, NULL, PROFILED("read y")),
+                 clEnqueueReadBuffer(g.queue, g.buf_vx, CL_TRUE, 0, bytes, soa.vx.data(), 0, NULL, PROFILED("read vx")),
+                 clEnqueueReadBuffer(g.queue, g.buf_vy, CL_TRUE, 0, bytes, soa.vy.data(), 0, NULL, PROFILED("read vy")) })
+            if (err == CL_SUCCESS) err = read;
+        ok = checkOpenCL(err, "clEnqueueReadBuffer (step)");
+    }
+    if (!ok) {
+        // the writes still read soa
+        clFinish(g.queue);
+        return false;
+    }
 
     // unpack results back into host bodies vector
-    for (size_t i = 0; i < s_n; ++i) {
+    NBODY_PROFILE_SCOPE("unpack");
+    for (size_t i = 0; i < g.n; ++i) {
         bodies[i].x          = soa.x[i];
         bodies[i].y          = soa.y[i];
         bodies[i].velocity_x = soa.vx[i];
@@ -143,20 +1029,162 @@ void runGpuComputation(std::vector<Body> &bodies,
         bodies[i].acceleration_x = soa.ax[i];
         bodies[i].acceleration_y = soa.ay[i];
     }
+    return true;
+}
+
+// Clean up: release kernels, program, queue, and memory
+GpuEngine::~GpuEngine() {
+    GpuState& g = *m_state;
+    // unmap the pinned staging buffer and drain the queue before releasing anything
+    if (g.queue) {
+        if (g.buf_staging && g.staging_host)
+            clEnqueueUnmapMemObject(g.queue, g.buf_staging, g.staging_host, 0, NULL, NULL);
+        clFinish(g.queue);
+    }
+    release_readback(g, 0);
+    release_readback(g, 1);
+
+    if (g.buf_offset)    clReleaseMemObject(g.buf_offset);
+    if (g.buf_source_id) clReleaseMemObject(g.buf_source_id);
+    if (g.buf_source)  clReleaseMemObject(g.buf_source);
+    if (g.buf_staging) clReleaseMemObject(g.buf_staging);
+    if (g.buf_perm)    clReleaseMemObject(g.buf_perm);
+    if (g.buf_scratch_bytes) clReleaseMemObject(g.buf_scratch_bytes);
+    if (g.buf_scratch) clReleaseMemObject(g.buf_scratch);
+    if (g.buf_body[1]) clReleaseMemObject(g.buf_body[1]);
+    if (g.buf_body[0]) clReleaseMemObject(g.buf_body[0]);
+    if (g.buf_pinned) clReleaseMemObject(g.buf_pinned);
+    if (g.buf_mass)  clReleaseMemObject(g.buf_mass);
+    if (g.buf_ay)    clReleaseMemObject(g.buf_ay);
+    if (g.buf_ax)    clReleaseMemObject(g.buf_ax);
+    if (g.buf_vy)    clReleaseMemObject(g.buf_vy);
+    if (g.buf_vx)    clReleaseMemObject(g.buf_vx);
+    if (g.buf_y)     clReleaseMemObject(g.buf_y);
+    if (g.buf_x)     clReleaseMemObject(g.buf_x);
+    if (g.k_ensemble_step)   clReleaseKernel(g.k_ensemble_step);
+    if (g.k_tracer_step)     clReleaseKernel(g.k_tracer_step);
+    if (g.k_gather_sources)  clReleaseKernel(g.k_gather_sources);
+    if (g.k_step_tiled)      clReleaseKernel(g.k_step_tiled);
+    if (g.k_integrate_tiled) clReleaseKernel(g.k_integrate_tiled);
+    if (g.k_forces_tiled)    clReleaseKernel(g.k_forces_tiled);
+    if (g.k_pack)            clReleaseKernel(g.k_pack);
+    if (g.k_gather_bytes)    clReleaseKernel(g.k_gather_bytes);
+    if (g.k_gather_floats)   clReleaseKernel(g.k_gather_floats);
+    if (g.k_integrate) clReleaseKernel(g.k_integrate);
+    if (g.k_forces)    clReleaseKernel(g.k_forces);
+    if (g.program)     clReleaseProgram(g.program);
+    if (g.queue)       clReleaseCommandQueue(g.queue);
+    if (g.context)     clReleaseContext(g.context);
+    delete m_state;
 }
 
-// Clean up GPU resources: release kernels, program, queue, and memory
+bool GpuEngine::step(std::vector<Body>& bodies, const float G, const float eps, const float dt,
+                     const int width, const int height)
+{
+    return runGpuComputation(*m_state, bodies, G, eps, dt, width, height);
+}
+
+bool GpuEngine::upload(const std::vector<Body>& bodies) {
+    return uploadGpuState(*m_state, bodies);
+}
+
+bool GpuEngine::download(std::vector<Body>& bodies) {
+    return downloadGpuState(*m_state, bodies);
+}
+
+void GpuEngine::invalidate() {
+    invalidateGpuState(*m_state);
+}
+
+bool GpuEngine::permute(const std::vector<uint32_t>& perm) {
+    return permuteGpuState(*m_state, perm);
+}
+
+bool GpuEngine::stepResident(const float G, const float eps, const float dt, const int width, const int height,
+                             int steps)
+{
+    return stepGpuResident(*m_state, G, eps, dt, width, height, steps);
+}
+
+bool GpuEngine::readback(std::vector<Body>& bodies, bool latest) {
+    return readbackGpuPositions(*m_state, bodies, latest);
+}
+
+void GpuEngine::finish() {
+    finishGpuComputation(*m_state);
+}
+
+bool GpuEngine::runResident(std::vector<Body>& bodies, const float G, const float eps, const float dt,
+                            const int width, const int height, const int steps)
+{
+    return runGpuResidentSubsteps(*m_state, bodies, G, eps, dt, width, height, steps);
+}
+
+// The free functions act on the default state
+
 void cleanupGpuComputation() {
-    if (s_buf_mass)  clReleaseMemObject(s_buf_mass);
-    if (s_buf_ay)    clReleaseMemObject(s_buf_ay);
-    if (s_buf_ax)    clReleaseMemObject(s_buf_ax);
-    if (s_buf_vy)    clReleaseMemObject(s_buf_vy);
-    if (s_buf_vx)    clReleaseMemObject(s_buf_vx);
-    if (s_buf_y)     clReleaseMemObject(s_buf_y);
-    if (s_buf_x)     clReleaseMemObject(s_buf_x);
-    if (s_k_integrate) clReleaseKernel(s_k_integrate);
-    if (s_k_forces)    clReleaseKernel(s_k_forces);
-    if (s_program)     clReleaseProgram(s_program);
-    if (s_queue)       clReleaseCommandQueue(s_queue);
-    if (s_context)     clReleaseContext(s_context);
-}
\ No newline at end of file
+    s_default.reset();
+}
+
+bool uploadGpuState(const std::vector<Body>& bodies) {
+    return s_default->upload(bodies);
+}
+
+bool downloadGpuState(std::vector<Body>& bodies) {
+    return s_default->download(bodies);
+}
+
+void invalidateGpuState() {
+    s_default->invalidate();
+}
+
+bool permuteGpuState(const std::vector<uint32_t>& perm) {
+    return s_default->permute(perm);
+}
+
+bool stepGpuResident(const float G, const float eps, const float dt, const int width, const int height, int steps) {
+    return s_default->stepResident(G, eps, dt, width, height, steps);
+}
+
+bool stepGpuResident(const float G, const float eps, const float dt, const int width, const int height) {
+    return s_default->stepResident(G, eps, dt, width, height, 1);
+}
+
+bool readbackGpuPositions(std::vector<Body>& bodies, bool latest) {
+    return s_default->readback(bodies, latest);
+}
+
+void finishGpuComputation() {
+    s_default->finish();
+}
+
+bool runGpuResidentComputation(std::vector<Body>& bodies,
+                               const float G,
+                               const float eps,
+                               const float dt,
+                               const int width,
+                               const int height)
+{
+    return s_default->runResident(bodies, G, eps, dt, width, height, 1);
+}
+
+bool runGpuResidentSubsteps(std::vector<Body>& bodies,
+                            const float G,
+                            const float eps,
+                            const float dt,
+                            const int width,
+                            const int height,
+                            const int steps)
+{
+    return s_default->runResident(bodies, G, eps, dt, width, height, steps);
+}
+
+bool runGpuComputation(std::vector<Body>& bodies,
+                       const float G,
+                       const float eps,
+                       const float dt,
+                       const int width,
+                       const int height)
+{
+    return s_default->step(bodies, G, eps, dt, width, height);
+}
@@ -0,0 +1,423 @@
+// File: HybridComputation.cpp
+// Implements the CPU + OpenCL split engine
+//  - the device owns rows [0, k) and the CPU rows [k, N); both need every position, so each step
+//    writes the CPU slice to the device and reads the device slice back, nothing else
+//  - device work (slice write, float4 pack, tiled forces over all N, integration of its rows,
+//    slice read) is queued without waiting, then the CPU sums its rows on the pool meanwhile
+//  - new CPU positions go to a back buffer, so the slice write and the other CPU rows still read
+//    the old ones; the device slice is read into the same back buffer and the buffers are swapped
+//  - the device time comes from event timestamps (first write to last read), so transfers count
+//    against the device; the CPU time is wall clock around its pass
+//  - when k moves, the rows that change side carry their velocities (and, towards the device,
+//    their positions) across once
+
+#include <algorithm>  // for std::min, std::max, std::clamp
+#include <chrono>     // for std::chrono::steady_clock
+#include <iostream>   // for std::cerr
+#include <memory>     // for std::unique_ptr
+#include <utility>    // for std::swap
+
+#include "HybridComputation.h"
+#include "NBodyKernelSource.h"   // NBODY_KERNEL_SOURCE, generated from opencl/NBody.cl by CMake
+#include "OpenCLDevice.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+// CPU side
+static std::unique_ptr<ThreadPool> s_pool;
+static HybridOptions               s_options;
+static HybridStats                 s_stats;
+static BodiesSOA                   s_soa(0);
+static AlignedFloats               s_x_next;
+static AlignedFloats               s_y_next;
+
+// Device side: SoA buffers plus the float4 copy the tiled force kernel reads
+static cl_context        s_context     = nullptr;
+static cl_command_queue  s_queue       = nullptr;
+static cl_device_id      s_device      = nullptr;
+static cl_program        s_program     = nullptr;
+static cl_kernel         s_k_pack      = nullptr;
+static cl_kernel         s_k_forces    = nullptr;
+static cl_kernel         s_k_integrate = nullptr;
+static cl_mem            s_buf_x       = nullptr;
+static cl_mem            s_buf_y       = nullptr;
+static cl_mem            s_buf_vx      = nullptr;
+static cl_mem            s_buf_vy      = nullptr;
+static cl_mem            s_buf_ax      = nullptr;
+static cl_mem            s_buf_ay      = nullptr;
+static cl_mem            s_buf_mass    = nullptr;
+static cl_mem            s_buf_pinned  = nullptr;
+static cl_mem            s_buf_body    = nullptr;
+static size_t            s_local_size  = 64;      // work-group size, also the granularity of the split
+static const size_t      TILE_SIZE     = 64;
+
+// Split state
+static size_t            s_rows        = 0;       // device rows k
+static double            s_device_rate = 0.0;     // averaged rows per second
+static double            s_cpu_rate    = 0.0;
+
+size_t hybridSplit(size_t n, double device_rate, double cpu_rate, size_t min_rows, size_t granularity) {
+    if (n < 2 * min_rows) return 0;
+    const double share = device_rate + cpu_rate > 0.0 ? device_rate / (device_rate + cpu_rate) : 0.5;
+    const size_t step = std::max<size_t>(1, granularity);
+    size_t rows = static_cast<size_t>(share * static_cast<double>(n) / static_cast<double>(step) + 0.5) * step;
+    return std::clamp(rows, min_rows, n - min_rows);
+}
+
+// Seconds between the start of 'first' and the end of 'last' on the device clock
+static double device_seconds(cl_event first, cl_event last) {
+    cl_ulong start = 0, end = 0;
+    if (clGetEventProfilingInfo(first, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL) != CL_SUCCESS ||
+        clGetEventProfilingInfo(last,  CL_PROFILING_COMMAND_END,   sizeof(end),   &end,   NULL) != CL_SUCCESS)
+        return 0.0;
+    return end > start ? static_cast<double>(end - start) * 1e-9 : 0.0;
+}
+
+// Every step of the device setup; on false the caller releases whatever was created
+static bool init_device(size_t n) {
+    cl_int err;
+    // event timestamps drive the split, so profiling is always on for this queue
+    OpenCLDeviceInfo selected;
+    if (!createOpenCLQueue(s_options.device, CL_QUEUE_PROFILING_ENABLE, selected, s_context, s_queue)) return false;
+    s_device = selected.device;
+
+    const size_t count = std::max<size_t>(n, 1);
+    for (cl_mem* buf : { &s_buf_x, &s_buf_y, &s_buf_vx, &s_buf_vy, &s_buf_ax, &s_buf_ay, &s_buf_mass }) {
+        *buf = clCreateBuffer(s_context, CL_MEM_READ_WRITE, sizeof(float) * count, NULL, &err);
+        if (!checkOpenCL(err, "clCreateBuffer")) return false;
+    }
+    s_buf_pinned = clCreateBuffer(s_context, CL_MEM_READ_ONLY, count, NULL, &err);
+    if (!checkOpenCL(err, "clCreateBuffer")) return false;
+    s_buf_body = clCreateBuffer(s_context, CL_MEM_READ_WRITE, sizeof(cl_float4) * count, NULL, &err);
+    if (!checkOpenCL(err, "clCreateBuffer")) return false;
+
+    s_program = buildOpenCLProgram(s_context, s_device, NBODY_KERNEL_SOURCE,
+                                   "-D TILE_SIZE=" + std::to_string(TILE_SIZE), s_options.binary_cache);
+    if (!s_program) return false;
+
+    size_t local = TILE_SIZE;
+    for (auto k : { std::make_pair(&s_k_pack, "pack_bodies"), std::make_pair(&s_k_forces, "compute_forces_tiled"),
+                    std::make_pair(&s_k_integrate, "integrate_bodies") }) {
+        *k.first = clCreateKernel(s_program, k.second, &err);
+        if (!checkOpenCL(err, k.second)) return false;
+        size_t kernel_group = 0;
+        if (clGetKernelWorkGroupInfo(*k.first, s_device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(kernel_group),
+                                     &kernel_group, NULL) == CL_SUCCESS && kernel_group > 0)
+            local = std::min(local, kernel_group);
+    }
+    s_local_size = local;
+    return true;
+}
+
+bool initHybridComputation(size_t n_bodies, const HybridOptions& options) {
+    if (!simdKernelSupported(options.kernel)) return false;
+
+    s_options = options;
+    s_pool = std::make_unique<ThreadPool>(options.threads);
+    s_options.threads = s_pool->size();
+    s_stats = HybridStats();
+    s_soa.resize(n_bodies);
+    s_x_next.assign(n_bodies, 0.f);
+    s_y_next.assign(n_bodies, 0.f);
+
+    if (!init_device(n_bodies)) {
+        cleanupHybridComputation();
+        return false;
+    }
+    const double share = std::clamp(static_cast<double>(options.device_share), 0.0, 1.0);
+    s_rows = hybridSplit(n_bodies, share, 1.0 - share, options.min_rows, s_local_size);
+    s_device_rate = 0.0;
+    s_cpu_rate = 0.0;
+    return true;
+}
+
+bool initHybridComputation(size_t n_bodies) {
+    return initHybridComputation(n_bodies, HybridOptions());
+}
+
+// Move the split to 'rows': rows joining the device get their positions and velocities written,
+// rows leaving it get their velocities read back (their positions come back every step). On
+// failure the split stays where it was
+static bool move_split(size_t rows) {
+    if (rows == s_rows) return true;
+    const size_t lo = std::min(rows, s_rows);
+    const size_t hi = std::max(rows, s_rows);
+    const size_t offset = sizeof(float) * lo;
+    const size_t bytes = sizeof(float) * (hi - lo);
+
+    cl_int err = CL_SUCCESS;
+    if (rows > s_rows) {
+        for (cl_int write : {
+                 clEnqueueWriteBuffer(s_queue, s_buf_x,  CL_FALSE, offset, bytes, s_soa.x.data() + lo,  0, NULL, NULL),
+                 clEnqueueWriteBuffer(s_queue, s_buf_y,  CL_FALSE, offset, bytes, s_soa.y.data() + lo,  0, NULL, NULL),
+                 clEnqueueWriteBuffer(s_queue, s_buf_vx, CL_FALSE, offset, bytes, s_soa.vx.data() + lo, 0, NULL, NULL),
+                 clEnqueueWriteBuffer(s_queue, s_buf_vy, CL_TRUE,  offset, bytes, s_soa.vy.data() + lo, 0, NULL, NULL) })
+            if (err == CL_SUCCESS) err = write;
+        if (!checkOpenCL(err, "clEnqueueWriteBuffer (split)")) {
+            clFinish(s_queue);
+            return false;
+        }
+        s_stats.exchanged_bytes += 4 * bytes;
+    }
+    else {
+        for (cl_int read : {
+                 clEnqueueReadBuffer(s_queue, s_buf_vx, CL_FALSE, offset, bytes, s_soa.vx.data() + lo, 0, NULL, NULL),
+                 clEnqueueReadBuffer(s_queue, s_buf_vy, CL_TRUE,  offset, bytes, s_soa.vy.data() + lo, 0, NULL, NULL) })
+            if (err == CL_SUCCESS) err = read;
+        if (!checkOpenCL(err, "clEnqueueReadBuffer (split)")) {
+            clFinish(s_queue);
+            return false;
+        }
+        s_stats.exchanged_bytes += 2 * bytes;
+    }
+    s_rows = rows;
+    ++s_stats.rebalances;
+    return true;
+}
+
+// Queue the device rows of one step; 'first' and 'last' bracket it for timing. On failure nothing
+// is left in flight and both events are null
+static bool enqueue_device_rows(const float G, const float eps, const float dt, const int width, const int height,
+                                cl_event* first, cl_event* last)
+{
+    const size_t n = s_soa.size;
+    const size_t k = s_rows;
+    int ni = static_cast<int>(n);
+    int ki = static_cast<int>(k);
+
+    cl_event written = nullptr, packed = nullptr, forces_done = nullptr, integrate_done = nullptr;
+    *first = nullptr;
+    *last = nullptr;
+    // prints the failing stage, drains the queue and drops the events queued so far
+    auto failed = [&](cl_int err, const char* what) {
+        if (checkOpenCL(err, what)) return false;
+        clFinish(s_queue);
+        for (cl_event* event : { &written, &packed, &forces_done, &integrate_done, last }) {
+            if (*event) clReleaseEvent(*event);
+            *event = nullptr;
+        }
+        return true;
+    };
+
+    // the CPU rows' positions of the previous step; the device rows are current on the device
+    const size_t offset = sizeof(float) * k;
+    const size_t bytes = sizeof(float) * (n - k);
+    cl_int err = CL_SUCCESS;
+    if (n > k) {
+        for (cl_int write : {
+                 clEnqueueWriteBuffer(s_queue, s_buf_x, CL_FALSE, offset, bytes, s_soa.x.data() + k, 0, NULL, &written),
+                 clEnqueueWriteBuffer(s_queue, s_buf_y, CL_FALSE, offset, bytes, s_soa.y.data() + k, 0, NULL, NULL) })
+            if (err == CL_SUCCESS) err = write;
+        if (failed(err, "clEnqueueWriteBuffer (cpu rows)")) return false;
+    }
+
+    size_t all = roundUpToMultiple(n, s_local_size);
+    setOpenCLArg(err, s_k_pack, 0, sizeof(cl_mem), &s_buf_x);
+    setOpenCLArg(err, s_k_pack, 1, sizeof(cl_mem), &s_buf_y);
+    setOpenCLArg(err, s_k_pack, 2, sizeof(cl_mem), &s_buf_mass);
+    setOpenCLArg(err, s_k_pack, 3, sizeof(cl_mem), &s_buf_pinned);
+    setOpenCLArg(err, s_k_pack, 4, sizeof(cl_mem), &s_buf_body);
+    setOpenCLArg(err, s_k_pack, 5, sizeof(int),    &ni);
+    if (failed(err, "clSetKernelArg (pack_bodies)")) return false;
+    err = clEnqueueNDRangeKernel(s_queue, s_k_pack, 1, NULL, &all, &s_local_size, 0, NULL, written ? NULL : &packed);
+    if (failed(err, "clEnqueueNDRangeKernel (pack_bodies)")) return false;
+
+    // forces for rows [0, k) over all n bodies; padding rows up to the group size compute CPU rows
+    // the device never integrates
+    size_t rows = roundUpToMultiple(k, s_local_size);
+    setOpenCLArg(err, s_k_forces, 0, sizeof(cl_mem), &s_buf_body);
+    setOpenCLArg(err, s_k_forces, 1, sizeof(cl_mem), &s_buf_ax);
+    setOpenCLArg(err, s_k_forces, 2, sizeof(cl_mem), &s_buf_ay);
+    setOpenCLArg(err, s_k_forces, 3, sizeof(int),    &ni);
+    setOpenCLArg(err, s_k_forces, 4, sizeof(float),  &G);
+    setOpenCLArg(err, s_k_forces, 5, sizeof(float),  &eps);
+    setOpenCLArg(err, s_k_forces, 6, sizeof(cl_float4) * TILE_SIZE, NULL);
+    if (failed(err, "clSetKernelArg (compute_forces_tiled)")) return false;
+    err = clEnqueueNDRangeKernel(s_queue, s_k_forces, 1, NULL, &rows, &s_local_size, 0, NULL, &forces_done);
+    if (failed(err, "clEnqueueNDRangeKernel (compute_forces_tiled)")) return false;
+
+    setOpenCLArg(err, s_k_integrate,  0, sizeof(cl_mem), &s_buf_x);
+    setOpenCLArg(err, s_k_integrate,  1, sizeof(cl_mem), &s_buf_y);
+    setOpenCLArg(err, s_k_integrate,  2, sizeof(cl_mem), &s_buf_vx);
+    setOpenCLArg(err, s_k_integrate,  3, sizeof(cl_mem), &s_buf_vy);
+    setOpenCLArg(err, s_k_integrate,  4, sizeof(cl_mem), &s_buf_ax);
+    setOpenCLArg(err, s_k_integrate,  5, sizeof(cl_mem), &s_buf_ay);
+    setOpenCLArg(err, s_k_integrate,  6, sizeof(cl_mem), &s_buf_pinned);
+    setOpenCLArg(err, s_k_integrate,  7, sizeof(int),    &ki);
+    setOpenCLArg(err, s_k_integrate,  8, sizeof(float),  &dt);
+    setOpenCLArg(err, s_k_integrate,  9, sizeof(int),    &width);
+    setOpenCLArg(err, s_k_integrate, 10, sizeof(int),    &height);
+    if (failed(err, "clSetKernelArg (integrate_bodies)")) return false;
+    err = clEnqueueNDRangeKernel(s_queue, s_k_integrate, 1, NULL, &rows, &s_local_size, 0, NULL, &integrate_done);
+    if (failed(err, "clEnqueueNDRangeKernel (integrate_bodies)")) return false;
+
+    // the device rows' new positions, into the back buffer the CPU rows are written to
+    for (cl_int read : {
+             clEnqueueReadBuffer(s_queue, s_buf_x, CL_FALSE, 0, sizeof(float) * k, s_x_next.data(), 0, NULL, NULL),
+             clEnqueueReadBuffer(s_queue, s_buf_y, CL_FALSE, 0, sizeof(float) * k, s_y_next.data(), 0, NULL, last) })
+        if (err == CL_SUCCESS) err = read;
+    if (failed(err, "clEnqueueReadBuffer (device rows)")) return false;
+    clFlush(s_queue);
+
+    NBODY_PROFILE_GPU_EVENT("compute_forces_tiled", forces_done);
+    NBODY_PROFILE_GPU_EVENT("integrate_bodies", integrate_done);
+    clReleaseEvent(forces_done);
+    clReleaseEvent(integrate_done);
+
+    *first = written ? written : packed;
+    s_stats.exchanged_bytes += 2 * bytes + 2 * sizeof(float) * k;
+    return true;
+}
+
+// One step of both sides; on failure the positions, the rates and the split are left as they were
+static bool hybrid_step(const float G, const float eps, const float dt, const int width, const int height) {
+    const size_t n = s_soa.size;
+    const size_t k = s_rows;
+
+    cl_event first = nullptr, last = nullptr;
+    if (k > 0 && !enqueue_device_rows(G, eps, dt, width, height, &first, &last)) return false;
+
+    double cpu_seconds = 0.0;
+    if (n > k) {
+        NBODY_PROFILE_SCOPE("cpu rows");
+        auto start = std::chrono::steady_clock::now();
+        const size_t grain = std::max<size_t>(32, ((n - k) / (4 * s_pool->size()) + 31) / 32 * 32);
+        s_pool->parallel_for(n - k, grain, [&](size_t begin, size_t end, size_t) {
+            simd_compute_forces_range(s_soa, k + begin, k + end, G, eps, s_options.kernel);
+            simd_integrate_range_into(s_soa, s_x_next.data(), s_y_next.data(), k + begin, k + end, dt, width, height);
+        });
+        cpu_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    double device_seconds_taken = 0.0;
+    if (k > 0) {
+        NBODY_PROFILE_SCOPE("wait device rows");
+        cl_int err = clWaitForEvents(1, &last);
+        if (err == CL_SUCCESS) device_seconds_taken = device_seconds(first, last);
+        clReleaseEvent(first);
+        clReleaseEvent(last);
+        if (!checkOpenCL(err, "clWaitForEvents (device rows)")) {
+            clFinish(s_queue);
+            return false;
+        }
+    }
+    std::swap(s_soa.x, s_x_next);
+    std::swap(s_soa.y, s_y_next);
+
+    // averaged rates, then the split that would have let both sides finish together
+    const double a = std::clamp(static_cast<double>(s_options.smoothing), 0.0, 1.0);
+    auto average = [a](double& rate, double rows, double seconds) {
+        if (rows <= 0.0 || seconds <= 0.0) return;
+        const double measured = rows / seconds;
+        rate = rate > 0.0 ? a * measured + (1.0 - a) * rate : measured;
+    };
+    average(s_device_rate, static_cast<double>(k), device_seconds_taken);
+    average(s_cpu_rate, static_cast<double>(n - k), cpu_seconds);
+    if (s_options.rebalance && k > 0 && n > k)
+        return move_split(hybridSplit(n, s_device_rate, s_cpu_rate, s_options.min_rows, s_local_size));
+    return true;
+}
+
+bool runHybridSubsteps(std::vector<Body>& bodies,
+                       const float G,
+                       const float eps,
+                       const float dt,
+                       const int width,
+                       const int height,
+                       const int steps)
+{
+    const size_t n = bodies.size();
+    const size_t bytes = sizeof(float) * n;
+    {
+        NBODY_PROFILE_SCOPE("pack");
+        packBodies(bodies, s_soa);
+    }
+    // full state once per call, the steps then only trade position slices; every call starts from
+    // this upload, so a failed call leaves nothing behind for the next one
+    if (s_rows > 0) {
+        cl_int err = CL_SUCCESS;
+        for (cl_int write : {
+                 clEnqueueWriteBuffer(s_queue, s_buf_x,    CL_FALSE, 0, bytes, s_soa.x.data(),    0, NULL, NULL),
+                 clEnqueueWriteBuffer(s_queue, s_buf_y,    CL_FALSE, 0, bytes, s_soa.y.data(),    0, NULL, NULL),
+                 clEnqueueWriteBuffer(s_queue, s_buf_vx,   CL_FALSE, 0, bytes, s_soa.vx.data(),   0, NULL, NULL),
+                 clEnqueueWriteBuffer(s_queue, s_buf_vy,   CL_FALSE, 0, bytes, s_soa.vy.data(),   0, NULL, NULL),
+                 clEnqueueWriteBuffer(s_queue, s_buf_mass, CL_FALSE, 0, bytes, s_soa.mass.data(), 0, NULL, NULL),
+                 clEnqueueWriteBuffer(s_queue, s_buf_pinned, CL_TRUE, 0, n, s_soa.pinned.data(), 0, NULL, NULL) })
+            if (err == CL_SUCCESS) err = write;
+        if (!checkOpenCL(err, "clEnqueueWriteBuffer (upload)")) {
+            clFinish(s_queue);
+            return false;
+        }
+    }
+
+    for (int step = 0; step < steps; ++step) {
+        NBODY_PROFILE_SCOPE("forces + integrate");
+        if (!hybrid_step(G, eps, dt, width, height)) return false;
+    }
+
+    // velocities and accelerations of the device rows (positions are already on the host)
+    if (s_rows > 0) {
+        const size_t rows = sizeof(float) * s_rows;
+        cl_int err = CL_SUCCESS;
+        for (cl_int read : {
+                 clEnqueueReadBuffer(s_queue, s_buf_vx, CL_FALSE, 0, rows, s_soa.vx.data(), 0, NULL, NULL),
+                 clEnqueueReadBuffer(s_queue, s_buf_vy, CL_FALSE, 0, rows, s_soa.vy.data(), 0, NULL, NULL),
+                 clEnqueueReadBuffer(s_queue, s_buf_ax, CL_FALSE, 0, rows, s_soa.ax.data(), 0, NULL, NULL),
+                 clEnqueueReadBuffer(s_queue, s_buf_ay, CL_TRUE,  0, rows, s_soa.ay.data(), 0, NULL, NULL) })
+            if (err == CL_SUCCESS) err = read;
+        if (!checkOpenCL(err, "clEnqueueReadBuffer (download)")) {
+            clFinish(s_queue);
+            return false;
+        }
+    }
+
+    s_stats.steps += steps;
+    s_stats.device_rows = s_rows;
+    s_stats.device_share = n ? static_cast<double>(s_rows) / static_cast<double>(n) : 0.0;
+    s_stats.device_rate = s_device_rate;
+    s_stats.cpu_rate = s_cpu_rate;
+
+    NBODY_PROFILE_SCOPE("unpack");
+    unpackBodies(s_soa, bodies);
+    return true;
+}
+
+bool runHybridComputation(std::vector<Body>& bodies,
+                          const float G,
+                          const float eps,
+                          const float dt,
+                          const int width,
+                          const int height)
+{
+    return runHybridSubsteps(bodies, G, eps, dt, width, height, 1);
+}
+
+const HybridStats& hybridStats() {
+    return s_stats;
+}
+
+void cleanupHybridComputation() {
+    if (s_queue) clFinish(s_queue);
+    for (cl_mem* buf : { &s_buf_body, &s_buf_pinned, &s_buf_mass, &s_buf_ay, &s_buf_ax, &s_buf_vy, &s_buf_vx,
+                         &s_buf_y, &s_buf_x }) {
+        if (*buf) clReleaseMemObject(*buf);
+        *buf = nullptr;
+    }
+    for (cl_kernel* k : { &s_k_integrate, &s_k_forces, &s_k_pack }) {
+        if (*k) clReleaseKernel(*k);
+        *k = nullptr;
+    }
+    if (s_program) clReleaseProgram(s_program);
+    if (s_queue)   clReleaseCommandQueue(s_queue);
+    if (s_context) clReleaseContext(s_context);
+    s_program = nullptr;
+    s_queue = nullptr;
+    s_context = nullptr;
+    s_device = nullptr;
+
+    s_pool.reset();
+    s_soa = BodiesSOA(0);
+    s_x_next = AlignedFloats();
+    s_y_next = AlignedFloats();
+    s_rows = 0;
+}
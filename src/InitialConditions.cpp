@@ -0,0 +1,189 @@
+// File: InitialConditions.cpp
+// Implements the initial condition generator
+//  - every body draws from its own Philox stream keyed by the seed and counted by the body index,
+//    so bodies can be generated in any order, on any number of threads, with identical results
+//  - bodies are written straight into SoA storage in parallel blocks on a ThreadPool
+
+#include <algorithm>  // for std::min, std::max
+#include <cmath>      // for std::sqrt, std::cos, std::sin, std::pow
+#include <iostream>   // for std::cerr
+
+#include "InitialConditions.h"
+#include "Philox.h"
+#include "ThreadPool.h"
+
+constexpr double TWO_PI = 6.28318530717958647692;
+
+// Bodies per parallel task, and the count below which a single thread is quicker than waking workers
+constexpr size_t IC_BLOCK = 16384;
+
+const char* icPresetName(ICPreset preset) {
+    switch (preset) {
+    case ICPreset::Random:      return "random";
+    case ICPreset::UniformDisk: return "uniform-disk";
+    case ICPreset::Plummer:     return "plummer";
+    default:                    return "kepler-disk";
+    }
+}
+
+bool parseICPreset(const std::string& name, ICPreset& preset) {
+    for (ICPreset p : { ICPreset::Random, ICPreset::UniformDisk, ICPreset::Plummer, ICPreset::KeplerDisk }) {
+        if (name == icPresetName(p)) {
+            preset = p;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Position, velocity and mass of one body
+struct ICBody {
+    double x, y, vx, vy, mass;
+};
+
+// Radius with uniform surface density in the annulus [r0, r1)
+static double annulus_radius(PhiloxStream& rng, double r0, double r1) {
+    return std::sqrt(r0 * r0 + (r1 * r1 - r0 * r0) * rng.uniform());
+}
+
+// Unit vector with uniform direction in 3D, projected onto the plane
+static void isotropic_xy(PhiloxStream& rng, double& ux, double& uy) {
+    double z = rng.uniform(-1.0, 1.0);
+    double phi = TWO_PI * rng.uniform();
+    double s = std::sqrt(1.0 - z * z);
+    ux = s * std::cos(phi);
+    uy = s * std::sin(phi);
+}
+
+// Resolved preset parameters shared by every body
+struct ICParams {
+    ICOptions options;
+    double inner_radius;
+    double outer_radius;
+    double plummer_radius;
+    double plummer_mass;     // total mass of the sphere, from the mean body mass
+};
+
+static ICBody generate_one(const ICParams& p, uint64_t index) {
+    const ICOptions& o = p.options;
+    PhiloxStream rng(o.seed, index);
+    ICBody b{};
+    b.mass = rng.uniform(o.min_mass, o.max_mass);
+
+    switch (o.preset) {
+    case ICPreset::Random: {
+        double angle = TWO_PI * rng.uniform();
+        double radius = rng.uniform(p.inner_radius, p.outer_radius);
+        b.x = radius * std::cos(angle);
+        b.y = radius * std::sin(angle);
+        b.vx = rng.uniform(-1.0, 1.0);
+        b.vy = rng.uniform(-1.0, 1.0);
+        break;
+    }
+    case ICPreset::UniformDisk:
+    case ICPreset::KeplerDisk: {
+        double angle = TWO_PI * rng.uniform();
+        double radius = annulus_radius(rng, p.inner_radius, p.outer_radius);
+        b.x = radius * std::cos(angle);
+        b.y = radius * std::sin(angle);
+        if (o.preset == ICPreset::KeplerDisk && o.central_mass > 0.f) {
+            // counter-clockwise circular orbit around the central mass
+            double v = orbital_velocity_scalar(o.G * o.central_mass, static_cast<float>(radius));
+            b.vx = -v * std::sin(angle);
+            b.vy = v * std::cos(angle);
+        }
+        break;
+    }
+    case ICPreset::Plummer: {
+        // radius from the inverted cumulative mass profile, redrawn while the projection falls
+        // outside the box
+        const double a = p.plummer_radius;
+        double r, ux, uy;
+        do {
+            double u = rng.uniform();
+            r = u > 0.0 ? a / std::sqrt(std::pow(u, -2.0 / 3.0) - 1.0) : 0.0;
+            isotropic_xy(rng, ux, uy);
+        } while (r * std::sqrt(ux * ux + uy * uy) > p.outer_radius);
+        b.x = r * ux;
+        b.y = r * uy;
+
+        // speed as a fraction q of the local escape speed, q ~ q^2 (1 - q^2)^3.5 by rejection
+        // (Aarseth, Henon & Wielen 1974)
+        double q, g;
+        do {
+            q = rng.uniform();
+            g = rng.uniform(0.0, 0.1);
+        } while (g > q * q * std::pow(1.0 - q * q, 3.5));
+        double escape = std::sqrt(2.0 * o.G * p.plummer_mass / a) * std::pow(1.0 + r * r / (a * a), -0.25);
+        isotropic_xy(rng, ux, uy);
+        b.vx = q * escape * ux;
+        b.vy = q * escape * uy;
+        break;
+    }
+    }
+    return b;
+}
+
+void generateBodies(BodiesSOA& soa, size_t n, int width, int height, const ICOptions& options) {
+    soa.resize(n);
+    if (n == 0) return;
+
+    ICParams p;
+    p.options = options;
+    p.outer_radius = options.outer_radius > 0.f ? options.outer_radius : std::min(width, height) / 2.0 - 20.0;
+    p.inner_radius = std::max(0.0, static_cast<double>(options.inner_radius));
+    // a box of 40 px or less leaves no default radius, and an annulus needs inner < outer (the
+    // Plummer rejection loop would never end, the disks would draw outside the box)
+    if (p.outer_radius <= 0.0) {
+        std::cerr << "Box " << width << " x " << height << " too small for the initial conditions, outer radius set to 1\n";
+        p.outer_radius = 1.0;
+    }
+    if (p.inner_radius >= p.outer_radius) {
+        std::cerr << "Inner radius " << p.inner_radius << " not below the outer radius " << p.outer_radius
+                  << ", set to " << p.outer_radius / 2.0 << "\n";
+        p.inner_radius = p.outer_radius / 2.0;
+    }
+    p.plummer_radius = options.plummer_radius > 0.f ? options.plummer_radius : p.outer_radius / 4.0;
+
+    const bool central = options.central_mass > 0.f;
+    const size_t count = central ? n - 1 : n;
+    p.plummer_mass = count * 0.5 * (options.min_mass + options.max_mass);
+
+    ThreadPool pool(count < 4 * IC_BLOCK ? 1 : options.threads);
+    pool.parallel_for(count, IC_BLOCK, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            ICBody b = generate_one(p, i);
+            soa.x[i] = static_cast<float>(b.x);
+            soa.y[i] = static_cast<float>(b.y);
+            soa.vx[i] = static_cast<float>(b.vx);
+            soa.vy[i] = static_cast<float>(b.vy);
+            soa.ax[i] = 0.f;
+            soa.ay[i] = 0.f;
+            soa.mass[i] = static_cast<float>(b.mass);
+            soa.pinned[i] = 0;
+            soa.id[i] = static_cast<uint32_t>(i);
+        }
+    });
+
+    if (central) {
+        soa.x[n - 1] = soa.y[n - 1] = 0.f;
+        soa.vx[n - 1] = soa.vy[n - 1] = 0.f;
+        soa.ax[n - 1] = soa.ay[n - 1] = 0.f;
+        soa.mass[n - 1] = options.central_mass;
+        soa.pinned[n - 1] = 1;
+        soa.id[n - 1] = static_cast<uint32_t>(n - 1);
+    }
+}
+
+std::vector<Body> generateBodies(size_t n, int width, int height, const ICOptions& options) {
+    BodiesSOA soa(0);
+    generateBodies(soa, n, width, height, options);
+    std::vector<Body> bodies(n);
+    unpackBodies(soa, bodies);
+    for (size_t i = 0; i < n; ++i) {
+        bodies[i].mass = soa.mass[i];
+        bodies[i].pinned = soa.pinned[i] != 0;
+        bodies[i].id = soa.id[i];
+    }
+    return bodies;
+}
@@ -0,0 +1,192 @@
+// File: Integrators.cpp
+// Implements the integrator engine
+//  - the scheme is picked once per call by a switch; each case instantiates integrate_steps for
+//    its policy, so the kick / drift loops and force calls are inlined with no virtual dispatch
+//  - state stays in SoA form between the steps of a batch; accelerations left by a step are
+//    reused as the starting forces of the next one by the schemes that need them
+//  - energy, momentum and angular momentum are measured against the state before the first step
+
+#include <cmath>      // for std::sqrt, std::abs
+#include <memory>     // for std::unique_ptr
+
+#include "Integrators.h"
+
+// Integrator runtime state
+static std::unique_ptr<ThreadPool>   s_pool;
+static IntegratorOptions             s_options;
+static IntegratorStats               s_stats;
+static BodiesSOA                     s_soa(0);
+static AlignedFloats                 s_saved_ax;    // velocity Verlet: accelerations of the step start
+static AlignedFloats                 s_saved_ay;
+static bool                          s_primed = false;   // ax / ay hold the forces of the current positions
+static float                         s_G = 1.f;          // last step's constants, for measurements on request
+static float                         s_eps = 0.1f;
+
+const char* integratorName(IntegratorScheme scheme) {
+    switch (scheme) {
+    case IntegratorScheme::Euler:          return "euler";
+    case IntegratorScheme::LeapfrogKDK:    return "kdk";
+    case IntegratorScheme::VelocityVerlet: return "verlet";
+    default:                               return "yoshida4";
+    }
+}
+
+bool parseIntegrator(const std::string& name, IntegratorScheme& scheme) {
+    for (IntegratorScheme s : { IntegratorScheme::Euler, IntegratorScheme::LeapfrogKDK,
+                                IntegratorScheme::VelocityVerlet, IntegratorScheme::Yoshida4 }) {
+        if (name == integratorName(s)) {
+            scheme = s;
+            return true;
+        }
+    }
+    return false;
+}
+
+ConservedQuantities measureConserved(const BodiesSOA& soa, float G, float eps, ThreadPool& pool) {
+    struct Partial {
+        ConservedQuantities q;
+        char pad[64];   // keep the workers' sums on separate cache lines
+    };
+    std::vector<Partial> partial(pool.size());
+    const size_t n = soa.size;
+    const double eps2 = static_cast<double>(eps) * eps;
+
+    pool.parallel_for(n, 64, [&](size_t begin, size_t end, size_t worker) {
+        ConservedQuantities& q = partial[worker].q;
+        for (size_t i = begin; i < end; ++i) {
+            const double m = soa.mass[i];
+            const double vx = soa.vx[i], vy = soa.vy[i];
+            q.kinetic += 0.5 * m * (vx * vx + vy * vy);
+            q.px += m * vx;
+            q.py += m * vy;
+            q.lz += m * (soa.x[i] * vy - soa.y[i] * vx);
+            q.momentum_scale += m * std::sqrt(vx * vx + vy * vy);
+
+            // every pair is visited from both ends, hence the half
+            double phi = 0.0;
+            for (size_t j = 0; j < n; ++j) {
+                if (j == i) continue;
+                const double dx = soa.x[j] - soa.x[i];
+                const double dy = soa.y[j] - soa.y[i];
+                phi += soa.mass[j] / std::sqrt(dx * dx + dy * dy + eps2);
+            }
+            q.potential -= 0.5 * G * m * phi;
+        }
+    });
+
+    ConservedQuantities total;
+    for (const Partial& p : partial) {
+        total.kinetic += p.q.kinetic;
+        total.potential += p.q.potential;
+        total.px += p.q.px;
+        total.py += p.q.py;
+        total.lz += p.q.lz;
+        total.momentum_scale += p.q.momentum_scale;
+    }
+    return total;
+}
+
+void measureIntegratorDrift() {
+    if (!s_pool || s_stats.steps == 0) return;
+
+    const ConservedQuantities& q0 = s_stats.initial;
+    const ConservedQuantities q = measureConserved(s_soa, s_G, s_eps, *s_pool);
+    s_stats.current = q;
+    s_stats.measured_step = s_stats.steps;
+    s_stats.energy_error = q0.energy() != 0.0 ? (q.energy() - q0.energy()) / std::abs(q0.energy()) : 0.0;
+    s_stats.max_energy_error = std::max(s_stats.max_energy_error, std::abs(s_stats.energy_error));
+    const double dpx = q.px - q0.px, dpy = q.py - q0.py;
+    s_stats.momentum_error = q0.momentum_scale > 0.0 ? std::sqrt(dpx * dpx + dpy * dpy) / q0.momentum_scale : 0.0;
+    s_stats.angular_momentum_error = q0.lz != 0.0 ? (q.lz - q0.lz) / std::abs(q0.lz) : 0.0;
+}
+
+// 'steps' steps of the configured scheme on s_soa
+static void run_scheme(int steps, const float G, const float eps, const float dt, const int width, const int height) {
+    SimdForces forces{ s_pool.get(), G, eps, s_options.kernel };
+    IntegratorOps<SimdForces> ops(s_soa, forces, *s_pool, s_saved_ax, s_saved_ay, width, height);
+
+    switch (s_options.scheme) {
+    case IntegratorScheme::Euler:
+        integrate_steps<integrator::Euler>(ops, dt, steps, s_primed);
+        break;
+    case IntegratorScheme::LeapfrogKDK:
+        integrate_steps<integrator::LeapfrogKDK>(ops, dt, steps, s_primed);
+        break;
+    case IntegratorScheme::VelocityVerlet:
+        integrate_steps<integrator::VelocityVerlet>(ops, dt, steps, s_primed);
+        break;
+    case IntegratorScheme::Yoshida4:
+        integrate_steps<integrator::Yoshida4>(ops, dt, steps, s_primed);
+        break;
+    }
+    s_primed = true;
+    s_stats.steps += steps;
+    s_stats.force_evaluations += ops.force_passes();
+}
+
+bool initIntegratorComputation(size_t n_bodies, const IntegratorOptions& options) {
+    if (!simdKernelSupported(options.kernel)) return false;
+
+    s_options = options;
+    s_pool = std::make_unique<ThreadPool>(options.threads);
+    s_options.threads = s_pool->size();
+    s_soa.resize(n_bodies);
+    s_saved_ax.resize(n_bodies);
+    s_saved_ay.resize(n_bodies);
+    s_stats = IntegratorStats();
+    s_primed = false;
+    return true;
+}
+
+void runIntegratorSubsteps(std::vector<Body>& bodies,
+                           const float G,
+                           const float eps,
+                           const float dt,
+                           const int width,
+                           const int height,
+                           const int steps)
+{
+    if (bodies.size() != s_soa.size) initIntegratorComputation(bodies.size(), s_options);
+    packBodies(bodies, s_soa);
+    s_saved_ax.resize(s_soa.size);
+    s_saved_ay.resize(s_soa.size);
+    s_G = G;
+    s_eps = eps;
+
+    if (s_stats.steps == 0) s_stats.initial = measureConserved(s_soa, G, eps, *s_pool);
+
+    // split the batch at the monitoring points
+    const uint64_t every = s_options.monitor_every;
+    int left = steps;
+    while (left > 0) {
+        int chunk = left;
+        if (every > 0) chunk = static_cast<int>(std::min<uint64_t>(left, every - s_stats.steps % every));
+        run_scheme(chunk, G, eps, dt, width, height);
+        left -= chunk;
+        if (every > 0 && s_stats.steps % every == 0) measureIntegratorDrift();
+    }
+
+    unpackBodies(s_soa, bodies);
+}
+
+void runIntegratorComputation(std::vector<Body>& bodies,
+                              const float G,
+                              const float eps,
+                              const float dt,
+                              const int width,
+                              const int height)
+{
+    runIntegratorSubsteps(bodies, G, eps, dt, width, height, 1);
+}
+
+const IntegratorStats& integratorStats() {
+    return s_stats;
+}
+
+void cleanupIntegratorComputation() {
+    s_pool.reset();
+    s_soa = BodiesSOA(0);
+    s_saved_ax = AlignedFloats();
+    s_saved_ay = AlignedFloats();
+    s_primed = false;
+}
@@ -0,0 +1,166 @@
+// File: MortonOrder.cpp
+// Implements Morton and Hilbert key generation and the parallel LSD radix sort
+
+#include <algorithm>  // for std::min, std::max, std::fill
+#include <limits>     // for std::numeric_limits
+#include <utility>    // for std::swap
+
+#include "MortonOrder.h"
+#include "ThreadPool.h"
+
+// Spread the low 16 bits of v so that there is a zero bit between each of them
+static uint32_t spread_bits(uint32_t v) {
+    v &= 0x0000FFFFu;
+    v = (v | (v << 8)) & 0x00FF00FFu;
+    v = (v | (v << 4)) & 0x0F0F0F0Fu;
+    v = (v | (v << 2)) & 0x33333333u;
+    v = (v | (v << 1)) & 0x55555555u;
+    return v;
+}
+
+uint32_t morton_encode(uint32_t gx, uint32_t gy) {
+    return spread_bits(gx) | (spread_bits(gy) << 1);
+}
+
+// One quadrant per level from the top: the quadrant's index along the curve is added to d, then the
+// coordinates are flipped / transposed into the frame of that quadrant's sub-curve
+uint32_t hilbert_encode(uint32_t gx, uint32_t gy) {
+    constexpr uint32_t side = 1u << MORTON_BITS;
+    uint32_t d = 0;
+    for (uint32_t s = side / 2; s > 0; s /= 2) {
+        const uint32_t rx = (gx & s) ? 1 : 0;
+        const uint32_t ry = (gy & s) ? 1 : 0;
+        d += s * s * ((3 * rx) ^ ry);
+        if (ry == 0) {
+            if (rx == 1) {
+                gx = side - 1 - gx;
+                gy = side - 1 - gy;
+            }
+            std::swap(gx, gy);
+        }
+    }
+    return d;
+}
+
+// Per-chunk min/max, then a serial reduction over the chunks
+MortonBounds morton_bounds(const float* x, const float* y, size_t n, MortonScratch& scratch, ThreadPool& pool) {
+    const size_t chunks = pool.size();
+    const size_t grain = (n + chunks - 1) / chunks;
+
+    // four slots per chunk: min x, max x, min y, max y
+    scratch.bounds.resize(chunks * 4);
+    float* lo_x = &scratch.bounds[0];
+    float* hi_x = &scratch.bounds[chunks];
+    float* lo_y = &scratch.bounds[chunks * 2];
+    float* hi_y = &scratch.bounds[chunks * 3];
+    std::fill(lo_x, lo_x + chunks, std::numeric_limits<float>::max());
+    std::fill(hi_x, hi_x + chunks, std::numeric_limits<float>::lowest());
+    std::fill(lo_y, lo_y + chunks, std::numeric_limits<float>::max());
+    std::fill(hi_y, hi_y + chunks, std::numeric_limits<float>::lowest());
+
+    pool.run(chunks, [&](size_t c, size_t) {
+        size_t begin = c * grain;
+        size_t end = std::min(n, begin + grain);
+        for (size_t i = begin; i < end; ++i) {
+            lo_x[c] = std::min(lo_x[c], x[i]);
+            hi_x[c] = std::max(hi_x[c], x[i]);
+            lo_y[c] = std::min(lo_y[c], y[i]);
+            hi_y[c] = std::max(hi_y[c], y[i]);
+        }
+    });
+
+    float min_x = *std::min_element(lo_x, lo_x + chunks);
+    float max_x = *std::max_element(hi_x, hi_x + chunks);
+    float min_y = *std::min_element(lo_y, lo_y + chunks);
+    float max_y = *std::max_element(hi_y, hi_y + chunks);
+
+    MortonBounds bounds;
+    bounds.min_x = min_x;
+    bounds.min_y = min_y;
+    // pad slightly so the max corner still maps inside the grid
+    bounds.size = std::max(max_x - min_x, max_y - min_y) * 1.0001f + 1e-6f;
+    return bounds;
+}
+
+// Quantize every point onto the 16-bit grid over 'bounds' and key its cell with 'encode'
+template <typename Encode>
+static void grid_keys(const float* x, const float* y, size_t n, const MortonBounds& bounds,
+                      uint32_t* keys, ThreadPool& pool, Encode encode)
+{
+    const float cells = static_cast<float>((1u << MORTON_BITS) - 1);
+    const float scale = cells / bounds.size;
+
+    pool.parallel_for(n, 4096, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            float fx = std::min(cells, std::max(0.f, (x[i] - bounds.min_x) * scale));
+            float fy = std::min(cells, std::max(0.f, (y[i] - bounds.min_y) * scale));
+            keys[i] = encode(static_cast<uint32_t>(fx), static_cast<uint32_t>(fy));
+        }
+    });
+}
+
+void morton_keys(const float* x, const float* y, size_t n, const MortonBounds& bounds,
+                 uint32_t* keys, ThreadPool& pool)
+{
+    grid_keys(x, y, n, bounds, keys, pool, morton_encode);
+}
+
+void hilbert_keys(const float* x, const float* y, size_t n, const MortonBounds& bounds,
+                  uint32_t* keys, ThreadPool& pool)
+{
+    grid_keys(x, y, n, bounds, keys, pool, hilbert_encode);
+}
+
+// Four 8-bit passes. Each chunk histograms its slice, an exclusive scan over (digit, chunk)
+// gives every chunk its own output offsets, and the scatter keeps equal keys in input order
+void radix_sort_pairs(uint32_t* keys, uint32_t* values, size_t n, MortonScratch& scratch, ThreadPool& pool)
+{
+    constexpr size_t RADIX = 256;
+    const size_t chunks = std::max<size_t>(1, std::min(pool.size(), n / 4096 + 1));
+    const size_t grain = (n + chunks - 1) / chunks;
+
+    if (scratch.keys.size() < n) {
+        scratch.keys.resize(n);
+        scratch.values.resize(n);
+    }
+    scratch.histograms.resize(chunks * RADIX);
+
+    uint32_t* src_k = keys;
+    uint32_t* src_v = values;
+    uint32_t* dst_k = scratch.keys.data();
+    uint32_t* dst_v = scratch.values.data();
+
+    for (int shift = 0; shift < 32; shift += 8) {
+        std::fill(scratch.histograms.begin(), scratch.histograms.end(), 0);
+
+        pool.run(chunks, [&](size_t c, size_t) {
+            size_t* hist = &scratch.histograms[c * RADIX];
+            size_t end = std::min(n, (c + 1) * grain);
+            for (size_t i = c * grain; i < end; ++i) ++hist[(src_k[i] >> shift) & 0xFF];
+        });
+
+        size_t offset = 0;
+        for (size_t d = 0; d < RADIX; ++d) {
+            for (size_t c = 0; c < chunks; ++c) {
+                size_t count = scratch.histograms[c * RADIX + d];
+                scratch.histograms[c * RADIX + d] = offset;
+                offset += count;
+            }
+        }
+
+        pool.run(chunks, [&](size_t c, size_t) {
+            size_t* pos = &scratch.histograms[c * RADIX];
+            size_t end = std::min(n, (c + 1) * grain);
+            for (size_t i = c * grain; i < end; ++i) {
+                size_t p = pos[(src_k[i] >> shift) & 0xFF]++;
+                dst_k[p] = src_k[i];
+                dst_v[p] = src_v[i];
+            }
+        });
+
+        std::swap(src_k, dst_k);
+        std::swap(src_v, dst_v);
+    }
+
+    // an even number of passes leaves the result back in the caller's arrays
+}
@@ -1,19 +1,22 @@
 // File: NBody.cpp
 // Implements CPU-based N-Body simulation
 //  - compute_forces: calculates gravitational accelerations with softening
-//  - integrate_bodies: updates velocities and positions, applies toroidal wrapping, skips central mass
+//  - accumulate_forces: the same sum over a separate block of (x, y, mass) sources
+//  - integrate_bodies: updates velocities and positions, applies toroidal wrapping, skips pinned bodies
 //  - runCpuComputation: performs one simulation step by chaining forces and integration
 
 #include <cstddef>    // for size_t
 #include <vector>     // for std::vector
-#include <cmath>      // for std::pow, std::sqrt
+#include <cmath>      // for std::sqrt
 
 #include "Body.h"     // Body struct, randomBody(), centralBody()
 #include "NBody.h"    // declarations of compute_forces(), integrate_bodies()
+#include "Profiler.h" // NBODY_PROFILE_SCOPE
 
 // Compute pairwise gravitational accelerations for each body
 void compute_forces(std::vector<Body>& bodies, const float G, const float eps)
 {
+    NBODY_PROFILE_SCOPE("forces");
     for(Body& current_body : bodies)
     {
         // ensure old acceleration is cleared before new calculation
@@ -31,8 +34,10 @@ void compute_forces(std::vector<Body>& bodies, const float G, const float eps)
             float dx = other_body.x - current_body.x;
             float dy = other_body.y - current_body.y;
 
-            // compute softened inverse distance cubed for numerical stability
-            float inv_distance_cubed = pow(1/sqrt(pow(dx,2) + pow(dy,2) + pow(eps,2)), 3);
+            // compute softened inverse distance cubed for numerical stability; float math
+            // throughout (pow / sqrt on mixed arguments would promote every pair to double)
+            float inv_distance = 1.f / std::sqrt(dx * dx + dy * dy + eps * eps);
+            float inv_distance_cubed = inv_distance * inv_distance * inv_distance;
 
             // Newtonian gravitational force magnitude
             float force = G * other_body.mass * inv_distance_cubed;
@@ -44,13 +49,39 @@ void compute_forces(std::vector<Body>& bodies, const float G, const float eps)
     }
 }
 
-// update body velocities and positions, applying wrapping and skipping central mass
+// Add the accelerations due to a block of sources, in the same float arithmetic as compute_forces
+void accumulate_forces(std::vector<Body>& bodies, const float* sources, size_t count, const float G, const float eps)
+{
+    NBODY_PROFILE_SCOPE("forces");
+    for(Body& current_body : bodies)
+    {
+        for(size_t j = 0; j < count; ++j)
+        {
+            const float* source = sources + 3 * j;
+            if (source[0] == current_body.x && source[1] == current_body.y) continue;
+
+            float dx = source[0] - current_body.x;
+            float dy = source[1] - current_body.y;
+
+            float inv_distance = 1.f / std::sqrt(dx * dx + dy * dy + eps * eps);
+            float inv_distance_cubed = inv_distance * inv_distance * inv_distance;
+
+            float force = G * source[2] * inv_distance_cubed;
+
+            current_body.acceleration_x += dx * force;
+            current_body.acceleration_y += dy * force;
+        }
+    }
+}
+
+// update body velocities and positions, applying wrapping and skipping pinned bodies
 void integrate_bodies(std::vector<Body>& bodies, const float dt, const int width, const int height)
 {
+    NBODY_PROFILE_SCOPE("integrate");
     for(Body& current_body : bodies) 
     {
-        // Skip the heavy central to keep it fixed
-        if (current_body.mass >= 1000.f) continue;
+        // pinned bodies (the central mass) stay fixed
+        if (current_body.pinned) continue;
 
         // update velocity based on acceleration
         current_body.velocity_x += current_body.acceleration_x * dt;
@@ -76,3 +107,10 @@ void runCpuComputation(std::vector<Body>& bodies, const float G, const float eps
     compute_forces(bodies, G, eps);
     integrate_bodies(bodies, dt, width, height);
 }
+
+// Call a single-step function 'steps' times
+BatchStepFunction repeat_steps(StepFunction step) {
+    return [step](std::vector<Body>& bodies, float G, float eps, float dt, int width, int height, int steps) {
+        for (int s = 0; s < steps; ++s) step(bodies, G, eps, dt, width, height);
+    };
+}
@@ -0,0 +1,298 @@
+// File: OpenCLDevice.cpp
+// Implements OpenCL device enumeration/selection and the program binary cache
+
+#include "OpenCLDevice.h"
+#include <algorithm>   // for std::all_of
+#include <cctype>      // for std::tolower, std::isdigit
+#include <cstdint>     // for uint64_t
+#include <cstdlib>     // for std::getenv
+#include <filesystem>
+#include <fstream>
+#include <iomanip>     // for std::setw
+#include <iostream>
+#include <random>      // for std::random_device
+#include <sstream>
+
+// String-valued clGetPlatformInfo / clGetDeviceInfo without the trailing NUL
+static std::string platform_string(cl_platform_id platform, cl_platform_info param) {
+    size_t size = 0;
+    if (clGetPlatformInfo(platform, param, 0, NULL, &size) != CL_SUCCESS || size == 0) return {};
+    std::string value(size, '\0');
+    clGetPlatformInfo(platform, param, size, &value[0], NULL);
+    value.resize(value.find('\0') == std::string::npos ? size : value.find('\0'));
+    return value;
+}
+
+static std::string device_string(cl_device_id device, cl_device_info param) {
+    size_t size = 0;
+    if (clGetDeviceInfo(device, param, 0, NULL, &size) != CL_SUCCESS || size == 0) return {};
+    std::string value(size, '\0');
+    clGetDeviceInfo(device, param, size, &value[0], NULL);
+    value.resize(value.find('\0') == std::string::npos ? size : value.find('\0'));
+    return value;
+}
+
+bool checkOpenCL(cl_int err, const char* what) {
+    if (err == CL_SUCCESS) return true;
+    std::cerr << "OpenCL error " << err << " in " << what << "\n";
+    return false;
+}
+
+void setOpenCLArg(cl_int& err, cl_kernel kernel, cl_uint index, size_t size, const void* value) {
+    cl_int result = clSetKernelArg(kernel, index, size, value);
+    if (err == CL_SUCCESS) err = result;
+}
+
+std::vector<OpenCLDeviceInfo> listOpenCLDevices() {
+    std::vector<OpenCLDeviceInfo> devices;
+
+    cl_uint num_platforms = 0;
+    if (clGetPlatformIDs(0, NULL, &num_platforms) != CL_SUCCESS || num_platforms == 0) return devices;
+    std::vector<cl_platform_id> platforms(num_platforms);
+    clGetPlatformIDs(num_platforms, platforms.data(), NULL);
+
+    for (size_t p = 0; p < platforms.size(); ++p) {
+        cl_uint num_devices = 0;
+        if (clGetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, 0, NULL, &num_devices) != CL_SUCCESS) continue;
+        std::vector<cl_device_id> ids(num_devices);
+        clGetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, num_devices, ids.data(), NULL);
+
+        for (size_t d = 0; d < ids.size(); ++d) {
+            OpenCLDeviceInfo info;
+            info.platform = platforms[p];
+            info.device = ids[d];
+            clGetDeviceInfo(ids[d], CL_DEVICE_TYPE, sizeof(info.type), &info.type, NULL);
+            info.platform_index = p;
+            info.device_index = d;
+            info.name = device_string(ids[d], CL_DEVICE_NAME);
+            info.platform_name = platform_string(platforms[p], CL_PLATFORM_NAME);
+            info.fp64 = device_string(ids[d], CL_DEVICE_EXTENSIONS).find("cl_khr_fp64") != std::string::npos;
+            devices.push_back(info);
+        }
+    }
+    return devices;
+}
+
+static const char* device_type_name(cl_device_type type) {
+    if (type & CL_DEVICE_TYPE_GPU) return "gpu";
+    if (type & CL_DEVICE_TYPE_CPU) return "cpu";
+    if (type & CL_DEVICE_TYPE_ACCELERATOR) return "accelerator";
+    return "other";
+}
+
+static std::string lowercase(std::string s) {
+    for (char& c : s) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return s;
+}
+
+static bool is_number(const std::string& s) {
+    return !s.empty() && std::all_of(s.begin(), s.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); });
+}
+
+// First device of the given type, or nullptr
+static const OpenCLDeviceInfo* first_of_type(const std::vector<OpenCLDeviceInfo>& devices, cl_device_type type) {
+    for (const OpenCLDeviceInfo& d : devices) {
+        if (d.type & type) return &d;
+    }
+    return nullptr;
+}
+
+bool selectOpenCLDevice(const std::string& spec, OpenCLDeviceInfo& selected) {
+    std::vector<OpenCLDeviceInfo> devices = listOpenCLDevices();
+    if (devices.empty()) {
+        std::cerr << "No OpenCL platform/device found\n";
+        return false;
+    }
+
+    const std::string key = lowercase(spec);
+    const OpenCLDeviceInfo* match = nullptr;
+
+    if (key.empty()) {
+        match = first_of_type(devices, CL_DEVICE_TYPE_GPU);
+        if (!match) {
+            match = first_of_type(devices, CL_DEVICE_TYPE_CPU);
+            if (!match) match = &devices.front();
+            std::cerr << "No OpenCL GPU found, using " << device_type_name(match->type) << " device '"
+                      << match->name << "' (" << match->platform_name << ")\n";
+        }
+    }
+    else if (key == "gpu")         match = first_of_type(devices, CL_DEVICE_TYPE_GPU);
+    else if (key == "cpu")         match = first_of_type(devices, CL_DEVICE_TYPE_CPU);
+    else if (key == "accelerator") match = first_of_type(devices, CL_DEVICE_TYPE_ACCELERATOR);
+    else if (key == "all")         match = &devices.front();
+    else if (is_number(key)) {
+        size_t index = std::stoul(key);
+        if (index < devices.size()) match = &devices[index];
+    }
+    else if (key.find(':') != std::string::npos && is_number(key.substr(0, key.find(':')))
+             && is_number(key.substr(key.find(':') + 1))) {
+        size_t p = std::stoul(key.substr(0, key.find(':')));
+        size_t d = std::stoul(key.substr(key.find(':') + 1));
+        for (const OpenCLDeviceInfo& info : devices) {
+            if (info.platform_index == p && info.device_index == d) match = &info;
+        }
+    }
+    else {
+        for (const OpenCLDeviceInfo& info : devices) {
+            if (lowercase(info.name).find(key) != std::string::npos ||
+                lowercase(info.platform_name).find(key) != std::string::npos) {
+                match = &info;
+                break;
+            }
+        }
+    }
+
+    if (!match) {
+        std::cerr << "No OpenCL device matches '" << spec << "'; available devices:\n";
+        printOpenCLDevices(std::cerr);
+        return false;
+    }
+    selected = *match;
+    return true;
+}
+
+bool createOpenCLQueue(const std::string& spec, cl_command_queue_properties queue_properties,
+                       OpenCLDeviceInfo& selected, cl_context& context, cl_command_queue& queue)
+{
+    std::string device_spec = spec;
+    if (device_spec.empty()) {
+        if (const char* env = std::getenv("NBODY_OPENCL_DEVICE")) device_spec = env;
+    }
+    if (!selectOpenCLDevice(device_spec, selected)) return false;
+
+    cl_int err;
+    context = clCreateContext(NULL, 1, &selected.device, NULL, NULL, &err);
+    if (!checkOpenCL(err, "clCreateContext")) return false;
+    queue = clCreateCommandQueue(context, selected.device, queue_properties, &err);
+    return checkOpenCL(err, "clCreateCommandQueue");
+}
+
+size_t roundUpToMultiple(size_t n, size_t multiple) {
+    return (n + multiple - 1) / multiple * multiple;
+}
+
+void printOpenCLDevices(std::ostream& out) {
+    std::vector<OpenCLDeviceInfo> devices = listOpenCLDevices();
+    if (devices.empty()) out << "  (none)\n";
+    for (size_t k = 0; k < devices.size(); ++k) {
+        const OpenCLDeviceInfo& d = devices[k];
+        out << "  " << std::setw(2) << k << "  " << d.platform_index << ":" << d.device_index
+            << "  " << std::setw(11) << std::left << device_type_name(d.type) << std::right
+            << d.name << " (" << d.platform_name << ")" << (d.fp64 ? " fp64" : "") << "\n";
+    }
+}
+
+std::string openclCacheDirectory() {
+    if (const char* dir = std::getenv("NBODY_CACHE_DIR")) return dir;
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME")) return (std::filesystem::path(xdg) / "nbody").string();
+    if (const char* home = std::getenv("HOME")) return (std::filesystem::path(home) / ".cache" / "nbody").string();
+    return ".";
+}
+
+// 64-bit FNV-1a, enough to tell sources and devices apart in a file name
+static uint64_t fnv1a(const std::string& data, uint64_t hash = 1469598103934665603ull) {
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Cache file for this device, driver, options and source
+static std::filesystem::path binary_path(cl_device_id device, const std::string& source, const std::string& options) {
+    cl_platform_id platform = nullptr;
+    clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, NULL);
+
+    std::string identity = platform_string(platform, CL_PLATFORM_NAME) + '\n' +
+                           platform_string(platform, CL_PLATFORM_VERSION) + '\n' +
+                           device_string(device, CL_DEVICE_NAME) + '\n' +
+                           device_string(device, CL_DEVICE_VERSION) + '\n' +
+                           device_string(device, CL_DRIVER_VERSION) + '\n' +
+                           options + '\n';
+    std::ostringstream name;
+    name << std::hex << std::setfill('0') << std::setw(16) << fnv1a(source, fnv1a(identity)) << ".bin";
+    return std::filesystem::path(openclCacheDirectory()) / "kernels" / name.str();
+}
+
+// Load and build a cached binary; nullptr if there is none or the driver rejects it
+static cl_program load_binary(cl_context context, cl_device_id device, const std::filesystem::path& path,
+                              const std::string& options)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return nullptr;
+    std::vector<unsigned char> binary{ std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() };
+    if (binary.empty()) return nullptr;
+
+    const unsigned char* data = binary.data();
+    size_t size = binary.size();
+    cl_int status, err;
+    cl_program program = clCreateProgramWithBinary(context, 1, &device, &size, &data, &status, &err);
+    if (err != CL_SUCCESS || status != CL_SUCCESS) {
+        if (program) clReleaseProgram(program);
+        return nullptr;
+    }
+    if (clBuildProgram(program, 1, &device, options.c_str(), NULL, NULL) != CL_SUCCESS) {
+        clReleaseProgram(program);
+        return nullptr;
+    }
+    return program;
+}
+
+// Write the device binary next to the others; a temporary file and rename keep concurrent
+// starts from reading a half-written binary
+static void store_binary(cl_program program, const std::filesystem::path& path) {
+    size_t size = 0;
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, NULL) != CL_SUCCESS || size == 0)
+        return;
+    std::vector<unsigned char> binary(size);
+    unsigned char* data = binary.data();
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(data), &data, NULL) != CL_SUCCESS) return;
+
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    std::filesystem::path tmp = path;
+    tmp += ".tmp" + std::to_string(std::random_device{}());
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+        if (!out) {
+            std::filesystem::remove(tmp, ec);
+            return;
+        }
+    }
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) std::filesystem::remove(tmp, ec);
+}
+
+cl_program buildOpenCLProgram(cl_context context,
+                              cl_device_id device,
+                              const std::string& source,
+                              const std::string& options,
+                              bool use_cache)
+{
+    std::filesystem::path cached;
+    if (use_cache) {
+        cached = binary_path(device, source, options);
+        if (cl_program program = load_binary(context, device, cached, options)) return program;
+    }
+
+    cl_int err;
+    const char* source_str = source.c_str();
+    size_t source_size = source.size();
+    cl_program program = clCreateProgramWithSource(context, 1, &source_str, &source_size, &err);
+    if (!checkOpenCL(err, "clCreateProgramWithSource")) return nullptr;
+
+    err = clBuildProgram(program, 1, &device, options.c_str(), NULL, NULL);
+    if (err != CL_SUCCESS) {
+        size_t log_size = 0;
+        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+        std::string log(log_size, '\0');
+        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_size, &log[0], NULL);
+        std::cerr << "OpenCL program build failed (" << options << "):\n" << log << "\n";
+        clReleaseProgram(program);
+        return nullptr;
+    }
+
+    if (use_cache) store_binary(program, cached);
+    return program;
+}
@@ -0,0 +1,300 @@
+// File: ParallelComputation.cpp
+// Implements the multithreaded CPU engine
+//  - the N x N interaction matrix is cut into row blocks x source tiles sized for the caches
+//  - row blocks are scheduled on the work-stealing ThreadPool
+//  - integration is fused into the force pass: new positions go to a back buffer so other rows
+//    still see the old ones, then the buffers are swapped
+//  - symmetric mode evaluates each pair once (i < j) into per-thread accumulators which are
+//    reduced and integrated in a second parallel pass
+//  - all of it lives in a ParallelState per ParallelEngine; the free functions use a default engine
+
+#include <algorithm>  // for std::min, std::max, std::fill
+#include <cmath>      // for std::sqrt
+#include <memory>     // for std::unique_ptr
+#include <utility>    // for std::pair, std::swap
+#include <immintrin.h>
+
+#include "ParallelComputation.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+// Parallel runtime state of one engine: pool, options, SoA copy of the bodies, and scratch
+// buffers. Engines share nothing, so any number can run in one process
+struct ParallelState {
+    std::unique_ptr<ThreadPool>            pool;
+    ParallelOptions                        options;
+    BodiesSOA                              soa{0};
+    AlignedFloats                          x_next;
+    AlignedFloats                          y_next;
+    std::vector<AlignedFloats>             acc_x;       // one per worker (symmetric mode)
+    std::vector<AlignedFloats>             acc_y;
+    std::vector<std::pair<size_t, size_t>> tile_pairs;  // (I, J) tile pairs with I <= J
+    size_t                                 sym_tile = 0;
+};
+
+static std::unique_ptr<ParallelEngine> s_default;
+
+// Symmetric tile, plain C++: pairs (i, j) with i in [ib, ie), j in [jb, je) and j > i.
+// Accumulates unscaled (G = 1) accelerations; i gets +m_j * d, j gets -m_i * d
+static void symmetric_tile_scalar(const float* x, const float* y, const float* m,
+                                  size_t ib, size_t ie, size_t jb, size_t je,
+                                  float* acc_x, float* acc_y, float eps2)
+{
+    for (size_t i = ib; i < ie; ++i) {
+        float xi = x[i], yi = y[i], mi = m[i];
+        float axi = 0.f, ayi = 0.f;
+
+        for (size_t j = std::max(jb, i + 1); j < je; ++j) {
+            float dx = x[j] - xi;
+            float dy = y[j] - yi;
+            float inv = 1.f / std::sqrt(dx * dx + dy * dy + eps2);
+            float inv3 = inv * inv * inv;
+
+            axi += dx * m[j] * inv3;
+            ayi += dy * m[j] * inv3;
+            acc_x[j] -= dx * mi * inv3;
+            acc_y[j] -= dy * mi * inv3;
+        }
+
+        acc_x[i] += axi;
+        acc_y[i] += ayi;
+    }
+}
+
+// Symmetric tile, AVX2: vectorized over j, the j-side updates are contiguous load/fnmadd/store
+__attribute__((target("avx2,fma")))
+static void symmetric_tile_avx2(const float* x, const float* y, const float* m,
+                                size_t ib, size_t ie, size_t jb, size_t je,
+                                float* acc_x, float* acc_y, float eps2)
+{
+    const __m256 v_eps2 = _mm256_set1_ps(eps2);
+    const __m256 v_half = _mm256_set1_ps(0.5f);
+    const __m256 v_three_halves = _mm256_set1_ps(1.5f);
+
+    for (size_t i = ib; i < ie; ++i) {
+        __m256 xi = _mm256_set1_ps(x[i]);
+        __m256 yi = _mm256_set1_ps(y[i]);
+        __m256 mi = _mm256_set1_ps(m[i]);
+        __m256 axi = _mm256_setzero_ps();
+        __m256 ayi = _mm256_setzero_ps();
+
+        size_t j = std::max(jb, i + 1);
+        for (; j + 8 <= je; j += 8) {
+            __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + j), xi);
+            __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + j), yi);
+            __m256 r2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, v_eps2));
+
+            __m256 inv = _mm256_rsqrt_ps(r2);
+            inv = _mm256_mul_ps(inv, _mm256_fnmadd_ps(_mm256_mul_ps(v_half, r2), _mm256_mul_ps(inv, inv), v_three_halves));
+            __m256 inv3 = _mm256_mul_ps(inv, _mm256_mul_ps(inv, inv));
+
+            __m256 sj = _mm256_mul_ps(_mm256_loadu_ps(m + j), inv3);
+            __m256 si = _mm256_mul_ps(mi, inv3);
+
+            axi = _mm256_fmadd_ps(dx, sj, axi);
+            ayi = _mm256_fmadd_ps(dy, sj, ayi);
+            _mm256_storeu_ps(acc_x + j, _mm256_fnmadd_ps(dx, si, _mm256_loadu_ps(acc_x + j)));
+            _mm256_storeu_ps(acc_y + j, _mm256_fnmadd_ps(dy, si, _mm256_loadu_ps(acc_y + j)));
+        }
+
+        // horizontal sums of the i-side accumulators
+        alignas(32) float lanes_x[8], lanes_y[8];
+        _mm256_store_ps(lanes_x, axi);
+        _mm256_store_ps(lanes_y, ayi);
+        float sum_x = 0.f, sum_y = 0.f;
+        for (int k = 0; k < 8; ++k) { sum_x += lanes_x[k]; sum_y += lanes_y[k]; }
+        acc_x[i] += sum_x;
+        acc_y[i] += sum_y;
+
+        // leftover columns of this row
+        if (j < je) symmetric_tile_scalar(x, y, m, i, i + 1, j, je, acc_x, acc_y, eps2);
+    }
+}
+
+// Initialize the pool, scratch buffers and the symmetric tile schedule
+static bool init_state(ParallelState& st, size_t n_bodies, const ParallelOptions& options) {
+    if (!simdKernelSupported(options.kernel)) return false;
+
+    st.options = options;
+    st.pool = std::make_unique<ThreadPool>(options.threads);
+    st.options.threads = st.pool->size();
+
+    // enough row blocks for every worker to get several (stealing needs slack), multiple of 32 rows
+    if (st.options.tile_rows == 0) {
+        size_t per_task = (n_bodies + st.options.threads * 8 - 1) / (st.options.threads * 8);
+        st.options.tile_rows = std::min<size_t>(256, std::max<size_t>(32, (per_task + 31) / 32 * 32));
+    }
+    st.options.tile_cols = std::max<size_t>(1, st.options.tile_cols);
+
+    st.soa.resize(n_bodies);
+    st.x_next.assign(n_bodies, 0.f);
+    st.y_next.assign(n_bodies, 0.f);
+
+    st.acc_x.clear();
+    st.acc_y.clear();
+    st.tile_pairs.clear();
+    if (st.options.symmetric) {
+        st.acc_x.assign(st.options.threads, AlignedFloats(n_bodies));
+        st.acc_y.assign(st.options.threads, AlignedFloats(n_bodies));
+
+        // square tiles: about 4 per thread along each side keeps the pair list short but balanced
+        st.sym_tile = (n_bodies + st.options.threads * 4 - 1) / (st.options.threads * 4);
+        st.sym_tile = std::min<size_t>(2048, std::max<size_t>(64, st.sym_tile));
+
+        size_t tile = st.sym_tile;
+        size_t tiles = (n_bodies + tile - 1) / tile;
+        for (size_t I = 0; I < tiles; ++I)
+            for (size_t J = I; J < tiles; ++J)
+                st.tile_pairs.emplace_back(I, J);
+    }
+    return true;
+}
+
+// Full interaction matrix, one task per row block, integration fused into the same task
+static void parallel_step_full(ParallelState& st, BodiesSOA& soa, const float G, const float eps, const float dt,
+                               const int width, const int height)
+{
+    const size_t n = soa.size;
+    const size_t rows = st.options.tile_rows;
+    const size_t cols = st.options.tile_cols;
+    const size_t row_tiles = (n + rows - 1) / rows;
+
+    st.pool->run(row_tiles, [&](size_t t, size_t) {
+        size_t begin = t * rows;
+        size_t end = std::min(n, begin + rows);
+
+        std::fill(soa.ax.begin() + begin, soa.ax.begin() + end, 0.f);
+        std::fill(soa.ay.begin() + begin, soa.ay.begin() + end, 0.f);
+        for (size_t jb = 0; jb < n; jb += cols) {
+            simd_accumulate_forces_tile(soa, begin, end, jb, std::min(n, jb + cols), G, eps, st.options.kernel);
+        }
+
+        simd_integrate_range_into(soa, st.x_next.data(), st.y_next.data(), begin, end, dt, width, height);
+    });
+
+    std::swap(soa.x, st.x_next);
+    std::swap(soa.y, st.y_next);
+}
+
+// Upper triangle of tiles into per-worker accumulators, then a reduce + integrate pass
+static void parallel_step_symmetric(ParallelState& st, BodiesSOA& soa, const float G, const float eps,
+                                    const float dt, const int width, const int height)
+{
+    const size_t n = soa.size;
+    const size_t tile = st.sym_tile;
+    const size_t workers = st.pool->size();
+    const float eps2 = eps * eps;
+    const bool vector = st.options.kernel != SimdKernel::Scalar;
+
+    st.pool->run(workers, [&](size_t w, size_t) {
+        std::fill(st.acc_x[w].begin(), st.acc_x[w].end(), 0.f);
+        std::fill(st.acc_y[w].begin(), st.acc_y[w].end(), 0.f);
+    });
+
+    st.pool->run(st.tile_pairs.size(), [&](size_t t, size_t worker) {
+        size_t ib = st.tile_pairs[t].first * tile;
+        size_t jb = st.tile_pairs[t].second * tile;
+        size_t ie = std::min(n, ib + tile);
+        size_t je = std::min(n, jb + tile);
+        float* acc_x = st.acc_x[worker].data();
+        float* acc_y = st.acc_y[worker].data();
+
+        if (vector) symmetric_tile_avx2(soa.x.data(), soa.y.data(), soa.mass.data(), ib, ie, jb, je, acc_x, acc_y, eps2);
+        else        symmetric_tile_scalar(soa.x.data(), soa.y.data(), soa.mass.data(), ib, ie, jb, je, acc_x, acc_y, eps2);
+    });
+
+    st.pool->parallel_for(n, tile, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            float sum_x = 0.f, sum_y = 0.f;
+            for (size_t w = 0; w < workers; ++w) {
+                sum_x += st.acc_x[w][i];
+                sum_y += st.acc_y[w][i];
+            }
+            soa.ax[i] = G * sum_x;
+            soa.ay[i] = G * sum_y;
+        }
+        simd_integrate_range(soa, begin, end, dt, width, height);
+    });
+}
+
+static void parallel_step(ParallelState& st, BodiesSOA& soa, const float G, const float eps, const float dt,
+                          const int width, const int height)
+{
+    // the scratch buffers and the tile schedule are sized for the body count of the last init
+    if (soa.size != st.x_next.size()) init_state(st, soa.size, st.options);
+
+    // forces and integration are fused, so the step is one phase
+    NBODY_PROFILE_SCOPE("forces + integrate");
+    if (st.options.symmetric) parallel_step_symmetric(st, soa, G, eps, dt, width, height);
+    else                      parallel_step_full(st, soa, G, eps, dt, width, height);
+}
+
+std::unique_ptr<ParallelEngine> ParallelEngine::create(size_t n_bodies, const ParallelOptions& options) {
+    std::unique_ptr<ParallelEngine> engine(new ParallelEngine(new ParallelState()));
+    if (!init_state(*engine->m_state, n_bodies, options)) return nullptr;
+    return engine;
+}
+
+// Join the workers and free scratch memory
+ParallelEngine::~ParallelEngine() {
+    delete m_state;
+}
+
+// Perform one parallel step: pack into SoA, step, unpack
+void ParallelEngine::step(std::vector<Body>& bodies, const float G, const float eps, const float dt,
+                          const int width, const int height)
+{
+    ParallelState& st = *m_state;
+    packBodies(bodies, st.soa);
+    parallel_step(st, st.soa, G, eps, dt, width, height);
+    unpackBodies(st.soa, bodies);
+}
+
+void ParallelEngine::stepSoA(BodiesSOA& soa, const float G, const float eps, const float dt,
+                             const int width, const int height)
+{
+    parallel_step(*m_state, soa, G, eps, dt, width, height);
+}
+
+size_t ParallelEngine::threads() const {
+    return m_state->pool->size();
+}
+
+// The free functions act on the default engine
+
+bool initParallelComputation(size_t n_bodies, const ParallelOptions& options) {
+    s_default = ParallelEngine::create(n_bodies, options);
+    return s_default != nullptr;
+}
+
+bool initParallelComputation(size_t n_bodies) {
+    return initParallelComputation(n_bodies, ParallelOptions());
+}
+
+size_t parallelThreadCount() {
+    return s_default ? s_default->threads() : 0;
+}
+
+void parallel_step(BodiesSOA& soa,
+                   const float G,
+                   const float eps,
+                   const float dt,
+                   const int width,
+                   const int height)
+{
+    s_default->stepSoA(soa, G, eps, dt, width, height);
+}
+
+void runParallelComputation(std::vector<Body>& bodies,
+                            const float G,
+                            const float eps,
+                            const float dt,
+                            const int width,
+                            const int height)
+{
+    s_default->step(bodies, G, eps, dt, width, height);
+}
+
+void cleanupParallelComputation() {
+    s_default.reset();
+}
@@ -0,0 +1,521 @@
+// File: ParticleMesh.cpp
+// Implements the periodic particle-mesh engine
+//  - cloud-in-cell (CIC) mass deposition onto an Nx x Ny mesh covering the toroidal box; every
+//    worker deposits into its own copy of the mesh and the copies are summed in a parallel pass
+//  - forward 2D FFT of the mass, multiplication by the Green's function of the softened 1/r^2
+//    force used by the other engines (plane transform 2 pi / k), spectral gradient for x and y
+//    packed into one complex field (ax + i ay), inverse 2D FFT. The radix-2 FFT is implemented
+//    here; rows and blocks of columns are transformed in parallel
+//  - CIC interpolation of the mesh acceleration back to the bodies, in parallel
+//  - P3M: the mesh carries only the long-range part (2 pi erfc(k r_s) / k) and pairs closer than
+//    the cutoff add the complementary short-range force, found through a periodic chaining mesh
+// A step costs O(N + M log M) for M mesh cells, plus O(N * neighbours) for the P3M correction
+
+#include <algorithm>  // for std::min, std::max, std::swap
+#include <cmath>      // for std::floor, std::sqrt, std::erfc, std::exp
+#include <complex>    // for std::complex
+#include <cstdint>    // for uint32_t
+#include <iostream>
+#include <memory>     // for std::unique_ptr
+
+#include "ParticleMesh.h"
+#include "Profiler.h"
+#include "SimdComputation.h"  // simd_integrate_range()
+#include "ThreadPool.h"
+
+using Complex = std::complex<float>;
+
+// Tables for transforms of one length
+struct FftPlan {
+    size_t n = 0;
+    std::vector<uint32_t> reverse;   // bit-reversal permutation
+    std::vector<Complex> twiddle;    // exp(-2 pi i k / n) for k < n / 2
+};
+
+constexpr double PI = 3.14159265358979323846;
+constexpr size_t FFT_COLUMN_BLOCK = 8;     // columns gathered and transformed together
+constexpr size_t SHORT_RANGE_TABLE = 1024; // samples of the short-range force factor over [0, r_cut]
+
+// Particle-mesh runtime state
+static std::unique_ptr<ThreadPool>        s_pool;
+static ParticleMeshOptions                s_options;
+static BodiesSOA                          s_soa(0);
+// the mesh is rebuilt whenever the box, softening or body count differs from these
+static int                                s_box_w = 0;
+static int                                s_box_h = 0;
+static float                              s_eps = -1.f;
+static size_t                             s_bodies = 0;
+// mesh
+static size_t                             s_nx = 0, s_ny = 0;
+static float                              s_hx = 0.f, s_hy = 0.f;   // cell size
+static FftPlan                            s_plan_x, s_plan_y;
+static std::vector<float>                 s_kx, s_ky;               // wavenumbers for the gradient
+static std::vector<float>                 s_green;                  // Green's function per mode
+static std::vector<Complex>               s_mesh;                   // mass, then ax + i ay
+static std::vector<AlignedFloats>         s_deposit;                // per-worker mass meshes
+static std::vector<std::vector<Complex>>  s_columns;                // per-worker column block scratch
+// P3M chaining mesh: cells at least r_cut wide, bodies bucketed by cell
+static float                              s_rcut = 0.f;
+static int                                s_cells_x = 0, s_cells_y = 0;
+static std::vector<uint32_t>              s_cell_start;             // bucket offsets, one past the end too
+static std::vector<uint32_t>              s_cursor;
+static std::vector<uint32_t>              s_cell_of;                // chaining cell of every body
+static std::vector<uint32_t>              s_sorted;                 // bucket position -> body index
+static AlignedFloats                      s_px, s_py, s_pm;         // bodies in bucket order
+static std::vector<float>                 s_short;                  // short-range factor table
+
+// Smallest power of two >= minimum that is closest to v on a log scale
+static size_t nearest_pow2(double v, size_t minimum) {
+    size_t p = minimum;
+    while (p * std::sqrt(2.0) < v) p *= 2;
+    return p;
+}
+
+static void make_plan(FftPlan& plan, size_t n) {
+    int bits = 0;
+    while ((size_t(1) << bits) < n) ++bits;
+
+    plan.n = n;
+    plan.reverse.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t r = 0;
+        for (int b = 0; b < bits; ++b) r |= static_cast<uint32_t>((i >> b) & 1) << (bits - 1 - b);
+        plan.reverse[i] = r;
+    }
+    plan.twiddle.resize(n / 2);
+    for (size_t k = 0; k < n / 2; ++k) {
+        double angle = -2.0 * PI * k / n;
+        plan.twiddle[k] = Complex(static_cast<float>(std::cos(angle)), static_cast<float>(std::sin(angle)));
+    }
+}
+
+// In-place iterative radix-2 transform of plan.n values; the inverse is not normalized
+static void fft(Complex* data, const FftPlan& plan, bool inverse) {
+    const size_t n = plan.n;
+    for (size_t i = 0; i < n; ++i) {
+        size_t j = plan.reverse[i];
+        if (i < j) std::swap(data[i], data[j]);
+    }
+
+    const float sign = inverse ? -1.f : 1.f;
+    for (size_t len = 2; len <= n; len <<= 1) {
+        const size_t half = len / 2;
+        const size_t stride = n / len;
+        for (size_t i = 0; i < n; i += len) {
+            for (size_t k = 0; k < half; ++k) {
+                const float wr = plan.twiddle[k * stride].real();
+                const float wi = sign * plan.twiddle[k * stride].imag();
+                const Complex a = data[i + k];
+                const Complex b = data[i + k + half];
+                // spelled out: std::complex operator* handles inf/NaN through a library call
+                const Complex t(b.real() * wr - b.imag() * wi, b.real() * wi + b.imag() * wr);
+                data[i + k] = a + t;
+                data[i + k + half] = a - t;
+            }
+        }
+    }
+}
+
+// 2D transform of s_mesh: every row, then blocks of columns gathered into per-worker scratch
+static void fft_2d(bool inverse) {
+    const size_t nx = s_nx, ny = s_ny;
+    const size_t row_grain = std::max<size_t>(1, ny / (4 * s_pool->size()));
+
+    s_pool->parallel_for(ny, row_grain, [&](size_t begin, size_t end, size_t) {
+        for (size_t y = begin; y < end; ++y) fft(&s_mesh[y * nx], s_plan_x, inverse);
+    });
+
+    const size_t blocks = (nx + FFT_COLUMN_BLOCK - 1) / FFT_COLUMN_BLOCK;
+    s_pool->run(blocks, [&](size_t b, size_t worker) {
+        Complex* column = s_columns[worker].data();
+        const size_t x0 = b * FFT_COLUMN_BLOCK;
+        const size_t count = std::min(FFT_COLUMN_BLOCK, nx - x0);
+
+        for (size_t y = 0; y < ny; ++y)
+            for (size_t c = 0; c < count; ++c) column[c * ny + y] = s_mesh[y * nx + x0 + c];
+        for (size_t c = 0; c < count; ++c) fft(column + c * ny, s_plan_y, inverse);
+        for (size_t y = 0; y < ny; ++y)
+            for (size_t c = 0; c < count; ++c) s_mesh[y * nx + x0 + c] = column[c * ny + y];
+    });
+}
+
+// sin(x) / x
+static double sinc(double x) {
+    return std::abs(x) < 1e-8 ? 1.0 : std::sin(x) / x;
+}
+
+// Size the mesh for the box and body count, build the FFT plans and the Green's function
+static void setup_mesh(size_t n_bodies, const float eps, const int width, const int height) {
+    s_box_w = width;
+    s_box_h = height;
+    s_eps = eps;
+    s_bodies = n_bodies;
+
+    // about one body per cell by default; cells stay close to square
+    const double long_side = std::max(width, height);
+    const double short_side = std::min(width, height);
+    size_t cells = s_options.grid > 0
+        ? nearest_pow2(static_cast<double>(s_options.grid), 16)
+        : std::min<size_t>(2048, nearest_pow2(std::sqrt(n_bodies * long_side / short_side), 64));
+    size_t across = nearest_pow2(cells * short_side / long_side, 16);
+    s_nx = width >= height ? cells : across;
+    s_ny = width >= height ? across : cells;
+    s_hx = static_cast<float>(width) / s_nx;
+    s_hy = static_cast<float>(height) / s_ny;
+
+    make_plan(s_plan_x, s_nx);
+    make_plan(s_plan_y, s_ny);
+    const size_t workers = s_pool->size();
+    s_mesh.assign(s_nx * s_ny, Complex());
+    s_deposit.assign(workers, AlignedFloats(s_nx * s_ny, 0.f));
+    s_columns.assign(workers, std::vector<Complex>(FFT_COLUMN_BLOCK * s_ny));
+
+    // wavenumbers; the Nyquist mode has no well defined gradient and is left out of it
+    s_kx.assign(s_nx, 0.f);
+    s_ky.assign(s_ny, 0.f);
+    for (size_t i = 0; i < s_nx; ++i)
+        if (i != s_nx / 2) s_kx[i] = static_cast<float>(2.0 * PI * (i < s_nx / 2 ? double(i) : double(i) - s_nx) / width);
+    for (size_t j = 0; j < s_ny; ++j)
+        if (j != s_ny / 2) s_ky[j] = static_cast<float>(2.0 * PI * (j < s_ny / 2 ? double(j) : double(j) - s_ny) / height);
+
+    // Potential of a unit mass in the plane, -1 / sqrt(r^2 + eps^2), transforms to
+    // -2 pi exp(-k eps) / k. With P3M the mesh keeps the long-range part 2 pi erfc(k r_s) / k
+    // and divides out the CIC window twice (deposit and interpolation); without it the mesh
+    // itself smooths below a cell and the window is left in. The mean density (k = 0) is dropped.
+    // 1 / (width * height) turns the unnormalized inverse FFT into the inverse Fourier series
+    const float rs = s_options.split * std::max(s_hx, s_hy);
+    const double area = static_cast<double>(width) * height;
+    s_green.assign(s_nx * s_ny, 0.f);
+    for (size_t j = 0; j < s_ny; ++j) {
+        const double ky = 2.0 * PI * (j <= s_ny / 2 ? double(j) : double(j) - s_ny) / height;
+        for (size_t i = 0; i < s_nx; ++i) {
+            const double kx = 2.0 * PI * (i <= s_nx / 2 ? double(i) : double(i) - s_nx) / width;
+            const double k = std::sqrt(kx * kx + ky * ky);
+            if (k == 0.0) continue;
+
+            double filter;
+            if (s_options.p3m) {
+                double window = sinc(0.5 * kx * s_hx) * sinc(0.5 * ky * s_hy);
+                window *= window;
+                filter = std::erfc(k * rs) / (window * window);
+            }
+            else {
+                filter = std::exp(-k * eps);
+            }
+            s_green[j * s_nx + i] = static_cast<float>(2.0 * PI * filter / (k * area));
+        }
+    }
+
+    if (!s_options.p3m) return;
+
+    // short-range factor: erfc(u) + 2u / sqrt(pi) exp(-u^2), u = r / (2 r_s), the part of the
+    // pair force the mesh leaves out; negligible beyond the cutoff
+    s_rcut = s_options.cutoff * rs;
+    // one extra sample so interpolation just below r_cut stays inside the table
+    s_short.resize(SHORT_RANGE_TABLE + 1);
+    for (size_t t = 0; t <= SHORT_RANGE_TABLE; ++t) {
+        double u = s_rcut * t / (SHORT_RANGE_TABLE - 1) / (2.0 * rs);
+        s_short[t] = static_cast<float>(std::erfc(u) + 2.0 * u / std::sqrt(PI) * std::exp(-u * u));
+    }
+
+    s_cells_x = std::max(1, static_cast<int>(width / s_rcut));
+    s_cells_y = std::max(1, static_cast<int>(height / s_rcut));
+    s_cell_start.assign(static_cast<size_t>(s_cells_x) * s_cells_y + 1, 0);
+    s_cursor.assign(static_cast<size_t>(s_cells_x) * s_cells_y, 0);
+    s_cell_of.assign(n_bodies, 0);
+    s_sorted.assign(n_bodies, 0);
+    s_px.assign(n_bodies, 0.f);
+    s_py.assign(n_bodies, 0.f);
+    s_pm.assign(n_bodies, 0.f);
+}
+
+// Lower mesh cell and CIC weights of a position: the body is spread over the four cells whose
+// centres surround it, cell (x0 + dx, y0 + dy) gets weight wx[dx] * wy[dy]
+struct CicStencil {
+    size_t x[2];
+    size_t y[2];
+    float wx[2];
+    float wy[2];
+};
+
+static inline CicStencil cic_stencil(float x, float y) {
+    const float gx = (x + 0.5f * s_box_w) / s_hx - 0.5f;
+    const float gy = (y + 0.5f * s_box_h) / s_hy - 0.5f;
+    const float fx = std::floor(gx);
+    const float fy = std::floor(gy);
+    const int ix = static_cast<int>(fx);
+    const int iy = static_cast<int>(fy);
+
+    // mesh sides are powers of two, so masking wraps negative indices too
+    const int mask_x = static_cast<int>(s_nx) - 1;
+    const int mask_y = static_cast<int>(s_ny) - 1;
+    CicStencil s;
+    s.x[0] = static_cast<size_t>(ix & mask_x);
+    s.x[1] = static_cast<size_t>((ix + 1) & mask_x);
+    s.y[0] = static_cast<size_t>(iy & mask_y);
+    s.y[1] = static_cast<size_t>((iy + 1) & mask_y);
+    s.wx[1] = gx - fx;
+    s.wx[0] = 1.f - s.wx[1];
+    s.wy[1] = gy - fy;
+    s.wy[0] = 1.f - s.wy[1];
+    return s;
+}
+
+// Mass of every body onto the mesh (real part of s_mesh)
+static void deposit(const BodiesSOA& soa) {
+    const size_t n = soa.size;
+    const size_t nx = s_nx;
+    const size_t grain = std::max<size_t>(4096, n / (8 * s_pool->size()));
+
+    s_pool->parallel_for(n, grain, [&](size_t begin, size_t end, size_t worker) {
+        float* mesh = s_deposit[worker].data();
+        for (size_t i = begin; i < end; ++i) {
+            const CicStencil s = cic_stencil(soa.x[i], soa.y[i]);
+            const float m = soa.mass[i];
+            for (int dy = 0; dy < 2; ++dy)
+                for (int dx = 0; dx < 2; ++dx) mesh[s.y[dy] * nx + s.x[dx]] += m * s.wx[dx] * s.wy[dy];
+        }
+    });
+
+    // sum the worker meshes and clear them for the next step
+    const size_t cells = s_mesh.size();
+    const size_t workers = s_deposit.size();
+    s_pool->parallel_for(cells, std::max<size_t>(4096, cells / (4 * workers)), [&](size_t begin, size_t end, size_t) {
+        for (size_t c = begin; c < end; ++c) {
+            float sum = 0.f;
+            for (size_t w = 0; w < workers; ++w) {
+                sum += s_deposit[w][c];
+                s_deposit[w][c] = 0.f;
+            }
+            s_mesh[c] = Complex(sum, 0.f);
+        }
+    });
+}
+
+// Mass spectrum -> acceleration spectrum: a(k) = G * green(k) * i k * M(k), with the x component
+// in the real and the y component in the imaginary part (both fields are real, so one inverse
+// transform yields ax + i ay)
+static void apply_green(const float G) {
+    const size_t nx = s_nx;
+    s_pool->parallel_for(s_ny, std::max<size_t>(1, s_ny / (4 * s_pool->size())), [&](size_t begin, size_t end, size_t) {
+        for (size_t y = begin; y < end; ++y) {
+            const float ky = s_ky[y];
+            for (size_t x = 0; x < nx; ++x) {
+                const size_t c = y * nx + x;
+                const float g = G * s_green[c];
+                const float re = g * s_mesh[c].real();
+                const float im = g * s_mesh[c].imag();
+                const float kx = s_kx[x];
+                // (i kx - ky) * (re + i im)
+                s_mesh[c] = Complex(-kx * im - ky * re, kx * re - ky * im);
+            }
+        }
+    });
+}
+
+// Mesh acceleration at every body, with the same weights as the deposit
+static void interpolate(BodiesSOA& soa) {
+    const size_t n = soa.size;
+    const size_t nx = s_nx;
+    const size_t grain = std::max<size_t>(4096, n / (8 * s_pool->size()));
+
+    s_pool->parallel_for(n, grain, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            const CicStencil s = cic_stencil(soa.x[i], soa.y[i]);
+            float ax = 0.f, ay = 0.f;
+            for (int dy = 0; dy < 2; ++dy) {
+                for (int dx = 0; dx < 2; ++dx) {
+                    const Complex a = s_mesh[s.y[dy] * nx + s.x[dx]];
+                    const float w = s.wx[dx] * s.wy[dy];
+                    ax += w * a.real();
+                    ay += w * a.imag();
+                }
+            }
+            soa.ax[i] = ax;
+            soa.ay[i] = ay;
+        }
+    });
+}
+
+// Chaining cell of a coordinate, wrapped into [0, cells)
+static inline int chaining_cell(float v, float half, float size, int cells) {
+    int c = static_cast<int>(std::floor((v + half) / size));
+    c %= cells;
+    return c < 0 ? c + cells : c;
+}
+
+// Neighbouring cells of c (itself included), each listed once even on meshes narrower than 3
+static int neighbour_cells(int c, int cells, int out[3]) {
+    int count = 0;
+    for (int d = -1; d <= 1; ++d) {
+        int v = ((c + d) % cells + cells) % cells;
+        if (std::find(out, out + count, v) == out + count) out[count++] = v;
+    }
+    return count;
+}
+
+// P3M correction: add the short-range part of every pair closer than r_cut (minimum image)
+static void short_range(BodiesSOA& soa, const float G, const float eps) {
+    const size_t n = soa.size;
+    const size_t cells = static_cast<size_t>(s_cells_x) * s_cells_y;
+    const float half_w = 0.5f * s_box_w, half_h = 0.5f * s_box_h;
+    const float cell_w = static_cast<float>(s_box_w) / s_cells_x;
+    const float cell_h = static_cast<float>(s_box_h) / s_cells_y;
+
+    // bucket the bodies by chaining cell; positions are copied so the pair loop reads contiguously
+    s_pool->parallel_for(n, std::max<size_t>(4096, n / (8 * s_pool->size())), [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            int cx = chaining_cell(soa.x[i], half_w, cell_w, s_cells_x);
+            int cy = chaining_cell(soa.y[i], half_h, cell_h, s_cells_y);
+            s_cell_of[i] = static_cast<uint32_t>(cy * s_cells_x + cx);
+        }
+    });
+    std::fill(s_cell_start.begin(), s_cell_start.end(), 0u);
+    for (size_t i = 0; i < n; ++i) ++s_cell_start[s_cell_of[i] + 1];
+    for (size_t c = 0; c < cells; ++c) {
+        s_cell_start[c + 1] += s_cell_start[c];
+        s_cursor[c] = s_cell_start[c];
+    }
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t p = s_cursor[s_cell_of[i]]++;
+        s_sorted[p] = static_cast<uint32_t>(i);
+        s_px[p] = soa.x[i];
+        s_py[p] = soa.y[i];
+        s_pm[p] = soa.mass[i];
+    }
+
+    const float rcut2 = s_rcut * s_rcut;
+    const float eps2 = eps * eps;
+    const float table_scale = (SHORT_RANGE_TABLE - 1) / s_rcut;
+    const float box_w = static_cast<float>(s_box_w), box_h = static_cast<float>(s_box_h);
+
+    s_pool->run(cells, [&](size_t c, size_t) {
+        int near_x[3], near_y[3];
+        const int count_x = neighbour_cells(static_cast<int>(c) % s_cells_x, s_cells_x, near_x);
+        const int count_y = neighbour_cells(static_cast<int>(c) / s_cells_x, s_cells_y, near_y);
+
+        for (uint32_t p = s_cell_start[c]; p < s_cell_start[c + 1]; ++p) {
+            const float xi = s_px[p], yi = s_py[p];
+            float ax = 0.f, ay = 0.f;
+
+            for (int b = 0; b < count_y; ++b) {
+                for (int a = 0; a < count_x; ++a) {
+                    const size_t d = static_cast<size_t>(near_y[b]) * s_cells_x + near_x[a];
+                    for (uint32_t q = s_cell_start[d]; q < s_cell_start[d + 1]; ++q) {
+                        if (q == p) continue;
+                        float dx = s_px[q] - xi;
+                        float dy = s_py[q] - yi;
+                        if (dx > half_w) dx -= box_w; else if (dx < -half_w) dx += box_w;
+                        if (dy > half_h) dy -= box_h; else if (dy < -half_h) dy += box_h;
+
+                        const float r2 = dx * dx + dy * dy;
+                        if (r2 >= rcut2) continue;
+
+                        const float t = std::sqrt(r2) * table_scale;
+                        const size_t k = static_cast<size_t>(t);
+                        const float factor = s_short[k] + (t - k) * (s_short[k + 1] - s_short[k]);
+                        const float inv = 1.f / std::sqrt(r2 + eps2);
+                        const float s = s_pm[q] * inv * inv * inv * factor;
+                        ax += dx * s;
+                        ay += dy * s;
+                    }
+                }
+            }
+
+            soa.ax[s_sorted[p]] += G * ax;
+            soa.ay[s_sorted[p]] += G * ay;
+        }
+    });
+}
+
+// Create the pool; the mesh waits for the first step
+bool initParticleMeshComputation(size_t n_bodies, const ParticleMeshOptions& options) {
+    if (options.p3m && (options.split <= 0.f || options.cutoff <= 0.f)) {
+        std::cerr << "Particle-mesh: split and cutoff must be positive\n";
+        return false;
+    }
+
+    s_options = options;
+    s_pool = std::make_unique<ThreadPool>(options.threads);
+    s_options.threads = s_pool->size();
+    s_soa.resize(n_bodies);
+    s_box_w = s_box_h = 0;
+    return true;
+}
+
+bool initParticleMeshComputation(size_t n_bodies) {
+    return initParticleMeshComputation(n_bodies, ParticleMeshOptions());
+}
+
+void particle_mesh_compute_forces(BodiesSOA& soa, const float G, const float eps, const int width, const int height) {
+    if (width != s_box_w || height != s_box_h || eps != s_eps || soa.size != s_bodies)
+        setup_mesh(soa.size, eps, width, height);
+
+    {
+        NBODY_PROFILE_SCOPE("deposit");
+        deposit(soa);
+    }
+    {
+        NBODY_PROFILE_SCOPE("fft + green");
+        fft_2d(false);
+        apply_green(G);
+        fft_2d(true);
+    }
+    {
+        NBODY_PROFILE_SCOPE("interpolate");
+        interpolate(soa);
+    }
+    if (s_options.p3m) {
+        NBODY_PROFILE_SCOPE("short range");
+        short_range(soa, G, eps);
+    }
+}
+
+void particle_mesh_step(BodiesSOA& soa,
+                        const float G,
+                        const float eps,
+                        const float dt,
+                        const int width,
+                        const int height)
+{
+    particle_mesh_compute_forces(soa, G, eps, width, height);
+
+    NBODY_PROFILE_SCOPE("integrate");
+    s_pool->parallel_for(soa.size, std::max<size_t>(4096, soa.size / (8 * s_pool->size())),
+                         [&](size_t begin, size_t end, size_t) {
+                             simd_integrate_range(soa, begin, end, dt, width, height);
+                         });
+}
+
+// Perform one particle-mesh step: pack into SoA, step, unpack
+void runParticleMeshComputation(std::vector<Body>& bodies,
+                                const float G,
+                                const float eps,
+                                const float dt,
+                                const int width,
+                                const int height)
+{
+    packBodies(bodies, s_soa);
+    particle_mesh_step(s_soa, G, eps, dt, width, height);
+    unpackBodies(s_soa, bodies);
+}
+
+// Join the workers and free the mesh
+void cleanupParticleMeshComputation() {
+    s_pool.reset();
+    s_soa = BodiesSOA(0);
+    s_box_w = s_box_h = 0;
+    s_bodies = 0;
+    s_mesh = std::vector<Complex>();
+    s_green = std::vector<float>();
+    s_deposit.clear();
+    s_columns.clear();
+    s_cell_start.clear();
+    s_cursor.clear();
+    s_cell_of = std::vector<uint32_t>();
+    s_sorted = std::vector<uint32_t>();
+    s_px = AlignedFloats();
+    s_py = AlignedFloats();
+    s_pm = AlignedFloats();
+    s_short.clear();
+}
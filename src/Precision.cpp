@@ -0,0 +1,279 @@
+// File: Precision.cpp
+// Implements the precision-templated direct-sum engine
+//  - one state per storage type; the mode picks the (storage, accumulator) instantiation once
+//    per call through dispatch(), the loops themselves are all compile-time
+//  - forces go through the SIMD tile kernels (rsqrt + Newton step for float, exact 1 / sqrt for
+//    double), instantiated on the mode's accumulator, so the modes compare summation, not loops
+//  - the state is kept between calls, so double storage keeps its extra bits across frames; it is
+//    reloaded from bodies only when they differ from what the previous call stored into them
+//  - errors are measured in double: the energy against the initial one, forces against a double
+//    Kahan-summed direct sum on the same positions
+
+#include <algorithm>  // for std::max, std::min, std::fill
+#include <cmath>      // for std::sqrt, std::abs, std::hypot
+#include <iostream>   // for std::cerr
+#include <memory>     // for std::unique_ptr
+#include <type_traits>  // for std::decay_t, std::is_same
+
+#include "Precision.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+// Precision runtime state
+static std::unique_ptr<ThreadPool>   s_pool;
+static PrecisionOptions              s_options;
+static PrecisionStats                s_stats;
+static PrecisionState<float>         s_float;
+static PrecisionState<double>        s_double;
+static bool                          s_loaded = false;   // the state matches the bodies last stored
+static float                         s_G = 1.f;          // last step's constants, for measurements on request
+static float                         s_eps = 0.1f;
+
+template <typename T>
+struct AccumulateIn { using type = T; };
+
+const char* precisionName(PrecisionMode mode) {
+    switch (mode) {
+    case PrecisionMode::Float:  return "float";
+    case PrecisionMode::Double: return "double";
+    case PrecisionMode::Mixed:  return "mixed";
+    default:                    return "kahan";
+    }
+}
+
+bool parsePrecision(const std::string& name, PrecisionMode& mode) {
+    for (PrecisionMode m : { PrecisionMode::Float, PrecisionMode::Double, PrecisionMode::Mixed, PrecisionMode::Kahan }) {
+        if (name == precisionName(m)) {
+            mode = m;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Call f(state, AccumulateIn<Accum>) with the state and accumulator type of the configured mode
+template <typename F>
+static void dispatch(F&& f) {
+    switch (s_options.mode) {
+    case PrecisionMode::Float:  f(s_float, AccumulateIn<float>());           break;
+    case PrecisionMode::Double: f(s_double, AccumulateIn<double>());         break;
+    case PrecisionMode::Mixed:  f(s_float, AccumulateIn<double>());          break;
+    case PrecisionMode::Kahan:  f(s_float, AccumulateIn<KahanSum<float>>()); break;
+    }
+}
+
+template <typename Real>
+static void load(PrecisionState<Real>& s, const std::vector<Body>& bodies) {
+    s.resize(bodies.size());
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        s.x[i]    = bodies[i].x;
+        s.y[i]    = bodies[i].y;
+        s.vx[i]   = bodies[i].velocity_x;
+        s.vy[i]   = bodies[i].velocity_y;
+        s.ax[i]   = bodies[i].acceleration_x;
+        s.ay[i]   = bodies[i].acceleration_y;
+        s.mass[i] = bodies[i].mass;
+        s.pinned[i] = bodies[i].pinned;
+    }
+}
+
+template <typename Real>
+static void store(const PrecisionState<Real>& s, std::vector<Body>& bodies) {
+    for (size_t i = 0; i < s.size; ++i) {
+        bodies[i].x              = static_cast<float>(s.x[i]);
+        bodies[i].y              = static_cast<float>(s.y[i]);
+        bodies[i].velocity_x     = static_cast<float>(s.vx[i]);
+        bodies[i].velocity_y     = static_cast<float>(s.vy[i]);
+        bodies[i].acceleration_x = static_cast<float>(s.ax[i]);
+        bodies[i].acceleration_y = static_cast<float>(s.ay[i]);
+    }
+}
+
+// True if bodies still hold exactly what store() wrote from this state
+template <typename Real>
+static bool matches(const PrecisionState<Real>& s, const std::vector<Body>& bodies) {
+    if (s.size != bodies.size()) return false;
+    for (size_t i = 0; i < s.size; ++i) {
+        if (bodies[i].x != static_cast<float>(s.x[i]) || bodies[i].y != static_cast<float>(s.y[i]) ||
+            bodies[i].velocity_x != static_cast<float>(s.vx[i]) ||
+            bodies[i].velocity_y != static_cast<float>(s.vy[i]))
+            return false;
+    }
+    return true;
+}
+
+// Softened total energy, -G m_i m_j / sqrt(r^2 + eps^2) per pair, in double
+template <typename Real>
+static double total_energy(const PrecisionState<Real>& s, double G, double eps) {
+    struct Partial {
+        double energy;
+        char pad[64];   // keep the workers' sums on separate cache lines
+    };
+    std::vector<Partial> partial(s_pool->size(), Partial{ 0.0, {} });
+    const double eps2 = eps * eps;
+    s_pool->parallel_for(s.size, 64, [&](size_t begin, size_t end, size_t worker) {
+        double e = 0.0;
+        for (size_t i = begin; i < end; ++i) {
+            const double m = s.mass[i];
+            const double vx = s.vx[i], vy = s.vy[i];
+            e += 0.5 * m * (vx * vx + vy * vy);
+            // every pair is visited from both ends, hence the half
+            double phi = 0.0;
+            for (size_t j = 0; j < s.size; ++j) {
+                if (j == i) continue;
+                const double dx = static_cast<double>(s.x[j]) - s.x[i];
+                const double dy = static_cast<double>(s.y[j]) - s.y[i];
+                phi += s.mass[j] / std::sqrt(dx * dx + dy * dy + eps2);
+            }
+            e -= 0.5 * G * m * phi;
+        }
+        partial[worker].energy += e;
+    });
+    double total = 0.0;
+    for (const Partial& p : partial) total += p.energy;
+    return total;
+}
+
+// Forces of bodies [begin, end): the SIMD tile kernel of the mode, or the scalar template for
+// the double Kahan-summed reference
+template <typename Real, typename Accum>
+static void forces_range(PrecisionState<Real>& s, size_t begin, size_t end, Real G, Real eps) {
+    if constexpr (std::is_same<Accum, KahanSum<double>>::value) {
+        precision_forces_range<Real, Accum>(s, begin, end, G, eps);
+    }
+    else {
+        std::fill(s.ax.begin() + begin, s.ax.begin() + end, Real(0));
+        std::fill(s.ay.begin() + begin, s.ay.begin() + end, Real(0));
+        if constexpr (std::is_same<Real, double>::value) {
+            simd_accumulate_forces_tile(s.x.data(), s.y.data(), s.mass.data(), s.ax.data(), s.ay.data(),
+                                        begin, end, 0, s.size, G, eps, s_options.kernel);
+        }
+        else {
+            simd_accumulate_forces_tile<Accum>(s.x.data(), s.y.data(), s.mass.data(), s.ax.data(), s.ay.data(),
+                                               begin, end, 0, s.size, G, eps, s_options.kernel);
+        }
+    }
+}
+
+// Forces of every body with the mode's kernel, split over the pool
+template <typename Real, typename Accum>
+static void forces_pass(PrecisionState<Real>& s, size_t count, Real G, Real eps) {
+    NBODY_PROFILE_SCOPE("forces");
+    const size_t grain = std::max<size_t>(16, count / (4 * s_pool->size()));
+    s_pool->parallel_for(count, grain, [&](size_t begin, size_t end, size_t) {
+        forces_range<Real, Accum>(s, begin, end, G, eps);
+    });
+}
+
+template <typename Real, typename Accum>
+static void run_steps(PrecisionState<Real>& s, int steps, float G, float eps, float dt, int width, int height) {
+    for (int step = 0; step < steps; ++step) {
+        forces_pass<Real, Accum>(s, s.size, static_cast<Real>(G), static_cast<Real>(eps));
+        NBODY_PROFILE_SCOPE("integrate");
+        s_pool->parallel_for(s.size, std::max<size_t>(4096, s.size / (4 * s_pool->size())),
+                             [&](size_t begin, size_t end, size_t) {
+                                 precision_integrate_range(s, begin, end, static_cast<Real>(dt), width, height);
+                             });
+    }
+}
+
+bool initPrecisionComputation(size_t n_bodies, const PrecisionOptions& options) {
+    if (!simdKernelSupported(options.kernel)) {
+        std::cerr << "This CPU cannot run the " << simdKernelName(options.kernel) << " kernel\n";
+        return false;
+    }
+    s_options = options;
+    s_pool = std::make_unique<ThreadPool>(options.threads);
+    s_options.threads = s_pool->size();
+    s_stats = PrecisionStats();
+    s_loaded = false;
+    if (options.mode == PrecisionMode::Double) s_double.resize(n_bodies);
+    else s_float.resize(n_bodies);
+    return true;
+}
+
+void runPrecisionSubsteps(std::vector<Body>& bodies,
+                          const float G,
+                          const float eps,
+                          const float dt,
+                          const int width,
+                          const int height,
+                          const int steps)
+{
+    s_G = G;
+    s_eps = eps;
+    dispatch([&](auto& state, auto accumulate) {
+        using Real = typename std::decay_t<decltype(state.x)>::value_type;
+        using Accum = typename decltype(accumulate)::type;
+
+        if (!s_loaded || !matches(state, bodies)) {
+            NBODY_PROFILE_SCOPE("pack");
+            load(state, bodies);
+            s_loaded = true;
+        }
+        if (s_stats.steps == 0) s_stats.initial_energy = total_energy(state, G, eps);
+
+        run_steps<Real, Accum>(state, steps, G, eps, dt, width, height);
+        s_stats.steps += steps;
+
+        NBODY_PROFILE_SCOPE("unpack");
+        store(state, bodies);
+    });
+}
+
+void runPrecisionComputation(std::vector<Body>& bodies,
+                             const float G,
+                             const float eps,
+                             const float dt,
+                             const int width,
+                             const int height)
+{
+    runPrecisionSubsteps(bodies, G, eps, dt, width, height, 1);
+}
+
+void measurePrecisionError(size_t samples) {
+    if (!s_pool || !s_loaded) return;
+
+    dispatch([&](auto& state, auto accumulate) {
+        using Real = typename std::decay_t<decltype(state.x)>::value_type;
+        using Accum = typename decltype(accumulate)::type;
+
+        const double e = total_energy(state, s_G, s_eps);
+        const double e0 = s_stats.initial_energy;
+        s_stats.energy_error = e0 != 0.0 ? (e - e0) / std::abs(e0) : 0.0;
+
+        // the mode's forces and the reference on copies of the same positions
+        const size_t k = std::min(samples, state.size);
+        PrecisionState<Real> approx = state;
+        PrecisionState<double> exact;
+        exact.resize(state.size);
+        for (size_t i = 0; i < state.size; ++i) {
+            exact.x[i] = state.x[i];
+            exact.y[i] = state.y[i];
+            exact.mass[i] = state.mass[i];
+        }
+        forces_pass<Real, Accum>(approx, k, static_cast<Real>(s_G), static_cast<Real>(s_eps));
+        forces_pass<double, KahanSum<double>>(exact, k, s_G, s_eps);
+
+        double sum_sq = 0.0, max_err = 0.0;
+        for (size_t i = 0; i < k; ++i) {
+            const double ref = std::hypot(exact.ax[i], exact.ay[i]);
+            const double err = std::hypot(approx.ax[i] - exact.ax[i], approx.ay[i] - exact.ay[i]) / (ref > 0.0 ? ref : 1.0);
+            sum_sq += err * err;
+            max_err = std::max(max_err, err);
+        }
+        s_stats.force_rms_error = k ? std::sqrt(sum_sq / static_cast<double>(k)) : 0.0;
+        s_stats.force_max_error = max_err;
+    });
+}
+
+const PrecisionStats& precisionStats() {
+    return s_stats;
+}
+
+void cleanupPrecisionComputation() {
+    s_pool.reset();
+    s_float = PrecisionState<float>();
+    s_double = PrecisionState<double>();
+    s_loaded = false;
+}
@@ -0,0 +1,230 @@
+// File: Profiler.cpp
+// Implements the phase profiler
+//  - records go to one mutex-protected store: the phases are coarse (a few per step or frame),
+//    so a lock per record costs far less than the phases themselves
+//  - every phase keeps a ring of its last PROFILE_WINDOW durations for p50/p99, and the trace
+//    keeps up to MAX_TRACE_EVENTS complete events for export
+//  - OpenCL events are kept retained until they complete and then read once
+
+#include "Profiler.h"
+
+#include <iostream>
+
+#ifdef NBODY_PROFILING
+
+#include <algorithm>  // for std::sort, std::nth_element, std::min
+#include <cstdio>     // for std::snprintf
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+#include "OpenCLDevice.h"   // OpenCL headers
+
+// Trace events kept for export; later ones still feed the statistics
+constexpr size_t MAX_TRACE_EVENTS = size_t(1) << 20;
+
+// Track id of the OpenCL device in the trace
+constexpr uint32_t GPU_TRACK = 1000;
+
+struct TraceEvent {
+    const char* name;
+    uint64_t begin_ns;
+    uint64_t end_ns;
+    uint32_t track;
+};
+
+// Rolling window of one phase
+struct PhaseStats {
+    std::vector<float> window_ms;   // ring of the last PROFILE_WINDOW durations
+    size_t next = 0;
+    uint64_t count = 0;
+    double total_ms = 0.0;
+};
+
+struct PendingGpuEvent {
+    const char* name;
+    cl_event event;
+    uint64_t queued_host_ns;
+};
+
+static std::mutex                                   s_mutex;
+static std::vector<TraceEvent>                      s_trace;
+static size_t                                       s_dropped = 0;
+static std::unordered_map<std::string, PhaseStats>  s_phases;
+static std::vector<PendingGpuEvent>                 s_pending;
+static std::unordered_map<uint32_t, std::string>    s_track_names;
+static uint32_t                                     s_next_track = 0;
+static const uint64_t                               s_start_ns = profileNow();
+
+// Small per-thread track number, assigned on first use
+static uint32_t current_track() {
+    thread_local uint32_t track = [] {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        return s_next_track++;
+    }();
+    return track;
+}
+
+// Caller holds s_mutex
+static void record_locked(const char* name, uint64_t begin_ns, uint64_t end_ns, uint32_t track) {
+    if (s_trace.size() < MAX_TRACE_EVENTS) s_trace.push_back({ name, begin_ns, end_ns, track });
+    else ++s_dropped;
+
+    PhaseStats& phase = s_phases[name];
+    const float ms = static_cast<float>((end_ns - begin_ns) * 1e-6);
+    if (phase.window_ms.size() < PROFILE_WINDOW) phase.window_ms.push_back(ms);
+    else phase.window_ms[phase.next] = ms;
+    phase.next = (phase.next + 1) % PROFILE_WINDOW;
+    ++phase.count;
+    phase.total_ms += ms;
+}
+
+// Read the finished events among the pending ones; caller holds s_mutex
+static void collect_locked() {
+    size_t kept = 0;
+    for (PendingGpuEvent& p : s_pending) {
+        cl_int status = CL_QUEUED;
+        clGetEventInfo(p.event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, NULL);
+        if (status > CL_COMPLETE) {
+            s_pending[kept++] = p;
+            continue;
+        }
+        cl_ulong queued = 0, start = 0, end = 0;
+        bool ok = status == CL_COMPLETE &&
+                  clGetEventProfilingInfo(p.event, CL_PROFILING_COMMAND_QUEUED, sizeof(queued), &queued, NULL) == CL_SUCCESS &&
+                  clGetEventProfilingInfo(p.event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL) == CL_SUCCESS &&
+                  clGetEventProfilingInfo(p.event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL) == CL_SUCCESS;
+        if (ok && end >= start && start >= queued) {
+            // device clock -> host clock, anchored at the moment the command was queued
+            record_locked(p.name, p.queued_host_ns + (start - queued), p.queued_host_ns + (end - queued), GPU_TRACK);
+        }
+        clReleaseEvent(p.event);
+    }
+    s_pending.resize(kept);
+}
+
+void profileRecord(const char* name, uint64_t begin_ns, uint64_t end_ns) {
+    const uint32_t track = current_track();
+    std::lock_guard<std::mutex> lock(s_mutex);
+    record_locked(name, begin_ns, end_ns, track);
+}
+
+void profileGpuEvent(const char* name, cl_event event) {
+    if (!event) return;
+    const uint64_t now = profileNow();
+    clRetainEvent(event);
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_pending.push_back({ name, event, now });
+    // keep the pending list short without a separate collector thread
+    if (s_pending.size() >= 256) collect_locked();
+}
+
+void profileThreadName(const char* name) {
+    const uint32_t track = current_track();
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_track_names[track] = name;
+}
+
+void profileCollectGpu() {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    collect_locked();
+}
+
+std::vector<ProfileSummary> profileSummary() {
+    profileCollectGpu();
+    std::lock_guard<std::mutex> lock(s_mutex);
+    std::vector<ProfileSummary> summary;
+    for (const auto& entry : s_phases) {
+        const PhaseStats& phase = entry.second;
+        std::vector<float> sorted = phase.window_ms;
+        if (sorted.empty()) continue;
+
+        ProfileSummary s;
+        s.name = entry.first;
+        s.count = phase.count;
+        s.total_ms = phase.total_ms;
+        auto percentile = [&](double q) {
+            size_t k = std::min(sorted.size() - 1, static_cast<size_t>(q * sorted.size()));
+            std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+            return static_cast<double>(sorted[k]);
+        };
+        s.p50_ms = percentile(0.50);
+        s.p99_ms = percentile(0.99);
+        double sum = 0.0;
+        for (float ms : phase.window_ms) sum += ms;
+        s.mean_ms = sum / phase.window_ms.size();
+        summary.push_back(s);
+    }
+    std::sort(summary.begin(), summary.end(),
+              [](const ProfileSummary& a, const ProfileSummary& b) { return a.total_ms > b.total_ms; });
+    return summary;
+}
+
+void printProfileSummary(std::ostream& out) {
+    out << "phase                          count     p50 ms     p99 ms    mean ms   total ms\n";
+    for (const ProfileSummary& s : profileSummary()) {
+        char line[160];
+        std::snprintf(line, sizeof(line), "%-28s %7llu %10.3f %10.3f %10.3f %10.1f\n", s.name.c_str(),
+                      static_cast<unsigned long long>(s.count), s.p50_ms, s.p99_ms, s.mean_ms, s.total_ms);
+        out << line;
+    }
+}
+
+// Escape a phase name for a JSON string
+static std::string json_escape(const char* text) {
+    std::string out;
+    for (const char* c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\') out += '\\';
+        out += *c;
+    }
+    return out;
+}
+
+bool writeChromeTrace(const std::string& path) {
+    profileCollectGpu();
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Cannot write trace " << path << "\n";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    // complete ("X") events in microseconds since the profiler started, one track per thread
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    out << "  {\"ph\": \"M\", \"pid\": 1, \"tid\": " << GPU_TRACK
+        << ", \"name\": \"thread_name\", \"args\": {\"name\": \"OpenCL device\"}}";
+    for (const auto& track : s_track_names) {
+        out << ",\n  {\"ph\": \"M\", \"pid\": 1, \"tid\": " << track.first
+            << ", \"name\": \"thread_name\", \"args\": {\"name\": \"" << json_escape(track.second.c_str()) << "\"}}";
+    }
+    char buffer[64];
+    for (const TraceEvent& e : s_trace) {
+        const double ts = (static_cast<double>(e.begin_ns) - static_cast<double>(s_start_ns)) * 1e-3;
+        const double dur = (e.end_ns - e.begin_ns) * 1e-3;
+        out << ",\n  {\"ph\": \"X\", \"pid\": 1, \"tid\": " << e.track
+            << ", \"cat\": \"" << (e.track == GPU_TRACK ? "gpu" : "cpu")
+            << "\", \"name\": \"" << json_escape(e.name) << "\"";
+        std::snprintf(buffer, sizeof(buffer), ", \"ts\": %.3f, \"dur\": %.3f}", ts, dur);
+        out << buffer;
+    }
+    out << "\n]}\n";
+    if (s_dropped) std::cerr << "Trace buffer full, " << s_dropped << " events only counted in the statistics\n";
+    std::cout << "Wrote " << s_trace.size() << " trace events to " << path << "\n";
+    return static_cast<bool>(out);
+}
+
+#else
+
+void profileRecord(const char*, uint64_t, uint64_t) {}
+void profileGpuEvent(const char*, cl_event) {}
+void profileThreadName(const char*) {}
+void profileCollectGpu() {}
+std::vector<ProfileSummary> profileSummary() { return {}; }
+void printProfileSummary(std::ostream&) {}
+
+bool writeChromeTrace(const std::string& path) {
+    std::cerr << "Not writing " << path << ": built without NBODY_PROFILING\n";
+    return false;
+}
+
+#endif
@@ -0,0 +1,92 @@
+// File: Reorder.cpp
+// Implements the spatial reordering stage on top of the Morton helpers
+//  - keys come from the same 16-bit grid over the bounding square as the Barnes-Hut sort
+//  - the permutation is the radix sort's value array, seeded with 0..n-1, so it is stable
+//  - bodies are gathered whole (id, mass and the pinned flag included) into a scratch vector
+
+#include <algorithm>  // for std::min
+#include <memory>     // for std::make_shared, std::unique_ptr
+
+#include "Profiler.h"
+#include "Reorder.h"
+#include "ThreadPool.h"
+
+const char* spaceCurveName(SpaceCurve curve) {
+    return curve == SpaceCurve::Hilbert ? "hilbert" : "morton";
+}
+
+bool parseSpaceCurve(const std::string& name, SpaceCurve& curve) {
+    for (SpaceCurve c : { SpaceCurve::Morton, SpaceCurve::Hilbert }) {
+        if (name == spaceCurveName(c)) {
+            curve = c;
+            return true;
+        }
+    }
+    return false;
+}
+
+void spatialOrder(const std::vector<Body>& bodies, SpaceCurve curve, std::vector<uint32_t>& perm,
+                  ReorderScratch& scratch, ThreadPool& pool)
+{
+    const size_t n = bodies.size();
+    scratch.x.resize(n);
+    scratch.y.resize(n);
+    scratch.keys.resize(n);
+    perm.resize(n);
+
+    pool.parallel_for(n, 4096, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            scratch.x[i] = bodies[i].x;
+            scratch.y[i] = bodies[i].y;
+            perm[i] = static_cast<uint32_t>(i);
+        }
+    });
+
+    MortonBounds bounds = morton_bounds(scratch.x.data(), scratch.y.data(), n, scratch.morton, pool);
+    if (curve == SpaceCurve::Hilbert)
+        hilbert_keys(scratch.x.data(), scratch.y.data(), n, bounds, scratch.keys.data(), pool);
+    else
+        morton_keys(scratch.x.data(), scratch.y.data(), n, bounds, scratch.keys.data(), pool);
+    radix_sort_pairs(scratch.keys.data(), perm.data(), n, scratch.morton, pool);
+}
+
+void permuteBodies(std::vector<Body>& bodies, const std::vector<uint32_t>& perm,
+                   ReorderScratch& scratch, ThreadPool& pool)
+{
+    scratch.bodies.resize(bodies.size());
+    pool.parallel_for(bodies.size(), 4096, [&](size_t begin, size_t end, size_t) {
+        for (size_t k = begin; k < end; ++k) scratch.bodies[k] = bodies[perm[k]];
+    });
+    bodies.swap(scratch.bodies);
+}
+
+BatchStepFunction with_reordering(BatchStepFunction compute, const ReorderOptions& options,
+                                  PermuteFunction permute_state)
+{
+    struct State {
+        std::unique_ptr<ThreadPool> pool;
+        ReorderScratch scratch;
+        std::vector<uint32_t> perm;
+        uint64_t step = 0;
+    };
+    auto state = std::make_shared<State>();
+    state->pool = std::make_unique<ThreadPool>(options.threads);
+    const uint64_t every = std::max<uint64_t>(1, options.every);
+    const SpaceCurve curve = options.curve;
+
+    return [compute, permute_state, state, every, curve](std::vector<Body>& bodies, float G, float eps, float dt,
+                                                          int width, int height, int steps) {
+        while (steps > 0) {
+            if (state->step % every == 0 && bodies.size() > 1) {
+                NBODY_PROFILE_SCOPE("reorder");
+                spatialOrder(bodies, curve, state->perm, state->scratch, *state->pool);
+                permuteBodies(bodies, state->perm, state->scratch, *state->pool);
+                if (permute_state) permute_state(state->perm);
+            }
+            int chunk = static_cast<int>(std::min<uint64_t>(steps, every - state->step % every));
+            compute(bodies, G, eps, dt, width, height, chunk);
+            steps -= chunk;
+            state->step += chunk;
+        }
+    };
+}
@@ -3,69 +3,123 @@
 
 #include <SFML/Graphics.hpp>  // SFML main header
 #include "SFML.h"
+#include "BodyRenderer.h"
+#include <algorithm>  // for std::max, std::min
 #include <iostream>
 #include "NBody.h"
+#include "Profiler.h"
+#include "SimulationThread.h"
 
 constexpr float TARGET_FPS = 165.f;  // target frames per second
 const sf::Time FRAME_DURATION = sf::seconds(1.f / TARGET_FPS);
 
-// Main rendering function: takes a computation callback to update bodies each frame
+// Load the HUD font and set up the text line in the top-left corner
+static void setup_hud(sf::Font& font, sf::Text& text) {
+    if (!font.loadFromFile("../OpenSans-Bold.ttf")) {
+        std::cerr << "Failed to load font\n";
+    }
+    text = sf::Text("", font, 18);
+    text.setFillColor(sf::Color::White);
+    text.setPosition(10, 5);
+}
+
+// Close on window close / Escape, cycle the render mode on M
+static void handle_events(sf::RenderWindow& window, BodyRenderer& renderer) {
+    sf::Event e;
+    while (window.pollEvent(e)) {
+        if (e.type == sf::Event::Closed)
+            window.close();
+        else if (e.type == sf::Event::KeyPressed && e.key.code == sf::Keyboard::Escape)
+            window.close();
+        else if (e.type == sf::Event::KeyPressed && e.key.code == sf::Keyboard::M)
+            renderer.cycle_mode();
+    }
+}
+
+// Single step per frame
 void render_bodies(
-    std::function<void(std::vector<Body>&, const float, const float, const float, const int, const int)> compute,
+    StepFunction compute,
     std::vector<Body>& bodies,
     const float G,
     const float eps,
     const float dt,
     const int width,
     const int height) {
+    render_bodies(repeat_steps(compute), bodies, G, eps, dt, width, height, SubstepOptions());
+}
+
+// Main rendering function: takes a computation callback that advances bodies by K steps each frame
+void render_bodies(
+    BatchStepFunction compute,
+    std::vector<Body>& bodies,
+    const float G,
+    const float eps,
+    const float dt,
+    const int width,
+    const int height,
+    const SubstepOptions& substeps) {
     // create window
     sf::RenderWindow window(sf::VideoMode(width, height), "N-Body Simulation");
 
     // load font for FPS display
     sf::Font font;
-    if (!font.loadFromFile("../OpenSans-Bold.ttf")) {
-        std::cerr << "Failed to load font\n";
-    }
-    sf::Text fpsText("", font, 18);
-    fpsText.setFillColor(sf::Color::White);
-    fpsText.setPosition(10, 5);
+    sf::Text fpsText;
+    setup_hud(font, fpsText);
+
+    BodyRenderer renderer(width, height, defaultRenderMode(bodies.size()));
 
     sf::Clock frameClock;  // for frame limiting
     sf::Clock fpsClock;    // for FPS calculation
+    sf::Clock physicsClock; // time spent in compute, drives the adaptive substep count
     float lastFPS = 0.0f;
 
+    int steps = std::max(1, substeps.substeps);
+    const int max_steps = std::max(steps, substeps.max_substeps);
+    const float physics_budget = substeps.budget_fraction * FRAME_DURATION.asSeconds();
+    float step_cost = 0.0f;
+
     // main loop
+    profileThreadName("render");
     while (window.isOpen()) {
+        NBODY_PROFILE_SCOPE("frame");
         // handle events
-        sf::Event e;
-        while (window.pollEvent(e)) {
-            if (e.type == sf::Event::Closed) 
-                window.close();
-        }
+        handle_events(window, renderer);
 
-        // update simulation state
-        compute(bodies, G, eps, dt, width, height);
+        // update simulation state by 'steps' substeps
+        physicsClock.restart();
+        {
+            NBODY_PROFILE_SCOPE("compute");
+            compute(bodies, G, eps, dt, width, height, steps);
+        }
+        float physics_seconds = physicsClock.getElapsedTime().asSeconds();
+        int frame_steps = steps;
+        if (substeps.adaptive)
+            steps = adaptSubsteps(steps, physics_seconds, physics_budget, max_steps, step_cost);
 
         // clear screen
         window.clear(sf::Color::Black);
 
-        // draw each body as a circle
-        for (const Body& b : bodies) {
-            sf::CircleShape circle(b.mass > 50.0f ? 6 : 2);
-            circle.setFillColor(mass_to_color(b.mass));
-            circle.setPosition(width / 2 + b.x, height / 2 + b.y);
-            circle.setOrigin(circle.getRadius(), circle.getRadius());
-            window.draw(circle);
+        // draw all bodies in one batch
+        {
+            NBODY_PROFILE_SCOPE("draw");
+            renderer.update(bodies);
+            renderer.draw(window);
         }
 
         // calculate and display FPS
         float elapsed = fpsClock.restart().asSeconds();
         lastFPS = 1.0f / elapsed;
-        fpsText.setString("FPS: " + std::to_string((int)lastFPS));
+        fpsText.setString("FPS: " + std::to_string((int)lastFPS) +
+                          "  steps/frame: " + std::to_string(frame_steps) +
+                          "  steps/s: " + std::to_string((int)(lastFPS * frame_steps)) +
+                          "  view: " + renderModeName(renderer.mode()) + " [M]");
         window.draw(fpsText);
 
         // show on screen
-        window.display();
+        {
+            NBODY_PROFILE_SCOPE("present");
+            window.display();
+        }
 
         // limit to target frame rate
         sf::Time elapsed2 = frameClock.getElapsedTime();
@@ -75,13 +129,87 @@ void render_bodies(
     }
 }
 
+// Threaded variant: physics runs free on a SimulationThread and this loop draws whatever snapshot
+// is newest when a frame starts, so neither side waits for the other. Adaptive substeps size each
+// batch to one whole frame, since physics no longer shares the frame with drawing
+void render_bodies_threaded(
+    BatchStepFunction compute,
+    std::vector<Body>& bodies,
+    const float G,
+    const float eps,
+    const float dt,
+    const int width,
+    const int height,
+    const SubstepOptions& substeps) {
+    sf::RenderWindow window(sf::VideoMode(width, height), "N-Body Simulation");
+
+    sf::Font font;
+    sf::Text hudText;
+    setup_hud(font, hudText);
+
+    BodyRenderer renderer(width, height, defaultRenderMode(bodies.size()));
+    RenderMode drawn_mode = renderer.mode();
+
+    SimulationThread simulation(compute, bodies, G, eps, dt, width, height, substeps.substeps);
+    if (substeps.adaptive) simulation.adapt(FRAME_DURATION.asSeconds(), substeps.max_substeps);
+    simulation.start();
+
+    sf::Clock frameClock;  // for frame limiting
+    sf::Clock statsClock;  // rates are averaged over half a second
+    uint64_t frames = 0, frames_total = 0, last_steps = 0;
+
+    profileThreadName("render");
+    while (window.isOpen()) {
+        NBODY_PROFILE_SCOPE("frame");
+        handle_events(window, renderer);
+
+        // pick up the newest snapshot if one arrived; otherwise redraw the previous vertices as they are
+        bool fresh = simulation.acquire();
+        if (fresh || renderer.mode() != drawn_mode || frames_total == 0) {
+            const BodySnapshot& snapshot = simulation.snapshot();
+            renderer.update(snapshot.x.data(), snapshot.y.data(), snapshot.mass.data(), snapshot.x.size());
+            drawn_mode = renderer.mode();
+        }
+        ++frames_total;
+
+        window.clear(sf::Color::Black);
+        {
+            NBODY_PROFILE_SCOPE("draw");
+            renderer.draw(window);
+        }
+
+        ++frames;
+        float stats_seconds = statsClock.getElapsedTime().asSeconds();
+        if (stats_seconds >= 0.5f) {
+            uint64_t steps = simulation.steps();
+            hudText.setString("FPS: " + std::to_string((int)(frames / stats_seconds)) +
+                              "  steps/s: " + std::to_string((int)((steps - last_steps) / stats_seconds)) +
+                              "  steps/snapshot: " + std::to_string(simulation.batch()) +
+                              "  skipped snapshots: " + std::to_string(simulation.skipped()) +
+                              "  view: " + renderModeName(renderer.mode()) + " [M]");
+            frames = 0;
+            last_steps = steps;
+            statsClock.restart();
+        }
+        window.draw(hudText);
+        {
+            NBODY_PROFILE_SCOPE("present");
+            window.display();
+        }
+
+        // limit to target frame rate; only the render thread sleeps
+        sf::Time elapsed = frameClock.getElapsedTime();
+        if (elapsed < FRAME_DURATION)
+            sf::sleep(FRAME_DURATION - elapsed);
+        frameClock.restart();
+    }
+
+    // bodies belong to the caller again once the thread has joined
+    simulation.stop();
+}
+
 // Convert mass to a color gradient from blue to pink
 sf::Color mass_to_color(float mass) {
     float norm = std::min(1.0f, mass / 10.0f);
     return sf::Color(255 * norm, 50, 255 * (1 - norm));
-}
-
-// Compute circular orbital speed for mass M at distance r (assumes G=1)
-float orbital_velocity_scalar(float M, float r) {
-    return std::sqrt(1.0f * M / r);
 }
\ No newline at end of file
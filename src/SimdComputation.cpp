@@ -0,0 +1,788 @@
+// File: SimdComputation.cpp
+// Implements the vectorized structure-of-arrays CPU engine
+//  - scalar, AVX2 and AVX-512 force kernels (rsqrt + one Newton step, FMA), chosen at runtime via CPUID
+//  - self-interaction is skipped by index, so coincident bodies still attract each other
+//  - integration matches integrate_bodies() in NBody.cpp
+
+#include <algorithm>  // for std::fill
+#include <cstddef>    // for size_t
+#include <cmath>      // for std::sqrt
+#include <immintrin.h>
+
+#include "Profiler.h"
+#include "SimdComputation.h"
+
+// SIMD runtime state: SoA copy of the bodies and the kernel in use
+static BodiesSOA   s_soa(0);
+static SimdKernel  s_kernel = SimdKernel::Scalar;
+
+// All kernels add G * sum_j m_j * d_ij / (r_ij^2 + eps^2)^(3/2) over sources [j_begin, j_end)
+// to the accelerations of targets [begin, end), so a row can be built up tile by tile
+
+// Every kernel is templated on Accum, the type a target row is summed in (float, double or
+// KahanSum<float>); pair terms are always float. The float instances are what the engines run
+
+// Plain C++ kernel: also used for the rows left over by the vector kernels
+template <typename Accum>
+static void forces_scalar(const float* x, const float* y, const float* m, size_t j_begin, size_t j_end,
+                          float* ax, float* ay, size_t begin, size_t end,
+                          float G, float eps2)
+{
+    for (size_t i = begin; i < end; ++i) {
+        float xi = x[i];
+        float yi = y[i];
+        Accum axi = Accum();
+        Accum ayi = Accum();
+
+        for (size_t j = j_begin; j < j_end; ++j) {
+            float dx = x[j] - xi;
+            float dy = y[j] - yi;
+            float r2 = dx * dx + dy * dy + eps2;
+            float inv = 1.f / std::sqrt(r2);
+            float s = (j == i) ? 0.f : m[j] * inv * inv * inv;
+            axi += dx * s;
+            ayi += dy * s;
+        }
+
+        ax[i] += G * static_cast<float>(axi);
+        ay[i] += G * static_cast<float>(ayi);
+    }
+}
+
+// Row sums of the AVX2 kernel, 8 lanes each: add(d, s) adds d * s (s is already zero on the self
+// lane), value() returns the float sums
+template <typename Accum>
+struct Avx2Sum;
+
+template <>
+struct Avx2Sum<float> {
+    __m256 sum;
+
+    __attribute__((target("avx2,fma"))) void zero() { sum = _mm256_setzero_ps(); }
+    __attribute__((target("avx2,fma"))) void add(__m256 d, __m256 s) { sum = _mm256_fmadd_ps(d, s, sum); }
+    __attribute__((target("avx2,fma"))) __m256 value() const { return sum; }
+};
+
+// float terms widened to two 4-lane double sums
+template <>
+struct Avx2Sum<double> {
+    __m256d lo, hi;
+
+    __attribute__((target("avx2,fma"))) void zero() { lo = hi = _mm256_setzero_pd(); }
+    __attribute__((target("avx2,fma"))) void add(__m256 d, __m256 s) {
+        __m256 t = _mm256_mul_ps(d, s);
+        lo = _mm256_add_pd(lo, _mm256_cvtps_pd(_mm256_castps256_ps128(t)));
+        hi = _mm256_add_pd(hi, _mm256_cvtps_pd(_mm256_extractf128_ps(t, 1)));
+    }
+    __attribute__((target("avx2,fma"))) __m256 value() const {
+        return _mm256_set_m128(_mm256_cvtpd_ps(hi), _mm256_cvtpd_ps(lo));
+    }
+};
+
+// compensated float sums, the steps of KahanSum per lane (no FMA, the product is rounded first)
+template <>
+struct Avx2Sum<KahanSum<float>> {
+    __m256 sum, c;
+
+    __attribute__((target("avx2,fma"))) void zero() { sum = c = _mm256_setzero_ps(); }
+    __attribute__((target("avx2,fma"))) void add(__m256 d, __m256 s) {
+        __m256 y = _mm256_sub_ps(_mm256_mul_ps(d, s), c);
+        __m256 t = _mm256_add_ps(sum, y);
+        c = _mm256_sub_ps(_mm256_sub_ps(t, sum), y);
+        sum = t;
+    }
+    __attribute__((target("avx2,fma"))) __m256 value() const { return sum; }
+};
+
+// AVX2 kernel: 8 target bodies per register, two registers (16 rows) in flight to hide FMA latency,
+// every source body j is broadcast to all lanes
+template <typename Accum>
+__attribute__((target("avx2,fma")))
+static void forces_avx2(const float* x, const float* y, const float* m, size_t j_begin, size_t j_end,
+                        float* ax, float* ay, size_t begin, size_t end,
+                        float G, float eps2)
+{
+    const __m256 v_eps2 = _mm256_set1_ps(eps2);
+    const __m256 v_half = _mm256_set1_ps(0.5f);
+    const __m256 v_three_halves = _mm256_set1_ps(1.5f);
+    const __m256 v_G = _mm256_set1_ps(G);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    size_t i = begin;
+    for (; i + 16 <= end; i += 16) {
+        __m256 xi0 = _mm256_loadu_ps(x + i);
+        __m256 yi0 = _mm256_loadu_ps(y + i);
+        __m256 xi1 = _mm256_loadu_ps(x + i + 8);
+        __m256 yi1 = _mm256_loadu_ps(y + i + 8);
+        __m256i id0 = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(i)), lanes);
+        __m256i id1 = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(i + 8)), lanes);
+
+        Avx2Sum<Accum> ax0, ay0, ax1, ay1;
+        ax0.zero(); ay0.zero(); ax1.zero(); ay1.zero();
+
+        for (size_t j = j_begin; j < j_end; ++j) {
+            __m256 xj = _mm256_broadcast_ss(x + j);
+            __m256 yj = _mm256_broadcast_ss(y + j);
+            __m256 mj = _mm256_broadcast_ss(m + j);
+            __m256i jj = _mm256_set1_epi32(static_cast<int>(j));
+
+            __m256 dx0 = _mm256_sub_ps(xj, xi0);
+            __m256 dy0 = _mm256_sub_ps(yj, yi0);
+            __m256 dx1 = _mm256_sub_ps(xj, xi1);
+            __m256 dy1 = _mm256_sub_ps(yj, yi1);
+
+            __m256 r2_0 = _mm256_fmadd_ps(dx0, dx0, _mm256_fmadd_ps(dy0, dy0, v_eps2));
+            __m256 r2_1 = _mm256_fmadd_ps(dx1, dx1, _mm256_fmadd_ps(dy1, dy1, v_eps2));
+
+            // 12-bit rsqrt estimate refined by one Newton step: inv *= 1.5 - 0.5 * r2 * inv^2
+            __m256 inv0 = _mm256_rsqrt_ps(r2_0);
+            __m256 inv1 = _mm256_rsqrt_ps(r2_1);
+            inv0 = _mm256_mul_ps(inv0, _mm256_fnmadd_ps(_mm256_mul_ps(v_half, r2_0), _mm256_mul_ps(inv0, inv0), v_three_halves));
+            inv1 = _mm256_mul_ps(inv1, _mm256_fnmadd_ps(_mm256_mul_ps(v_half, r2_1), _mm256_mul_ps(inv1, inv1), v_three_halves));
+
+            __m256 s0 = _mm256_mul_ps(mj, _mm256_mul_ps(inv0, _mm256_mul_ps(inv0, inv0)));
+            __m256 s1 = _mm256_mul_ps(mj, _mm256_mul_ps(inv1, _mm256_mul_ps(inv1, inv1)));
+
+            // zero the lane where j is the target itself
+            s0 = _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(id0, jj)), s0);
+            s1 = _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(id1, jj)), s1);
+
+            ax0.add(dx0, s0);
+            ay0.add(dy0, s0);
+            ax1.add(dx1, s1);
+            ay1.add(dy1, s1);
+        }
+
+        _mm256_storeu_ps(ax + i,     _mm256_fmadd_ps(v_G, ax0.value(), _mm256_loadu_ps(ax + i)));
+        _mm256_storeu_ps(ay + i,     _mm256_fmadd_ps(v_G, ay0.value(), _mm256_loadu_ps(ay + i)));
+        _mm256_storeu_ps(ax + i + 8, _mm256_fmadd_ps(v_G, ax1.value(), _mm256_loadu_ps(ax + i + 8)));
+        _mm256_storeu_ps(ay + i + 8, _mm256_fmadd_ps(v_G, ay1.value(), _mm256_loadu_ps(ay + i + 8)));
+    }
+
+    forces_scalar<Accum>(x, y, m, j_begin, j_end, ax, ay, i, end, G, eps2);
+}
+
+// Row sums of the AVX-512 kernel, as Avx2Sum with 16 lanes; add() only touches the 'keep' lanes
+template <typename Accum>
+struct Avx512Sum;
+
+template <>
+struct Avx512Sum<float> {
+    __m512 sum;
+
+    __attribute__((target("avx512f"))) void zero() { sum = _mm512_setzero_ps(); }
+    __attribute__((target("avx512f"))) void add(__m512 d, __m512 s, __mmask16 keep) {
+        sum = _mm512_mask3_fmadd_ps(d, s, sum, keep);
+    }
+    __attribute__((target("avx512f"))) __m512 value() const { return sum; }
+};
+
+template <>
+struct Avx512Sum<double> {
+    __m512d lo, hi;
+
+    __attribute__((target("avx512f"))) void zero() { lo = hi = _mm512_setzero_pd(); }
+    __attribute__((target("avx512f"))) void add(__m512 d, __m512 s, __mmask16 keep) {
+        // zero-masked forms throughout: the plain ones trip GCC's uninitialized warning
+        __m512d t = _mm512_castps_pd(_mm512_maskz_mul_ps(keep, d, s));
+        lo = _mm512_add_pd(lo, _mm512_maskz_cvtps_pd(0xFF, _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xF, t, 0))));
+        hi = _mm512_add_pd(hi, _mm512_maskz_cvtps_pd(0xFF, _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xF, t, 1))));
+    }
+    __attribute__((target("avx512f"))) __m512 value() const {
+        __m512d low = _mm512_maskz_insertf64x4(0xFF, _mm512_setzero_pd(), _mm256_castps_pd(_mm512_maskz_cvtpd_ps(0xFF, lo)), 0);
+        return _mm512_castpd_ps(_mm512_maskz_insertf64x4(0xFF, low, _mm256_castps_pd(_mm512_maskz_cvtpd_ps(0xFF, hi)), 1));
+    }
+};
+
+template <>
+struct Avx512Sum<KahanSum<float>> {
+    __m512 sum, c;
+
+    __attribute__((target("avx512f"))) void zero() { sum = c = _mm512_setzero_ps(); }
+    __attribute__((target("avx512f"))) void add(__m512 d, __m512 s, __mmask16 keep) {
+        __m512 y = _mm512_sub_ps(_mm512_maskz_mul_ps(keep, d, s), c);
+        __m512 t = _mm512_add_ps(sum, y);
+        c = _mm512_sub_ps(_mm512_sub_ps(t, sum), y);
+        sum = t;
+    }
+    __attribute__((target("avx512f"))) __m512 value() const { return sum; }
+};
+
+// AVX-512 kernel: same scheme with 16 lanes, 32 rows in flight, and a 14-bit rsqrt estimate
+template <typename Accum>
+__attribute__((target("avx512f")))
+static void forces_avx512(const float* x, const float* y, const float* m, size_t j_begin, size_t j_end,
+                          float* ax, float* ay, size_t begin, size_t end,
+                          float G, float eps2)
+{
+    const __m512 v_eps2 = _mm512_set1_ps(eps2);
+    const __m512 v_half = _mm512_set1_ps(0.5f);
+    const __m512 v_three_halves = _mm512_set1_ps(1.5f);
+    const __m512 v_G = _mm512_set1_ps(G);
+    const __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+    size_t i = begin;
+    for (; i + 32 <= end; i += 32) {
+        __m512 xi0 = _mm512_loadu_ps(x + i);
+        __m512 yi0 = _mm512_loadu_ps(y + i);
+        __m512 xi1 = _mm512_loadu_ps(x + i + 16);
+        __m512 yi1 = _mm512_loadu_ps(y + i + 16);
+        __m512i id0 = _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(i)), lanes);
+        __m512i id1 = _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(i + 16)), lanes);
+
+        Avx512Sum<Accum> ax0, ay0, ax1, ay1;
+        ax0.zero(); ay0.zero(); ax1.zero(); ay1.zero();
+
+        for (size_t j = j_begin; j < j_end; ++j) {
+            __m512 xj = _mm512_set1_ps(x[j]);
+            __m512 yj = _mm512_set1_ps(y[j]);
+            __m512 mj = _mm512_set1_ps(m[j]);
+            __m512i jj = _mm512_set1_epi32(static_cast<int>(j));
+
+            __m512 dx0 = _mm512_sub_ps(xj, xi0);
+            __m512 dy0 = _mm512_sub_ps(yj, yi0);
+            __m512 dx1 = _mm512_sub_ps(xj, xi1);
+            __m512 dy1 = _mm512_sub_ps(yj, yi1);
+
+            __m512 r2_0 = _mm512_fmadd_ps(dx0, dx0, _mm512_fmadd_ps(dy0, dy0, v_eps2));
+            __m512 r2_1 = _mm512_fmadd_ps(dx1, dx1, _mm512_fmadd_ps(dy1, dy1, v_eps2));
+
+            // 14-bit rsqrt estimate refined by one Newton step
+            __m512 inv0 = _mm512_maskz_rsqrt14_ps(0xFFFF, r2_0);
+            __m512 inv1 = _mm512_maskz_rsqrt14_ps(0xFFFF, r2_1);
+            inv0 = _mm512_mul_ps(inv0, _mm512_fnmadd_ps(_mm512_mul_ps(v_half, r2_0), _mm512_mul_ps(inv0, inv0), v_three_halves));
+            inv1 = _mm512_mul_ps(inv1, _mm512_fnmadd_ps(_mm512_mul_ps(v_half, r2_1), _mm512_mul_ps(inv1, inv1), v_three_halves));
+
+            __m512 s0 = _mm512_mul_ps(mj, _mm512_mul_ps(inv0, _mm512_mul_ps(inv0, inv0)));
+            __m512 s1 = _mm512_mul_ps(mj, _mm512_mul_ps(inv1, _mm512_mul_ps(inv1, inv1)));
+
+            // accumulate only the lanes whose target is not j itself
+            __mmask16 keep0 = _mm512_cmpneq_epi32_mask(id0, jj);
+            __mmask16 keep1 = _mm512_cmpneq_epi32_mask(id1, jj);
+
+            ax0.add(dx0, s0, keep0);
+            ay0.add(dy0, s0, keep0);
+            ax1.add(dx1, s1, keep1);
+            ay1.add(dy1, s1, keep1);
+        }
+
+        _mm512_storeu_ps(ax + i,      _mm512_fmadd_ps(v_G, ax0.value(), _mm512_loadu_ps(ax + i)));
+        _mm512_storeu_ps(ay + i,      _mm512_fmadd_ps(v_G, ay0.value(), _mm512_loadu_ps(ay + i)));
+        _mm512_storeu_ps(ax + i + 16, _mm512_fmadd_ps(v_G, ax1.value(), _mm512_loadu_ps(ax + i + 16)));
+        _mm512_storeu_ps(ay + i + 16, _mm512_fmadd_ps(v_G, ay1.value(), _mm512_loadu_ps(ay + i + 16)));
+    }
+
+    forces_scalar<Accum>(x, y, m, j_begin, j_end, ax, ay, i, end, G, eps2);
+}
+
+// Double state: pair terms and sums in double with an exact 1 / sqrt (an estimate would cost the
+// bits double is there for), self lane zeroed as in the float kernels
+static void forces_scalar_double(const double* x, const double* y, const double* m, size_t j_begin, size_t j_end,
+                                 double* ax, double* ay, size_t begin, size_t end,
+                                 double G, double eps2)
+{
+    for (size_t i = begin; i < end; ++i) {
+        double xi = x[i];
+        double yi = y[i];
+        double axi = 0.0;
+        double ayi = 0.0;
+
+        for (size_t j = j_begin; j < j_end; ++j) {
+            double dx = x[j] - xi;
+            double dy = y[j] - yi;
+            double r2 = dx * dx + dy * dy + eps2;
+            double inv = 1.0 / std::sqrt(r2);
+            double s = (j == i) ? 0.0 : m[j] * inv * inv * inv;
+            axi += dx * s;
+            ayi += dy * s;
+        }
+
+        ax[i] += G * axi;
+        ay[i] += G * ayi;
+    }
+}
+
+// 4 double lanes per register, two registers (8 rows) in flight
+__attribute__((target("avx2,fma")))
+static void forces_avx2_double(const double* x, const double* y, const double* m, size_t j_begin, size_t j_end,
+                               double* ax, double* ay, size_t begin, size_t end,
+                               double G, double eps2)
+{
+    const __m256d v_eps2 = _mm256_set1_pd(eps2);
+    const __m256d v_one = _mm256_set1_pd(1.0);
+    const __m256d v_G = _mm256_set1_pd(G);
+    const __m256i lanes = _mm256_setr_epi64x(0, 1, 2, 3);
+
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256d xi0 = _mm256_loadu_pd(x + i);
+        __m256d yi0 = _mm256_loadu_pd(y + i);
+        __m256d xi1 = _mm256_loadu_pd(x + i + 4);
+        __m256d yi1 = _mm256_loadu_pd(y + i + 4);
+        __m256i id0 = _mm256_add_epi64(_mm256_set1_epi64x(static_cast<long long>(i)), lanes);
+        __m256i id1 = _mm256_add_epi64(_mm256_set1_epi64x(static_cast<long long>(i + 4)), lanes);
+
+        __m256d ax0 = _mm256_setzero_pd(), ay0 = _mm256_setzero_pd();
+        __m256d ax1 = _mm256_setzero_pd(), ay1 = _mm256_setzero_pd();
+
+        for (size_t j = j_begin; j < j_end; ++j) {
+            __m256d xj = _mm256_broadcast_sd(x + j);
+            __m256d yj = _mm256_broadcast_sd(y + j);
+            __m256d mj = _mm256_broadcast_sd(m + j);
+            __m256i jj = _mm256_set1_epi64x(static_cast<long long>(j));
+
+            __m256d dx0 = _mm256_sub_pd(xj, xi0);
+            __m256d dy0 = _mm256_sub_pd(yj, yi0);
+            __m256d dx1 = _mm256_sub_pd(xj, xi1);
+            __m256d dy1 = _mm256_sub_pd(yj, yi1);
+
+            __m256d r2_0 = _mm256_fmadd_pd(dx0, dx0, _mm256_fmadd_pd(dy0, dy0, v_eps2));
+            __m256d r2_1 = _mm256_fmadd_pd(dx1, dx1, _mm256_fmadd_pd(dy1, dy1, v_eps2));
+
+            __m256d inv0 = _mm256_div_pd(v_one, _mm256_sqrt_pd(r2_0));
+            __m256d inv1 = _mm256_div_pd(v_one, _mm256_sqrt_pd(r2_1));
+
+            __m256d s0 = _mm256_mul_pd(mj, _mm256_mul_pd(inv0, _mm256_mul_pd(inv0, inv0)));
+            __m256d s1 = _mm256_mul_pd(mj, _mm256_mul_pd(inv1, _mm256_mul_pd(inv1, inv1)));
+
+            s0 = _mm256_andnot_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(id0, jj)), s0);
+            s1 = _mm256_andnot_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(id1, jj)), s1);
+
+            ax0 = _mm256_fmadd_pd(dx0, s0, ax0);
+            ay0 = _mm256_fmadd_pd(dy0, s0, ay0);
+            ax1 = _mm256_fmadd_pd(dx1, s1, ax1);
+            ay1 = _mm256_fmadd_pd(dy1, s1, ay1);
+        }
+
+        _mm256_storeu_pd(ax + i,     _mm256_fmadd_pd(v_G, ax0, _mm256_loadu_pd(ax + i)));
+        _mm256_storeu_pd(ay + i,     _mm256_fmadd_pd(v_G, ay0, _mm256_loadu_pd(ay + i)));
+        _mm256_storeu_pd(ax + i + 4, _mm256_fmadd_pd(v_G, ax1, _mm256_loadu_pd(ax + i + 4)));
+        _mm256_storeu_pd(ay + i + 4, _mm256_fmadd_pd(v_G, ay1, _mm256_loadu_pd(ay + i + 4)));
+    }
+
+    forces_scalar_double(x, y, m, j_begin, j_end, ax, ay, i, end, G, eps2);
+}
+
+// 8 double lanes per register, 16 rows in flight
+__attribute__((target("avx512f")))
+static void forces_avx512_double(const double* x, const double* y, const double* m, size_t j_begin, size_t j_end,
+                                 double* ax, double* ay, size_t begin, size_t end,
+                                 double G, double eps2)
+{
+    const __m512d v_eps2 = _mm512_set1_pd(eps2);
+    const __m512d v_one = _mm512_set1_pd(1.0);
+    const __m512d v_G = _mm512_set1_pd(G);
+    const __m512i lanes = _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7);
+
+    size_t i = begin;
+    for (; i + 16 <= end; i += 16) {
+        __m512d xi0 = _mm512_loadu_pd(x + i);
+        __m512d yi0 = _mm512_loadu_pd(y + i);
+        __m512d xi1 = _mm512_loadu_pd(x + i + 8);
+        __m512d yi1 = _mm512_loadu_pd(y + i + 8);
+        __m512i id0 = _mm512_add_epi64(_mm512_set1_epi64(static_cast<long long>(i)), lanes);
+        __m512i id1 = _mm512_add_epi64(_mm512_set1_epi64(static_cast<long long>(i + 8)), lanes);
+
+        __m512d ax0 = _mm512_setzero_pd(), ay0 = _mm512_setzero_pd();
+        __m512d ax1 = _mm512_setzero_pd(), ay1 = _mm512_setzero_pd();
+
+        for (size_t j = j_begin; j < j_end; ++j) {
+            __m512d xj = _mm512_set1_pd(x[j]);
+            __m512d yj = _mm512_set1_pd(y[j]);
+            __m512d mj = _mm512_set1_pd(m[j]);
+            __m512i jj = _mm512_set1_epi64(static_cast<long long>(j));
+
+            __m512d dx0 = _mm512_sub_pd(xj, xi0);
+            __m512d dy0 = _mm512_sub_pd(yj, yi0);
+            __m512d dx1 = _mm512_sub_pd(xj, xi1);
+            __m512d dy1 = _mm512_sub_pd(yj, yi1);
+
+            __m512d r2_0 = _mm512_fmadd_pd(dx0, dx0, _mm512_fmadd_pd(dy0, dy0, v_eps2));
+            __m512d r2_1 = _mm512_fmadd_pd(dx1, dx1, _mm512_fmadd_pd(dy1, dy1, v_eps2));
+
+            // zero-masked sqrt, the plain one trips GCC's uninitialized warning
+            __m512d inv0 = _mm512_div_pd(v_one, _mm512_maskz_sqrt_pd(0xFF, r2_0));
+            __m512d inv1 = _mm512_div_pd(v_one, _mm512_maskz_sqrt_pd(0xFF, r2_1));
+
+            __m512d s0 = _mm512_mul_pd(mj, _mm512_mul_pd(inv0, _mm512_mul_pd(inv0, inv0)));
+            __m512d s1 = _mm512_mul_pd(mj, _mm512_mul_pd(inv1, _mm512_mul_pd(inv1, inv1)));
+
+            __mmask8 keep0 = _mm512_cmpneq_epi64_mask(id0, jj);
+            __mmask8 keep1 = _mm512_cmpneq_epi64_mask(id1, jj);
+
+            ax0 = _mm512_mask3_fmadd_pd(dx0, s0, ax0, keep0);
+            ay0 = _mm512_mask3_fmadd_pd(dy0, s0, ay0, keep0);
+            ax1 = _mm512_mask3_fmadd_pd(dx1, s1, ax1, keep1);
+            ay1 = _mm512_mask3_fmadd_pd(dy1, s1, ay1, keep1);
+        }
+
+        _mm512_storeu_pd(ax + i,     _mm512_fmadd_pd(v_G, ax0, _mm512_loadu_pd(ax + i)));
+        _mm512_storeu_pd(ay + i,     _mm512_fmadd_pd(v_G, ay0, _mm512_loadu_pd(ay + i)));
+        _mm512_storeu_pd(ax + i + 8, _mm512_fmadd_pd(v_G, ax1, _mm512_loadu_pd(ax + i + 8)));
+        _mm512_storeu_pd(ay + i + 8, _mm512_fmadd_pd(v_G, ay1, _mm512_loadu_pd(ay + i + 8)));
+    }
+
+    forces_scalar_double(x, y, m, j_begin, j_end, ax, ay, i, end, G, eps2);
+}
+
+// Source-list kernels: the same sums over a separate list of sources with one softening each.
+// Targets skip the source whose id is their own index
+
+static void source_forces_scalar(const ForceSources& src, const float* x, const float* y,
+                                 float* ax, float* ay, size_t begin, size_t end, float G)
+{
+    const size_t n_src = src.size();
+    for (size_t i = begin; i < end; ++i) {
+        float xi = x[i];
+        float yi = y[i];
+        float axi = 0.f;
+        float ayi = 0.f;
+
+        for (size_t j = 0; j < n_src; ++j) {
+            float dx = src.x[j] - xi;
+            float dy = src.y[j] - yi;
+            float r2 = dx * dx + dy * dy + src.eps2[j];
+            float inv = 1.f / std::sqrt(r2);
+            float s = (src.id[j] == static_cast<int32_t>(i)) ? 0.f : src.mass[j] * inv * inv * inv;
+            axi += dx * s;
+            ayi += dy * s;
+        }
+
+        ax[i] += G * axi;
+        ay[i] += G * ayi;
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void source_forces_avx2(const ForceSources& src, const float* x, const float* y,
+                               float* ax, float* ay, size_t begin, size_t end, float G)
+{
+    const __m256 v_half = _mm256_set1_ps(0.5f);
+    const __m256 v_three_halves = _mm256_set1_ps(1.5f);
+    const __m256 v_G = _mm256_set1_ps(G);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const size_t n_src = src.size();
+
+    size_t i = begin;
+    for (; i + 16 <= end; i += 16) {
+        __m256 xi0 = _mm256_loadu_ps(x + i);
+        __m256 yi0 = _mm256_loadu_ps(y + i);
+        __m256 xi1 = _mm256_loadu_ps(x + i + 8);
+        __m256 yi1 = _mm256_loadu_ps(y + i + 8);
+        __m256i id0 = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(i)), lanes);
+        __m256i id1 = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(i + 8)), lanes);
+
+        __m256 ax0 = _mm256_setzero_ps(), ay0 = _mm256_setzero_ps();
+        __m256 ax1 = _mm256_setzero_ps(), ay1 = _mm256_setzero_ps();
+
+        for (size_t j = 0; j < n_src; ++j) {
+            __m256 xj = _mm256_broadcast_ss(&src.x[j]);
+            __m256 yj = _mm256_broadcast_ss(&src.y[j]);
+            __m256 mj = _mm256_broadcast_ss(&src.mass[j]);
+            __m256 e2 = _mm256_broadcast_ss(&src.eps2[j]);
+            __m256i jj = _mm256_set1_epi32(src.id[j]);
+
+            __m256 dx0 = _mm256_sub_ps(xj, xi0);
+            __m256 dy0 = _mm256_sub_ps(yj, yi0);
+            __m256 dx1 = _mm256_sub_ps(xj, xi1);
+            __m256 dy1 = _mm256_sub_ps(yj, yi1);
+
+            __m256 r2_0 = _mm256_fmadd_ps(dx0, dx0, _mm256_fmadd_ps(dy0, dy0, e2));
+            __m256 r2_1 = _mm256_fmadd_ps(dx1, dx1, _mm256_fmadd_ps(dy1, dy1, e2));
+
+            __m256 inv0 = _mm256_rsqrt_ps(r2_0);
+            __m256 inv1 = _mm256_rsqrt_ps(r2_1);
+            inv0 = _mm256_mul_ps(inv0, _mm256_fnmadd_ps(_mm256_mul_ps(v_half, r2_0), _mm256_mul_ps(inv0, inv0), v_three_halves));
+            inv1 = _mm256_mul_ps(inv1, _mm256_fnmadd_ps(_mm256_mul_ps(v_half, r2_1), _mm256_mul_ps(inv1, inv1), v_three_halves));
+
+            __m256 s0 = _mm256_mul_ps(mj, _mm256_mul_ps(inv0, _mm256_mul_ps(inv0, inv0)));
+            __m256 s1 = _mm256_mul_ps(mj, _mm256_mul_ps(inv1, _mm256_mul_ps(inv1, inv1)));
+
+            s0 = _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(id0, jj)), s0);
+            s1 = _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(id1, jj)), s1);
+
+            ax0 = _mm256_fmadd_ps(dx0, s0, ax0);
+            ay0 = _mm256_fmadd_ps(dy0, s0, ay0);
+            ax1 = _mm256_fmadd_ps(dx1, s1, ax1);
+            ay1 = _mm256_fmadd_ps(dy1, s1, ay1);
+        }
+
+        _mm256_storeu_ps(ax + i,     _mm256_fmadd_ps(v_G, ax0, _mm256_loadu_ps(ax + i)));
+        _mm256_storeu_ps(ay + i,     _mm256_fmadd_ps(v_G, ay0, _mm256_loadu_ps(ay + i)));
+        _mm256_storeu_ps(ax + i + 8, _mm256_fmadd_ps(v_G, ax1, _mm256_loadu_ps(ax + i + 8)));
+        _mm256_storeu_ps(ay + i + 8, _mm256_fmadd_ps(v_G, ay1, _mm256_loadu_ps(ay + i + 8)));
+    }
+
+    source_forces_scalar(src, x, y, ax, ay, i, end, G);
+}
+
+__attribute__((target("avx512f")))
+static void source_forces_avx512(const ForceSources& src, const float* x, const float* y,
+                                 float* ax, float* ay, size_t begin, size_t end, float G)
+{
+    const __m512 v_half = _mm512_set1_ps(0.5f);
+    const __m512 v_three_halves = _mm512_set1_ps(1.5f);
+    const __m512 v_G = _mm512_set1_ps(G);
+    const __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const size_t n_src = src.size();
+
+    size_t i = begin;
+    for (; i + 32 <= end; i += 32) {
+        __m512 xi0 = _mm512_loadu_ps(x + i);
+        __m512 yi0 = _mm512_loadu_ps(y + i);
+        __m512 xi1 = _mm512_loadu_ps(x + i + 16);
+        __m512 yi1 = _mm512_loadu_ps(y + i + 16);
+        __m512i id0 = _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(i)), lanes);
+        __m512i id1 = _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(i + 16)), lanes);
+
+        __m512 ax0 = _mm512_setzero_ps(), ay0 = _mm512_setzero_ps();
+        __m512 ax1 = _mm512_setzero_ps(), ay1 = _mm512_setzero_ps();
+
+        for (size_t j = 0; j < n_src; ++j) {
+            __m512 xj = _mm512_set1_ps(src.x[j]);
+            __m512 yj = _mm512_set1_ps(src.y[j]);
+            __m512 mj = _mm512_set1_ps(src.mass[j]);
+            __m512 e2 = _mm512_set1_ps(src.eps2[j]);
+            __m512i jj = _mm512_set1_epi32(src.id[j]);
+
+            __m512 dx0 = _mm512_sub_ps(xj, xi0);
+            __m512 dy0 = _mm512_sub_ps(yj, yi0);
+            __m512 dx1 = _mm512_sub_ps(xj, xi1);
+            __m512 dy1 = _mm512_sub_ps(yj, yi1);
+
+            __m512 r2_0 = _mm512_fmadd_ps(dx0, dx0, _mm512_fmadd_ps(dy0, dy0, e2));
+            __m512 r2_1 = _mm512_fmadd_ps(dx1, dx1, _mm512_fmadd_ps(dy1, dy1, e2));
+
+            __m512 inv0 = _mm512_maskz_rsqrt14_ps(0xFFFF, r2_0);
+            __m512 inv1 = _mm512_maskz_rsqrt14_ps(0xFFFF, r2_1);
+            inv0 = _mm512_mul_ps(inv0, _mm512_fnmadd_ps(_mm512_mul_ps(v_half, r2_0), _mm512_mul_ps(inv0, inv0), v_three_halves));
+            inv1 = _mm512_mul_ps(inv1, _mm512_fnmadd_ps(_mm512_mul_ps(v_half, r2_1), _mm512_mul_ps(inv1, inv1), v_three_halves));
+
+            __m512 s0 = _mm512_mul_ps(mj, _mm512_mul_ps(inv0, _mm512_mul_ps(inv0, inv0)));
+            __m512 s1 = _mm512_mul_ps(mj, _mm512_mul_ps(inv1, _mm512_mul_ps(inv1, inv1)));
+
+            __mmask16 keep0 = _mm512_cmpneq_epi32_mask(id0, jj);
+            __mmask16 keep1 = _mm512_cmpneq_epi32_mask(id1, jj);
+
+            ax0 = _mm512_mask3_fmadd_ps(dx0, s0, ax0, keep0);
+            ay0 = _mm512_mask3_fmadd_ps(dy0, s0, ay0, keep0);
+            ax1 = _mm512_mask3_fmadd_ps(dx1, s1, ax1, keep1);
+            ay1 = _mm512_mask3_fmadd_ps(dy1, s1, ay1, keep1);
+        }
+
+        _mm512_storeu_ps(ax + i,      _mm512_fmadd_ps(v_G, ax0, _mm512_loadu_ps(ax + i)));
+        _mm512_storeu_ps(ay + i,      _mm512_fmadd_ps(v_G, ay0, _mm512_loadu_ps(ay + i)));
+        _mm512_storeu_ps(ax + i + 16, _mm512_fmadd_ps(v_G, ax1, _mm512_loadu_ps(ax + i + 16)));
+        _mm512_storeu_ps(ay + i + 16, _mm512_fmadd_ps(v_G, ay1, _mm512_loadu_ps(ay + i + 16)));
+    }
+
+    source_forces_scalar(src, x, y, ax, ay, i, end, G);
+}
+
+// Pick the widest kernel the CPU supports
+SimdKernel detectSimdKernel() {
+    if (simdKernelSupported(SimdKernel::AVX512)) return SimdKernel::AVX512;
+    if (simdKernelSupported(SimdKernel::AVX2))   return SimdKernel::AVX2;
+    return SimdKernel::Scalar;
+}
+
+// Check CPUID feature bits for the given kernel
+bool simdKernelSupported(SimdKernel kernel) {
+    __builtin_cpu_init();
+    switch (kernel) {
+        case SimdKernel::AVX512: return __builtin_cpu_supports("avx512f");
+        case SimdKernel::AVX2:   return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        default:                 return true;
+    }
+}
+
+const char* simdKernelName(SimdKernel kernel) {
+    switch (kernel) {
+        case SimdKernel::AVX512: return "avx512";
+        case SimdKernel::AVX2:   return "avx2";
+        default:                 return "scalar";
+    }
+}
+
+// Add the contribution of sources [j_begin, j_end) to the accelerations of targets [begin, end)
+template <typename Accum>
+void simd_accumulate_forces_tile(const float* x, const float* y, const float* m, float* ax, float* ay,
+                                 size_t begin, size_t end, size_t j_begin, size_t j_end,
+                                 const float G, const float eps, SimdKernel kernel)
+{
+    const float eps2 = eps * eps;
+    switch (kernel) {
+        case SimdKernel::AVX512:
+            forces_avx512<Accum>(x, y, m, j_begin, j_end, ax, ay, begin, end, G, eps2);
+            break;
+        case SimdKernel::AVX2:
+            forces_avx2<Accum>(x, y, m, j_begin, j_end, ax, ay, begin, end, G, eps2);
+            break;
+        default:
+            forces_scalar<Accum>(x, y, m, j_begin, j_end, ax, ay, begin, end, G, eps2);
+            break;
+    }
+}
+
+template void simd_accumulate_forces_tile<float>(const float*, const float*, const float*, float*, float*,
+                                                 size_t, size_t, size_t, size_t, const float, const float, SimdKernel);
+template void simd_accumulate_forces_tile<double>(const float*, const float*, const float*, float*, float*,
+                                                  size_t, size_t, size_t, size_t, const float, const float, SimdKernel);
+template void simd_accumulate_forces_tile<KahanSum<float>>(const float*, const float*, const float*, float*, float*,
+                                                           size_t, size_t, size_t, size_t, const float, const float,
+                                                           SimdKernel);
+
+void simd_accumulate_forces_tile(const double* x, const double* y, const double* m, double* ax, double* ay,
+                                 size_t begin, size_t end, size_t j_begin, size_t j_end,
+                                 const double G, const double eps, SimdKernel kernel)
+{
+    const double eps2 = eps * eps;
+    switch (kernel) {
+        case SimdKernel::AVX512:
+            forces_avx512_double(x, y, m, j_begin, j_end, ax, ay, begin, end, G, eps2);
+            break;
+        case SimdKernel::AVX2:
+            forces_avx2_double(x, y, m, j_begin, j_end, ax, ay, begin, end, G, eps2);
+            break;
+        default:
+            forces_scalar_double(x, y, m, j_begin, j_end, ax, ay, begin, end, G, eps2);
+            break;
+    }
+}
+
+void simd_accumulate_forces_tile(BodiesSOA& soa, size_t begin, size_t end, size_t j_begin, size_t j_end,
+                                 const float G, const float eps, SimdKernel kernel)
+{
+    simd_accumulate_forces_tile<float>(soa.x.data(), soa.y.data(), soa.mass.data(), soa.ax.data(), soa.ay.data(),
+                                       begin, end, j_begin, j_end, G, eps, kernel);
+}
+
+void ForceSources::clear() {
+    x.clear();
+    y.clear();
+    mass.clear();
+    eps2.clear();
+    id.clear();
+}
+
+void ForceSources::add(float sx, float sy, float smass, float seps2, int32_t sid) {
+    x.push_back(sx);
+    y.push_back(sy);
+    mass.push_back(smass);
+    eps2.push_back(seps2);
+    id.push_back(sid);
+}
+
+void simd_accumulate_source_forces(BodiesSOA& soa, size_t begin, size_t end, const ForceSources& sources,
+                                   const float G, SimdKernel kernel)
+{
+    switch (kernel) {
+        case SimdKernel::AVX512:
+            source_forces_avx512(sources, soa.x.data(), soa.y.data(), soa.ax.data(), soa.ay.data(), begin, end, G);
+            break;
+        case SimdKernel::AVX2:
+            source_forces_avx2(sources, soa.x.data(), soa.y.data(), soa.ax.data(), soa.ay.data(), begin, end, G);
+            break;
+        default:
+            source_forces_scalar(sources, soa.x.data(), soa.y.data(), soa.ax.data(), soa.ay.data(), begin, end, G);
+            break;
+    }
+}
+
+// Compute accelerations for a range of target bodies with the chosen kernel
+void simd_compute_forces_range(BodiesSOA& soa, size_t begin, size_t end, const float G, const float eps, SimdKernel kernel)
+{
+    std::fill(soa.ax.begin() + begin, soa.ax.begin() + end, 0.f);
+    std::fill(soa.ay.begin() + begin, soa.ay.begin() + end, 0.f);
+    simd_accumulate_forces_tile(soa, begin, end, 0, soa.size, G, eps, kernel);
+}
+
+void simd_compute_forces(BodiesSOA& soa, const float G, const float eps, SimdKernel kernel)
+{
+    NBODY_PROFILE_SCOPE("forces");
+    simd_compute_forces_range(soa, 0, soa.size, G, eps, kernel);
+}
+
+// Update velocities and positions of a range of bodies, applying wrapping and skipping pinned bodies.
+// Positions are read from soa.x / soa.y and written to x_out / y_out (which may alias them)
+void simd_integrate_range_into(BodiesSOA& soa, float* x_out, float* y_out, size_t begin, size_t end,
+                               const float dt, const int width, const int height)
+{
+    const float* x = soa.x.data();
+    const float* y = soa.y.data();
+    float* vx = soa.vx.data();
+    float* vy = soa.vy.data();
+    const float* ax = soa.ax.data();
+    const float* ay = soa.ay.data();
+    const uint8_t* pinned = soa.pinned.data();
+
+    const float half_w = static_cast<float>(width / 2);
+    const float half_h = static_cast<float>(height / 2);
+
+    for (size_t i = begin; i < end; ++i) {
+        // pinned bodies (the central mass) stay fixed
+        if (pinned[i]) {
+            x_out[i] = x[i];
+            y_out[i] = y[i];
+            continue;
+        }
+
+        vx[i] += ax[i] * dt;
+        vy[i] += ay[i] * dt;
+
+        float xi = x[i] + vx[i] * dt;
+        float yi = y[i] + vy[i] * dt;
+
+        // wrap around to maintain toroidal space
+        if (xi < -half_w) xi += width;
+        else if (xi > half_w) xi -= width;
+
+        if (yi < -half_h) yi += height;
+        else if (yi > half_h) yi -= height;
+
+        x_out[i] = xi;
+        y_out[i] = yi;
+    }
+}
+
+void simd_integrate_range(BodiesSOA& soa, size_t begin, size_t end, const float dt, const int width, const int height)
+{
+    simd_integrate_range_into(soa, soa.x.data(), soa.y.data(), begin, end, dt, width, height);
+}
+
+void simd_integrate_bodies(BodiesSOA& soa, const float dt, const int width, const int height)
+{
+    NBODY_PROFILE_SCOPE("integrate");
+    simd_integrate_range(soa, 0, soa.size, dt, width, height);
+}
+
+// Allocate SoA storage and select the kernel
+bool initSimdComputation(size_t n_bodies, SimdKernel kernel) {
+    if (!simdKernelSupported(kernel)) return false;
+    s_kernel = kernel;
+    s_soa.resize(n_bodies);
+    return true;
+}
+
+bool initSimdComputation(size_t n_bodies) {
+    return initSimdComputation(n_bodies, detectSimdKernel());
+}
+
+// Perform one SIMD step: pack into SoA, compute forces, integrate, unpack
+void runSimdComputation(std::vector<Body>& bodies,
+                        const float G,
+                        const float eps,
+                        const float dt,
+                        const int width,
+                        const int height)
+{
+    packBodies(bodies, s_soa);
+    simd_compute_forces(s_soa, G, eps, s_kernel);
+    simd_integrate_bodies(s_soa, dt, width, height);
+    unpackBodies(s_soa, bodies);
+}
+
+// Release SoA storage
+void cleanupSimdComputation() {
+    s_soa = BodiesSOA(0);
+}
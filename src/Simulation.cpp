@@ -0,0 +1,100 @@
+// File: Simulation.cpp
+// Implements Simulation
+//  - every engine keeps its state in the object: the Simd and Parallel engines pack the bodies once
+//    and step the SoA, the Gpu engine uploads once and steps the device-resident state
+//  - bodies() copies back lazily, so stepping in a loop never touches the AoS copy
+
+#include <iostream>   // for std::cerr
+#include <utility>    // for std::move
+
+#include "NBody.h"
+#include "Simulation.h"
+
+const char* simulationEngineName(SimulationEngine engine) {
+    switch (engine) {
+    case SimulationEngine::Simd:     return "simd";
+    case SimulationEngine::Parallel: return "parallel";
+    case SimulationEngine::Gpu:      return "gpu";
+    default:                         return "cpu";
+    }
+}
+
+bool parseSimulationEngine(const std::string& name, SimulationEngine& engine) {
+    for (SimulationEngine e : { SimulationEngine::Cpu, SimulationEngine::Simd, SimulationEngine::Parallel,
+                                SimulationEngine::Gpu }) {
+        if (name == simulationEngineName(e)) {
+            engine = e;
+            return true;
+        }
+    }
+    return false;
+}
+
+Simulation::Simulation(std::vector<Body> bodies, const SnapshotInfo& run, const SimulationOptions& options)
+    : m_bodies(std::move(bodies)), m_run(run), m_options(options), m_soa(0) {}
+
+std::unique_ptr<Simulation> Simulation::create(std::vector<Body> bodies, const SnapshotInfo& run,
+                                               const SimulationOptions& options)
+{
+    std::unique_ptr<Simulation> sim(new Simulation(std::move(bodies), run, options));
+    switch (options.engine) {
+    case SimulationEngine::Simd:
+        if (!simdKernelSupported(options.kernel)) {
+            std::cerr << "This CPU cannot run the " << simdKernelName(options.kernel) << " kernel\n";
+            return nullptr;
+        }
+        packBodies(sim->m_bodies, sim->m_soa);
+        break;
+    case SimulationEngine::Parallel:
+        sim->m_parallel = ParallelEngine::create(sim->m_bodies.size(), options.parallel);
+        if (!sim->m_parallel) {
+            std::cerr << "This CPU cannot run the " << simdKernelName(options.parallel.kernel) << " kernel\n";
+            return nullptr;
+        }
+        packBodies(sim->m_bodies, sim->m_soa);
+        break;
+    case SimulationEngine::Gpu:
+        sim->m_gpu = GpuEngine::create(sim->m_bodies.size(), options.gpu);
+        if (!sim->m_gpu || !sim->m_gpu->upload(sim->m_bodies)) return nullptr;
+        break;
+    default:
+        break;
+    }
+    return sim;
+}
+
+bool Simulation::step(int steps) {
+    const SnapshotInfo& r = m_run;
+    switch (m_options.engine) {
+    case SimulationEngine::Simd:
+        for (int s = 0; s < steps; ++s) {
+            simd_compute_forces(m_soa, r.G, r.eps, m_options.kernel);
+            simd_integrate_bodies(m_soa, r.dt, r.width, r.height);
+        }
+        m_stale = true;
+        break;
+    case SimulationEngine::Parallel:
+        for (int s = 0; s < steps; ++s) m_parallel->stepSoA(m_soa, r.G, r.eps, r.dt, r.width, r.height);
+        m_stale = true;
+        break;
+    case SimulationEngine::Gpu:
+        if (!m_gpu->stepResident(r.G, r.eps, r.dt, r.width, r.height, steps)) return false;
+        m_stale = true;
+        break;
+    default:
+        for (int s = 0; s < steps; ++s) runCpuComputation(m_bodies, r.G, r.eps, r.dt, r.width, r.height);
+        break;
+    }
+    m_run.step += steps;
+    m_run.time += static_cast<double>(steps) * r.dt;
+    return true;
+}
+
+const std::vector<Body>& Simulation::bodies() {
+    if (m_stale) {
+        if (m_options.engine != SimulationEngine::Gpu) unpackBodies(m_soa, m_bodies);
+        else if (!m_gpu->download(m_bodies)) return m_bodies;
+        m_stale = false;
+    }
+    return m_bodies;
+}
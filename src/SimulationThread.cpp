@@ -0,0 +1,102 @@
+// File: SimulationThread.cpp
+// Implements the free-running simulation thread and its snapshot publishing
+
+#include <algorithm>  // for std::max, std::clamp, std::min
+#include <chrono>     // for std::chrono::steady_clock
+#include <utility>    // for std::move
+
+#include "Profiler.h"
+#include "SimulationThread.h"
+
+// The measured time includes waiting for a device to finish earlier work, so asynchronous engines
+// settle where the device is kept busy for about the budget
+int adaptSubsteps(int steps, float seconds, float budget, int max_steps, float& step_cost) {
+    float cost = seconds / steps;
+    step_cost = step_cost > 0.f ? 0.8f * step_cost + 0.2f * cost : cost;
+    int target = step_cost > 0.f ? static_cast<int>(budget / step_cost) : max_steps;
+    // grow at most 2x per batch so one fast batch cannot overshoot
+    return std::clamp(std::min(target, 2 * steps), 1, max_steps);
+}
+
+// Pre-size every slot so publishing never allocates
+SimulationThread::SimulationThread(BatchStepFunction compute,
+                                   std::vector<Body>& bodies,
+                                   float G,
+                                   float eps,
+                                   float dt,
+                                   int width,
+                                   int height,
+                                   int steps_per_snapshot)
+    : m_compute(std::move(compute)), m_bodies(bodies), m_G(G), m_eps(eps), m_dt(dt),
+      m_width(width), m_height(height), m_steps_per_snapshot(std::max(1, steps_per_snapshot))
+{
+    for (int s = 0; s < 3; ++s) {
+        BodySnapshot& snapshot = m_buffer.slot(s);
+        snapshot.x.resize(bodies.size());
+        snapshot.y.resize(bodies.size());
+        snapshot.mass.resize(bodies.size());
+    }
+}
+
+SimulationThread::~SimulationThread()
+{
+    stop();
+}
+
+// Publish the initial state first so the renderer has something to draw right away
+void SimulationThread::start()
+{
+    if (m_thread.joinable()) return;
+    m_stop.store(false, std::memory_order_relaxed);
+    publish();
+    m_thread = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::adapt(float batch_seconds, int max_steps)
+{
+    m_batch_seconds = batch_seconds;
+    m_max_steps = std::max(m_steps_per_snapshot, max_steps);
+}
+
+void SimulationThread::stop()
+{
+    m_stop.store(true, std::memory_order_relaxed);
+    if (m_thread.joinable()) m_thread.join();
+}
+
+void SimulationThread::run()
+{
+    profileThreadName("simulation");
+    int steps = m_steps_per_snapshot;
+    float step_cost = 0.f;
+    while (!m_stop.load(std::memory_order_relaxed)) {
+        m_batch.store(steps, std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        {
+            NBODY_PROFILE_SCOPE("compute");
+            m_compute(m_bodies, m_G, m_eps, m_dt, m_width, m_height, steps);
+        }
+        m_steps.fetch_add(steps, std::memory_order_relaxed);
+        if (m_batch_seconds > 0.f) {
+            float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+            steps = adaptSubsteps(steps, seconds, m_batch_seconds, m_max_steps, step_cost);
+        }
+        NBODY_PROFILE_SCOPE("publish");
+        publish();
+    }
+}
+
+// Copy positions and masses into the producer slot and swap it in
+void SimulationThread::publish()
+{
+    BodySnapshot& snapshot = m_buffer.write_buffer();
+    for (size_t i = 0; i < m_bodies.size(); ++i) {
+        snapshot.x[i] = m_bodies[i].x;
+        snapshot.y[i] = m_bodies[i].y;
+        snapshot.mass[i] = m_bodies[i].mass;
+    }
+    snapshot.step = m_steps.load(std::memory_order_relaxed);
+
+    if (!m_buffer.publish()) m_skipped.fetch_add(1, std::memory_order_relaxed);
+    m_published.fetch_add(1, std::memory_order_relaxed);
+}
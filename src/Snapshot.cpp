@@ -0,0 +1,497 @@
+// File: Snapshot.cpp
+// Implements snapshot writing/reading (mmap), the background checkpoint writer and restart lookup
+
+#include "Snapshot.h"
+
+#include <algorithm>   // for std::min, std::sort
+#include <cerrno>
+#include <cstring>     // for std::memcpy, std::memcmp, std::strerror
+#include <filesystem>
+#include <iomanip>     // for std::setw
+#include <iostream>
+#include <memory>      // for std::make_shared
+#include <sstream>
+
+#include <fcntl.h>     // for open
+#include <sys/mman.h>  // for mmap, munmap
+#include <sys/stat.h>  // for fstat
+#include <unistd.h>    // for write, fsync, close
+
+#ifdef NBODY_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Bytes rounded up to the next 64-byte boundary
+static size_t padded(size_t bytes) {
+    return (bytes + 63) / 64 * 64;
+}
+
+// Bytes of one element of array 'index': the flags after the five float arrays are single bytes,
+// the ids after them 32-bit
+static size_t element_bytes(int index) {
+    return index < 5 ? sizeof(float) : index == 5 ? sizeof(uint8_t) : sizeof(uint32_t);
+}
+
+size_t snapshotArrayOffset(size_t n, int index) {
+    size_t offset = 0;
+    for (int a = 0; a < index; ++a) offset += padded(n * element_bytes(a));
+    return offset;
+}
+
+size_t snapshotPayloadBytes(size_t n, uint32_t version) {
+    // version 1 has the five float arrays, every later version adds one more
+    return snapshotArrayOffset(n, std::min<int>(SNAPSHOT_ARRAYS, 4 + static_cast<int>(version)));
+}
+
+// Arrays of a BodiesSOA in file order
+static const void* soa_array(const BodiesSOA& soa, int index) {
+    switch (index) {
+    case 0:  return soa.x.data();
+    case 1:  return soa.y.data();
+    case 2:  return soa.vx.data();
+    case 3:  return soa.vy.data();
+    case 4:  return soa.mass.data();
+    case 5:  return soa.pinned.data();
+    default: return soa.id.data();
+    }
+}
+
+// write() until everything is out or an error occurs
+static bool write_all(int fd, const void* data, size_t bytes) {
+    const char* p = static_cast<const char*>(data);
+    while (bytes > 0) {
+        ssize_t done = ::write(fd, p, bytes);
+        if (done < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += done;
+        bytes -= static_cast<size_t>(done);
+    }
+    return true;
+}
+
+// Raw padded arrays after the header
+static bool write_plain(int fd, const BodiesSOA& soa) {
+    static const char zeros[64] = {};
+    for (int a = 0; a < SNAPSHOT_ARRAYS; ++a) {
+        const size_t bytes = soa.size * element_bytes(a);
+        if (!write_all(fd, soa_array(soa, a), bytes) || !write_all(fd, zeros, padded(bytes) - bytes)) return false;
+    }
+    return true;
+}
+
+#ifdef NBODY_HAVE_ZLIB
+// One deflate stream of the padded arrays; returns the compressed size, 0 on failure
+static uint64_t write_compressed(int fd, const BodiesSOA& soa) {
+    static const unsigned char zeros[64] = {};
+    std::vector<unsigned char> out(1 << 20);
+    z_stream z{};
+    // fastest level: checkpoints are about not blocking, float data compresses modestly anyway
+    if (deflateInit(&z, Z_BEST_SPEED) != Z_OK) return 0;
+
+    uint64_t total = 0;
+    bool ok = true;
+    auto pump = [&](const void* data, size_t bytes, int flush) {
+        z.next_in = const_cast<Bytef*>(static_cast<const Bytef*>(data));
+        z.avail_in = static_cast<uInt>(bytes);
+        do {
+            z.next_out = out.data();
+            z.avail_out = static_cast<uInt>(out.size());
+            if (deflate(&z, flush) == Z_STREAM_ERROR) { ok = false; return; }
+            size_t produced = out.size() - z.avail_out;
+            if (!write_all(fd, out.data(), produced)) { ok = false; return; }
+            total += produced;
+        } while (z.avail_out == 0);
+    };
+
+    for (int a = 0; a < SNAPSHOT_ARRAYS && ok; ++a) {
+        // feed in chunks so avail_in (32 bit) cannot overflow for very large N
+        const size_t bytes = soa.size * element_bytes(a);
+        const unsigned char* p = static_cast<const unsigned char*>(soa_array(soa, a));
+        for (size_t done = 0; done < bytes && ok; done += (1u << 30))
+            pump(p + done, std::min<size_t>(1u << 30, bytes - done), Z_NO_FLUSH);
+        if (ok) pump(zeros, padded(bytes) - bytes, a + 1 == SNAPSHOT_ARRAYS ? Z_FINISH : Z_NO_FLUSH);
+    }
+    deflateEnd(&z);
+    return ok ? total : 0;
+}
+#endif
+
+bool writeSnapshot(const std::string& path, const BodiesSOA& soa, const SnapshotInfo& info, bool compress) {
+#ifndef NBODY_HAVE_ZLIB
+    if (compress) {
+        std::cerr << "Snapshot compression needs zlib, writing " << path << " uncompressed\n";
+        compress = false;
+    }
+#endif
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.flags = compress ? SNAPSHOT_COMPRESSED : 0;
+    header.n = soa.size;
+    header.step = info.step;
+    header.time = info.time;
+    header.G = info.G;
+    header.eps = info.eps;
+    header.dt = info.dt;
+    header.width = info.width;
+    header.height = info.height;
+    header.payload_bytes = snapshotPayloadBytes(soa.size);
+
+    const std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "Cannot create " << tmp << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    bool ok = write_all(fd, &header, sizeof(header));
+    if (ok && compress) {
+#ifdef NBODY_HAVE_ZLIB
+        // the header goes in again once the compressed size is known
+        header.payload_bytes = write_compressed(fd, soa);
+        ok = header.payload_bytes > 0 &&
+             ::pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+#endif
+    }
+    else if (ok) {
+        ok = write_plain(fd, soa);
+    }
+
+    // on disk before the rename, so a crash leaves either the old file or the complete new one
+    ok = ok && ::fsync(fd) == 0;
+    ok = (::close(fd) == 0) && ok;
+    if (!ok || ::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to write snapshot " << path << ": " << std::strerror(errno) << "\n";
+        ::unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+MappedSnapshot::~MappedSnapshot() {
+    close();
+}
+
+void MappedSnapshot::close() {
+    if (m_map) ::munmap(m_map, m_map_bytes);
+    m_map = nullptr;
+    m_map_bytes = 0;
+    m_payload = nullptr;
+    m_inflated = AlignedFloats();
+    m_n = 0;
+    m_version = 0;
+    m_compressed = false;
+}
+
+bool MappedSnapshot::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Cannot open snapshot " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+        std::cerr << "Snapshot " << path << " is too short\n";
+        ::close(fd);
+        return false;
+    }
+    m_map_bytes = static_cast<size_t>(st.st_size);
+    void* map = ::mmap(nullptr, m_map_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        std::cerr << "Cannot map snapshot " << path << ": " << std::strerror(errno) << "\n";
+        m_map_bytes = 0;
+        return false;
+    }
+    m_map = map;
+
+    SnapshotHeader header;
+    std::memcpy(&header, m_map, sizeof(header));
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 || header.version == 0 ||
+        header.version > SNAPSHOT_VERSION) {
+        std::cerr << path << " is not a snapshot this build can read\n";
+        close();
+        return false;
+    }
+    if (header.payload_bytes > m_map_bytes - sizeof(header) ||
+        (!(header.flags & SNAPSHOT_COMPRESSED) && header.payload_bytes < snapshotPayloadBytes(header.n, header.version))) {
+        std::cerr << "Snapshot " << path << " is truncated\n";
+        close();
+        return false;
+    }
+
+    m_n = header.n;
+    m_version = header.version;
+    m_info.step = header.step;
+    m_info.time = header.time;
+    m_info.G = header.G;
+    m_info.eps = header.eps;
+    m_info.dt = header.dt;
+    m_info.width = header.width;
+    m_info.height = header.height;
+    m_payload = static_cast<const unsigned char*>(m_map) + sizeof(header);
+    m_compressed = (header.flags & SNAPSHOT_COMPRESSED) != 0;
+    if (!m_compressed) return true;
+
+#ifdef NBODY_HAVE_ZLIB
+    // compressed: inflate once, the mapping is not needed afterwards. zlib counts in 32 bits,
+    // so input and output are handed over in chunks of at most 1 GB
+    const size_t expected = snapshotPayloadBytes(m_n, m_version);
+    m_inflated.resize(expected / sizeof(float));
+    uint64_t in_left = header.payload_bytes;
+    size_t out_left = expected;
+    z_stream z{};
+    z.next_in = const_cast<Bytef*>(m_payload);
+    z.next_out = reinterpret_cast<Bytef*>(m_inflated.data());
+    bool ok = inflateInit(&z) == Z_OK;
+    int status = Z_OK;
+    while (ok && status != Z_STREAM_END) {
+        if (z.avail_in == 0) {
+            z.avail_in = static_cast<uInt>(std::min<uint64_t>(in_left, 1u << 30));
+            in_left -= z.avail_in;
+        }
+        if (z.avail_out == 0) {
+            z.avail_out = static_cast<uInt>(std::min<size_t>(out_left, 1u << 30));
+            out_left -= z.avail_out;
+        }
+        // Z_BUF_ERROR: no progress possible, the stream is truncated or longer than expected
+        status = inflate(&z, Z_NO_FLUSH);
+        ok = status == Z_OK || status == Z_STREAM_END;
+    }
+    ok = ok && z.total_out == expected;
+    inflateEnd(&z);
+    ::munmap(m_map, m_map_bytes);
+    m_map = nullptr;
+    m_map_bytes = 0;
+    m_payload = nullptr;
+    if (!ok) {
+        std::cerr << "Snapshot " << path << " is corrupt\n";
+        close();
+        return false;
+    }
+    return true;
+#else
+    std::cerr << "Snapshot " << path << " is compressed, which needs a build with zlib\n";
+    close();
+    return false;
+#endif
+}
+
+const unsigned char* MappedSnapshot::bytes(int index) const {
+    const unsigned char* base = m_compressed ? reinterpret_cast<const unsigned char*>(m_inflated.data()) : m_payload;
+    return base ? base + snapshotArrayOffset(m_n, index) : nullptr;
+}
+
+// Step number of a file named snapshot_<step>.nbs, false for other names
+static bool snapshot_step(const fs::path& file, uint64_t& step) {
+    const std::string name = file.filename().string();
+    const std::string prefix = "snapshot_", suffix = ".nbs";
+    if (name.size() <= prefix.size() + suffix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+        return false;
+    const std::string digits = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+    if (digits.find_first_not_of("0123456789") != std::string::npos) return false;
+    step = std::stoull(digits);
+    return true;
+}
+
+// Snapshot files of a directory, oldest first
+static std::vector<std::pair<uint64_t, fs::path>> list_snapshots(const std::string& directory) {
+    std::vector<std::pair<uint64_t, fs::path>> files;
+    std::error_code ec;
+    for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+        uint64_t step;
+        if (it->is_regular_file(ec) && snapshot_step(it->path(), step)) files.emplace_back(step, it->path());
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+std::string findLatestSnapshot(const std::string& directory) {
+    auto files = list_snapshots(directory);
+    return files.empty() ? std::string() : files.back().second.string();
+}
+
+bool loadSnapshot(const std::string& path, std::vector<Body>& bodies, SnapshotInfo& info) {
+    std::string file = path;
+    std::error_code ec;
+    if (fs::is_directory(path, ec)) {
+        file = findLatestSnapshot(path);
+        if (file.empty()) {
+            std::cerr << "No snapshot found in " << path << "\n";
+            return false;
+        }
+    }
+
+    MappedSnapshot snapshot;
+    if (!snapshot.open(file)) return false;
+
+    bodies.resize(snapshot.size());
+    for (size_t i = 0; i < snapshot.size(); ++i) {
+        bodies[i].x = snapshot.x()[i];
+        bodies[i].y = snapshot.y()[i];
+        bodies[i].velocity_x = snapshot.vx()[i];
+        bodies[i].velocity_y = snapshot.vy()[i];
+        bodies[i].acceleration_x = 0.f;
+        bodies[i].acceleration_y = 0.f;
+        bodies[i].mass = snapshot.mass()[i];
+        bodies[i].pinned = snapshot.pinned() ? snapshot.pinned()[i] != 0 : bodies[i].mass >= 1000.f;
+        bodies[i].id = snapshot.ids() ? snapshot.ids()[i] : static_cast<uint32_t>(i);
+    }
+    info = snapshot.info();
+    std::cout << "Loaded " << snapshot.size() << " bodies at step " << info.step << " from " << file << "\n";
+    return true;
+}
+
+SnapshotWriter::SnapshotWriter(const std::string& directory, bool compress, int keep)
+    : m_directory(directory), m_compress(compress), m_keep(std::max(1, keep))
+{
+    std::error_code ec;
+    fs::create_directories(directory, ec);
+    if (ec) std::cerr << "Cannot create snapshot directory " << directory << ": " << ec.message() << "\n";
+    m_thread = std::thread(&SnapshotWriter::writer_loop, this);
+}
+
+// Writes whatever is still queued, then joins
+SnapshotWriter::~SnapshotWriter() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+// The thread only ever touches the pending slot or the one it is writing, so the slot picked here
+// can be filled without holding the lock
+template <typename Fill>
+void SnapshotWriter::submit_with(Fill fill) {
+    int target;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_pending >= 0) {
+            target = m_pending;
+            m_pending = -1;
+            ++m_replaced;
+        }
+        else {
+            target = m_writing == 0 ? 1 : 0;
+        }
+    }
+
+    fill(m_slots[target]);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending = target;
+    }
+    m_wake.notify_one();
+}
+
+void SnapshotWriter::submit(const std::vector<Body>& bodies, const SnapshotInfo& info) {
+    submit_with([&](Slot& slot) {
+        packBodies(bodies, slot.soa);
+        slot.info = info;
+    });
+}
+
+void SnapshotWriter::submit(const BodiesSOA& soa, const SnapshotInfo& info) {
+    submit_with([&](Slot& slot) {
+        slot.soa.resize(soa.size);
+        std::copy(soa.x.begin(), soa.x.begin() + soa.size, slot.soa.x.begin());
+        std::copy(soa.y.begin(), soa.y.begin() + soa.size, slot.soa.y.begin());
+        std::copy(soa.vx.begin(), soa.vx.begin() + soa.size, slot.soa.vx.begin());
+        std::copy(soa.vy.begin(), soa.vy.begin() + soa.size, slot.soa.vy.begin());
+        std::copy(soa.mass.begin(), soa.mass.begin() + soa.size, slot.soa.mass.begin());
+        std::copy(soa.pinned.begin(), soa.pinned.begin() + soa.size, slot.soa.pinned.begin());
+        std::copy(soa.id.begin(), soa.id.begin() + soa.size, slot.soa.id.begin());
+        slot.info = info;
+    });
+}
+
+void SnapshotWriter::flush() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [&] { return m_pending < 0 && m_writing < 0; });
+}
+
+uint64_t SnapshotWriter::written() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_written;
+}
+
+uint64_t SnapshotWriter::replaced() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_replaced;
+}
+
+void SnapshotWriter::writer_loop() {
+    for (;;) {
+        int slot;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stop || m_pending >= 0; });
+            if (m_pending < 0) return;   // stopping and nothing left to write
+            slot = m_pending;
+            m_pending = -1;
+            m_writing = slot;
+        }
+
+        std::ostringstream name;
+        name << "snapshot_" << std::setw(12) << std::setfill('0') << m_slots[slot].info.step << ".nbs";
+        bool ok = writeSnapshot((fs::path(m_directory) / name.str()).string(), m_slots[slot].soa,
+                                m_slots[slot].info, m_compress);
+        if (ok) remove_old();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_writing = -1;
+            if (ok) ++m_written;
+        }
+        m_idle.notify_all();
+    }
+}
+
+// Keep the newest m_keep snapshots; the older ones are no longer needed for a restart
+void SnapshotWriter::remove_old() {
+    auto files = list_snapshots(m_directory);
+    std::error_code ec;
+    for (size_t i = 0; i + m_keep < files.size(); ++i) fs::remove(files[i].second, ec);
+}
+
+BatchStepFunction with_checkpoints(BatchStepFunction compute, SnapshotWriter& writer, SnapshotInfo info, uint64_t every,
+                                   SyncFunction sync) {
+    auto state = std::make_shared<SnapshotInfo>(info);
+    every = std::max<uint64_t>(1, every);
+
+    return [compute, &writer, state, every, sync](std::vector<Body>& bodies, float G, float eps, float dt,
+                                                  int width, int height, int steps) {
+        // batches are cut at checkpoint boundaries, so snapshots land on exact multiples of 'every'
+        while (steps > 0) {
+            int chunk = static_cast<int>(std::min<uint64_t>(steps, every - state->step % every));
+            compute(bodies, G, eps, dt, width, height, chunk);
+            steps -= chunk;
+            state->step += chunk;
+            state->time += static_cast<double>(chunk) * dt;
+
+            if (state->step % every == 0) {
+                state->G = G;
+                state->eps = eps;
+                state->dt = dt;
+                state->width = width;
+                state->height = height;
+                if (sync && !sync(bodies)) {
+                    std::cerr << "Checkpoint at step " << state->step << " skipped, the engine state could not be read\n";
+                    continue;
+                }
+                writer.submit(bodies, *state);
+            }
+        }
+    };
+}
@@ -0,0 +1,127 @@
+// File: ThreadPool.cpp
+// Implements the persistent work-stealing thread pool
+
+#include <algorithm>  // for std::min, std::max
+
+#include "ThreadPool.h"
+
+// Start threads - 1 workers; the caller of run() acts as worker 0
+ThreadPool::ThreadPool(size_t threads)
+{
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    m_workers = threads;
+
+    for (size_t w = 0; w < m_workers; ++w) {
+        m_queues.push_back(std::make_unique<WorkQueue>());
+    }
+    for (size_t w = 1; w < m_workers; ++w) {
+        m_threads.emplace_back(&ThreadPool::worker_loop, this, w);
+    }
+}
+
+// Wake every worker with the stop flag set and join them
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& t : m_threads) t.join();
+}
+
+// Distribute tasks in contiguous blocks (keeps neighbouring tiles on one worker) and wait for completion
+void ThreadPool::run_tasks(size_t n_tasks, TaskFunction function, void* ctx)
+{
+    if (n_tasks == 0) return;
+
+    if (m_workers == 1) {
+        for (size_t t = 0; t < n_tasks; ++t) function(ctx, t, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_function = function;
+        m_context = ctx;
+        m_remaining = n_tasks;
+
+        size_t per_worker = (n_tasks + m_workers - 1) / m_workers;
+        for (size_t w = 0; w < m_workers; ++w) {
+            std::lock_guard<std::mutex> queue_lock(m_queues[w]->mutex);
+            size_t begin = std::min(n_tasks, w * per_worker);
+            size_t end = std::min(n_tasks, begin + per_worker);
+            for (size_t t = begin; t < end; ++t) m_queues[w]->tasks.push_back(t);
+        }
+        ++m_generation;
+    }
+    m_wake.notify_all();
+
+    drain(0);
+
+    // wait until every task ran and no worker still holds a reference to the callable
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_remaining == 0 && m_busy == 0; });
+    m_function = nullptr;
+    m_context = nullptr;
+}
+
+// Sleep until a new batch is published, help drain it, repeat until stopped
+void ThreadPool::worker_loop(size_t worker)
+{
+    size_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stop || m_generation != seen; });
+            if (m_stop) return;
+            seen = m_generation;
+            ++m_busy;
+        }
+
+        drain(worker);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_busy;
+        }
+        m_done.notify_all();
+    }
+}
+
+// Execute tasks from the own queue, then from the other queues, until none are left
+void ThreadPool::drain(size_t worker)
+{
+    size_t t;
+    while (pop_local(worker, t) || steal(worker, t)) {
+        m_function(m_context, t, worker);
+        if (--m_remaining == 0) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_done.notify_all();
+        }
+    }
+}
+
+bool ThreadPool::pop_local(size_t worker, size_t& task)
+{
+    WorkQueue& q = *m_queues[worker];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tasks.empty()) return false;
+    task = q.tasks.front();
+    q.tasks.pop_front();
+    return true;
+}
+
+// Take the last task of the first non-empty victim queue
+bool ThreadPool::steal(size_t worker, size_t& task)
+{
+    for (size_t k = 1; k < m_workers; ++k) {
+        WorkQueue& q = *m_queues[(worker + k) % m_workers];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tasks.empty()) continue;
+        task = q.tasks.back();
+        q.tasks.pop_back();
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,130 @@
+// File: TracerComputation.cpp
+// Implements the tracer engine on top of the SIMD source-list kernels
+//  - the source list is built once per call; moving sources keep the index of their body and only
+//    their positions are copied from the SoA at the start of every step
+//  - forces and integration are fused per chunk: targets read positions from the source list, not
+//    from the SoA, so a chunk can move its bodies while other chunks are still summing
+//  - every target (sources included) is summed over the list, the self term is masked by id
+
+#include <algorithm>  // for std::fill, std::max
+#include <memory>     // for std::unique_ptr
+
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include "TracerComputation.h"
+
+// Tracer runtime state
+static std::unique_ptr<ThreadPool> s_pool;
+static TracerOptions               s_options;
+static TracerStats                 s_stats;
+static BodiesSOA                   s_soa(0);
+static ForceSources                s_sources;
+static size_t                      s_moving = 0;   // leading sources re-read from the SoA every step
+
+void buildForceSources(const std::vector<Body>& bodies, const TracerOptions& options, float eps,
+                       ForceSources& sources, size_t& moving)
+{
+    const float eps2 = eps * eps;
+    const float pinned_softening = options.pinned_softening > 0.f ? options.pinned_softening : eps;
+    sources.clear();
+
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        const Body& b = bodies[i];
+        if (b.mass > options.tracer_mass && !(b.pinned && options.analytic_pinned))
+            sources.add(b.x, b.y, b.mass, eps2, static_cast<int32_t>(i));
+    }
+    moving = sources.size();
+
+    if (options.analytic_pinned) {
+        for (size_t i = 0; i < bodies.size(); ++i) {
+            const Body& b = bodies[i];
+            if (b.pinned && b.mass > options.tracer_mass)
+                sources.add(b.x, b.y, b.mass, pinned_softening * pinned_softening, static_cast<int32_t>(i));
+        }
+    }
+    for (const FixedPotential& p : options.potentials) {
+        const float softening = p.softening > 0.f ? p.softening : eps;
+        sources.add(p.x, p.y, p.mass, softening * softening, -1);
+    }
+}
+
+bool initTracerComputation(size_t n_bodies, const TracerOptions& options) {
+    if (!simdKernelSupported(options.kernel)) return false;
+
+    s_options = options;
+    s_pool = std::make_unique<ThreadPool>(options.threads);
+    s_options.threads = s_pool->size();
+    s_stats = TracerStats();
+    s_soa.resize(n_bodies);
+    s_sources.clear();
+    s_moving = 0;
+    return true;
+}
+
+bool initTracerComputation(size_t n_bodies) {
+    return initTracerComputation(n_bodies, TracerOptions());
+}
+
+void runTracerSubsteps(std::vector<Body>& bodies,
+                       const float G,
+                       const float eps,
+                       const float dt,
+                       const int width,
+                       const int height,
+                       const int steps)
+{
+    {
+        NBODY_PROFILE_SCOPE("pack");
+        packBodies(bodies, s_soa);
+        buildForceSources(bodies, s_options, eps, s_sources, s_moving);
+    }
+    s_stats.sources = s_moving;
+    s_stats.potentials = s_sources.size() - s_moving;
+    s_stats.tracers = 0;
+    for (const Body& b : bodies) s_stats.tracers += b.mass <= s_options.tracer_mass;
+
+    const size_t n = s_soa.size;
+    // multiples of 32 rows keep the AVX-512 kernel off its scalar tail
+    const size_t grain = std::max<size_t>(256, (n / (4 * s_pool->size()) + 31) / 32 * 32);
+
+    for (int step = 0; step < steps; ++step) {
+        for (size_t k = 0; k < s_moving; ++k) {
+            const size_t i = static_cast<size_t>(s_sources.id[k]);
+            s_sources.x[k] = s_soa.x[i];
+            s_sources.y[k] = s_soa.y[i];
+        }
+
+        NBODY_PROFILE_SCOPE("forces + integrate");
+        s_pool->parallel_for(n, grain, [&](size_t begin, size_t end, size_t) {
+            std::fill(s_soa.ax.begin() + begin, s_soa.ax.begin() + end, 0.f);
+            std::fill(s_soa.ay.begin() + begin, s_soa.ay.begin() + end, 0.f);
+            simd_accumulate_source_forces(s_soa, begin, end, s_sources, G, s_options.kernel);
+            simd_integrate_range(s_soa, begin, end, dt, width, height);
+        });
+    }
+    s_stats.steps += steps;
+
+    NBODY_PROFILE_SCOPE("unpack");
+    unpackBodies(s_soa, bodies);
+}
+
+void runTracerComputation(std::vector<Body>& bodies,
+                          const float G,
+                          const float eps,
+                          const float dt,
+                          const int width,
+                          const int height)
+{
+    runTracerSubsteps(bodies, G, eps, dt, width, height, 1);
+}
+
+const TracerStats& tracerStats() {
+    return s_stats;
+}
+
+void cleanupTracerComputation() {
+    s_pool.reset();
+    s_soa = BodiesSOA(0);
+    s_sources = ForceSources();
+    s_moving = 0;
+}
@@ -0,0 +1,365 @@
+// File: Transport.cpp
+// Implements the ring transports
+//  - overlap: startShift hands the blocking exchange to a helper thread that lives as long as the
+//    transport, finishShift waits until it is done; no thread is created per shift
+//  - shm: one segment holds a mailbox per rank with two slots; generation g goes to slot g % 2, so
+//    a rank can post g while its successor still copies g - 1. 'posted' and 'consumed' counters
+//    (written by the owner and by its successor) are the only synchronization
+//  - tcp: a connection to the next rank and one from the previous rank; the exchange polls both
+//    non-blocking sockets, so ranks that all send at once cannot deadlock on full socket buffers
+
+#include <algorithm>  // for std::max
+#include <atomic>     // for std::atomic
+#include <chrono>     // for std::chrono::steady_clock
+#include <cstdlib>    // for std::abort
+#include <cstring>    // for std::memcpy, std::strerror
+#include <iostream>   // for std::cerr
+
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Transport.h"
+
+const char* transportName(TransportKind kind) {
+    return kind == TransportKind::Tcp ? "tcp" : "shm";
+}
+
+bool parseTransport(const std::string& name, TransportKind& kind) {
+    for (TransportKind k : { TransportKind::Shm, TransportKind::Tcp }) {
+        if (name == transportName(k)) {
+            kind = k;
+            return true;
+        }
+    }
+    return false;
+}
+
+Transport::~Transport() {
+    if (!m_helper.joinable()) return;
+    finishShift();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    m_helper.join();
+}
+
+void Transport::startShift(const void* send, size_t send_bytes, void* recv, size_t recv_bytes) {
+    if (m_size == 1) {
+        std::memcpy(recv, send, recv_bytes);
+        return;
+    }
+    if (!m_helper.joinable()) m_helper = std::thread(&Transport::run_shifts, this);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_send = send;
+        m_send_bytes = send_bytes;
+        m_recv = recv;
+        m_recv_bytes = recv_bytes;
+        m_busy = true;
+    }
+    m_wake.notify_one();
+}
+
+void Transport::finishShift() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return !m_busy; });
+}
+
+void Transport::run_shifts() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_wake.wait(lock, [this] { return m_busy || m_stop; });
+        if (m_stop) return;
+        const void* send = m_send;
+        void* recv = m_recv;
+        const size_t send_bytes = m_send_bytes, recv_bytes = m_recv_bytes;
+        lock.unlock();
+        exchange(send, send_bytes, recv, recv_bytes);
+        lock.lock();
+        m_busy = false;
+        m_done.notify_one();
+    }
+}
+
+void Transport::shift(const void* send, size_t send_bytes, void* recv, size_t recv_bytes) {
+    if (m_size == 1) std::memcpy(recv, send, recv_bytes);
+    else exchange(send, send_bytes, recv, recv_bytes);
+}
+
+void Transport::allGather(const void* mine, size_t bytes, void* all) {
+    char* out = static_cast<char*>(all);
+    std::memcpy(out + bytes * m_rank, mine, bytes);
+    // after p shifts a rank holds the block of rank - p; pass on the one received last
+    for (int p = 1; p < m_size; ++p) {
+        const int sent = (m_rank - p + 1 + m_size) % m_size;
+        const int received = (m_rank - p + m_size) % m_size;
+        shift(out + bytes * sent, bytes, out + bytes * received, bytes);
+    }
+}
+
+void Transport::barrier() {
+    char token = 0;
+    std::vector<char> tokens(m_size);
+    allGather(&token, 1, tokens.data());
+}
+
+// ---------------------------------------------------------------------------------------------
+// Shared memory
+
+namespace {
+
+struct ShmHeader {
+    std::atomic<uint32_t> attached;
+    std::atomic<uint32_t> detached;
+    uint32_t size;
+    uint64_t slot_bytes;
+};
+
+struct alignas(64) Mailbox {
+    std::atomic<uint64_t> posted;               // last generation written by the owner
+    alignas(64) std::atomic<uint64_t> consumed; // last generation copied out by the next rank
+};
+
+// Spin briefly, then give the core away: ranks may share cores with each other
+void backoff(int& spins) {
+    if (++spins > 64) std::this_thread::yield();
+}
+
+class ShmTransport : public Transport {
+public:
+    ShmTransport(int rank, int size, std::string name, void* base, size_t bytes, size_t slot_bytes)
+        : Transport(rank, size), m_name(std::move(name)), m_base(static_cast<char*>(base)), m_bytes(bytes),
+          m_slot_bytes(slot_bytes) {}
+
+    ~ShmTransport() override {
+        ShmHeader* header = reinterpret_cast<ShmHeader*>(m_base);
+        const bool last = header->detached.fetch_add(1) + 1 == static_cast<uint32_t>(size());
+        munmap(m_base, m_bytes);
+        if (last) shm_unlink(m_name.c_str());
+    }
+
+    static size_t mailbox_offset(int r) { return 64 + sizeof(Mailbox) * r; }
+    static size_t slot_offset(int size, size_t slot_bytes, int r, int slot) {
+        return mailbox_offset(size) + slot_bytes * (2 * r + slot);
+    }
+
+protected:
+    void exchange(const void* send, size_t send_bytes, void* recv, size_t recv_bytes) override {
+        if (send_bytes > m_slot_bytes || recv_bytes > m_slot_bytes) {
+            std::cerr << "Shared memory shift of " << std::max(send_bytes, recv_bytes)
+                      << " bytes exceeds the " << m_slot_bytes << " byte slots\n";
+            std::abort();
+        }
+        const uint64_t g = ++m_generation;
+        const int prev = (rank() - 1 + size()) % size();
+        Mailbox& mine = mailbox(rank());
+        Mailbox& from = mailbox(prev);
+
+        // slot g % 2 is free once the next rank has copied generation g - 2 out of it
+        int spins = 0;
+        while (mine.consumed.load(std::memory_order_acquire) + 2 < g) backoff(spins);
+        std::memcpy(slot(rank(), g % 2), send, send_bytes);
+        mine.posted.store(g, std::memory_order_release);
+
+        spins = 0;
+        while (from.posted.load(std::memory_order_acquire) < g) backoff(spins);
+        std::memcpy(recv, slot(prev, g % 2), recv_bytes);
+        from.consumed.store(g, std::memory_order_release);
+    }
+
+private:
+    Mailbox& mailbox(int r) { return *reinterpret_cast<Mailbox*>(m_base + mailbox_offset(r)); }
+    char* slot(int r, int s) { return m_base + slot_offset(size(), m_slot_bytes, r, s); }
+
+    std::string m_name;
+    char* m_base;
+    size_t m_bytes;
+    size_t m_slot_bytes;
+    uint64_t m_generation = 0;
+};
+
+}  // namespace
+
+std::unique_ptr<Transport> makeShmTransport(const std::string& name, int rank, int size, size_t max_bytes) {
+    const size_t slot_bytes = (std::max<size_t>(max_bytes, 1) + 63) / 64 * 64;
+    const size_t bytes = ShmTransport::slot_offset(size, slot_bytes, size, 0);
+
+    // every rank creates or opens the same segment; a fresh one reads as zero, which is the start
+    // state of every counter
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+    if (fd < 0) {
+        std::cerr << "shm_open " << name << ": " << std::strerror(errno) << "\n";
+        return nullptr;
+    }
+    if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+        std::cerr << "ftruncate " << name << ": " << std::strerror(errno) << "\n";
+        close(fd);
+        return nullptr;
+    }
+    void* base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << "mmap " << name << ": " << std::strerror(errno) << "\n";
+        return nullptr;
+    }
+
+    ShmHeader* header = static_cast<ShmHeader*>(base);
+    if (header->attached.fetch_add(1) == 0) {
+        header->size = static_cast<uint32_t>(size);
+        header->slot_bytes = slot_bytes;
+    }
+    return std::make_unique<ShmTransport>(rank, size, name, base, bytes, slot_bytes);
+}
+
+// ---------------------------------------------------------------------------------------------
+// TCP
+
+namespace {
+
+class TcpTransport : public Transport {
+public:
+    TcpTransport(int rank, int size, int to_next, int from_prev)
+        : Transport(rank, size), m_next(to_next), m_prev(from_prev) {}
+
+    ~TcpTransport() override {
+        if (m_next >= 0) close(m_next);
+        if (m_prev >= 0) close(m_prev);
+    }
+
+protected:
+    void exchange(const void* send, size_t send_bytes, void* recv, size_t recv_bytes) override {
+        const char* out = static_cast<const char*>(send);
+        char* in = static_cast<char*>(recv);
+        size_t sent = 0, received = 0;
+
+        while (sent < send_bytes || received < recv_bytes) {
+            pollfd fds[2];
+            nfds_t count = 0;
+            if (sent < send_bytes) fds[count++] = { m_next, POLLOUT, 0 };
+            if (received < recv_bytes) fds[count++] = { m_prev, POLLIN, 0 };
+            if (poll(fds, count, -1) < 0) {
+                if (errno == EINTR) continue;
+                fail("poll");
+            }
+            for (nfds_t k = 0; k < count; ++k) {
+                if (!fds[k].revents) continue;
+                if (fds[k].fd == m_next) {
+                    ssize_t r = ::send(m_next, out + sent, send_bytes - sent, MSG_NOSIGNAL);
+                    if (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) fail("send");
+                    if (r > 0) sent += static_cast<size_t>(r);
+                }
+                else {
+                    ssize_t r = ::recv(m_prev, in + received, recv_bytes - received, 0);
+                    if (r == 0) fail("recv (connection closed)");
+                    if (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) fail("recv");
+                    if (r > 0) received += static_cast<size_t>(r);
+                }
+            }
+        }
+    }
+
+private:
+    // A broken ring cannot be recovered from: every rank would wait forever
+    [[noreturn]] void fail(const char* what) {
+        std::cerr << "Rank " << rank() << ": " << what << ": " << std::strerror(errno) << "\n";
+        std::abort();
+    }
+
+    int m_next;
+    int m_prev;
+};
+
+bool split_host(const std::string& entry, std::string& host, std::string& port) {
+    size_t colon = entry.rfind(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == entry.size()) return false;
+    host = entry.substr(0, colon);
+    port = entry.substr(colon + 1);
+    return true;
+}
+
+void tune_socket(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+}  // namespace
+
+std::unique_ptr<Transport> makeTcpTransport(const std::vector<std::string>& hosts, int rank, double timeout_seconds) {
+    const int size = static_cast<int>(hosts.size());
+    if (rank < 0 || rank >= size) {
+        std::cerr << "Rank " << rank << " has no entry in a host list of " << size << "\n";
+        return nullptr;
+    }
+    if (size == 1) return std::make_unique<TcpTransport>(rank, size, -1, -1);
+
+    std::string host, port, next_host, next_port;
+    if (!split_host(hosts[rank], host, port) || !split_host(hosts[(rank + 1) % size], next_host, next_port)) {
+        std::cerr << "Host entries must be host:port\n";
+        return nullptr;
+    }
+
+    // listen on our own port for the previous rank
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(static_cast<uint16_t>(std::stoi(port)));
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 1) != 0) {
+        std::cerr << "Rank " << rank << ": cannot listen on port " << port << ": " << std::strerror(errno) << "\n";
+        close(listener);
+        return nullptr;
+    }
+
+    // connect to the next rank, retrying while it is still starting up
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeout_seconds);
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* found = nullptr;
+    if (getaddrinfo(next_host.c_str(), next_port.c_str(), &hints, &found) != 0 || !found) {
+        std::cerr << "Rank " << rank << ": cannot resolve " << hosts[(rank + 1) % size] << "\n";
+        close(listener);
+        return nullptr;
+    }
+    int to_next = -1;
+    while (to_next < 0 && std::chrono::steady_clock::now() < deadline) {
+        int fd = socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+        if (connect(fd, found->ai_addr, found->ai_addrlen) == 0) to_next = fd;
+        else {
+            close(fd);
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    }
+    freeaddrinfo(found);
+
+    int from_prev = -1;
+    if (to_next >= 0) {
+        pollfd pending = { listener, POLLIN, 0 };
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (poll(&pending, 1, static_cast<int>(std::max<long long>(0, left.count()))) == 1)
+            from_prev = accept(listener, nullptr, nullptr);
+    }
+    close(listener);
+
+    if (to_next < 0 || from_prev < 0) {
+        std::cerr << "Rank " << rank << ": ring not connected within " << timeout_seconds << " s\n";
+        if (to_next >= 0) close(to_next);
+        if (from_prev >= 0) close(from_prev);
+        return nullptr;
+    }
+    tune_socket(to_next);
+    tune_socket(from_prev);
+    return std::make_unique<TcpTransport>(rank, size, to_next, from_prev);
+}